@@ -47,19 +47,115 @@ namespace Cubc {
         float x, y, w, h;
     };
 
-    class Canvas {
+    struct Corners {
+        float top_left, top_right, bottom_right, bottom_left;
+
+        Cubc_Corners CRepr() const {
+            return {top_left, top_right, bottom_right, bottom_left};
+        }
+    };
+
+    struct Insets {
+        uint32_t left, top, right, bottom;
+
+        Cubc_Insets CRepr() const { return {left, top, right, bottom}; }
+    };
+
+    // Owns a Cubc_Path; see the C API for how subpaths are built.
+    class Path {
+    public:
+        Path() = default;
+        Path(const Path&)            = delete;
+        Path& operator=(const Path&) = delete;
+        ~Path() { Cubc_PathFree(&path); }
+
+        void MoveTo(float x, float y) { Cubc_PathMoveTo(&path, x, y); }
+        void MoveTo(V2f p) { MoveTo(p.x, p.y); }
+        void LineTo(float x, float y) { Cubc_PathLineTo(&path, x, y); }
+        void LineTo(V2f p) { LineTo(p.x, p.y); }
+        void QuadTo(V2f c, V2f p) {
+            Cubc_PathQuadTo(&path, c.x, c.y, p.x, p.y);
+        }
+        void CubicTo(V2f c0, V2f c1, V2f p) {
+            Cubc_PathCubicTo(&path, c0.x, c0.y, c1.x, c1.y, p.x, p.y);
+        }
+        void Close() { Cubc_PathClose(&path); }
+
+        const Cubc_Path* CRepr() const { return &path; }
+
+    private:
+        Cubc_Path path = {};
+    };
+
+    // How a pixel of each Cubc_PixelFormat is stored.
+    template <Cubc_PixelFormat Format> struct PixelTraits {
+        using Type = uint32_t;
+    };
+    template <> struct PixelTraits<CUBC_FORMAT_RGB565> {
+        using Type = uint16_t;
+    };
+    template <> struct PixelTraits<CUBC_FORMAT_A8> {
+        using Type = uint8_t;
+    };
+    template <> struct PixelTraits<CUBC_FORMAT_RGBA16F> {
+        using Type = uint64_t;
+    };
+
+    // A canvas that stores its pixels in `Format`. Canvases of any two
+    // formats can be blitted, blended and composited onto each other.
+    template <Cubc_PixelFormat Format = CUBC_FORMAT_RGBA8888>
+    class BasicCanvas {
     public:
-        Canvas(size_t w = 1280, size_t h = 720, Color c = Black);
-        Canvas(const char* file_name);
-        ~Canvas();
+        BasicCanvas(size_t w = 1280, size_t h = 720, Color c = Black);
+        BasicCanvas(const char* file_name);
+        ~BasicCanvas();
+
+        template <Cubc_PixelFormat SrcFormat>
+        void BlitCanvas(const BasicCanvas<SrcFormat>& src, uint32_t x = 0,
+                        uint32_t y = 0, float scale_x = 1.0,
+                        float scale_y = 1.0) {
+            BlitRepr(src.CRepr(), x, y, scale_x, scale_y);
+        }
 
-        void BlitCanvas(const Canvas& src, uint32_t x = 0, uint32_t y = 0,
-                        float scale_x = 1.0, float scale_y = 1.0);
+        template <Cubc_PixelFormat SrcFormat>
+        void BlitCanvas(const BasicCanvas<SrcFormat>& src, V2u pos = {0, 0},
+                        V2f scale = {1, 1}) {
+            BlitCanvas(src, pos.x, pos.y, scale.x, scale.y);
+        }
 
-        void BlitCanvas(const Canvas& src, V2u pos = {0, 0},
-                        V2f scale = {1, 1});
+        template <Cubc_PixelFormat SrcFormat>
+        void BlitCanvas(const BasicCanvas<SrcFormat>& src,
+                        Rect rect = {0, 0, 1, 1}) {
+            BlitCanvas(src, rect.x, rect.y, rect.w, rect.h);
+        }
+
+        template <Cubc_PixelFormat SrcFormat>
+        void BlitCanvasFiltered(const BasicCanvas<SrcFormat>& src, uint32_t x,
+                                uint32_t y, float scale_x, float scale_y,
+                                Cubc_Filter filter = CUBC_FILTER_BILINEAR) {
+            BlitFilteredRepr(src.CRepr(), x, y, scale_x, scale_y, filter);
+        }
 
-        void BlitCanvas(const Canvas& src, Rect rect = {0, 0, 1, 1});
+        template <Cubc_PixelFormat SrcFormat>
+        void BlitCanvasSliced(const BasicCanvas<SrcFormat>& src, uint32_t x,
+                              uint32_t y, uint32_t w, uint32_t h,
+                              Insets insets) {
+            BlitSlicedRepr(src.CRepr(), x, y, w, h, insets);
+        }
+
+        template <Cubc_PixelFormat SrcFormat>
+        void BlendCanvas(const BasicCanvas<SrcFormat>& src, uint32_t x,
+                         uint32_t y, Cubc_BlendMode mode) {
+            BlendRepr(src.CRepr(), x, y, mode);
+        }
+
+        template <Cubc_PixelFormat SrcFormat>
+        void Composite(const BasicCanvas<SrcFormat>& src, uint32_t x,
+                       uint32_t y, Cubc_CompositeOp op) {
+            CompositeRepr(src.CRepr(), x, y, op);
+        }
+        void CompositeRect(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                           Color color, Cubc_CompositeOp op);
 
         void Clear(Color c = Black);
 
@@ -69,6 +165,31 @@ namespace Cubc {
         void Line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
                   Color color);
         void Line(V2u begin, V2u end, Color color);
+        void Lines(const uint32_t* x0, const uint32_t* y0,
+                   const uint32_t* x1, const uint32_t* y1,
+                   const Color* colors, size_t count,
+                   size_t thread_count = 1);
+
+        void LineAA(float x0, float y0, float x1, float y1, Color color);
+        void LineAA(V2f begin, V2f end, Color color);
+
+        void QuadBezier(V2f begin, V2f control, V2f end, Color color);
+        void CubicBezier(V2f begin, V2f control0, V2f control1, V2f end,
+                         Color color);
+
+        void Polyline(const V2f* points, size_t count, bool closed,
+                      float width, Cubc_LineJoin join, Cubc_LineCap cap,
+                      Color color);
+        void ThickLine(float x0, float y0, float x1, float y1, float width,
+                       Cubc_LineCap cap, Color color);
+        void ThickLine(V2f begin, V2f end, float width, Cubc_LineCap cap,
+                       Color color);
+
+        void Polygon(const V2f* points, const size_t* counts,
+                     size_t contour_count, Cubc_FillRule rule, Color color);
+        void FillPath(const Path& path, Cubc_FillRule rule, Color color);
+        void StrokePath(const Path& path, float width, Cubc_LineJoin join,
+                        Cubc_LineCap cap, Color color);
 
         void WireframeTriangle(uint32_t x0, uint32_t y0, uint32_t x1,
                                uint32_t y1, uint32_t x2, uint32_t y2,
@@ -82,18 +203,72 @@ namespace Cubc {
         void Rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, Color color);
         void Rect(V2f pos, V2f size, Color color);
         void Rect(struct Rect rect, Color color);
+
+        void RoundedRect(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                         Corners radii, Color color);
+        void RoundedRect(struct Rect rect, Corners radii, Color color);
+        void RoundedRectAA(float x, float y, float w, float h, Corners radii,
+                           Color color);
+
+        void Ellipse(uint32_t x, uint32_t y, uint32_t rx, uint32_t ry,
+                     Color color);
+        void Circle(uint32_t x, uint32_t y, uint32_t r, Color color);
+        void WireframeEllipse(uint32_t x, uint32_t y, uint32_t rx,
+                              uint32_t ry, Color color);
+        void WireframeCircle(uint32_t x, uint32_t y, uint32_t r, Color color);
+        void Arc(uint32_t x, uint32_t y, uint32_t r, float start, float end,
+                 Color color);
+        void Pie(uint32_t x, uint32_t y, uint32_t r, float start, float end,
+                 Color color);
+
+        void EllipseAA(float x, float y, float rx, float ry, Color color);
+        void CircleAA(float x, float y, float r, Color color);
+        void ArcAA(float x, float y, float r, float width, float start,
+                   float end, Color color);
+        void PieAA(float x, float y, float r, float start, float end,
+                   Color color);
+
+        void Premultiply();
+        void Unpremultiply();
+
+        int WritePPM(const char* file_name) const;
+        int WritePAM(const char* file_name) const;
+
+        void BeginDeferred(Cubc_CommandList* list);
+        void EndDeferred(size_t thread_count = 1);
+
         Cubc_Canvas CRepr() const {
             return {
-                .pixels = pixels,
-                .w      = w,
-                .h      = h,
+                .data          = pixels,
+                .w             = w,
+                .h             = h,
+                .stride        = w,
+                .commands      = commands,
+                .premultiplied = premultiplied,
+                .format        = Format,
             };
         }
 
     private:
+        void BlitRepr(const Cubc_Canvas& src, uint32_t x, uint32_t y,
+                      float scale_x, float scale_y);
+        void BlitFilteredRepr(const Cubc_Canvas& src, uint32_t x, uint32_t y,
+                              float scale_x, float scale_y,
+                              Cubc_Filter filter);
+        void BlitSlicedRepr(const Cubc_Canvas& src, uint32_t x, uint32_t y,
+                            uint32_t w, uint32_t h, Insets insets);
+        void BlendRepr(const Cubc_Canvas& src, uint32_t x, uint32_t y,
+                       Cubc_BlendMode mode);
+        void CompositeRepr(const Cubc_Canvas& src, uint32_t x, uint32_t y,
+                           Cubc_CompositeOp op);
+
         size_t w, h;
-        uint32_t* pixels;
+        typename PixelTraits<Format>::Type* pixels;
+        Cubc_CommandList* commands = nullptr;
+        bool premultiplied         = false;
     };
+
+    using Canvas = BasicCanvas<>;
 } // namespace Cubc
 
 #ifdef CUBC_IMPLEMENTATION
@@ -116,89 +291,367 @@ namespace Cubc {
         return Cubc_ColorSoftLightBlend(CRepr(), other.CRepr());
     }
 
-    Canvas::Canvas(size_t w, size_t h, Color c) : w(w), h(h) {
-        pixels = new uint32_t[w * h];
-        for (int i = 0; i < w * h; i++) {
-            pixels[i] = c.color;
-        }
+    template <Cubc_PixelFormat Format>
+    BasicCanvas<Format>::BasicCanvas(size_t w, size_t h, Color c)
+        : w(w), h(h) {
+        pixels = (typename PixelTraits<Format>::Type*) malloc(
+            Cubc_PixelFormatSize(Format) * w * h);
+        Clear(c);
     }
-    Canvas::Canvas(const char* file_name) {
-        Cubc_Canvas canvas = Cubc_CanvasFromImage(file_name);
+    template <Cubc_PixelFormat Format>
+    BasicCanvas<Format>::BasicCanvas(const char* file_name) {
+        Cubc_Canvas canvas = Cubc_CanvasFromImageFormat(file_name, Format);
         w                  = canvas.w;
         h                  = canvas.h;
-        pixels             = canvas.pixels;
+        pixels = (typename PixelTraits<Format>::Type*) canvas.data;
     }
-    Canvas::~Canvas() { free(pixels); }
-    void Canvas::Clear(Color c) {
-        for (int i = 0; i < w * h; i++) {
-            pixels[i] = c.color;
-        }
+    template <Cubc_PixelFormat Format> BasicCanvas<Format>::~BasicCanvas() {
+        free(pixels);
+    }
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Clear(Color c) {
+        auto repr = CRepr();
+        Cubc_CanvasClear(&repr, c.CRepr());
     }
 
-    void Canvas::Pixel(uint32_t x, uint32_t y, Color c) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Pixel(uint32_t x, uint32_t y, Color c) {
         auto repr = CRepr();
         Cubc_CanvasPixel(&repr, x, y, c.CRepr());
     }
-    void Canvas::Pixel(V2u pos, Color c) { Pixel(pos.x, pos.y, c); }
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Pixel(V2u pos, Color c) {
+        Pixel(pos.x, pos.y, c);
+    }
 
-    void Canvas::BlitCanvas(const Canvas& src, uint32_t x, uint32_t y,
-                            float scale_x, float scale_y) {
-        auto repr_dest = CRepr();
-        auto repr_src  = src.CRepr();
-        Cubc_CanvasBlitCanvas(&repr_dest, &repr_src, x, y, scale_x, scale_x);
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::BlitRepr(const Cubc_Canvas& src, uint32_t x,
+                                       uint32_t y, float scale_x,
+                                       float scale_y) {
+        auto repr = CRepr();
+        Cubc_CanvasBlitCanvas(&repr, &src, x, y, scale_x, scale_y);
     }
 
-    void Canvas::BlitCanvas(const Canvas& src, V2u pos, V2f scale) {
-        BlitCanvas(src, pos.x, pos.y, scale.x, scale.y);
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::BlitFilteredRepr(const Cubc_Canvas& src,
+                                               uint32_t x, uint32_t y,
+                                               float scale_x, float scale_y,
+                                               Cubc_Filter filter) {
+        auto repr = CRepr();
+        Cubc_CanvasBlitCanvasFiltered(&repr, &src, x, y, scale_x, scale_y,
+                                      filter);
     }
 
-    void Canvas::BlitCanvas(const Canvas& src, struct Rect rect) {
-        BlitCanvas(src, rect.x, rect.y, rect.w, rect.h);
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::BlitSlicedRepr(const Cubc_Canvas& src,
+                                             uint32_t x, uint32_t y,
+                                             uint32_t w, uint32_t h,
+                                             Insets insets) {
+        auto repr = CRepr();
+        Cubc_CanvasBlitCanvasSliced(&repr, &src, x, y, w, h, insets.CRepr());
     }
 
-    void Canvas::Line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
-                      Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::BlendRepr(const Cubc_Canvas& src, uint32_t x,
+                                        uint32_t y, Cubc_BlendMode mode) {
+        auto repr = CRepr();
+        Cubc_CanvasBlendCanvas(&repr, &src, x, y, mode);
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::CompositeRepr(const Cubc_Canvas& src,
+                                            uint32_t x, uint32_t y,
+                                            Cubc_CompositeOp op) {
+        auto repr = CRepr();
+        Cubc_CanvasComposite(&repr, &src, x, y, op);
+    }
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::CompositeRect(uint32_t x, uint32_t y, uint32_t w,
+                                            uint32_t h, Color color,
+                                            Cubc_CompositeOp op) {
+        auto repr = CRepr();
+        Cubc_CanvasCompositeRect(&repr, x, y, w, h, color.CRepr(), op);
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Line(uint32_t x0, uint32_t y0, uint32_t x1,
+                                   uint32_t y1, Color color) {
         auto repr = CRepr();
         Cubc_CanvasLine(&repr, x0, y0, x1, y1, color.CRepr());
     }
 
-    void Canvas::Line(V2u begin, V2u end, Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Line(V2u begin, V2u end, Color color) {
         Line(begin.x, begin.y, end.x, end.y, color);
     }
 
-    void Canvas::WireframeTriangle(uint32_t x0, uint32_t y0, uint32_t x1,
-                                   uint32_t y1, uint32_t x2, uint32_t y2,
-                                   Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Lines(const uint32_t* x0, const uint32_t* y0,
+                                    const uint32_t* x1, const uint32_t* y1,
+                                    const Color* colors, size_t count,
+                                    size_t thread_count) {
+        auto repr = CRepr();
+        Cubc_CanvasLines(&repr, x0, y0, x1, y1,
+                         reinterpret_cast<const Cubc_Color*>(colors), count,
+                         thread_count);
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::LineAA(float x0, float y0, float x1, float y1,
+                                     Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasLineAA(&repr, x0, y0, x1, y1, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::LineAA(V2f begin, V2f end, Color color) {
+        LineAA(begin.x, begin.y, end.x, end.y, color);
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::QuadBezier(V2f begin, V2f control, V2f end,
+                                         Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasQuadBezier(&repr, begin.x, begin.y, control.x, control.y,
+                              end.x, end.y, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::CubicBezier(V2f begin, V2f control0,
+                                          V2f control1, V2f end, Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasCubicBezier(&repr, begin.x, begin.y, control0.x, control0.y,
+                               control1.x, control1.y, end.x, end.y,
+                               color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Polyline(const V2f* points, size_t count,
+                                       bool closed, float width,
+                                       Cubc_LineJoin join, Cubc_LineCap cap,
+                                       Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasPolyline(&repr, reinterpret_cast<const Cubc_V2f*>(points),
+                            count, closed, width, join, cap, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::ThickLine(float x0, float y0, float x1, float y1,
+                                        float width, Cubc_LineCap cap,
+                                        Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasThickLine(&repr, x0, y0, x1, y1, width, cap, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::ThickLine(V2f begin, V2f end, float width,
+                                        Cubc_LineCap cap, Color color) {
+        ThickLine(begin.x, begin.y, end.x, end.y, width, cap, color);
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Polygon(const V2f* points, const size_t* counts,
+                                      size_t contour_count, Cubc_FillRule rule,
+                                      Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasPolygon(&repr, reinterpret_cast<const Cubc_V2f*>(points),
+                           counts, contour_count, rule, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::FillPath(const Path& path, Cubc_FillRule rule,
+                                       Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasFillPath(&repr, path.CRepr(), rule, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::StrokePath(const Path& path, float width,
+                                         Cubc_LineJoin join, Cubc_LineCap cap,
+                                         Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasStrokePath(&repr, path.CRepr(), width, join, cap,
+                              color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::WireframeTriangle(uint32_t x0, uint32_t y0,
+                                                uint32_t x1, uint32_t y1,
+                                                uint32_t x2, uint32_t y2,
+                                                Color color) {
         auto repr = CRepr();
         Cubc_CanvasWireframeTriangle(&repr, x0, y0, x1, y1, x2, y2,
                                      color.CRepr());
     }
-    void Canvas::WireframeTriangle(V2u pos0, V2u pos1, V2u pos2, Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::WireframeTriangle(V2u pos0, V2u pos1, V2u pos2,
+                                                Color color) {
         WireframeTriangle(pos0.x, pos0.y, pos1.x, pos1.y, pos2.x, pos2.y,
                           color);
     }
 
-    void Canvas::Triangle(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
-                          uint32_t x2, uint32_t y2, Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Triangle(uint32_t x0, uint32_t y0, uint32_t x1,
+                                       uint32_t y1, uint32_t x2, uint32_t y2,
+                                       Color color) {
         auto repr = CRepr();
         Cubc_CanvasTriangle(&repr, x0, y0, x1, y1, x2, y2, color.CRepr());
     }
-    void Canvas::Triangle(V2u pos0, V2u pos1, V2u pos2, Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Triangle(V2u pos0, V2u pos1, V2u pos2,
+                                       Color color) {
         Triangle(pos0.x, pos0.y, pos1.x, pos1.y, pos2.x, pos2.y, color);
     }
 
-    void Canvas::Rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h,
-                      Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Rect(uint32_t x, uint32_t y, uint32_t w,
+                                   uint32_t h, Color color) {
         auto repr = CRepr();
         Cubc_CanvasRect(&repr, x, y, w, h, color.CRepr());
     }
-    void Canvas::Rect(V2f pos, V2f size, Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Rect(V2f pos, V2f size, Color color) {
         Rect(pos.x, pos.y, size.x, size.y, color);
     }
-    void Canvas::Rect(struct Rect rect, Color color) {
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Rect(struct Rect rect, Color color) {
         Rect(rect.x, rect.y, rect.w, rect.h, color);
     }
 
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::RoundedRect(uint32_t x, uint32_t y, uint32_t w,
+                                          uint32_t h, Corners radii,
+                                          Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasRoundedRect(&repr, x, y, w, h, radii.CRepr(),
+                               color.CRepr());
+    }
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::RoundedRect(struct Rect rect, Corners radii,
+                                          Color color) {
+        RoundedRect(rect.x, rect.y, rect.w, rect.h, radii, color);
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::RoundedRectAA(float x, float y, float w,
+                                            float h, Corners radii,
+                                            Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasRoundedRectAA(&repr, x, y, w, h, radii.CRepr(),
+                                 color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Ellipse(uint32_t x, uint32_t y, uint32_t rx,
+                                      uint32_t ry, Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasEllipse(&repr, x, y, rx, ry, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Circle(uint32_t x, uint32_t y, uint32_t r,
+                                     Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasCircle(&repr, x, y, r, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::WireframeEllipse(uint32_t x, uint32_t y,
+                                               uint32_t rx, uint32_t ry,
+                                               Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasWireframeEllipse(&repr, x, y, rx, ry, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::WireframeCircle(uint32_t x, uint32_t y,
+                                              uint32_t r, Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasWireframeCircle(&repr, x, y, r, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Arc(uint32_t x, uint32_t y, uint32_t r,
+                                  float start, float end, Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasArc(&repr, x, y, r, start, end, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Pie(uint32_t x, uint32_t y, uint32_t r,
+                                  float start, float end, Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasPie(&repr, x, y, r, start, end, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::EllipseAA(float x, float y, float rx, float ry,
+                                        Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasEllipseAA(&repr, x, y, rx, ry, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::CircleAA(float x, float y, float r,
+                                       Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasCircleAA(&repr, x, y, r, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::ArcAA(float x, float y, float r, float width,
+                                    float start, float end, Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasArcAA(&repr, x, y, r, width, start, end, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::PieAA(float x, float y, float r, float start,
+                                    float end, Color color) {
+        auto repr = CRepr();
+        Cubc_CanvasPieAA(&repr, x, y, r, start, end, color.CRepr());
+    }
+
+    template <Cubc_PixelFormat Format> void BasicCanvas<Format>::Premultiply() {
+        auto repr = CRepr();
+        Cubc_CanvasPremultiply(&repr);
+        premultiplied = repr.premultiplied;
+    }
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::Unpremultiply() {
+        auto repr = CRepr();
+        Cubc_CanvasUnpremultiply(&repr);
+        premultiplied = repr.premultiplied;
+    }
+
+    template <Cubc_PixelFormat Format>
+    int BasicCanvas<Format>::WritePPM(const char* file_name) const {
+        auto repr = CRepr();
+        return Cubc_CanvasWritePPM(&repr, file_name);
+    }
+    template <Cubc_PixelFormat Format>
+    int BasicCanvas<Format>::WritePAM(const char* file_name) const {
+        auto repr = CRepr();
+        return Cubc_CanvasWritePAM(&repr, file_name);
+    }
+
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::BeginDeferred(Cubc_CommandList* list) {
+        commands = list;
+    }
+    template <Cubc_PixelFormat Format>
+    void BasicCanvas<Format>::EndDeferred(size_t thread_count) {
+        auto repr = CRepr();
+        Cubc_CanvasEndDeferred(&repr, thread_count);
+        commands = nullptr;
+    }
+
+    template class BasicCanvas<CUBC_FORMAT_RGBA8888>;
+    template class BasicCanvas<CUBC_FORMAT_BGRA8888>;
+    template class BasicCanvas<CUBC_FORMAT_RGB565>;
+    template class BasicCanvas<CUBC_FORMAT_A8>;
+    template class BasicCanvas<CUBC_FORMAT_RGBA16F>;
+
 } // namespace Cubc
 #endif
 
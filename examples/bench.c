@@ -0,0 +1,1184 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CUBC_IMPLEMENTATION
+#include "../src/cub.c"
+
+// Times the public Cubc_Canvas* calls on reproducible random inputs and
+// reports primitives and pixels per second, for example:
+//
+//   ./bench --json new.json --baseline old.json
+//
+// Options:
+//   --json FILE       also write the results as JSON
+//   --baseline FILE   compare against a JSON file written by --json, and exit
+//                     with 1 if a benchmark got slower by more than the
+//                     threshold
+//   --threshold PCT   allowed slowdown against the baseline, 10 by default
+//   --filter TEXT     only run the benchmarks whose name contains TEXT
+//   --time SECONDS    time spent per benchmark, 0.5 by default
+//   --cpu LEVEL       run the kernels of scalar, sse2, avx2 or avx512
+//   --threads N       threads for the deferred benchmarks, 4 by default
+
+#define TARGET_W 1920
+#define TARGET_H 1080
+// Inputs generated per benchmark, cycled through while timing.
+#define INPUTS   1024
+#define BATCHES  5
+
+// The arguments of one call. Benchmarks use the fields they need.
+typedef struct {
+    uint32_t x0, y0, x1, y1, x2, y2;
+    Cubc_Color color;
+} Input;
+
+typedef struct {
+    const char* name;
+    // Optional, prepares the canvases the benchmark draws into.
+    void (*setup)(void);
+    // Generates one input and returns the pixels the call touches.
+    double (*make)(Input* in);
+    void (*run)(const Input* in);
+} Bench;
+
+typedef struct {
+    const char* name;
+    double ns_per_op, ops_per_sec, pixels_per_sec;
+} Result;
+
+static Cubc_Canvas target;
+static Cubc_Canvas scratch;
+static Cubc_Canvas sprite;
+static Cubc_Canvas image;
+static Cubc_Canvas sprite_premultiplied;
+static Cubc_Canvas target_565;
+static int null_fd = -1;
+static size_t thread_count = 4;
+
+static uint64_t rng_state;
+
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) rng_state;
+}
+
+// Uniform in lo..hi, inclusive.
+static uint32_t range(uint32_t lo, uint32_t hi) {
+    return lo + rnd() % (hi - lo + 1);
+}
+
+static Cubc_Color random_color(void) {
+    return (Cubc_Color){.color = rnd()};
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static Cubc_Canvas canvas_new(size_t w, size_t h, Cubc_PixelFormat format) {
+    Cubc_Canvas canvas = {
+        .data   = calloc(w * h, Cubc_PixelFormatSize(format)),
+        .w      = w,
+        .h      = h,
+        .format = format,
+    };
+    if (canvas.data == NULL) {
+        fprintf(stderr, "out of memory for a %zux%zu canvas\n", w, h);
+        exit(2);
+    }
+    return canvas;
+}
+
+static void canvas_free(Cubc_Canvas* canvas) {
+    free(canvas->data);
+    *canvas = (Cubc_Canvas){.format = CUBC_FORMAT_RGBA8888};
+}
+
+// Translucent noise with some fully opaque and fully transparent pixels, the
+// mix blits and blends see in practice.
+static void fill_noise(Cubc_Canvas* canvas) {
+    for (size_t i = 0; i < canvas->w * canvas->h; i++) {
+        uint32_t p = rnd();
+        switch (p % 4) {
+        case 0:
+            p |= 0xff;
+            break;
+        case 1:
+            p &= ~0xffu;
+            break;
+        }
+        canvas->pixels[i] = p;
+    }
+}
+
+static double line_pixels(const Input* in) {
+    uint32_t dx = in->x0 > in->x1 ? in->x0 - in->x1 : in->x1 - in->x0;
+    uint32_t dy = in->y0 > in->y1 ? in->y0 - in->y1 : in->y1 - in->y0;
+    return (double) (dx > dy ? dx : dy) + 1;
+}
+
+static double triangle_pixels(const Input* in) {
+    double area = ((double) in->x1 - in->x0) * ((double) in->y2 - in->y0) -
+                  ((double) in->x2 - in->x0) * ((double) in->y1 - in->y0);
+    return (area < 0 ? -area : area) / 2;
+}
+
+// A segment of `lo` to `hi` pixels in a random direction, kept on the
+// target.
+static double make_line(Input* in, uint32_t lo, uint32_t hi) {
+    uint32_t len = range(lo, hi);
+    in->x0       = range(0, TARGET_W - 1);
+    in->y0       = range(0, TARGET_H - 1);
+    in->x1       = in->x0 + range(0, 1) * len;
+    in->y1       = in->y0 + range(0, 1) * len;
+    if (in->x1 == in->x0 && in->y1 == in->y0) {
+        in->x1 += len;
+    }
+    in->x1    = in->x1 < TARGET_W ? in->x1 : TARGET_W - 1;
+    in->y1    = in->y1 < TARGET_H ? in->y1 : TARGET_H - 1;
+    in->color = random_color();
+    return line_pixels(in);
+}
+
+// A triangle inside a random `size` by `size` box.
+static double make_triangle(Input* in, uint32_t size) {
+    uint32_t x = range(0, TARGET_W - size);
+    uint32_t y = range(0, TARGET_H - size);
+    in->x0     = x + range(0, size - 1);
+    in->y0     = y;
+    in->x1     = x;
+    in->y1     = y + range(0, size - 1);
+    in->x2     = x + size - 1;
+    in->y2     = y + size - 1;
+    in->color  = random_color();
+    return triangle_pixels(in);
+}
+
+static double make_rect(Input* in, uint32_t lo, uint32_t hi) {
+    in->x1    = range(lo, hi);
+    in->y1    = range(lo, hi);
+    in->x0    = range(0, TARGET_W - in->x1);
+    in->y0    = range(0, TARGET_H - in->y1);
+    in->color = random_color();
+    return (double) in->x1 * in->y1;
+}
+
+// A position for a source of `w` by `h` pixels, scaled by `scale`.
+static double make_blit(Input* in, size_t w, size_t h, float scale) {
+    uint32_t sw = (uint32_t) (w * scale);
+    uint32_t sh = (uint32_t) (h * scale);
+    in->x0      = range(0, TARGET_W - sw);
+    in->y0      = range(0, TARGET_H - sh);
+    return (double) sw * sh;
+}
+
+static void setup_target(void) {
+    Cubc_CanvasClear(&target, (Cubc_Color){.color = 0x202020ff});
+}
+
+#define DEFINE_CLEAR(name, w, h)                                               \
+    static void setup_##name(void) {                                           \
+        canvas_free(&scratch);                                                 \
+        scratch = canvas_new(w, h, CUBC_FORMAT_RGBA8888);                      \
+    }                                                                          \
+    static double make_##name(Input* in) {                                     \
+        in->color = random_color();                                            \
+        return (double) (w) * (h);                                             \
+    }
+
+DEFINE_CLEAR(clear_720p, 1280, 720)
+DEFINE_CLEAR(clear_1080p, 1920, 1080)
+DEFINE_CLEAR(clear_4k, 3840, 2160)
+DEFINE_CLEAR(clear_8k, 7680, 4320)
+
+static void run_clear(const Input* in) {
+    Cubc_CanvasClear(&scratch, in->color);
+}
+
+static void setup_clear_565(void) {
+    canvas_free(&scratch);
+    scratch = canvas_new(1920, 1080, CUBC_FORMAT_RGB565);
+}
+
+static double make_pixel(Input* in) {
+    in->x0    = range(0, TARGET_W - 1);
+    in->y0    = range(0, TARGET_H - 1);
+    in->color = random_color();
+    return 1;
+}
+
+static void run_pixel(const Input* in) {
+    Cubc_CanvasPixel(&target, in->x0, in->y0, in->color);
+}
+
+static double make_line_short(Input* in) {
+    return make_line(in, 1, 16);
+}
+
+static double make_line_long(Input* in) {
+    return make_line(in, 500, 1000);
+}
+
+static void run_line(const Input* in) {
+    Cubc_CanvasLine(&target, in->x0, in->y0, in->x1, in->y1, in->color);
+}
+
+// Batches of the same segments, drawn in one Cubc_CanvasLines call.
+#define BATCH_LINES 10000
+
+static uint32_t batch_x0[BATCH_LINES], batch_y0[BATCH_LINES];
+static uint32_t batch_x1[BATCH_LINES], batch_y1[BATCH_LINES];
+static Cubc_Color batch_colors[BATCH_LINES];
+static double batch_pixels;
+
+static void setup_batch(uint32_t lo, uint32_t hi) {
+    setup_target();
+    batch_pixels = 0;
+    for (int i = 0; i < BATCH_LINES; i++) {
+        Input in;
+        batch_pixels    += make_line(&in, lo, hi);
+        batch_x0[i]      = in.x0;
+        batch_y0[i]      = in.y0;
+        batch_x1[i]      = in.x1;
+        batch_y1[i]      = in.y1;
+        batch_colors[i]  = in.color;
+    }
+}
+
+static void setup_batch_short(void) {
+    setup_batch(1, 16);
+}
+
+static void setup_batch_long(void) {
+    setup_batch(500, 1000);
+}
+
+static double make_batch(Input* in) {
+    (void) in;
+    return batch_pixels;
+}
+
+static void run_lines_batch(const Input* in) {
+    (void) in;
+    Cubc_CanvasLines(&target, batch_x0, batch_y0, batch_x1, batch_y1,
+                     batch_colors, BATCH_LINES, thread_count);
+}
+
+// The same segments anti-aliased, counted per column along the major axis.
+static void run_line_aa(const Input* in) {
+    Cubc_CanvasLineAA(&target, (float) in->x0, (float) in->y0,
+                      (float) in->x1, (float) in->y1, in->color);
+}
+
+// The same segments as strokes eight pixels wide, with round caps.
+static double make_thick_line_short(Input* in) {
+    return make_line(in, 1, 16) * 8;
+}
+
+static double make_thick_line_long(Input* in) {
+    return make_line(in, 500, 1000) * 8;
+}
+
+static void run_thick_line(const Input* in) {
+    Cubc_CanvasThickLine(&target, (float) in->x0, (float) in->y0,
+                         (float) in->x1, (float) in->y1, 8, CUBC_CAP_ROUND,
+                         in->color);
+}
+
+// Curves through three random points in a square of `size` pixels, counted
+// by the length of their control polygon. Cubic ones also pass the corner
+// below the first point.
+static double make_curve(Input* in, uint32_t size) {
+    uint32_t x = range(0, TARGET_W - size), y = range(0, TARGET_H - size);
+    in->x0     = x + range(0, size - 1);
+    in->y0     = y + range(0, size - 1);
+    in->x1     = x + range(0, size - 1);
+    in->y1     = y + range(0, size - 1);
+    in->x2     = x + range(0, size - 1);
+    in->y2     = y + range(0, size - 1);
+    in->color  = random_color();
+    return hypot((double) in->x1 - in->x0, (double) in->y1 - in->y0) +
+           hypot((double) in->x2 - in->x1, (double) in->y2 - in->y1) + 1;
+}
+
+static double make_curve_small(Input* in) {
+    return make_curve(in, 32);
+}
+
+static double make_curve_large(Input* in) {
+    return make_curve(in, 1000);
+}
+
+static void run_quad_bezier(const Input* in) {
+    Cubc_CanvasQuadBezier(&target, (float) in->x0, (float) in->y0,
+                          (float) in->x1, (float) in->y1, (float) in->x2,
+                          (float) in->y2, in->color);
+}
+
+static void run_cubic_bezier(const Input* in) {
+    Cubc_CanvasCubicBezier(&target, (float) in->x0, (float) in->y0,
+                           (float) in->x1, (float) in->y1, (float) in->x0,
+                           (float) in->y2, (float) in->x2, (float) in->y2,
+                           in->color);
+}
+
+// A noisy chart series across the target, stroked in one call.
+#define SERIES_POINTS 10000
+
+static Cubc_V2f series[SERIES_POINTS];
+static double series_pixels;
+
+static void setup_series(void) {
+    setup_target();
+    float y       = TARGET_H / 2;
+    series_pixels = 0;
+    for (int i = 0; i < SERIES_POINTS; i++) {
+        float x    = (float) i * (TARGET_W - 1) / (SERIES_POINTS - 1);
+        y         += (float) range(0, 40) - 20;
+        y          = y < 0 ? 0 : y > TARGET_H - 1 ? TARGET_H - 1 : y;
+        series[i]  = (Cubc_V2f){x, y};
+        if (i > 0) {
+            float dx       = x - series[i - 1].x;
+            float dy       = y - series[i - 1].y;
+            series_pixels += sqrt(dx * dx + dy * dy) * 2;
+        }
+    }
+}
+
+static double make_series(Input* in) {
+    in->color = random_color();
+    return series_pixels;
+}
+
+static void run_polyline_series(const Input* in) {
+    Cubc_CanvasPolyline(&target, series, SERIES_POINTS, false, 2,
+                        CUBC_JOIN_MITER, CUBC_CAP_BUTT, in->color);
+}
+
+// A concave star with many spikes in the middle of the target, filled in
+// one call.
+#define STAR_POINTS 1000
+
+static Cubc_V2f star[STAR_POINTS];
+static double star_pixels;
+
+static void setup_star(void) {
+    setup_target();
+    for (int i = 0; i < STAR_POINTS; i++) {
+        double angle = 2 * M_PI * i / STAR_POINTS;
+        double r     = i % 2 ? TARGET_H * 0.45 : TARGET_H * 0.3;
+        star[i]      = (Cubc_V2f){TARGET_W / 2 + r * cos(angle),
+                                  TARGET_H / 2 + r * sin(angle)};
+    }
+    // Shoelace area.
+    star_pixels = 0;
+    for (int i = 0; i < STAR_POINTS; i++) {
+        Cubc_V2f a   = star[i];
+        Cubc_V2f b   = star[(i + 1) % STAR_POINTS];
+        star_pixels += ((double) a.x * b.y - (double) b.x * a.y) / 2;
+    }
+}
+
+static double make_star(Input* in) {
+    in->color = random_color();
+    return star_pixels;
+}
+
+static void run_polygon_star(const Input* in) {
+    static const size_t count = STAR_POINTS;
+    Cubc_CanvasPolygon(&target, star, &count, 1, CUBC_FILL_NONZERO,
+                       in->color);
+}
+
+// The same star as an anti-aliased path, and a large circle of four cubics.
+static Cubc_Path star_path;
+static Cubc_Path circle_path;
+static double circle_pixels;
+static double star_length;
+static double circle_length;
+
+static void setup_path_star(void) {
+    setup_star();
+    if (star_path.verb_count == 0) {
+        Cubc_PathMoveTo(&star_path, star[0].x, star[0].y);
+        for (int i = 1; i < STAR_POINTS; i++)
+            Cubc_PathLineTo(&star_path, star[i].x, star[i].y);
+        Cubc_PathClose(&star_path);
+    }
+    star_length = 0;
+    for (int i = 0; i < STAR_POINTS; i++) {
+        Cubc_V2f a   = star[i];
+        Cubc_V2f b   = star[(i + 1) % STAR_POINTS];
+        star_length += hypot(b.x - a.x, b.y - a.y);
+    }
+}
+
+static void setup_path_circle(void) {
+    setup_target();
+    float cx = TARGET_W / 2, cy = TARGET_H / 2, r = TARGET_H * 0.45f;
+    float k  = r * 0.5523f;
+    if (circle_path.verb_count == 0) {
+        Cubc_PathMoveTo(&circle_path, cx + r, cy);
+        Cubc_PathCubicTo(&circle_path, cx + r, cy + k, cx + k, cy + r, cx,
+                         cy + r);
+        Cubc_PathCubicTo(&circle_path, cx - k, cy + r, cx - r, cy + k,
+                         cx - r, cy);
+        Cubc_PathCubicTo(&circle_path, cx - r, cy - k, cx - k, cy - r, cx,
+                         cy - r);
+        Cubc_PathCubicTo(&circle_path, cx + k, cy - r, cx + r, cy - k,
+                         cx + r, cy);
+        Cubc_PathClose(&circle_path);
+    }
+    circle_pixels = M_PI * r * r;
+    circle_length = 2 * M_PI * r;
+}
+
+static double make_path_circle(Input* in) {
+    in->color = random_color();
+    return circle_pixels;
+}
+
+static void run_path_star(const Input* in) {
+    Cubc_CanvasFillPath(&target, &star_path, CUBC_FILL_NONZERO, in->color);
+}
+
+static void run_path_circle(const Input* in) {
+    Cubc_CanvasFillPath(&target, &circle_path, CUBC_FILL_NONZERO, in->color);
+}
+
+// Both paths stroked eight pixels wide with round joins, counted by their
+// length.
+static double make_stroke_star(Input* in) {
+    in->color = random_color();
+    return star_length * 8;
+}
+
+static double make_stroke_circle(Input* in) {
+    in->color = random_color();
+    return circle_length * 8;
+}
+
+static void run_stroke_star(const Input* in) {
+    Cubc_CanvasStrokePath(&target, &star_path, 8, CUBC_JOIN_ROUND,
+                          CUBC_CAP_BUTT, in->color);
+}
+
+static void run_stroke_circle(const Input* in) {
+    Cubc_CanvasStrokePath(&target, &circle_path, 8, CUBC_JOIN_ROUND,
+                          CUBC_CAP_BUTT, in->color);
+}
+
+// A circle of `lo` to `hi` pixels radius on the target, counted by its
+// area.
+static double make_circle(Input* in, uint32_t lo, uint32_t hi) {
+    in->x1    = range(lo, hi);
+    in->x0    = range(in->x1, TARGET_W - 1 - in->x1);
+    in->y0    = range(in->x1, TARGET_H - 1 - in->x1);
+    in->color = random_color();
+    return 3.14159265358979 * in->x1 * in->x1;
+}
+
+static double make_circle_small(Input* in) {
+    return make_circle(in, 8, 32);
+}
+
+static double make_circle_large(Input* in) {
+    return make_circle(in, 100, 400);
+}
+
+static void run_circle(const Input* in) {
+    Cubc_CanvasCircle(&target, in->x0, in->y0, in->x1, in->color);
+}
+
+// The 64 triangle fan circles used to be drawn with.
+static void run_circle_fan(const Input* in) {
+    for (int i = 0; i < 64; i++) {
+        double a0 = i * 6.28318530717959 / 64;
+        double a1 = (i + 1) * 6.28318530717959 / 64;
+        Cubc_CanvasTriangle(&target, in->x0, in->y0,
+                            (uint32_t) (in->x0 + in->x1 * cos(a0) + 0.5),
+                            (uint32_t) (in->y0 + in->x1 * sin(a0) + 0.5),
+                            (uint32_t) (in->x0 + in->x1 * cos(a1) + 0.5),
+                            (uint32_t) (in->y0 + in->x1 * sin(a1) + 0.5),
+                            in->color);
+    }
+}
+
+static double make_wireframe_circle(Input* in) {
+    make_circle(in, 16, 256);
+    return 6.28318530717959 * in->x1;
+}
+
+static void run_wireframe_circle(const Input* in) {
+    Cubc_CanvasWireframeCircle(&target, in->x0, in->y0, in->x1, in->color);
+}
+
+static void run_circle_aa(const Input* in) {
+    Cubc_CanvasCircleAA(&target, in->x0 + 0.3f, in->y0 + 0.6f, in->x1 + 0.5f,
+                        in->color);
+}
+
+// Gauge-like: three quarters of a turn, a tenth of the radius wide.
+static void run_arc_aa(const Input* in) {
+    Cubc_CanvasArcAA(&target, in->x0 + 0.3f, in->y0 + 0.6f, in->x1 * 0.95f,
+                     in->x1 * 0.1f, 2.356f, 7.069f, in->color);
+}
+
+static void run_pie_aa(const Input* in) {
+    Cubc_CanvasPieAA(&target, in->x0 + 0.3f, in->y0 + 0.6f, in->x1 + 0.5f,
+                     -1.0f, 1.5f, in->color);
+}
+
+static double make_triangle_tiny(Input* in) {
+    return make_triangle(in, range(2, 8));
+}
+
+static double make_triangle_small(Input* in) {
+    return make_triangle(in, range(16, 64));
+}
+
+static double make_triangle_huge(Input* in) {
+    return make_triangle(in, range(800, TARGET_H));
+}
+
+static void run_triangle(const Input* in) {
+    Cubc_CanvasTriangle(&target, in->x0, in->y0, in->x1, in->y1, in->x2,
+                        in->y2, in->color);
+}
+
+static double make_wireframe(Input* in) {
+    make_triangle(in, range(16, 256));
+    Input edges[3] = {
+        {in->x0, in->y0, in->x1, in->y1, 0, 0, {0}},
+        {in->x1, in->y1, in->x2, in->y2, 0, 0, {0}},
+        {in->x2, in->y2, in->x0, in->y0, 0, 0, {0}},
+    };
+    return line_pixels(&edges[0]) + line_pixels(&edges[1]) +
+           line_pixels(&edges[2]);
+}
+
+static void run_wireframe(const Input* in) {
+    Cubc_CanvasWireframeTriangle(&target, in->x0, in->y0, in->x1, in->y1,
+                                 in->x2, in->y2, in->color);
+}
+
+static double make_rect_small(Input* in) {
+    return make_rect(in, 1, 32);
+}
+
+static double make_rect_large(Input* in) {
+    return make_rect(in, 400, 1000);
+}
+
+static void run_rect(const Input* in) {
+    Cubc_CanvasRect(&target, in->x0, in->y0, in->x1, in->y1, in->color);
+}
+
+static void run_rect_565(const Input* in) {
+    Cubc_CanvasRect(&target_565, in->x0, in->y0, in->x1, in->y1, in->color);
+}
+
+// A UI panel, with room for the corners of the rounded and sliced ones.
+static double make_panel(Input* in) {
+    return make_rect(in, 48, 400);
+}
+
+static void run_rounded_rect(const Input* in) {
+    Cubc_CanvasRoundedRect(&target, in->x0, in->y0, in->x1, in->y1,
+                           (Cubc_Corners){12, 12, 12, 12}, in->color);
+}
+
+// Rounded panels as they used to be drawn: two rects over each other and a
+// circle in each corner.
+static void run_rounded_rect_composed(const Input* in) {
+    uint32_t x1 = in->x0 + in->x1 - 12, y1 = in->y0 + in->y1 - 12;
+    Cubc_CanvasRect(&target, in->x0 + 12, in->y0, in->x1 - 24, in->y1,
+                    in->color);
+    Cubc_CanvasRect(&target, in->x0, in->y0 + 12, in->x1, in->y1 - 24,
+                    in->color);
+    Cubc_CanvasCircle(&target, in->x0 + 12, in->y0 + 12, 12, in->color);
+    Cubc_CanvasCircle(&target, x1, in->y0 + 12, 12, in->color);
+    Cubc_CanvasCircle(&target, x1, y1, 12, in->color);
+    Cubc_CanvasCircle(&target, in->x0 + 12, y1, 12, in->color);
+}
+
+static void run_rounded_rect_aa(const Input* in) {
+    Cubc_CanvasRoundedRectAA(&target, in->x0 + 0.3f, in->y0 + 0.6f, in->x1,
+                             in->y1, (Cubc_Corners){12, 12, 12, 12},
+                             in->color);
+}
+
+// The sprite as a skin with 16 pixel borders.
+static const Cubc_Insets skin_insets = {16, 16, 16, 16};
+
+static void run_blit_sliced(const Input* in) {
+    Cubc_CanvasBlitCanvasSliced(&target, &sprite, in->x0, in->y0, in->x1,
+                                in->y1, skin_insets);
+}
+
+// The nine scaled blits of views a sliced panel used to take.
+static void run_blit_sliced_views(const Input* in) {
+    uint32_t src[4] = {0, 16, 48, 64};
+    uint32_t xs[4]  = {0, 16, in->x1 - 16, in->x1};
+    uint32_t ys[4]  = {0, 16, in->y1 - 16, in->y1};
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            Cubc_Canvas view = Cubc_CanvasView(&sprite, src[i], src[j],
+                                               src[i + 1] - src[i],
+                                               src[j + 1] - src[j]);
+            Cubc_CanvasBlitCanvas(&target, &view, in->x0 + xs[i],
+                                  in->y0 + ys[j],
+                                  (float) (xs[i + 1] - xs[i]) / view.w,
+                                  (float) (ys[j + 1] - ys[j]) / view.h);
+        }
+    }
+}
+
+static void run_blit_sliced_alpha(const Input* in) {
+    Cubc_CanvasBlitCanvasSlicedAlpha(&target, &sprite, in->x0, in->y0,
+                                     in->x1, in->y1, skin_insets,
+                                     CUBC_ALPHA_STRAIGHT);
+}
+
+static double make_view_rect(Input* in) {
+    make_rect(in, 64, 256);
+    in->x2 = in->x1 / 4;
+    in->y2 = in->y1 / 4;
+    return (double) (in->x1 / 2) * (in->y1 / 2);
+}
+
+static void run_view_rect(const Input* in) {
+    Cubc_Canvas view = Cubc_CanvasView(&target, in->x0, in->y0, in->x1, in->y1);
+    Cubc_CanvasRect(&view, in->x2, in->y2, in->x1 / 2, in->y1 / 2, in->color);
+}
+
+static double make_blit_sprite(Input* in) {
+    return make_blit(in, sprite.w, sprite.h, 1);
+}
+
+static double make_blit_image(Input* in) {
+    return make_blit(in, image.w, image.h, 1);
+}
+
+static double make_blit_image_2x(Input* in) {
+    return make_blit(in, image.w, image.h, 2);
+}
+
+static double make_blit_image_half(Input* in) {
+    return make_blit(in, image.w, image.h, 0.5f);
+}
+
+static double make_blit_image_quarter(Input* in) {
+    return make_blit(in, image.w, image.h, 0.25f);
+}
+
+static void run_blit_sprite(const Input* in) {
+    Cubc_CanvasBlitCanvas(&target, &sprite, in->x0, in->y0, 1, 1);
+}
+
+static void run_blit_image(const Input* in) {
+    Cubc_CanvasBlitCanvas(&target, &image, in->x0, in->y0, 1, 1);
+}
+
+static void run_blit_image_2x(const Input* in) {
+    Cubc_CanvasBlitCanvas(&target, &image, in->x0, in->y0, 2, 2);
+}
+
+static void run_blit_image_half(const Input* in) {
+    Cubc_CanvasBlitCanvas(&target, &image, in->x0, in->y0, 0.5f, 0.5f);
+}
+
+static void run_blit_565(const Input* in) {
+    Cubc_CanvasBlitCanvas(&target_565, &image, in->x0, in->y0, 1, 1);
+}
+
+static void run_blit_alpha_sprite(const Input* in) {
+    Cubc_CanvasBlitCanvasAlpha(&target, &sprite, in->x0, in->y0, 1, 1,
+                               CUBC_ALPHA_STRAIGHT);
+}
+
+static void run_blit_alpha_image(const Input* in) {
+    Cubc_CanvasBlitCanvasAlpha(&target, &image, in->x0, in->y0, 1, 1,
+                               CUBC_ALPHA_STRAIGHT);
+}
+
+static void run_blit_alpha_premultiplied(const Input* in) {
+    Cubc_CanvasBlitCanvasAlpha(&target, &sprite_premultiplied, in->x0, in->y0,
+                               1, 1, CUBC_ALPHA_PREMULTIPLIED);
+}
+
+static void run_blit_bilinear_2x(const Input* in) {
+    Cubc_CanvasBlitCanvasFiltered(&target, &image, in->x0, in->y0, 2, 2,
+                                  CUBC_FILTER_BILINEAR);
+}
+
+static void run_blit_bicubic_2x(const Input* in) {
+    Cubc_CanvasBlitCanvasFiltered(&target, &image, in->x0, in->y0, 2, 2,
+                                  CUBC_FILTER_BICUBIC);
+}
+
+static void run_blit_bilinear_half(const Input* in) {
+    Cubc_CanvasBlitCanvasFiltered(&target, &image, in->x0, in->y0, 0.5f, 0.5f,
+                                  CUBC_FILTER_BILINEAR);
+}
+
+static void run_blit_box_half(const Input* in) {
+    Cubc_CanvasBlitCanvasFiltered(&target, &image, in->x0, in->y0, 0.5f, 0.5f,
+                                  CUBC_FILTER_BOX);
+}
+
+static void run_blit_box_quarter(const Input* in) {
+    Cubc_CanvasBlitCanvasFiltered(&target, &image, in->x0, in->y0, 0.25f,
+                                  0.25f, CUBC_FILTER_BOX);
+}
+
+static void run_blend_multiply(const Input* in) {
+    Cubc_CanvasBlendCanvas(&target, &image, in->x0, in->y0,
+                           CUBC_BLEND_MULTIPLY);
+}
+
+static void run_blend_overlay(const Input* in) {
+    Cubc_CanvasBlendCanvas(&target, &image, in->x0, in->y0,
+                           CUBC_BLEND_OVERLAY);
+}
+
+static void run_blend_soft_light(const Input* in) {
+    Cubc_CanvasBlendCanvas(&target, &image, in->x0, in->y0,
+                           CUBC_BLEND_SOFT_LIGHT);
+}
+
+static void setup_premultiplied(void) {
+    setup_target();
+    Cubc_CanvasPremultiply(&target);
+}
+
+static void run_composite_src_over(const Input* in) {
+    Cubc_CanvasComposite(&target, &sprite_premultiplied, in->x0, in->y0,
+                         CUBC_COMPOSITE_SRC_OVER);
+}
+
+static void run_composite_xor(const Input* in) {
+    Cubc_CanvasComposite(&target, &sprite_premultiplied, in->x0, in->y0,
+                         CUBC_COMPOSITE_XOR);
+}
+
+static void run_composite_straight(const Input* in) {
+    Cubc_CanvasComposite(&target, &sprite, in->x0, in->y0,
+                         CUBC_COMPOSITE_SRC_ATOP);
+}
+
+static void run_composite_rect(const Input* in) {
+    Cubc_CanvasCompositeRect(&target, in->x0, in->y0, in->x1, in->y1,
+                             in->color, CUBC_COMPOSITE_SRC_OVER);
+}
+
+static double make_whole_target(Input* in) {
+    (void) in;
+    return (double) TARGET_W * TARGET_H;
+}
+
+// Converts there and back, which counts as two passes.
+static double make_premultiply(Input* in) {
+    return 2 * make_whole_target(in);
+}
+
+static void run_premultiply(const Input* in) {
+    (void) in;
+    Cubc_CanvasPremultiply(&target);
+    Cubc_CanvasUnpremultiply(&target);
+}
+
+static void setup_scratch_565(void) {
+    canvas_free(&scratch);
+    scratch = canvas_new(TARGET_W, TARGET_H, CUBC_FORMAT_RGB565);
+}
+
+static void run_convert_565(const Input* in) {
+    (void) in;
+    Cubc_PixelsConvert(scratch.data, CUBC_FORMAT_RGB565, target.pixels,
+                       CUBC_FORMAT_RGBA8888, TARGET_W * TARGET_H);
+}
+
+static void setup_scratch_bgra(void) {
+    canvas_free(&scratch);
+    scratch = canvas_new(TARGET_W, TARGET_H, CUBC_FORMAT_BGRA8888);
+}
+
+static void run_convert_bgra(const Input* in) {
+    (void) in;
+    Cubc_PixelsConvert(scratch.data, CUBC_FORMAT_BGRA8888, target.pixels,
+                       CUBC_FORMAT_RGBA8888, TARGET_W * TARGET_H);
+}
+
+// One frame of 256 small triangles and 64 rects, recorded and then drawn
+// tile by tile.
+static double make_deferred_frame(Input* in) {
+    in->x0 = rnd();
+    return 256 * 1024.0 + 64 * 128.0 * 128.0;
+}
+
+static void draw_frame(Cubc_Canvas* canvas, uint64_t seed) {
+    uint64_t saved = rng_state;
+    rng_state      = seed | 1;
+    Input in;
+    for (int i = 0; i < 256; i++) {
+        make_triangle(&in, 64);
+        Cubc_CanvasTriangle(canvas, in.x0, in.y0, in.x1, in.y1, in.x2, in.y2,
+                            in.color);
+    }
+    for (int i = 0; i < 64; i++) {
+        make_rect(&in, 128, 128);
+        Cubc_CanvasRect(canvas, in.x0, in.y0, in.x1, in.y1, in.color);
+    }
+    rng_state = saved;
+}
+
+static void run_immediate_frame(const Input* in) {
+    draw_frame(&target, in->x0);
+}
+
+static void run_deferred_frame(const Input* in) {
+    Cubc_CommandList list = {0};
+    Cubc_CanvasBeginDeferred(&target, &list);
+    draw_frame(&target, in->x0);
+    Cubc_CanvasEndDeferred(&target, thread_count);
+    Cubc_CommandListFree(&list);
+}
+
+static void run_write_ppm(const Input* in) {
+    (void) in;
+    Cubc_CanvasWritePPM(&target, "/dev/null");
+}
+
+static void run_write_pam(const Input* in) {
+    (void) in;
+    Cubc_CanvasWritePAM(&target, "/dev/null");
+}
+
+static void run_frame_y4m(const Input* in) {
+    (void) in;
+    Cubc_FrameWriter writer;
+    if (Cubc_FrameWriterOpen(&writer, null_fd, CUBC_FRAMES_Y4M, TARGET_W,
+                             TARGET_H, 60) == 0) {
+        Cubc_FrameWriterWrite(&writer, &target);
+        Cubc_FrameWriterClose(&writer);
+    }
+}
+
+static const Bench benches[] = {
+    {"clear_720p", setup_clear_720p, make_clear_720p, run_clear},
+    {"clear_1080p", setup_clear_1080p, make_clear_1080p, run_clear},
+    {"clear_4k", setup_clear_4k, make_clear_4k, run_clear},
+    {"clear_8k", setup_clear_8k, make_clear_8k, run_clear},
+    {"clear_1080p_rgb565", setup_clear_565, make_clear_1080p, run_clear},
+    {"pixel", setup_target, make_pixel, run_pixel},
+    {"line_short", setup_target, make_line_short, run_line},
+    {"line_long", setup_target, make_line_long, run_line},
+    {"lines_batch_short", setup_batch_short, make_batch, run_lines_batch},
+    {"lines_batch_long", setup_batch_long, make_batch, run_lines_batch},
+    {"line_aa_short", setup_target, make_line_short, run_line_aa},
+    {"line_aa_long", setup_target, make_line_long, run_line_aa},
+    {"thick_line_short", setup_target, make_thick_line_short,
+     run_thick_line},
+    {"thick_line_long", setup_target, make_thick_line_long, run_thick_line},
+    {"quad_bezier_small", setup_target, make_curve_small, run_quad_bezier},
+    {"quad_bezier_large", setup_target, make_curve_large, run_quad_bezier},
+    {"cubic_bezier_small", setup_target, make_curve_small, run_cubic_bezier},
+    {"cubic_bezier_large", setup_target, make_curve_large, run_cubic_bezier},
+    {"polyline_series_10k", setup_series, make_series, run_polyline_series},
+    {"polygon_star_1k", setup_star, make_star, run_polygon_star},
+    {"path_star_1k", setup_path_star, make_star, run_path_star},
+    {"path_circle", setup_path_circle, make_path_circle, run_path_circle},
+    {"stroke_star_1k", setup_path_star, make_stroke_star, run_stroke_star},
+    {"stroke_circle", setup_path_circle, make_stroke_circle,
+     run_stroke_circle},
+    {"circle_small", setup_target, make_circle_small, run_circle},
+    {"circle_large", setup_target, make_circle_large, run_circle},
+    {"circle_fan_large", setup_target, make_circle_large, run_circle_fan},
+    {"wireframe_circle", setup_target, make_wireframe_circle,
+     run_wireframe_circle},
+    {"circle_aa_small", setup_target, make_circle_small, run_circle_aa},
+    {"circle_aa_large", setup_target, make_circle_large, run_circle_aa},
+    {"arc_aa_large", setup_target, make_circle_large, run_arc_aa},
+    {"pie_aa_large", setup_target, make_circle_large, run_pie_aa},
+    {"wireframe_triangle", setup_target, make_wireframe, run_wireframe},
+    {"triangle_tiny", setup_target, make_triangle_tiny, run_triangle},
+    {"triangle_small", setup_target, make_triangle_small, run_triangle},
+    {"triangle_huge", setup_target, make_triangle_huge, run_triangle},
+    {"rect_small", setup_target, make_rect_small, run_rect},
+    {"rect_large", setup_target, make_rect_large, run_rect},
+    {"rect_large_rgb565", NULL, make_rect_large, run_rect_565},
+    {"view_rect", setup_target, make_view_rect, run_view_rect},
+    {"rounded_rect", setup_target, make_panel, run_rounded_rect},
+    {"rounded_rect_composed", setup_target, make_panel,
+     run_rounded_rect_composed},
+    {"rounded_rect_aa", setup_target, make_panel, run_rounded_rect_aa},
+    {"blit_sprite", setup_target, make_blit_sprite, run_blit_sprite},
+    {"blit_image", setup_target, make_blit_image, run_blit_image},
+    {"blit_image_2x", setup_target, make_blit_image_2x, run_blit_image_2x},
+    {"blit_image_half", setup_target, make_blit_image_half,
+     run_blit_image_half},
+    {"blit_image_to_rgb565", NULL, make_blit_image, run_blit_565},
+    {"blit_alpha_sprite", setup_target, make_blit_sprite,
+     run_blit_alpha_sprite},
+    {"blit_alpha_image", setup_target, make_blit_image, run_blit_alpha_image},
+    {"blit_alpha_premultiplied", setup_premultiplied, make_blit_sprite,
+     run_blit_alpha_premultiplied},
+    {"blit_bilinear_2x", setup_target, make_blit_image_2x,
+     run_blit_bilinear_2x},
+    {"blit_bicubic_2x", setup_target, make_blit_image_2x,
+     run_blit_bicubic_2x},
+    {"blit_bilinear_half", setup_target, make_blit_image_half,
+     run_blit_bilinear_half},
+    {"blit_box_half", setup_target, make_blit_image_half, run_blit_box_half},
+    {"blit_box_quarter", setup_target, make_blit_image_quarter,
+     run_blit_box_quarter},
+    {"blit_sliced", setup_target, make_panel, run_blit_sliced},
+    {"blit_sliced_views", setup_target, make_panel, run_blit_sliced_views},
+    {"blit_sliced_alpha", setup_target, make_panel, run_blit_sliced_alpha},
+    {"blend_multiply", setup_target, make_blit_image, run_blend_multiply},
+    {"blend_overlay", setup_target, make_blit_image, run_blend_overlay},
+    {"blend_soft_light", setup_target, make_blit_image, run_blend_soft_light},
+    {"composite_src_over", setup_premultiplied, make_blit_sprite,
+     run_composite_src_over},
+    {"composite_xor", setup_premultiplied, make_blit_sprite,
+     run_composite_xor},
+    {"composite_straight", setup_target, make_blit_sprite,
+     run_composite_straight},
+    {"composite_rect", setup_premultiplied, make_rect_small,
+     run_composite_rect},
+    {"premultiply_1080p", setup_target, make_premultiply, run_premultiply},
+    {"convert_1080p_rgb565", setup_scratch_565, make_whole_target,
+     run_convert_565},
+    {"convert_1080p_bgra", setup_scratch_bgra, make_whole_target,
+     run_convert_bgra},
+    {"frame_immediate", setup_target, make_deferred_frame,
+     run_immediate_frame},
+    {"frame_deferred", setup_target, make_deferred_frame, run_deferred_frame},
+    {"write_ppm_1080p", setup_target, make_whole_target, run_write_ppm},
+    {"write_pam_1080p", setup_target, make_whole_target, run_write_pam},
+    {"frame_writer_y4m_1080p", setup_target, make_whole_target, run_frame_y4m},
+};
+
+static double time_calls(const Bench* bench, const Input* inputs,
+                         size_t calls) {
+    double start = now();
+    for (size_t i = 0; i < calls; i++) {
+        bench->run(&inputs[i % INPUTS]);
+    }
+    return now() - start;
+}
+
+static Result run_bench(const Bench* bench, double seconds) {
+    static Input inputs[INPUTS];
+    // Seeded by the name, so that adding benchmarks doesn't change the
+    // inputs of the others.
+    rng_state = 14695981039346656037ull;
+    for (const char* c = bench->name; *c; c++) {
+        rng_state = (rng_state ^ (uint8_t) *c) * 1099511628211ull;
+    }
+    if (bench->setup) {
+        bench->setup();
+    }
+    double pixels = 0;
+    for (size_t i = 0; i < INPUTS; i++) {
+        pixels += bench->make(&inputs[i]);
+    }
+    pixels /= INPUTS;
+
+    // Grow the batch until it fills its share of the time, then keep the
+    // fastest of the batches.
+    size_t calls = 1;
+    double t     = time_calls(bench, inputs, calls);
+    while (t < seconds / BATCHES) {
+        calls *= 2;
+        t      = time_calls(bench, inputs, calls);
+    }
+    double best = t / calls;
+    for (int b = 1; b < BATCHES; b++) {
+        t    = time_calls(bench, inputs, calls) / calls;
+        best = t < best ? t : best;
+    }
+    return (Result){
+        .name           = bench->name,
+        .ns_per_op      = best * 1e9,
+        .ops_per_sec    = 1 / best,
+        .pixels_per_sec = pixels / best,
+    };
+}
+
+static const char* level_names[] = {"scalar", "sse2", "avx2", "avx512"};
+
+static int write_json(const char* file_name, const Result* results,
+                      size_t count) {
+    FILE* file = fopen(file_name, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    fprintf(file, "{\n  \"cpu_level\": \"%s\",\n  \"benchmarks\": [\n",
+            level_names[Cubc_GetCpuLevel()]);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file,
+                "    {\"name\": \"%s\", \"ns_per_op\": %.3f, "
+                "\"ops_per_sec\": %.3f, \"pixels_per_sec\": %.1f}%s\n",
+                results[i].name, results[i].ns_per_op, results[i].ops_per_sec,
+                results[i].pixels_per_sec, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file);
+}
+
+typedef struct {
+    char name[64];
+    double ns_per_op;
+} Baseline;
+
+// Reads the entries of a file written by write_json, one per line.
+static size_t read_baseline(const char* file_name, Baseline* out,
+                            size_t capacity) {
+    FILE* file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "can't open baseline %s\n", file_name);
+        exit(2);
+    }
+    char line[512];
+    size_t count = 0;
+    while (count < capacity && fgets(line, sizeof(line), file)) {
+        const char* entry = strstr(line, "{\"name\"");
+        if (entry != NULL &&
+            sscanf(entry, "{\"name\": \"%63[^\"]\", \"ns_per_op\": %lf",
+                   out[count].name, &out[count].ns_per_op) == 2) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static const Baseline* find_baseline(const Baseline* baseline, size_t count,
+                                     const char* name) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(baseline[i].name, name) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--json FILE] [--baseline FILE] [--threshold PCT]\n"
+            "       [--filter TEXT] [--time SECONDS] [--cpu LEVEL]\n"
+            "       [--threads N]\n",
+            program);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char* json_file     = NULL;
+    const char* baseline_file = NULL;
+    const char* filter        = NULL;
+    double threshold          = 10;
+    double seconds            = 0.5;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) {
+            usage(argv[0]);
+        }
+        const char* value = argv[++i];
+        if (strcmp(argv[i - 1], "--json") == 0) {
+            json_file = value;
+        } else if (strcmp(argv[i - 1], "--baseline") == 0) {
+            baseline_file = value;
+        } else if (strcmp(argv[i - 1], "--threshold") == 0) {
+            threshold = atof(value);
+        } else if (strcmp(argv[i - 1], "--filter") == 0) {
+            filter = value;
+        } else if (strcmp(argv[i - 1], "--time") == 0) {
+            seconds = atof(value);
+        } else if (strcmp(argv[i - 1], "--threads") == 0) {
+            thread_count = (size_t) atoi(value);
+        } else if (strcmp(argv[i - 1], "--cpu") == 0) {
+            int level = 0;
+            while (level < 4 && strcmp(level_names[level], value) != 0) {
+                level++;
+            }
+            if (level == 4) {
+                usage(argv[0]);
+            }
+            if ((int) Cubc_SetCpuLevel((Cubc_CpuLevel) level) != level) {
+                fprintf(stderr, "%s isn't supported here, using %s\n", value,
+                        level_names[Cubc_GetCpuLevel()]);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    static Baseline baseline[256];
+    size_t baseline_count = 0;
+    if (baseline_file) {
+        baseline_count = read_baseline(baseline_file, baseline, 256);
+    }
+
+    rng_state            = 1;
+    target               = canvas_new(TARGET_W, TARGET_H, CUBC_FORMAT_RGBA8888);
+    target_565           = canvas_new(TARGET_W, TARGET_H, CUBC_FORMAT_RGB565);
+    sprite               = canvas_new(64, 64, CUBC_FORMAT_RGBA8888);
+    image                = canvas_new(512, 512, CUBC_FORMAT_RGBA8888);
+    sprite_premultiplied = canvas_new(64, 64, CUBC_FORMAT_RGBA8888);
+    fill_noise(&sprite);
+    fill_noise(&image);
+    memcpy(sprite_premultiplied.pixels, sprite.pixels, 64 * 64 * 4);
+    Cubc_CanvasPremultiply(&sprite_premultiplied);
+    null_fd = open("/dev/null", O_WRONLY);
+
+    size_t bench_count = sizeof(benches) / sizeof(benches[0]);
+    Result results[sizeof(benches) / sizeof(benches[0])];
+    size_t count = 0;
+    int slower   = 0;
+
+    printf("cpu level %s\n", level_names[Cubc_GetCpuLevel()]);
+    printf("%-26s %12s %12s %12s", "benchmark", "ns/op", "Mprims/s",
+           "Mpixels/s");
+    printf(baseline_count ? " %10s\n" : "\n", "baseline");
+    for (size_t i = 0; i < bench_count; i++) {
+        if (filter && strstr(benches[i].name, filter) == NULL) {
+            continue;
+        }
+        Result r = run_bench(&benches[i], seconds);
+        printf("%-26s %12.1f %12.3f %12.1f", r.name, r.ns_per_op,
+               r.ops_per_sec / 1e6, r.pixels_per_sec / 1e6);
+        const Baseline* base =
+            find_baseline(baseline, baseline_count, r.name);
+        if (base) {
+            double change = (r.ns_per_op / base->ns_per_op - 1) * 100;
+            bool regressed = change > threshold;
+            printf(" %+9.1f%%%s", change, regressed ? "  SLOWER" : "");
+            slower += regressed;
+        }
+        printf("\n");
+        fflush(stdout);
+        results[count++] = r;
+    }
+
+    if (json_file && write_json(json_file, results, count) != 0) {
+        fprintf(stderr, "can't write %s\n", json_file);
+        return 2;
+    }
+    if (slower) {
+        printf("%d benchmark%s slower than the baseline by more than %.0f%%\n",
+               slower, slower == 1 ? "" : "s", threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -14,5 +14,5 @@ int main() {
       .pixels = malloc(sizeof(uint32_t) * 600 * 600),
   };
   memset(canvas.pixels, 0, 600 * 600);
-  write_ppm(canvas, "testing_out.ppm");
+  Cubc_CanvasWritePPM(&canvas, "testing_out.ppm");
 }
@@ -0,0 +1,834 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CUBC_IMPLEMENTATION
+#include "../src/cub.c"
+
+// Renders a fixed set of scenes and compares them against the reference
+// images in golden/, run from this directory:
+//
+//   ./golden            check every scene
+//   ./golden --update   rewrite the references from the scalar kernels
+//
+// Each scene is drawn with the scalar kernels and compared against its
+// reference within the tolerance of the scene. It is then drawn again on
+// every faster CPU level and, unless it uses views, deferred on several
+// threads, which all have to match the scalar result exactly. Mismatching
+// images are written to the current directory as <scene>-<variant>.pam.
+// Exits with 1 on a mismatch.
+//
+// Options:
+//   --dir DIR         where the references live, golden by default
+//   --filter TEXT     only check the scenes whose name contains TEXT
+//   --update          write the references instead of comparing
+
+#define SCENE_W 64
+#define SCENE_H 64
+
+typedef struct {
+    const char* name;
+    void (*draw)(Cubc_Canvas* canvas);
+    // Largest channel difference allowed against the reference, for results
+    // that depend on float rounding.
+    int tolerance;
+    // Views draw immediately even on deferred canvases, so scenes that use
+    // them skip the deferred run.
+    bool immediate;
+} Scene;
+
+static Cubc_Canvas sprite;
+static Cubc_Canvas sprite_premultiplied;
+static Cubc_Canvas gradient;
+
+// Canvases a scene allocates stay alive until the scene has been drawn,
+// since deferred blits only reference their source.
+static Cubc_Canvas scratch[16];
+static size_t scratch_count;
+
+static uint64_t rng_state;
+
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) rng_state;
+}
+
+static Cubc_Color rgba(uint32_t color) {
+    return (Cubc_Color){.color = color};
+}
+
+static Cubc_Canvas canvas_new(size_t w, size_t h, Cubc_PixelFormat format) {
+    Cubc_Canvas canvas = {
+        .data   = calloc(w * h, Cubc_PixelFormatSize(format)),
+        .w      = w,
+        .h      = h,
+        .format = format,
+    };
+    if (canvas.data == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    return canvas;
+}
+
+static Cubc_Canvas* scratch_new(size_t w, size_t h, Cubc_PixelFormat format) {
+    if (scratch_count == sizeof(scratch) / sizeof(scratch[0])) {
+        fprintf(stderr, "too many scratch canvases\n");
+        exit(2);
+    }
+    scratch[scratch_count] = canvas_new(w, h, format);
+    return &scratch[scratch_count++];
+}
+
+static void scratch_free(void) {
+    for (size_t i = 0; i < scratch_count; i++) {
+        free(scratch[i].data);
+    }
+    scratch_count = 0;
+}
+
+// A checkerboard backdrop, so that blends and composites have something to
+// work against.
+static void backdrop(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x303848ff));
+    for (uint32_t y = 0; y < SCENE_H; y += 8) {
+        for (uint32_t x = (y / 8 % 2) * 8; x < SCENE_W; x += 16) {
+            Cubc_CanvasRect(canvas, x, y, 7, 7, rgba(0xc0a080ff));
+        }
+    }
+}
+
+static void scene_clear(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x204060ff));
+    Cubc_Canvas view = Cubc_CanvasView(canvas, 5, 7, 33, 21);
+    Cubc_CanvasClear(&view, rgba(0xe0c040ff));
+}
+
+static void scene_pixels(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    for (int i = 0; i < 400; i++) {
+        // Some land outside the canvas and have to be dropped.
+        Cubc_CanvasPixel(canvas, rnd() % (SCENE_W + 8), rnd() % (SCENE_H + 8),
+                         rgba(rnd() | 0xff));
+    }
+}
+
+static void scene_lines(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    // Every octant from the center, then lines that leave the canvas.
+    for (uint32_t i = 0; i < SCENE_W; i += 7) {
+        Cubc_CanvasLine(canvas, 32, 32, i, 0, rgba(0xff4040ff));
+        Cubc_CanvasLine(canvas, 32, 32, i, SCENE_H - 1, rgba(0x40ff40ff));
+        Cubc_CanvasLine(canvas, 32, 32, 0, i, rgba(0x4040ffff));
+        Cubc_CanvasLine(canvas, 32, 32, SCENE_W - 1, i, rgba(0xffff40ff));
+    }
+    Cubc_CanvasLine(canvas, 10, 60, 200, 20, rgba(0xffffffff));
+    Cubc_CanvasLine(canvas, 50, 3, 50, 500, rgba(0xff40ffff));
+    Cubc_CanvasLine(canvas, 3, 3, 3, 3, rgba(0x40ffffff));
+    Cubc_CanvasLine(canvas, 100, 100, 200, 150, rgba(0xffffffff));
+}
+
+// The lines of scene_lines in one batch, which has to draw the same pixels.
+static void scene_lines_batch(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    static uint32_t x0[64], y0[64], x1[64], y1[64];
+    static Cubc_Color colors[64];
+    size_t n = 0;
+    for (uint32_t i = 0; i < SCENE_W; i += 7) {
+        uint32_t ends[4][2] = {
+            {i, 0}, {i, SCENE_H - 1}, {0, i}, {SCENE_W - 1, i}};
+        uint32_t fan[4] = {0xff4040ff, 0x40ff40ff, 0x4040ffff, 0xffff40ff};
+        for (int j = 0; j < 4; j++) {
+            x0[n]       = 32;
+            y0[n]       = 32;
+            x1[n]       = ends[j][0];
+            y1[n]       = ends[j][1];
+            colors[n++] = rgba(fan[j]);
+        }
+    }
+    uint32_t rest[4][5] = {
+        {10, 60, 200, 20, 0xffffffff},
+        {50, 3, 50, 500, 0xff40ffff},
+        {3, 3, 3, 3, 0x40ffffff},
+        {100, 100, 200, 150, 0xffffffff},
+    };
+    for (int j = 0; j < 4; j++) {
+        x0[n]       = rest[j][0];
+        y0[n]       = rest[j][1];
+        x1[n]       = rest[j][2];
+        y1[n]       = rest[j][3];
+        colors[n++] = rgba(rest[j][4]);
+    }
+    Cubc_CanvasLines(canvas, x0, y0, x1, y1, colors, n, 2);
+}
+
+// A fan of translucent anti-aliased lines at fractional positions, crossing
+// each other and the canvas edges.
+static void draw_lines_aa(Cubc_Canvas* canvas) {
+    for (int i = 0; i < 24; i++) {
+        float angle = (float) i * 0.2618f + 0.1f;
+        float x     = 31.5f + cosf(angle) * 40;
+        float y     = 31.25f + sinf(angle) * 40;
+        Cubc_CanvasLineAA(canvas, 31.5f, 31.25f, x, y, rgba(rnd() | 0x80));
+    }
+    Cubc_CanvasLineAA(canvas, 2.25f, 60.5f, 61.75f, 57.0f, rgba(0xffffffff));
+    Cubc_CanvasLineAA(canvas, 60.6f, 2.2f, 60.6f, 20.8f, rgba(0xffff00ff));
+    Cubc_CanvasLineAA(canvas, 4.3f, 4.3f, 4.7f, 4.9f, rgba(0xff00ffff));
+    Cubc_CanvasLineAA(canvas, -1e6f, 10.5f, 1e6f, 12.5f, rgba(0x00ffffc0));
+}
+
+static void scene_lines_aa(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    draw_lines_aa(canvas);
+}
+
+static void scene_lines_aa_premultiplied(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_CanvasPremultiply(canvas);
+    draw_lines_aa(canvas);
+    Cubc_CanvasUnpremultiply(canvas);
+}
+
+// One zigzag per join, each with a different cap, then closed, sharp and
+// clipped strokes. Every stroke is translucent, so overdraw would show.
+static void scene_polylines(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    static const Cubc_V2f zigzag[] = {{6, 14}, {18, 4}, {30, 14}, {42, 4}};
+    static const Cubc_LineJoin joins[] = {CUBC_JOIN_MITER, CUBC_JOIN_ROUND,
+                                          CUBC_JOIN_BEVEL};
+    static const Cubc_LineCap caps[] = {CUBC_CAP_BUTT, CUBC_CAP_ROUND,
+                                        CUBC_CAP_SQUARE};
+    // Deferred drawing reads the points when the commands run.
+    static Cubc_V2f points[3][4];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            points[i][j] = (Cubc_V2f){zigzag[j].x + 0.5f * (float) i,
+                                      zigzag[j].y + 14.25f * (float) i};
+        }
+        Cubc_CanvasPolyline(canvas, points[i], 4, false, 5, joins[i], caps[i],
+                            rgba(rnd() | 0x90));
+    }
+    static const Cubc_V2f triangle[] = {{48, 6}, {60, 30}, {46, 24}};
+    Cubc_CanvasPolyline(canvas, triangle, 3, true, 3.5f, CUBC_JOIN_MITER,
+                        CUBC_CAP_BUTT, rgba(0xffd040a0));
+    // Too sharp for a miter, so it falls back to a bevel.
+    static const Cubc_V2f sharp[] = {{8, 60}, {30, 52}, {8, 56}};
+    Cubc_CanvasPolyline(canvas, sharp, 3, false, 4, CUBC_JOIN_MITER,
+                        CUBC_CAP_BUTT, rgba(0x40ff80c0));
+    Cubc_CanvasThickLine(canvas, 40, 44, 80, 70, 9, CUBC_CAP_ROUND,
+                         rgba(0x8080ffa0));
+    Cubc_CanvasThickLine(canvas, 56.5f, 40.5f, 56.5f, 40.5f, 6, CUBC_CAP_ROUND,
+                         rgba(0xffffffc0));
+}
+
+// A pentagram by both fill rules, a frame whose hole only one rule cuts, two
+// polygons sharing an edge, and a concave shape hanging over the corner.
+static void scene_polygons(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    // Deferred drawing reads the points when the commands run.
+    static const Cubc_V2f star[2][5] = {
+        {{16, 2}, {25.4f, 28.9f}, {1.7f, 12.4f}, {30.3f, 12.4f},
+         {6.6f, 28.9f}},
+        {{48, 2}, {57.4f, 28.9f}, {33.7f, 12.4f}, {62.3f, 12.4f},
+         {38.6f, 28.9f}},
+    };
+    static const size_t star_count = 5;
+    Cubc_CanvasPolygon(canvas, star[0], &star_count, 1, CUBC_FILL_NONZERO,
+                       rgba(0xffc040ff));
+    Cubc_CanvasPolygon(canvas, star[1], &star_count, 1, CUBC_FILL_EVEN_ODD,
+                       rgba(0xffc040ff));
+    // Both contours of a frame run the same way, so only even-odd leaves
+    // the hole.
+    static const Cubc_V2f frames[2][8] = {
+        {{2, 33}, {16, 33}, {16, 47}, {2, 47},
+         {6.5f, 37.5f}, {11.5f, 37.5f}, {11.5f, 42.5f}, {6.5f, 42.5f}},
+        {{2, 49}, {16, 49}, {16, 63}, {2, 63},
+         {6.5f, 53.5f}, {11.5f, 53.5f}, {11.5f, 58.5f}, {6.5f, 58.5f}},
+    };
+    static const size_t frame_counts[] = {4, 4};
+    Cubc_CanvasPolygon(canvas, frames[0], frame_counts, 2, CUBC_FILL_NONZERO,
+                       rgba(0x40a0ffff));
+    Cubc_CanvasPolygon(canvas, frames[1], frame_counts, 2, CUBC_FILL_EVEN_ODD,
+                       rgba(0x40ff80ff));
+    static const Cubc_V2f halves[2][4] = {
+        {{20, 33}, {36.3f, 33}, {27.7f, 52.6f}, {20, 52.6f}},
+        {{36.3f, 33}, {42, 33}, {42, 52.6f}, {27.7f, 52.6f}},
+    };
+    static const size_t half_count = 4;
+    Cubc_CanvasPolygon(canvas, halves[0], &half_count, 1, CUBC_FILL_NONZERO,
+                       rgba(0xff4080ff));
+    Cubc_CanvasPolygon(canvas, halves[1], &half_count, 1, CUBC_FILL_NONZERO,
+                       rgba(0x8040ffff));
+    static const Cubc_V2f hook[] = {{50, 40}, {70, 36}, {70, 70}, {22, 70},
+                                    {22, 57}, {56, 61}, {58, 46}, {46, 50}};
+    static const size_t hook_count = 8;
+    Cubc_CanvasPolygon(canvas, hook, &hook_count, 1, CUBC_FILL_NONZERO,
+                       rgba(0xe0e0e0ff));
+}
+
+static void scene_paths(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    // Deferred drawing reads the paths when the commands run, so they are
+    // built once and kept.
+    static Cubc_Path paths[4];
+    if (paths[0].verb_count == 0) {
+        // A ring from two cubic circles wound the same way, so only
+        // even-odd leaves the hole.
+        for (int i = 0; i < 2; i++) {
+            Cubc_Path* ring = &paths[i];
+            float      cx   = 16 + 32 * i, cy = 16;
+            for (int j = 0; j < 2; j++) {
+                float r = j == 0 ? 14 : 7, k = r * 0.5523f;
+                Cubc_PathMoveTo(ring, cx + r, cy);
+                Cubc_PathCubicTo(ring, cx + r, cy + k, cx + k, cy + r, cx,
+                                 cy + r);
+                Cubc_PathCubicTo(ring, cx - k, cy + r, cx - r, cy + k,
+                                 cx - r, cy);
+                Cubc_PathCubicTo(ring, cx - r, cy - k, cx - k, cy - r, cx,
+                                 cy - r);
+                Cubc_PathCubicTo(ring, cx + k, cy - r, cx + r, cy - k,
+                                 cx + r, cy);
+                Cubc_PathClose(ring);
+            }
+        }
+        // A leaf of quadratics with a sliver of a triangle.
+        Cubc_PathMoveTo(&paths[2], 3.5f, 60.5f);
+        Cubc_PathQuadTo(&paths[2], 4, 34, 28.5f, 35.25f);
+        Cubc_PathQuadTo(&paths[2], 28, 60, 3.5f, 60.5f);
+        Cubc_PathMoveTo(&paths[2], 20, 62);
+        Cubc_PathLineTo(&paths[2], 30, 62);
+        Cubc_PathLineTo(&paths[2], 20, 62.6f);
+        // A wave that runs off the right and bottom edges.
+        Cubc_PathMoveTo(&paths[3], 34, 70);
+        Cubc_PathLineTo(&paths[3], 34, 36);
+        Cubc_PathCubicTo(&paths[3], 42, -20, 52, 68, 72, 16);
+        Cubc_PathLineTo(&paths[3], 72, 70);
+    }
+    Cubc_CanvasFillPath(canvas, &paths[0], CUBC_FILL_NONZERO,
+                        rgba(0x40a0ffff));
+    Cubc_CanvasFillPath(canvas, &paths[1], CUBC_FILL_EVEN_ODD,
+                        rgba(0x40ff80ff));
+    Cubc_CanvasFillPath(canvas, &paths[2], CUBC_FILL_NONZERO,
+                        rgba(0xffc040ff));
+    // Translucent, over the right ring.
+    Cubc_CanvasFillPath(canvas, &paths[3], CUBC_FILL_NONZERO,
+                        rgba(0xff408080));
+}
+
+static void scene_curves(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    Cubc_CanvasQuadBezier(canvas, 2, 30, 16, -10, 30, 30, rgba(0xffc040ff));
+    // A loop, a cusp and a curve along one line that turns back.
+    Cubc_CanvasCubicBezier(canvas, 34, 4, 70, 30, 30, 30, 62, 4,
+                           rgba(0x40a0ffff));
+    Cubc_CanvasCubicBezier(canvas, 34, 32, 62, 10, 34, 10, 62, 32,
+                           rgba(0x40ff80ff));
+    Cubc_CanvasQuadBezier(canvas, 4, 34, 28, 40, 16, 37, rgba(0xffffffff));
+    // Nearly flat, tiny and clipped ones.
+    Cubc_CanvasCubicBezier(canvas, 2, 44, 20, 44.5f, 40, 43.5f, 62, 44,
+                           rgba(0xff4080ff));
+    Cubc_CanvasQuadBezier(canvas, 50, 38, 50.4f, 38.2f, 50.1f, 38.4f,
+                          rgba(0xffffffff));
+    Cubc_CanvasCubicBezier(canvas, -20, 70, 10, 20, 40, 90, 90, 50,
+                           rgba(0xc080ffff));
+
+    // Deferred drawing reads the paths when the commands run, so they are
+    // built once and kept.
+    static Cubc_Path paths[2];
+    if (paths[0].verb_count == 0) {
+        Cubc_PathMoveTo(&paths[0], 6, 50);
+        Cubc_PathCubicTo(&paths[0], 6, 62, 26, 62, 26, 50);
+        Cubc_PathQuadTo(&paths[0], 16, 56, 6, 50);
+        Cubc_PathClose(&paths[0]);
+        Cubc_PathMoveTo(&paths[1], 32, 60);
+        Cubc_PathQuadTo(&paths[1], 44, 36, 56, 60);
+        Cubc_PathLineTo(&paths[1], 60, 52);
+        Cubc_PathMoveTo(&paths[1], 36, 52);
+        Cubc_PathLineTo(&paths[1], 52, 52);
+    }
+    Cubc_CanvasStrokePath(canvas, &paths[0], 3, CUBC_JOIN_MITER,
+                          CUBC_CAP_BUTT, rgba(0x40ff80c0));
+    // Translucent, with both subpaths over each other.
+    Cubc_CanvasStrokePath(canvas, &paths[1], 4, CUBC_JOIN_ROUND,
+                          CUBC_CAP_SQUARE, rgba(0xff408080));
+}
+
+static void scene_ellipses(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    Cubc_CanvasEllipse(canvas, 14, 10, 12, 7, rgba(0xff8000ff));
+    Cubc_CanvasWireframeEllipse(canvas, 14, 10, 12, 7, rgba(0xffffffff));
+    Cubc_CanvasWireframeCircle(canvas, 46, 10, 8, rgba(0x00c0ffff));
+    Cubc_CanvasCircle(canvas, 46, 10, 3, rgba(0x00c0ffff));
+    Cubc_CanvasCircle(canvas, 58, 2, 0, rgba(0xffffffff));
+    // Slices of one pie, the last ending before it starts, and an arc.
+    Cubc_CanvasPie(canvas, 12, 30, 9, 0, 2, rgba(0xff4040ff));
+    Cubc_CanvasPie(canvas, 12, 30, 9, 2, 4.5f, rgba(0x40ff40ff));
+    Cubc_CanvasPie(canvas, 12, 30, 9, 4.5f, 0, rgba(0x4040ffff));
+    Cubc_CanvasArc(canvas, 34, 30, 9, -2.5f, 1, rgba(0xffff40ff));
+    // Clipped by the canvas.
+    Cubc_CanvasCircle(canvas, 60, 30, 7, rgba(0xc080ffff));
+
+    Cubc_CanvasCircleAA(canvas, 8.5f, 52, 6.5f, rgba(0xffffffff));
+    Cubc_CanvasEllipseAA(canvas, 26.3f, 52.5f, 9, 4.5f, rgba(0xff8000c0));
+    // A gauge, and translucent slices over each other.
+    Cubc_CanvasArcAA(canvas, 50, 50, 10, 3, 2.356f, 7.069f,
+                     rgba(0x40ff80ff));
+    Cubc_CanvasPieAA(canvas, 50, 50, 6, -1, 1.5f, rgba(0xff4080c0));
+    Cubc_CanvasPieAA(canvas, 50, 50, 6, 1, 3, rgba(0x4080ff80));
+    Cubc_CanvasCircleAA(canvas, -2, 40, 5, rgba(0xffff40ff));
+}
+
+static void scene_wireframe_triangles(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    Cubc_CanvasWireframeTriangle(canvas, 4, 4, 60, 10, 20, 58,
+                                 rgba(0xff8000ff));
+    Cubc_CanvasWireframeTriangle(canvas, 30, 30, 90, 40, 40, 80,
+                                 rgba(0x00c0ffff));
+    Cubc_CanvasWireframeTriangle(canvas, 10, 40, 11, 41, 12, 40,
+                                 rgba(0xffffffff));
+}
+
+static void scene_triangles(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    // Vertices far off the canvas: one covering all of it, and a wedge.
+    Cubc_CanvasTriangle(canvas, 0, 0, UINT32_MAX, 0, 0, UINT32_MAX,
+                        rgba(0x202040ff));
+    Cubc_CanvasTriangle(canvas, 70, 0, 0, 70, UINT32_MAX, UINT32_MAX - 9,
+                        rgba(0x406020ff));
+    Cubc_CanvasTriangle(canvas, 2, 2, 61, 9, 18, 60, rgba(0xff8000ff));
+    // Clipped on two sides.
+    Cubc_CanvasTriangle(canvas, 40, 20, 120, 50, 30, 100, rgba(0x00c0ffff));
+    // Tiny, flat and degenerate ones.
+    Cubc_CanvasTriangle(canvas, 5, 50, 7, 52, 5, 53, rgba(0xffffffff));
+    Cubc_CanvasTriangle(canvas, 10, 40, 30, 40, 20, 40, rgba(0xff00ffff));
+    Cubc_CanvasTriangle(canvas, 50, 5, 50, 5, 50, 5, rgba(0xffff00ff));
+    for (int i = 0; i < 24; i++) {
+        uint32_t x = rnd() % 56, y = rnd() % 56;
+        Cubc_CanvasTriangle(canvas, x, y, x + rnd() % 8, y + rnd() % 8,
+                            x + rnd() % 8, y + rnd() % 8, rgba(rnd() | 0xff));
+    }
+}
+
+static void scene_rects(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    Cubc_CanvasRect(canvas, 4, 4, 20, 12, rgba(0xff0000ff));
+    Cubc_CanvasRect(canvas, 50, 40, 100, 100, rgba(0x00ff00ff));
+    Cubc_CanvasRect(canvas, 10, 30, 0, 0, rgba(0xffffffff));
+    Cubc_CanvasRect(canvas, 30, 10, 1, 40, rgba(0x0080ffff));
+    Cubc_CanvasRect(canvas, 200, 200, 10, 10, rgba(0xffffffff));
+    Cubc_CanvasRectR(canvas, (Cubc_Rect){12, 44, 25.5f, 9.5f},
+                     rgba(0x80408020));
+}
+
+static void scene_rounded_rects(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x000000ff));
+    Cubc_CanvasRoundedRect(canvas, 2, 2, 27, 17, (Cubc_Corners){6, 6, 6, 6},
+                           rgba(0xff8000ff));
+    // Mixed corners, one of them square, and a pill scaled down to fit.
+    Cubc_CanvasRoundedRect(canvas, 33, 2, 28, 17, (Cubc_Corners){0, 4, 9, 2},
+                           rgba(0x00c0ffff));
+    Cubc_CanvasRoundedRect(canvas, 2, 23, 40, 8,
+                           (Cubc_Corners){100, 100, 100, 100},
+                           rgba(0xffffffff));
+    // Clipped by the canvas.
+    Cubc_CanvasRoundedRect(canvas, 48, 23, 30, 10, (Cubc_Corners){5, 5, 5, 5},
+                           rgba(0xc080ffff));
+
+    Cubc_CanvasRoundedRectAA(canvas, 2.5f, 36.3f, 28, 12.4f,
+                             (Cubc_Corners){4, 4, 4, 4}, rgba(0xffffffff));
+    Cubc_CanvasRoundedRectAA(canvas, 34.2f, 37, 26, 24,
+                             (Cubc_Corners){12, 2, 0, 7.5f},
+                             rgba(0x40ff80c0));
+    // Translucent over the first.
+    Cubc_CanvasRoundedRectAA(canvas, 12, 44, 20, 16,
+                             (Cubc_Corners){8, 8, 8, 8}, rgba(0xff408080));
+}
+
+static void scene_blit(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_CanvasBlitCanvas(canvas, &gradient, 2, 2, 1, 1);
+    Cubc_CanvasBlitCanvas(canvas, &sprite, 30, 2, 2, 2);
+    Cubc_CanvasBlitCanvas(canvas, &gradient, 2, 30, 0.5f, 0.5f);
+    Cubc_CanvasBlitCanvas(canvas, &gradient, 20, 34, 1.37f, 0.8f);
+    // Clipped at the right and bottom edges.
+    Cubc_CanvasBlitCanvas(canvas, &sprite, 56, 56, 1, 1);
+}
+
+static void scene_blit_alpha(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_CanvasBlitCanvasAlpha(canvas, &sprite, 2, 2, 1, 1,
+                               CUBC_ALPHA_STRAIGHT);
+    Cubc_CanvasBlitCanvasAlpha(canvas, &sprite_premultiplied, 22, 2, 1, 1,
+                               CUBC_ALPHA_PREMULTIPLIED);
+    Cubc_CanvasBlitCanvasAlpha(canvas, &sprite, 2, 22, 2.5f, 2.5f,
+                               CUBC_ALPHA_STRAIGHT);
+    Cubc_CanvasBlitCanvasAlpha(canvas, &sprite_premultiplied, 44, 44, 1.5f,
+                               1.5f, CUBC_ALPHA_PREMULTIPLIED);
+}
+
+static void scene_blit_sliced(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_Insets insets = {5, 5, 5, 5};
+    Cubc_CanvasBlitCanvasSliced(canvas, &sprite, 2, 2, 40, 20, insets);
+    // Narrower than the borders, which shrink to fit.
+    Cubc_CanvasBlitCanvasSliced(canvas, &sprite, 46, 2, 7, 30, insets);
+    Cubc_CanvasBlitCanvasSlicedAlpha(canvas, &sprite, 2, 26, 36, 26,
+                                     (Cubc_Insets){3, 6, 8, 2},
+                                     CUBC_ALPHA_STRAIGHT);
+    // Clipped at the right and bottom edges.
+    Cubc_CanvasBlitCanvasSliced(canvas, &gradient, 44, 40, 40, 40,
+                                (Cubc_Insets){4, 4, 4, 4});
+}
+
+static void scene_blit_bilinear(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_CanvasBlitCanvasFiltered(canvas, &gradient, 0, 0, 2.5f, 1.5f,
+                                  CUBC_FILTER_BILINEAR);
+    Cubc_CanvasBlitCanvasFiltered(canvas, &sprite, 20, 38, 1.6f, 1.6f,
+                                  CUBC_FILTER_BILINEAR);
+}
+
+static void scene_blit_bicubic(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_CanvasBlitCanvasFiltered(canvas, &gradient, 0, 0, 2.5f, 1.5f,
+                                  CUBC_FILTER_BICUBIC);
+    Cubc_CanvasBlitCanvasFiltered(canvas, &sprite, 20, 38, 1.6f, 1.6f,
+                                  CUBC_FILTER_BICUBIC);
+}
+
+static void scene_blit_box(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_Canvas* big = scratch_new(200, 120, CUBC_FORMAT_RGBA8888);
+    Cubc_CanvasBlitCanvas(big, &gradient, 0, 0, 200.0f / 24, 5);
+    Cubc_CanvasBlitCanvas(big, &sprite, 40, 20, 5, 5);
+    Cubc_CanvasBlitCanvasFiltered(canvas, big, 0, 0, 0.3f, 0.3f,
+                                  CUBC_FILTER_BOX);
+    Cubc_CanvasBlitCanvasFiltered(canvas, big, 4, 40, 0.1f, 0.15f,
+                                  CUBC_FILTER_BOX);
+}
+
+static void scene_blend_modes(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    for (int mode = CUBC_BLEND_NORMAL; mode <= CUBC_BLEND_SOFT_LIGHT; mode++) {
+        Cubc_CanvasBlendCanvas(canvas, &sprite, 2 + mode % 3 * 20,
+                               4 + mode / 3 * 30, (Cubc_BlendMode) mode);
+    }
+}
+
+static void scene_composite(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_CanvasPremultiply(canvas);
+    for (int op = CUBC_COMPOSITE_CLEAR; op <= CUBC_COMPOSITE_PLUS; op++) {
+        Cubc_CanvasComposite(canvas, &sprite_premultiplied, op % 4 * 16,
+                             op / 4 * 16, (Cubc_CompositeOp) op);
+    }
+    // Straight sources are converted on the fly.
+    Cubc_CanvasComposite(canvas, &sprite, 40, 48, CUBC_COMPOSITE_SRC_ATOP);
+    Cubc_CanvasUnpremultiply(canvas);
+}
+
+static void scene_composite_rect(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    Cubc_CanvasPremultiply(canvas);
+    for (int op = CUBC_COMPOSITE_CLEAR; op <= CUBC_COMPOSITE_PLUS; op++) {
+        Cubc_CanvasCompositeRect(canvas, op % 4 * 16 + 2, op / 4 * 16 + 2, 12,
+                                 12, rgba(0x40200080), (Cubc_CompositeOp) op);
+    }
+    Cubc_CanvasUnpremultiply(canvas);
+}
+
+static void scene_premultiply(Cubc_Canvas* canvas) {
+    Cubc_CanvasBlitCanvas(canvas, &gradient, 0, 0, 64.0f / 24, 64.0f / 24);
+    Cubc_CanvasBlitCanvas(canvas, &sprite, 8, 8, 3, 3);
+    Cubc_CanvasPremultiply(canvas);
+    Cubc_CanvasRect(canvas, 0, 0, 8, 8, rgba(0x80808080));
+    Cubc_CanvasUnpremultiply(canvas);
+}
+
+static void scene_views(Cubc_Canvas* canvas) {
+    backdrop(canvas);
+    // Nested views draw with the stride of the canvas and clip to their own
+    // bounds.
+    Cubc_Canvas outer = Cubc_CanvasView(canvas, 8, 8, 48, 40);
+    Cubc_Canvas inner = Cubc_CanvasView(&outer, 30, 20, 40, 40);
+    Cubc_CanvasClear(&outer, rgba(0x102030ff));
+    Cubc_CanvasTriangle(&outer, 0, 0, 60, 10, 10, 50, rgba(0xff8000ff));
+    Cubc_CanvasLine(&outer, 0, 39, 47, 0, rgba(0xffffffff));
+    Cubc_CanvasClear(&inner, rgba(0x00ff0080));
+    Cubc_CanvasBlitCanvasAlpha(&inner, &sprite, 2, 2, 1, 1,
+                               CUBC_ALPHA_STRAIGHT);
+}
+
+static void draw_primitives(Cubc_Canvas* canvas) {
+    Cubc_CanvasClear(canvas, rgba(0x20406080));
+    Cubc_CanvasRect(canvas, 4, 4, 24, 16, rgba(0xff000080));
+    Cubc_CanvasTriangle(canvas, 30, 2, 62, 30, 20, 50, rgba(0x00ff00ff));
+    Cubc_CanvasLine(canvas, 0, 63, 63, 20, rgba(0xffffffff));
+    Cubc_CanvasLineAA(canvas, 0.5f, 40.25f, 63.5f, 60.75f, rgba(0x80ffffc0));
+    Cubc_CanvasThickLine(canvas, 6, 34, 24, 58, 5, CUBC_CAP_ROUND,
+                         rgba(0xff80ffa0));
+    Cubc_CanvasPixel(canvas, 60, 60, rgba(0xffff00ff));
+    Cubc_CanvasBlitCanvas(canvas, &sprite, 40, 44, 1, 1);
+}
+
+// Draws into a canvas of `format` and blits the result back.
+static void draw_format(Cubc_Canvas* canvas, Cubc_PixelFormat format) {
+    Cubc_Canvas* target = scratch_new(SCENE_W, SCENE_H, format);
+    draw_primitives(target);
+    Cubc_CanvasBlitCanvas(canvas, target, 0, 0, 1, 1);
+}
+
+static void scene_format_bgra(Cubc_Canvas* canvas) {
+    draw_format(canvas, CUBC_FORMAT_BGRA8888);
+}
+
+static void scene_format_rgb565(Cubc_Canvas* canvas) {
+    draw_format(canvas, CUBC_FORMAT_RGB565);
+}
+
+static void scene_format_a8(Cubc_Canvas* canvas) {
+    draw_format(canvas, CUBC_FORMAT_A8);
+}
+
+static void scene_format_rgba16f(Cubc_Canvas* canvas) {
+    draw_format(canvas, CUBC_FORMAT_RGBA16F);
+}
+
+// Converts rows of noise to every format and back, one band per format.
+static void scene_convert(Cubc_Canvas* canvas) {
+    static const Cubc_PixelFormat formats[] = {
+        CUBC_FORMAT_RGBA8888, CUBC_FORMAT_BGRA8888, CUBC_FORMAT_RGB565,
+        CUBC_FORMAT_A8,       CUBC_FORMAT_RGBA16F,
+    };
+    uint64_t buffer[SCENE_W];
+    for (uint32_t y = 0; y < SCENE_H; y++) {
+        uint32_t* row = &CUBC_CANVAS_AT(*canvas, 0, y);
+        for (uint32_t x = 0; x < SCENE_W; x++) {
+            row[x] = rnd();
+        }
+        Cubc_PixelFormat format = formats[y * 5 / SCENE_H];
+        Cubc_PixelsConvert(buffer, format, row, CUBC_FORMAT_RGBA8888, SCENE_W);
+        Cubc_PixelsConvert(row, CUBC_FORMAT_RGBA8888, buffer, format, SCENE_W);
+    }
+}
+
+static const Scene scenes[] = {
+    {"clear", scene_clear, 0, true},
+    {"pixels", scene_pixels, 0, false},
+    {"lines", scene_lines, 0, false},
+    {"lines_batch", scene_lines_batch, 0, false},
+    {"lines_aa", scene_lines_aa, 0, false},
+    {"lines_aa_premultiplied", scene_lines_aa_premultiplied, 0, false},
+    {"polylines", scene_polylines, 0, false},
+    {"polygons", scene_polygons, 0, false},
+    {"paths", scene_paths, 0, false},
+    {"curves", scene_curves, 0, false},
+    {"ellipses", scene_ellipses, 0, false},
+    {"wireframe_triangles", scene_wireframe_triangles, 0, false},
+    {"triangles", scene_triangles, 0, false},
+    {"rects", scene_rects, 0, false},
+    {"rounded_rects", scene_rounded_rects, 0, false},
+    {"blit", scene_blit, 0, false},
+    {"blit_alpha", scene_blit_alpha, 0, false},
+    {"blit_sliced", scene_blit_sliced, 0, false},
+    {"blit_bilinear", scene_blit_bilinear, 1, false},
+    {"blit_bicubic", scene_blit_bicubic, 1, false},
+    {"blit_box", scene_blit_box, 1, false},
+    {"blend_modes", scene_blend_modes, 0, false},
+    {"composite", scene_composite, 0, false},
+    {"composite_rect", scene_composite_rect, 0, false},
+    {"premultiply", scene_premultiply, 0, false},
+    {"views", scene_views, 0, true},
+    {"format_bgra", scene_format_bgra, 0, false},
+    {"format_rgb565", scene_format_rgb565, 0, false},
+    {"format_a8", scene_format_a8, 0, false},
+    {"format_rgba16f", scene_format_rgba16f, 0, false},
+    {"convert", scene_convert, 0, false},
+};
+
+// Draws `scene` into `canvas` on the current CPU level, recording it first
+// when `threads` isn't 0.
+static void render(const Scene* scene, Cubc_Canvas* canvas, size_t threads) {
+    // Every variant sees the same random numbers.
+    rng_state = 0x9e3779b97f4a7c15ull;
+    memset(canvas->pixels, 0, SCENE_W * SCENE_H * sizeof(uint32_t));
+    Cubc_CommandList list = {0};
+    if (threads) {
+        Cubc_CanvasBeginDeferred(canvas, &list);
+    }
+    scene->draw(canvas);
+    if (threads) {
+        Cubc_CanvasEndDeferred(canvas, threads);
+        Cubc_CommandListFree(&list);
+    }
+    scratch_free();
+}
+
+// Reads a PAM file as written by Cubc_CanvasWritePAM.
+static int read_pam(const char* file_name, Cubc_Canvas* canvas) {
+    FILE* file = fopen(file_name, "rb");
+    if (file == NULL) {
+        return 1;
+    }
+    size_t w, h;
+    int result = 1;
+    if (fscanf(file,
+               "P7\nWIDTH %zu\nHEIGHT %zu\nDEPTH 4\nMAXVAL 255\n"
+               "TUPLTYPE RGB_ALPHA\nENDHDR",
+               &w, &h) == 2 &&
+        fgetc(file) == '\n' && w == canvas->w && h == canvas->h) {
+        result = 0;
+        for (size_t i = 0; i < w * h && result == 0; i++) {
+            uint8_t p[4];
+            if (fread(p, 1, 4, file) != 4) {
+                result = 1;
+            }
+            canvas->pixels[i] = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+                                (uint32_t) p[2] << 8 | p[3];
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+// Returns the largest channel difference between the two canvases and counts
+// the pixels that differ by more than `tolerance`.
+static int compare(const Cubc_Canvas* a, const Cubc_Canvas* b, int tolerance,
+                   size_t* bad) {
+    int max = 0;
+    *bad    = 0;
+    for (size_t i = 0; i < a->w * a->h; i++) {
+        int diff = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            int d = abs((int) (a->pixels[i] >> shift & 0xff) -
+                        (int) (b->pixels[i] >> shift & 0xff));
+            diff  = d > diff ? d : diff;
+        }
+        max   = diff > max ? diff : max;
+        *bad += diff > tolerance;
+    }
+    return max;
+}
+
+// Compares `actual` with `expected` and writes it out on a mismatch.
+static bool check(const Scene* scene, const char* variant,
+                  const Cubc_Canvas* actual, const Cubc_Canvas* expected,
+                  int tolerance) {
+    size_t bad;
+    int max = compare(actual, expected, tolerance, &bad);
+    if (bad == 0) {
+        return true;
+    }
+    char file_name[256];
+    snprintf(file_name, sizeof(file_name), "%s-%s.pam", scene->name, variant);
+    Cubc_CanvasWritePAM(actual, file_name);
+    printf("FAIL %-22s %-10s %zu pixels off by up to %d, wrote %s\n",
+           scene->name, variant, bad, max, file_name);
+    return false;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--dir DIR] [--filter TEXT] [--update]\n",
+            program);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char* dir    = "golden";
+    const char* filter = NULL;
+    bool update        = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    static const char* level_names[] = {"scalar", "sse2", "avx2", "avx512"};
+    Cubc_CpuLevel fastest            = Cubc_CpuDetect();
+
+    rng_state            = 1;
+    sprite               = canvas_new(16, 16, CUBC_FORMAT_RGBA8888);
+    sprite_premultiplied = canvas_new(16, 16, CUBC_FORMAT_RGBA8888);
+    gradient             = canvas_new(24, 24, CUBC_FORMAT_RGBA8888);
+    for (uint32_t y = 0; y < 16; y++) {
+        for (uint32_t x = 0; x < 16; x++) {
+            // A translucent disc with opaque and transparent noise around it.
+            uint32_t dx = x * 2 - 15, dy = y * 2 - 15;
+            uint32_t d  = dx * dx + dy * dy;
+            uint32_t a  = d < 100 ? 0xff : d < 200 ? 0x80 : rnd() % 3 * 0x7f;
+            CUBC_CANVAS_AT(sprite, x, y) = (rnd() & 0xffffff00) | a;
+        }
+    }
+    for (uint32_t y = 0; y < 24; y++) {
+        for (uint32_t x = 0; x < 24; x++) {
+            CUBC_CANVAS_AT(gradient, x, y) =
+                (x * 11) << 24 | (y * 11) << 16 | ((x + y) * 5) << 8 | 0xff;
+        }
+    }
+    memcpy(sprite_premultiplied.pixels, sprite.pixels, 16 * 16 * 4);
+    Cubc_CanvasPremultiply(&sprite_premultiplied);
+
+    Cubc_Canvas reference = canvas_new(SCENE_W, SCENE_H, CUBC_FORMAT_RGBA8888);
+    Cubc_Canvas scalar    = canvas_new(SCENE_W, SCENE_H, CUBC_FORMAT_RGBA8888);
+    Cubc_Canvas actual    = canvas_new(SCENE_W, SCENE_H, CUBC_FORMAT_RGBA8888);
+    size_t failed         = 0;
+    size_t checked        = 0;
+    for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+        const Scene* scene = &scenes[i];
+        if (filter && strstr(scene->name, filter) == NULL) {
+            continue;
+        }
+        char file_name[256];
+        snprintf(file_name, sizeof(file_name), "%s/%s.pam", dir, scene->name);
+
+        Cubc_SetCpuLevel(CUBC_CPU_SCALAR);
+        render(scene, &scalar, 0);
+        if (update) {
+            if (Cubc_CanvasWritePAM(&scalar, file_name) != 0) {
+                fprintf(stderr, "can't write %s\n", file_name);
+                return 2;
+            }
+            printf("wrote %s\n", file_name);
+            continue;
+        }
+
+        bool ok = true;
+        if (read_pam(file_name, &reference) != 0) {
+            printf("FAIL %-22s missing or unreadable %s\n", scene->name,
+                   file_name);
+            ok = false;
+        } else {
+            ok &= check(scene, "reference", &scalar, &reference,
+                        scene->tolerance);
+        }
+        for (int level = CUBC_CPU_SSE2; level <= (int) fastest; level++) {
+            Cubc_SetCpuLevel((Cubc_CpuLevel) level);
+            render(scene, &actual, 0);
+            ok &= check(scene, level_names[level], &actual, &scalar, 0);
+        }
+        Cubc_SetCpuLevel(fastest);
+        if (!scene->immediate) {
+            render(scene, &actual, 3);
+            ok &= check(scene, "deferred", &actual, &scalar, 0);
+        }
+
+        printf("%s %s\n", ok ? "ok  " : "FAIL", scene->name);
+        failed += !ok;
+        checked++;
+    }
+    if (!update) {
+        printf("%zu of %zu scenes passed on scalar to %s\n", checked - failed,
+               checked, level_names[fastest]);
+    }
+    return failed != 0;
+}
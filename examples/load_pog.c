@@ -14,6 +14,7 @@ int main() {
         .pixels = malloc(sizeof(uint32_t) * pog.w * pog.h),
     };
     memset(canvas.pixels, 0, canvas.h * canvas.w);
-    Cubc_CanvasBlitCanvas(&canvas, &pog, 100, 100, 0.5, 0.5);
-    write_ppm(canvas, "testing_out.ppm");
+    Cubc_CanvasBlitCanvasFiltered(&canvas, &pog, 100, 100, 0.5, 0.5,
+                                  CUBC_FILTER_BOX);
+    Cubc_CanvasWritePPM(&canvas, "testing_out.ppm");
 }
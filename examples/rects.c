@@ -16,5 +16,5 @@ int main() {
   memset(canvas.pixels, 0, 600 * 600);
 
   Cubc_CanvasRect(&canvas, 100, 100, 128, 128, CC_GREEN);
-  write_ppm(canvas, "testing_out.ppm");
+  Cubc_CanvasWritePPM(&canvas, "testing_out.ppm");
 }
@@ -0,0 +1,31 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CUBC_IMPLEMENTATION
+#include "../src/cub.c"
+
+// Writes a short animation as YUV4MPEG2 to stdout, for example:
+// ./stream_frames | ffmpeg -i - out.mp4
+int main() {
+    Cubc_Canvas canvas = {
+        .w      = 640,
+        .h      = 360,
+        .pixels = malloc(sizeof(uint32_t) * 640 * 360),
+    };
+    Cubc_FrameWriter writer;
+    if (Cubc_FrameWriterOpen(&writer, STDOUT_FILENO, CUBC_FRAMES_Y4M, canvas.w,
+                             canvas.h, 60) != 0) {
+        return 1;
+    }
+    for (uint32_t frame = 0; frame < 120; frame++) {
+        Cubc_CanvasClear(&canvas, CC_BLACK);
+        Cubc_CanvasRect(&canvas, frame * 4, 140, 80, 80, CC_RED);
+        Cubc_CanvasTriangle(&canvas, 320, 40, 120 + frame, 320, 520 - frame,
+                            320, CC_BLUE);
+        if (Cubc_FrameWriterWrite(&writer, &canvas) != 0) {
+            return 1;
+        }
+    }
+    Cubc_FrameWriterClose(&writer);
+}
@@ -15,5 +15,5 @@ int main() {
     memset(canvas.pixels, 0, 600 * 600);
     Cubc_CanvasWireframeTriangle(&canvas, 100, 100, 200, 200, 100, 200,
                                  CC_WHITE);
-    write_ppm(canvas, "testing_out.ppm");
+    Cubc_CanvasWritePPM(&canvas, "testing_out.ppm");
 }
@@ -15,5 +15,5 @@ int main() {
   };
   memset(canvas.pixels, 0, 600 * 600);
   Cubc_CanvasLine(&canvas, 0, 0, 300, 300, CC_WHITE);
-  write_ppm(canvas, "testing_out.ppm");
+  Cubc_CanvasWritePPM(&canvas, "testing_out.ppm");
 }
@@ -5,9 +5,43 @@
 #include <stddef.h>
 #include <stdint.h>
 
+typedef struct Cubc_CommandList Cubc_CommandList;
+
+// Layout of the pixels of a canvas. Drawing calls take colors as RGBA8888 and
+// convert them to the format of the canvas they draw into, and blits convert
+// between the formats of the two canvases. Blends and composites run fastest
+// between RGBA8888 canvases, others go through RGBA8888 a chunk at a time.
+// Filtered blits need RGBA8888 on both sides and take the nearest pixel
+// otherwise. Only RGBA8888 and BGRA8888 canvases can be premultiplied.
+typedef enum {
+    // 0xRRGGBBAA words, the default.
+    CUBC_FORMAT_RGBA8888,
+    // B, G, R, A bytes (0xAARRGGBB words), the layout of most scanout buffers.
+    CUBC_FORMAT_BGRA8888,
+    // 0bRRRRRGGGGGGBBBBB halfwords, always opaque.
+    CUBC_FORMAT_RGB565,
+    // Alpha bytes only, the color reads back as white.
+    CUBC_FORMAT_A8,
+    // R, G, B, A half floats in [0, 1].
+    CUBC_FORMAT_RGBA16F,
+} Cubc_PixelFormat;
+
 typedef struct {
-    uint32_t* pixels;
+    union {
+        uint32_t* pixels;
+        // The pixels of canvases that aren't RGBA8888 or BGRA8888.
+        void* data;
+    };
     size_t w, h;
+    // Distance between the starts of two rows in pixels, 0 means `w`.
+    size_t stride;
+    // When set, drawing calls are recorded into this list instead of being
+    // drawn, see Cubc_CanvasBeginDeferred.
+    Cubc_CommandList* commands;
+    // Whether the color channels are scaled by alpha, see
+    // Cubc_CanvasPremultiply.
+    bool premultiplied;
+    Cubc_PixelFormat format;
 } Cubc_Canvas;
 
 typedef union Cubc_Color {
@@ -67,7 +101,265 @@ typedef struct {
     float x, y, w, h;
 } Cubc_Rect;
 
+// Radii of the corners of a rounded rect, see Cubc_CanvasRoundedRect.
+typedef struct {
+    float top_left, top_right, bottom_right, bottom_left;
+} Cubc_Corners;
+
+// Widths of the borders of a nine-slice source, see
+// Cubc_CanvasBlitCanvasSliced.
+typedef struct {
+    uint32_t left, top, right, bottom;
+} Cubc_Insets;
+
+typedef enum {
+    CUBC_ALPHA_STRAIGHT,
+    CUBC_ALPHA_PREMULTIPLIED,
+} Cubc_AlphaMode;
+
+typedef enum {
+    CUBC_FILTER_NEAREST,
+    CUBC_FILTER_BILINEAR,
+    CUBC_FILTER_BICUBIC,
+    // Averages the covered source area, for large downscales.
+    CUBC_FILTER_BOX,
+} Cubc_Filter;
+
+// Separable blend modes. The blended color replaces the source color before
+// the source is composited over the destination with its alpha.
+typedef enum {
+    CUBC_BLEND_NORMAL,
+    CUBC_BLEND_MULTIPLY,
+    CUBC_BLEND_SCREEN,
+    CUBC_BLEND_OVERLAY,
+    CUBC_BLEND_HARD_LIGHT,
+    // Pegtop's formula, which has no discontinuity at half intensity.
+    CUBC_BLEND_SOFT_LIGHT,
+} Cubc_BlendMode;
+
+// Porter-Duff operators on premultiplied alpha.
+typedef enum {
+    CUBC_COMPOSITE_CLEAR,
+    CUBC_COMPOSITE_SRC,
+    CUBC_COMPOSITE_SRC_OVER,
+    CUBC_COMPOSITE_DST_OVER,
+    CUBC_COMPOSITE_SRC_IN,
+    CUBC_COMPOSITE_DST_IN,
+    CUBC_COMPOSITE_SRC_OUT,
+    CUBC_COMPOSITE_DST_OUT,
+    CUBC_COMPOSITE_SRC_ATOP,
+    CUBC_COMPOSITE_DST_ATOP,
+    CUBC_COMPOSITE_XOR,
+    // Saturating sum of source and destination.
+    CUBC_COMPOSITE_PLUS,
+} Cubc_CompositeOp;
+
+// How the segments of a thick polyline meet. Miters longer than
+// CUBC_MITER_LIMIT half widths fall back to bevels.
+typedef enum {
+    CUBC_JOIN_MITER,
+    CUBC_JOIN_ROUND,
+    CUBC_JOIN_BEVEL,
+} Cubc_LineJoin;
+
+#define CUBC_MITER_LIMIT 4.0
+
+// How the ends of a thick line look. Square caps extend the line by half its
+// width.
+typedef enum {
+    CUBC_CAP_BUTT,
+    CUBC_CAP_ROUND,
+    CUBC_CAP_SQUARE,
+} Cubc_LineCap;
+
+// Which pixels a polygon whose contours overlap or wind around each other
+// covers: those its contours wind around at all, or an odd number of times.
+typedef enum {
+    CUBC_FILL_NONZERO,
+    CUBC_FILL_EVEN_ODD,
+} Cubc_FillRule;
+
+typedef enum {
+    CUBC_PATH_MOVE,
+    CUBC_PATH_LINE,
+    CUBC_PATH_QUAD,
+    CUBC_PATH_CUBIC,
+    CUBC_PATH_CLOSE,
+} Cubc_PathVerb;
+
+// Subpaths of lines and Bezier curves, built with Cubc_PathMoveTo and the
+// calls after it. Start from a zeroed path and free it with Cubc_PathFree.
+// Every verb but CUBC_PATH_CLOSE adds its control points and end point to
+// `points`.
+typedef struct {
+    Cubc_PathVerb* verbs;
+    size_t verb_count, verb_capacity;
+    Cubc_V2f* points;
+    size_t point_count, point_capacity;
+} Cubc_Path;
+
+// Instruction sets the pixel kernels run on, from slowest to fastest.
+// CUBC_CPU_AVX512 needs AVX-512F and AVX-512BW.
+typedef enum {
+    CUBC_CPU_SCALAR,
+    CUBC_CPU_SSE2,
+    CUBC_CPU_AVX2,
+    CUBC_CPU_AVX512,
+} Cubc_CpuLevel;
+
+typedef enum {
+    CUBC_COMMAND_CLEAR,
+    CUBC_COMMAND_PIXEL,
+    CUBC_COMMAND_LINE,
+    CUBC_COMMAND_LINE_AA,
+    CUBC_COMMAND_CURVE,
+    CUBC_COMMAND_POLYLINE,
+    CUBC_COMMAND_POLYGON,
+    CUBC_COMMAND_FILL_PATH,
+    CUBC_COMMAND_STROKE_PATH,
+    CUBC_COMMAND_TRIANGLE,
+    CUBC_COMMAND_RECT,
+    CUBC_COMMAND_ROUNDED_RECT,
+    CUBC_COMMAND_ROUNDED_RECT_AA,
+    CUBC_COMMAND_ELLIPSE,
+    CUBC_COMMAND_ELLIPSE_AA,
+    CUBC_COMMAND_BLIT,
+    CUBC_COMMAND_BLIT_SLICED,
+    CUBC_COMMAND_COMPOSITE,
+    CUBC_COMMAND_PREMULTIPLY,
+    CUBC_COMMAND_UNPREMULTIPLY,
+} Cubc_CommandKind;
+
+typedef struct {
+    Cubc_CommandKind kind;
+    Cubc_Color color;
+    union {
+        struct {
+            uint32_t x0, y0, x1, y1, x2, y2;
+        } points;
+        struct {
+            uint32_t x, y, w, h;
+        } rect;
+        struct {
+            float x0, y0, x1, y1;
+            Cubc_AlphaMode dest_alpha;
+        } segment;
+        struct {
+            // The last is unused by quadratic curves.
+            Cubc_V2f points[4];
+            bool cubic;
+        } curve;
+        struct {
+            // No points means the two in `ends`.
+            const Cubc_V2f* points;
+            size_t count;
+            Cubc_V2f ends[2];
+            bool closed;
+            float width;
+            Cubc_LineJoin join;
+            Cubc_LineCap cap;
+            Cubc_AlphaMode dest_alpha;
+        } polyline;
+        struct {
+            const Cubc_V2f* points;
+            const size_t* counts;
+            size_t contour_count;
+            Cubc_FillRule rule;
+        } polygon;
+        struct {
+            const Cubc_Path* path;
+            Cubc_FillRule rule;
+            Cubc_AlphaMode dest_alpha;
+            // Only used by strokes.
+            float width;
+            Cubc_LineJoin join;
+            Cubc_LineCap cap;
+        } path;
+        struct {
+            // Whole pixels unless anti-aliased.
+            double x, y, w, h;
+            Cubc_Corners radii;
+            Cubc_AlphaMode dest_alpha;
+        } rounded_rect;
+        struct {
+            // Whole pixels unless anti-aliased.
+            double x, y, rx, ry;
+            // The wedge drawn, all of the shape when a turn or more apart.
+            float start, end;
+            // Only used by anti-aliased outlines.
+            float width;
+            bool filled;
+            Cubc_AlphaMode dest_alpha;
+        } ellipse;
+        struct {
+            Cubc_Canvas src;
+            uint32_t x, y;
+            float scale_x, scale_y;
+            bool blend;
+            Cubc_AlphaMode alpha, dest_alpha;
+            Cubc_Filter filter;
+            Cubc_BlendMode mode;
+        } blit;
+        struct {
+            Cubc_Canvas src;
+            uint32_t x, y, w, h;
+            Cubc_Insets insets;
+            bool blend;
+            Cubc_AlphaMode alpha, dest_alpha;
+        } sliced;
+        struct {
+            // No pixels means a solid rect of the command color.
+            Cubc_Canvas src;
+            uint32_t x, y, w, h;
+            Cubc_CompositeOp op;
+            Cubc_AlphaMode dest_alpha;
+        } composite;
+    };
+    // Inclusive bounds of the pixels the command can touch.
+    int64_t min_x, min_y, max_x, max_y;
+} Cubc_Command;
+
+struct Cubc_CommandList {
+    Cubc_Command* items;
+    size_t count, capacity;
+};
+
+typedef enum {
+    // YUV4MPEG2 with full resolution BT.601 chroma (C444).
+    CUBC_FRAMES_Y4M,
+    // Headerless R, G, B, A bytes.
+    CUBC_FRAMES_RGBA,
+} Cubc_FrameFormat;
+
+typedef struct {
+    int fd;
+    Cubc_FrameFormat format;
+    size_t w, h;
+    // One converted frame, written with a single call.
+    uint8_t* frame;
+    size_t size;
+} Cubc_FrameWriter;
+
 Cubc_Canvas Cubc_CanvasFromImage(const char* file_name);
+// Like Cubc_CanvasFromImage, but stores the pixels in `format`.
+Cubc_Canvas Cubc_CanvasFromImageFormat(const char* file_name,
+                                       Cubc_PixelFormat format);
+
+// Bytes per pixel of `format`.
+size_t Cubc_PixelFormatSize(Cubc_PixelFormat format);
+
+// Converts `n` pixels from `src_format` to `dest_format`. Formats without
+// color or alpha drop them, and RGBA16F is rounded to 8 bits per channel.
+void Cubc_PixelsConvert(void* dest, Cubc_PixelFormat dest_format,
+                        const void* src, Cubc_PixelFormat src_format,
+                        size_t n);
+
+// Returns a canvas that draws into the given region of `canvas` without
+// copying or allocating. The region is clipped to `canvas`. Views always draw
+// immediately, even when `canvas` is deferred.
+Cubc_Canvas Cubc_CanvasView(const Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                            uint32_t w, uint32_t h);
+Cubc_Canvas Cubc_CanvasViewR(const Cubc_Canvas* canvas, Cubc_Rect rect);
 
 void Cubc_CanvasBlitCanvas(Cubc_Canvas* dest, const Cubc_Canvas* src,
                            uint32_t x, uint32_t y, float scale_x,
@@ -79,6 +371,65 @@ void Cubc_CanvasBlitCanvasV(Cubc_Canvas* dest, const Cubc_Canvas* src,
 void Cubc_CanvasBlitCanvasR(Cubc_Canvas* dest, const Cubc_Canvas* src,
                             Cubc_Rect rect);
 
+// Like Cubc_CanvasBlitCanvas, but composites `src` over `dest` (source-over)
+// using the alpha convention of the source pixels.
+void Cubc_CanvasBlitCanvasAlpha(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                uint32_t x, uint32_t y, float scale_x,
+                                float scale_y, Cubc_AlphaMode alpha);
+
+// Like Cubc_CanvasBlitCanvas, but resamples `src` with `filter` instead of
+// taking the nearest source pixel.
+void Cubc_CanvasBlitCanvasFiltered(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                   uint32_t x, uint32_t y, float scale_x,
+                                   float scale_y, Cubc_Filter filter);
+
+// Draws `src` as a nine-slice into the `w` by `h` pixels at `x`, `y`. The
+// corners, the borders `insets` wide, are copied as they are, the edges are
+// stretched along them and the middle both ways, each destination pixel
+// taking the source pixel under its center. Borders that don't fit in `w` or
+// `h`, or that leave no middle in `src`, are scaled in proportion to fill it.
+// Insets are limited to `src`. Rows drawn from the same source row as the
+// row above are copied from it.
+void Cubc_CanvasBlitCanvasSliced(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                 uint32_t x, uint32_t y, uint32_t w,
+                                 uint32_t h, Cubc_Insets insets);
+void Cubc_CanvasBlitCanvasSlicedR(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                  Cubc_Rect rect, Cubc_Insets insets);
+
+// Like Cubc_CanvasBlitCanvasSliced, but composites `src` over `dest` like
+// Cubc_CanvasBlitCanvasAlpha.
+void Cubc_CanvasBlitCanvasSlicedAlpha(Cubc_Canvas* dest,
+                                      const Cubc_Canvas* src, uint32_t x,
+                                      uint32_t y, uint32_t w, uint32_t h,
+                                      Cubc_Insets insets,
+                                      Cubc_AlphaMode alpha);
+
+// Composites `src` over `dest` at its own size, blending the colors with
+// `mode`.
+void Cubc_CanvasBlendCanvas(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                            uint32_t x, uint32_t y, Cubc_BlendMode mode);
+
+// Combines `src`, placed at `x`, `y`, with `dest` by the Porter-Duff operator
+// `op`. Pixels outside `src` are unchanged. Runs fastest when both canvases
+// are premultiplied, others are converted on the fly.
+void Cubc_CanvasComposite(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                          uint32_t x, uint32_t y, Cubc_CompositeOp op);
+
+// Like Cubc_CanvasComposite with a `w` by `h` source of the premultiplied
+// `color`.
+void Cubc_CanvasCompositeRect(Cubc_Canvas* dest, uint32_t x, uint32_t y,
+                              uint32_t w, uint32_t h, Cubc_Color color,
+                              Cubc_CompositeOp op);
+
+// Converts the pixels of `canvas` to premultiplied alpha and marks it as
+// such. Blits, blends and composites read the marks of both canvases, skip
+// the conversion where they match and convert on the fly where they don't.
+// Filtering a premultiplied canvas doesn't bleed the color of transparent
+// pixels.
+void Cubc_CanvasPremultiply(Cubc_Canvas* canvas);
+// Converts the pixels of `canvas` back to straight alpha.
+void Cubc_CanvasUnpremultiply(Cubc_Canvas* canvas);
+
 void Cubc_CanvasClear(Cubc_Canvas* canvas, Cubc_Color color);
 
 void Cubc_CanvasPixel(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
@@ -90,6 +441,94 @@ void Cubc_CanvasLine(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0, uint32_t x1,
 void Cubc_CanvasLineV(Cubc_Canvas* canvas, Cubc_V2u begin, Cubc_V2u end,
                       Cubc_Color color);
 
+// Draws `count` lines, line i from x0[i], y0[i] to x1[i], y1[i] in
+// colors[i], with the pixels of as many Cubc_CanvasLine calls in order. The
+// lines are binned by the tiles they cross and drawn tile by tile on
+// `thread_count` threads, so the pixels being written stay in cache however
+// the lines are spread. A single thread draws batches of only a few lines
+// per tile directly. A deferred canvas records the lines one by one.
+void Cubc_CanvasLines(Cubc_Canvas* canvas, const uint32_t* x0,
+                      const uint32_t* y0, const uint32_t* x1,
+                      const uint32_t* y1, const Cubc_Color* colors,
+                      size_t count, size_t thread_count);
+
+// Draws a quadratic or cubic Bezier curve from x0, y0 to x1, y1, pulled
+// toward the control points in between, with the pixels of Cubc_CanvasLine.
+// The curve is flattened into as few lines as keep within
+// CUBC_PATH_TOLERANCE pixels of it, which are drawn between the pixels
+// nearest to their ends. Draws nothing when a point isn't finite.
+void Cubc_CanvasQuadBezier(Cubc_Canvas* canvas, float x0, float y0, float cx,
+                           float cy, float x1, float y1, Cubc_Color color);
+void Cubc_CanvasQuadBezierV(Cubc_Canvas* canvas, Cubc_V2f begin,
+                            Cubc_V2f control, Cubc_V2f end, Cubc_Color color);
+void Cubc_CanvasCubicBezier(Cubc_Canvas* canvas, float x0, float y0,
+                            float c0x, float c0y, float c1x, float c1y,
+                            float x1, float y1, Cubc_Color color);
+void Cubc_CanvasCubicBezierV(Cubc_Canvas* canvas, Cubc_V2f begin,
+                             Cubc_V2f control0, Cubc_V2f control1,
+                             Cubc_V2f end, Cubc_Color color);
+
+// Draws an anti-aliased line with pixel centers on whole coordinates. Every
+// pixel is composited source-over with `color`, its alpha scaled by how much
+// of the pixel the line covers, so lines blend into translucent canvases too.
+void Cubc_CanvasLineAA(Cubc_Canvas* canvas, float x0, float y0, float x1,
+                       float y1, Cubc_Color color);
+void Cubc_CanvasLineAAV(Cubc_Canvas* canvas, Cubc_V2f begin, Cubc_V2f end,
+                        Cubc_Color color);
+
+// Strokes the `count` points as one line `width` pixels wide, back to the
+// first point when `closed`. Every pixel whose center the stroke covers is
+// composited source-over with `color` once, so translucent strokes don't
+// darken where their segments overlap. Points that aren't finite or repeat
+// the previous one are skipped, and a single point left only draws its caps.
+void Cubc_CanvasPolyline(Cubc_Canvas* canvas, const Cubc_V2f* points,
+                         size_t count, bool closed, float width,
+                         Cubc_LineJoin join, Cubc_LineCap cap,
+                         Cubc_Color color);
+
+// A single segment of Cubc_CanvasPolyline, which draws nothing when an end
+// isn't finite.
+void Cubc_CanvasThickLine(Cubc_Canvas* canvas, float x0, float y0, float x1,
+                          float y1, float width, Cubc_LineCap cap,
+                          Cubc_Color color);
+void Cubc_CanvasThickLineV(Cubc_Canvas* canvas, Cubc_V2f begin, Cubc_V2f end,
+                           float width, Cubc_LineCap cap, Cubc_Color color);
+
+// Fills the polygon made of `contour_count` closed contours, contour i being
+// the next counts[i] of `points`, so that contours inside others cut holes
+// or fill islands by `rule`. Sets every pixel whose center is inside to
+// `color`, where centers on the right or bottom edge count as outside, so
+// polygons sharing an edge neither overlap nor leave a gap. Points that
+// aren't finite are skipped.
+void Cubc_CanvasPolygon(Cubc_Canvas* canvas, const Cubc_V2f* points,
+                        const size_t* counts, size_t contour_count,
+                        Cubc_FillRule rule, Cubc_Color color);
+
+// Start a subpath at `x`, `y`, or continue the current one with a line or a
+// quadratic or cubic Bezier curve to it. A path continued before its first
+// move starts at 0, 0.
+void Cubc_PathMoveTo(Cubc_Path* path, float x, float y);
+void Cubc_PathLineTo(Cubc_Path* path, float x, float y);
+void Cubc_PathQuadTo(Cubc_Path* path, float cx, float cy, float x, float y);
+void Cubc_PathCubicTo(Cubc_Path* path, float c0x, float c0y, float c1x,
+                      float c1y, float x, float y);
+// Ends the current subpath back at its start.
+void Cubc_PathClose(Cubc_Path* path);
+void Cubc_PathFree(Cubc_Path* path);
+
+// Fills `path` anti-aliased, every subpath closed. Each pixel is composited
+// source-over with `color`, its alpha scaled by how much of the pixel's
+// square, centered on whole coordinates, the path covers by `rule`.
+void Cubc_CanvasFillPath(Cubc_Canvas* canvas, const Cubc_Path* path,
+                         Cubc_FillRule rule, Cubc_Color color);
+
+// Strokes every subpath of `path` like Cubc_CanvasPolyline, closed ones back
+// to their start, and composites each pixel the strokes cover once.
+// Subpaths without a line or curve draw nothing.
+void Cubc_CanvasStrokePath(Cubc_Canvas* canvas, const Cubc_Path* path,
+                           float width, Cubc_LineJoin join, Cubc_LineCap cap,
+                           Cubc_Color color);
+
 void Cubc_CanvasWireframeTriangle(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0,
                                   uint32_t x1, uint32_t y1, uint32_t x2,
                                   uint32_t y2, Cubc_Color color);
@@ -112,13 +551,133 @@ void Cubc_CanvasRectV(Cubc_Canvas* canvas, Cubc_V2f pos, Cubc_V2f size,
                       Cubc_Color color);
 void Cubc_CanvasRectR(Cubc_Canvas* canvas, Cubc_Rect rect, Cubc_Color color);
 
+// Sets the pixels of Cubc_CanvasRect to `color`, one span per row, but for
+// those its corners cut off: each is a quarter of Cubc_CanvasCircle with its
+// radius in `radii` truncated to whole pixels. Corners along a side that
+// don't fit in it are scaled down together until they do, and radii are
+// limited to 2^30.
+void Cubc_CanvasRoundedRect(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                            uint32_t w, uint32_t h, Cubc_Corners radii,
+                            Cubc_Color color);
+void Cubc_CanvasRoundedRectR(Cubc_Canvas* canvas, Cubc_Rect rect,
+                             Cubc_Corners radii, Cubc_Color color);
+
+// Fills an anti-aliased rounded rect from `x`, `y` to `x` + `w`, `y` + `h`
+// with pixel centers on whole coordinates, its corners quarter circles
+// scaled to fit like those of Cubc_CanvasRoundedRect. Pixels are composited
+// like Cubc_CanvasEllipseAA, one covered span per row.
+void Cubc_CanvasRoundedRectAA(Cubc_Canvas* canvas, float x, float y, float w,
+                              float h, Cubc_Corners radii, Cubc_Color color);
+
+// Sets the pixels of the ellipse centered on `x`, `y` with radii `rx`, `ry`
+// to `color`, one span per row: those whose centers are inside the ellipse
+// through the far edges of the pixels `rx` and `ry` off the center, so that
+// it is 2 `rx` + 1 pixels wide. Radii are limited to 2^30.
+void Cubc_CanvasEllipse(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                        uint32_t rx, uint32_t ry, Cubc_Color color);
+void Cubc_CanvasCircle(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t r,
+                       Cubc_Color color);
+
+// The one pixel thick outline of Cubc_CanvasEllipse: the pixels of each row
+// past those of the row outside it.
+void Cubc_CanvasWireframeEllipse(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                                 uint32_t rx, uint32_t ry, Cubc_Color color);
+void Cubc_CanvasWireframeCircle(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                                uint32_t r, Cubc_Color color);
+
+// The part of Cubc_CanvasWireframeCircle or Cubc_CanvasCircle whose pixel
+// centers are at angles from `start` up to `end` radians, measured from the
+// x axis toward the y axis. An `end` below `start` is taken a turn later, and
+// ends a turn or more apart draw the whole circle. Pie slices sharing an
+// edge leave no gap, and only overlap at the center pixel, which all of them
+// have.
+void Cubc_CanvasArc(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t r,
+                    float start, float end, Cubc_Color color);
+void Cubc_CanvasPie(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t r,
+                    float start, float end, Cubc_Color color);
+
+// Fills an anti-aliased ellipse with pixel centers on whole coordinates. Each
+// pixel is composited source-over with `color`, its alpha scaled by the part
+// of the pixel's square inside the tangent of the ellipse nearest to it, and
+// the pixels fully inside are filled one span per row.
+void Cubc_CanvasEllipseAA(Cubc_Canvas* canvas, float x, float y, float rx,
+                          float ry, Cubc_Color color);
+void Cubc_CanvasCircleAA(Cubc_Canvas* canvas, float x, float y, float r,
+                         Cubc_Color color);
+
+// Anti-aliased like Cubc_CanvasEllipseAA, a `width` pixels wide stroke along
+// the circle with butt ends, or a pie slice, from `start` to `end` like
+// Cubc_CanvasArc. The straight edges are anti-aliased too.
+void Cubc_CanvasArcAA(Cubc_Canvas* canvas, float x, float y, float r,
+                      float width, float start, float end, Cubc_Color color);
+void Cubc_CanvasPieAA(Cubc_Canvas* canvas, float x, float y, float r,
+                      float start, float end, Cubc_Color color);
+
+// Records the drawing calls on `canvas` into `list` until
+// Cubc_CanvasEndDeferred. Blit sources, polyline and polygon points, and
+// paths are referenced, not copied, and have to stay alive and unchanged
+// until then.
+void Cubc_CanvasBeginDeferred(Cubc_Canvas* canvas, Cubc_CommandList* list);
+
+// Draws the recorded calls tile by tile on `thread_count` threads, empties
+// the list and returns `canvas` to immediate mode. The result is identical to
+// having drawn the calls immediately.
+void Cubc_CanvasEndDeferred(Cubc_Canvas* canvas, size_t thread_count);
+
+void Cubc_CommandListFree(Cubc_CommandList* list);
+
+// Write `canvas` as a binary PPM (P6, without alpha) or PAM (P7, RGB_ALPHA)
+// file. Return 0 on success.
+int Cubc_CanvasWritePPM(const Cubc_Canvas* canvas, const char* file_name);
+int Cubc_CanvasWritePAM(const Cubc_Canvas* canvas, const char* file_name);
+
+// Starts a stream of `w` by `h` frames on `fd`, such as a pipe into an
+// encoder, and writes its header. `fd` stays owned by the caller. Returns 0 on
+// success.
+int Cubc_FrameWriterOpen(Cubc_FrameWriter* writer, int fd,
+                         Cubc_FrameFormat format, size_t w, size_t h,
+                         uint32_t fps);
+
+// Appends `canvas`, which has to match the stream size, as the next frame.
+// Returns 0 on success.
+int Cubc_FrameWriterWrite(Cubc_FrameWriter* writer, const Cubc_Canvas* canvas);
+
+void Cubc_FrameWriterClose(Cubc_FrameWriter* writer);
+
+// Straight-alpha source-over of `src` onto `dest`.
+Cubc_Color Cubc_ColorBlend(Cubc_Color src, Cubc_Color dest);
+// Like Cubc_ColorBlend, but blends the colors with `mode` first.
+Cubc_Color Cubc_ColorBlendMode(Cubc_Color src, Cubc_Color dest,
+                               Cubc_BlendMode mode);
+// Cubc_ColorBlendMode over all `n` pixels of `src` and `dest` at once.
+void Cubc_ColorBlendRow(uint32_t* dest, const uint32_t* src, size_t n,
+                        Cubc_BlendMode mode);
+// Blend `b` onto the backdrop `a`.
 Cubc_Color Cubc_ColorMultiplyBlend(Cubc_Color a, Cubc_Color b);
 Cubc_Color Cubc_ColorScreenBlend(Cubc_Color a, Cubc_Color b);
 Cubc_Color Cubc_ColorOverlayBlend(Cubc_Color a, Cubc_Color b);
 Cubc_Color Cubc_ColorHardLightBlend(Cubc_Color a, Cubc_Color b);
 Cubc_Color Cubc_ColorSoftLightBlend(Cubc_Color a, Cubc_Color b);
 
-#define CUBC_CANVAS_AT(canvas, x, y) (canvas).pixels[(x) + (y) * (canvas).w]
+// The fastest level the CPU and the build support, detected once. Clears,
+// fills, blits, blends, composites and format conversions run on it unless
+// Cubc_SetCpuLevel picked another one.
+Cubc_CpuLevel Cubc_CpuDetect(void);
+// Runs the kernels of `level`, lowered to Cubc_CpuDetect, from now on and
+// returns the level used. Meant for benchmarks and tests, and must not race
+// with drawing on other threads. Every level produces identical pixels.
+Cubc_CpuLevel Cubc_SetCpuLevel(Cubc_CpuLevel level);
+Cubc_CpuLevel Cubc_GetCpuLevel(void);
+
+#define CUBC_CANVAS_STRIDE(canvas)                                             \
+    ((canvas).stride ? (canvas).stride : (canvas).w)
+
+#define CUBC_CANVAS_AT(canvas, x, y)                                           \
+    (canvas).pixels[(x) + (y) * CUBC_CANVAS_STRIDE(canvas)]
+
+// The pixel at `x`, `y` of a canvas whose format is stored as `type`.
+#define CUBC_CANVAS_AT_AS(canvas, type, x, y)                                  \
+    ((type*) (canvas).data)[(x) + (y) * CUBC_CANVAS_STRIDE(canvas)]
 
 #define SWAP(x, y)                                                             \
     {                                                                          \
@@ -131,258 +690,7686 @@ Cubc_Color Cubc_ColorSoftLightBlend(Cubc_Color a, Cubc_Color b);
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-Cubc_Canvas Cubc_CanvasFromImage(const char* file_name) {
+// Zero initializer of any struct. C before C23 has no empty braces, and C++
+// warns about the members {0} leaves out.
+#if defined(__cplusplus)
+#define CUBC_ZERO {}
+#else
+#define CUBC_ZERO {0}
+#endif
+
+// On x86 with GCC or Clang the kernels are compiled for every level and
+// picked at run time, see Cubc_SetCpuLevel. Define CUBC_NO_DISPATCH to only
+// build the levels the compiler flags enable.
+#if !defined(CUBC_NO_DISPATCH) && defined(__GNUC__) &&                         \
+    (defined(__x86_64__) || defined(__i386__))
+#define CUBC_DISPATCH
+#endif
+
+#if defined(CUBC_DISPATCH) || defined(__SSE2__)
+#define CUBC_HAVE_SSE2
+#endif
+#if defined(CUBC_DISPATCH) || defined(__AVX2__)
+#define CUBC_HAVE_AVX2
+#endif
+#if defined(CUBC_DISPATCH) || defined(__F16C__)
+#define CUBC_HAVE_F16C
+#endif
+#if defined(CUBC_DISPATCH) || (defined(__AVX512F__) && defined(__AVX512BW__))
+#define CUBC_HAVE_AVX512
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+#include <immintrin.h>
+#elif defined(CUBC_HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
+// Bracket the kernels of one level, which are built for its instruction set
+// regardless of the compiler flags. The 256- and 512-bit kernels clear the
+// upper register halves before handing their tails to the scalar ones: the
+// compiler leaves them dirty across those tail calls, and SSE code run with
+// dirty upper halves stalls.
+#define CUBC_PRAGMA(x) _Pragma(#x)
+#if defined(CUBC_DISPATCH) && defined(__clang__)
+#define CUBC_TARGET_BEGIN(isa)                                                 \
+    CUBC_PRAGMA(clang attribute push(__attribute__((target(isa))),             \
+                                     apply_to = function))
+#define CUBC_TARGET_END CUBC_PRAGMA(clang attribute pop)
+#elif defined(CUBC_DISPATCH)
+#define CUBC_TARGET_BEGIN(isa)                                                 \
+    CUBC_PRAGMA(GCC push_options) CUBC_PRAGMA(GCC target(isa))
+#define CUBC_TARGET_END CUBC_PRAGMA(GCC pop_options)
+#else
+#define CUBC_TARGET_BEGIN(isa)
+#define CUBC_TARGET_END
+#endif
+
+#define CUBC_TARGET_SSE2   "sse2"
+#define CUBC_TARGET_AVX2   "avx2,f16c"
+#define CUBC_TARGET_AVX512 "avx512f,avx512bw,avx2,f16c"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef CUBC_NO_THREADS
+#include <pthread.h>
+#endif
+
+// Inclusive bounds of the pixels a primitive may write to. Immediate calls
+// clip to the whole canvas, deferred ones to the tile being rendered.
+typedef struct {
+    int64_t x0, y0, x1, y1;
+} _Cubc_Clip;
+
+// Wide enough for the product of two coordinate differences.
+#ifdef __SIZEOF_INT128__
+__extension__ typedef __int128 _Cubc_Wide;
+#else
+typedef int64_t _Cubc_Wide;
+#endif
+
+static _Cubc_Clip _Cubc_CanvasClip(const Cubc_Canvas* canvas) {
+    return (_Cubc_Clip){
+        .x0 = 0,
+        .y0 = 0,
+        .x1 = (int64_t) canvas->w - 1,
+        .y1 = (int64_t) canvas->h - 1,
+    };
+}
+
+static void _Cubc_Record(Cubc_Canvas* canvas, Cubc_Command command);
+static void _Cubc_PackRGBA(uint8_t* dst, const uint32_t* src, size_t n);
+static void _Cubc_EncodeRow(Cubc_PixelFormat format, void* dst,
+                            const uint32_t* src, size_t n);
+
+// Kernels of one level. The filters take the first destination pixel `i`, so
+// that the SIMD kernels can hand their tails to the scalar ones.
+typedef struct _Cubc_FilterTable _Cubc_FilterTable;
+
+typedef struct {
+    void (*fill8)(uint8_t* dst, size_t n, uint8_t value, bool stream);
+    void (*fill16)(uint16_t* dst, size_t n, uint16_t value, bool stream);
+    void (*fill32)(uint32_t* dst, size_t n, uint32_t value, bool stream);
+    void (*fill64)(uint64_t* dst, size_t n, uint64_t value, bool stream);
+    void (*over_row)(uint32_t* dst, const uint32_t* src, size_t n,
+                     Cubc_AlphaMode alpha);
+    void (*cover_row)(uint32_t* dst, const uint8_t* coverage, size_t n,
+                      uint32_t color, Cubc_AlphaMode alpha);
+    void (*accumulate_row)(uint8_t* coverage, int32_t* area, size_t n,
+                           bool even_odd);
+    void (*premultiply_row)(uint32_t* dst, const uint32_t* src, size_t n);
+    void (*unpremultiply_row)(uint32_t* dst, const uint32_t* src, size_t n);
+    void (*encode_row)(Cubc_PixelFormat format, void* dst,
+                       const uint32_t* src, size_t n);
+    void (*decode_row)(Cubc_PixelFormat format, uint32_t* dst,
+                       const void* src, size_t n);
+    void (*mix_row)(uint32_t* out, const uint32_t* dst, const uint32_t* src,
+                    size_t n, Cubc_BlendMode mode);
+    void (*composite_row)(uint32_t* dst, const uint32_t* src, size_t n,
+                          Cubc_CompositeOp op);
+    void (*filter_row)(uint32_t* dst, const uint32_t* src,
+                       const _Cubc_FilterTable* table, size_t i, size_t n);
+    void (*filter_columns)(uint32_t* dst, const uint32_t* const* rows,
+                           const int16_t* w, size_t taps, size_t i, size_t n);
+    void (*triangle_block)(uint32_t* dst, size_t stride, const int32_t* w,
+                           const int32_t* a, const int32_t* b, uint32_t color);
+    void (*pack_rgb)(uint8_t* dst, const uint32_t* src, size_t n);
+    void (*pack_rgba)(uint8_t* dst, const uint32_t* src, size_t n);
+    void (*pack_ycbcr)(uint8_t* y, uint8_t* cb, uint8_t* cr,
+                       const uint32_t* src, size_t n);
+} _Cubc_Kernels;
+
+// The kernels of the current level.
+static const _Cubc_Kernels* _Cubc_ActiveKernels(void);
+
+// Define _Cubc_Fill<bits><level>, which fill with the widest aligned stores
+// of the level. Streaming stores bypass the cache, which only pays off for
+// fills much larger than it.
+#define CUBC_DEFINE_FILL_SCALAR(bits, type)                                    \
+    static void _Cubc_Fill##bits##Scalar(type* dst, size_t n, type value,      \
+                                         bool stream) {                        \
+        (void) stream;                                                         \
+        for (size_t i = 0; i < n; i++) {                                       \
+            dst[i] = value;                                                    \
+        }                                                                      \
+    }
+
+CUBC_DEFINE_FILL_SCALAR(8, uint8_t)
+CUBC_DEFINE_FILL_SCALAR(16, uint16_t)
+CUBC_DEFINE_FILL_SCALAR(32, uint32_t)
+CUBC_DEFINE_FILL_SCALAR(64, uint64_t)
+
+#if defined(CUBC_HAVE_SSE2)
+#define CUBC_DEFINE_FILL_SSE2(bits, type, lanes)                               \
+    static void _Cubc_Fill##bits##Sse2(type* dst, size_t n, type value,        \
+                                       bool stream) {                          \
+        const size_t l = 16 / sizeof(type);                                    \
+        size_t i       = 0;                                                    \
+        if (n >= 4 * l) {                                                      \
+            for (; ((uintptr_t) (dst + i) & 15) != 0; i++) {                   \
+                dst[i] = value;                                                \
+            }                                                                  \
+            const __m128i c = _mm_set1_##lanes(value);                         \
+            if (stream) {                                                      \
+                for (; i + 4 * l <= n; i += 4 * l) {                           \
+                    _mm_stream_si128((__m128i*) (dst + i), c);                 \
+                    _mm_stream_si128((__m128i*) (dst + i + l), c);             \
+                    _mm_stream_si128((__m128i*) (dst + i + 2 * l), c);         \
+                    _mm_stream_si128((__m128i*) (dst + i + 3 * l), c);         \
+                }                                                              \
+                _mm_sfence();                                                  \
+            }                                                                  \
+            for (; i + 4 * l <= n; i += 4 * l) {                               \
+                _mm_store_si128((__m128i*) (dst + i), c);                      \
+                _mm_store_si128((__m128i*) (dst + i + l), c);                  \
+                _mm_store_si128((__m128i*) (dst + i + 2 * l), c);              \
+                _mm_store_si128((__m128i*) (dst + i + 3 * l), c);              \
+            }                                                                  \
+            for (; i + l <= n; i += l) {                                       \
+                _mm_store_si128((__m128i*) (dst + i), c);                      \
+            }                                                                  \
+        }                                                                      \
+        for (; i < n; i++) {                                                   \
+            dst[i] = value;                                                    \
+        }                                                                      \
+    }
+
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+CUBC_DEFINE_FILL_SSE2(8, uint8_t, epi8)
+CUBC_DEFINE_FILL_SSE2(16, uint16_t, epi16)
+CUBC_DEFINE_FILL_SSE2(32, uint32_t, epi32)
+CUBC_DEFINE_FILL_SSE2(64, uint64_t, epi64x)
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+#define CUBC_DEFINE_FILL_AVX2(bits, type, lanes)                               \
+    static void _Cubc_Fill##bits##Avx2(type* dst, size_t n, type value,        \
+                                       bool stream) {                          \
+        const size_t l = 32 / sizeof(type);                                    \
+        size_t i       = 0;                                                    \
+        if (n >= 4 * l) {                                                      \
+            for (; ((uintptr_t) (dst + i) & 31) != 0; i++) {                   \
+                dst[i] = value;                                                \
+            }                                                                  \
+            const __m256i c = _mm256_set1_##lanes(value);                      \
+            if (stream) {                                                      \
+                for (; i + 4 * l <= n; i += 4 * l) {                           \
+                    _mm256_stream_si256((__m256i*) (dst + i), c);              \
+                    _mm256_stream_si256((__m256i*) (dst + i + l), c);          \
+                    _mm256_stream_si256((__m256i*) (dst + i + 2 * l), c);      \
+                    _mm256_stream_si256((__m256i*) (dst + i + 3 * l), c);      \
+                }                                                              \
+                _mm_sfence();                                                  \
+            }                                                                  \
+            for (; i + 4 * l <= n; i += 4 * l) {                               \
+                _mm256_store_si256((__m256i*) (dst + i), c);                   \
+                _mm256_store_si256((__m256i*) (dst + i + l), c);               \
+                _mm256_store_si256((__m256i*) (dst + i + 2 * l), c);           \
+                _mm256_store_si256((__m256i*) (dst + i + 3 * l), c);           \
+            }                                                                  \
+            for (; i + l <= n; i += l) {                                       \
+                _mm256_store_si256((__m256i*) (dst + i), c);                   \
+            }                                                                  \
+        }                                                                      \
+        for (; i < n; i++) {                                                   \
+            dst[i] = value;                                                    \
+        }                                                                      \
+    }
+
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+CUBC_DEFINE_FILL_AVX2(8, uint8_t, epi8)
+CUBC_DEFINE_FILL_AVX2(16, uint16_t, epi16)
+CUBC_DEFINE_FILL_AVX2(32, uint32_t, epi32)
+CUBC_DEFINE_FILL_AVX2(64, uint64_t, epi64x)
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX512)
+// Spans shorter than a vector take a masked store, longer ones start and end
+// with an unaligned store so that the stores in between can be aligned.
+#define CUBC_DEFINE_FILL_AVX512(bits, type, lanes)                             \
+    static void _Cubc_Fill##bits##Avx512(type* dst, size_t n, type value,      \
+                                         bool stream) {                        \
+        const size_t l  = 64 / sizeof(type);                                   \
+        const __m512i c = _mm512_set1_##lanes(value);                          \
+        if (n < l) {                                                           \
+            __mmask64 bytes = ((__mmask64) 1 << (n * sizeof(type))) - 1;       \
+            _mm512_mask_storeu_epi8(dst, bytes, c);                            \
+            return;                                                            \
+        }                                                                      \
+        _mm512_storeu_si512(dst, c);                                           \
+        _mm512_storeu_si512(dst + n - l, c);                                   \
+        size_t i = (64 - ((uintptr_t) dst & 63)) / sizeof(type);               \
+        if (stream) {                                                          \
+            for (; i + 4 * l <= n; i += 4 * l) {                               \
+                _mm512_stream_si512((__m512i*) (dst + i), c);                  \
+                _mm512_stream_si512((__m512i*) (dst + i + l), c);              \
+                _mm512_stream_si512((__m512i*) (dst + i + 2 * l), c);          \
+                _mm512_stream_si512((__m512i*) (dst + i + 3 * l), c);          \
+            }                                                                  \
+            _mm_sfence();                                                      \
+        }                                                                      \
+        for (; i + 4 * l <= n; i += 4 * l) {                                   \
+            _mm512_store_si512(dst + i, c);                                    \
+            _mm512_store_si512(dst + i + l, c);                                \
+            _mm512_store_si512(dst + i + 2 * l, c);                            \
+            _mm512_store_si512(dst + i + 3 * l, c);                            \
+        }                                                                      \
+        for (; i + l <= n; i += l) {                                           \
+            _mm512_store_si512(dst + i, c);                                    \
+        }                                                                      \
+    }
+
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX512)
+CUBC_DEFINE_FILL_AVX512(8, uint8_t, epi8)
+CUBC_DEFINE_FILL_AVX512(16, uint16_t, epi16)
+CUBC_DEFINE_FILL_AVX512(32, uint32_t, epi32)
+CUBC_DEFINE_FILL_AVX512(64, uint64_t, epi64)
+CUBC_TARGET_END
+#endif
+
+// Instantiates the primitives that depend on the size of a pixel for pixels
+// stored as `type`: the span fill, which runs the fill kernel of the current
+// level, the gather of nearest neighbour blits and the Bresenham loop of
+// lines.
+#define CUBC_DEFINE_PIXEL_OPS(bits, type)                                      \
+    static inline void _Cubc_Fill##bits(type* dst, size_t n, type value,       \
+                                        bool stream) {                         \
+        _Cubc_ActiveKernels()->fill##bits(dst, n, value, stream);              \
+    }                                                                          \
+                                                                               \
+    static void _Cubc_Gather##bits(type* dst, const type* src,                 \
+                                   const uint32_t* xs, size_t n) {             \
+        for (size_t i = 0; i < n; i++) {                                       \
+            dst[i] = src[xs[i]];                                               \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void _Cubc_LineLoop##bits(type* p, ptrdiff_t i, int64_t count,      \
+                                     ptrdiff_t step_a, ptrdiff_t step_b,       \
+                                     int64_t error2, int64_t da, int64_t db,   \
+                                     type value) {                             \
+        for (int64_t k = 0; k < count; k++) {                                  \
+            p[i]    = value;                                                   \
+            i      += step_a;                                                  \
+            error2 += 2 * db;                                                  \
+            if (error2 > da) {                                                 \
+                i      += step_b;                                              \
+                error2 -= 2 * da;                                              \
+            }                                                                  \
+        }                                                                      \
+    }
+
+CUBC_DEFINE_PIXEL_OPS(8, uint8_t)
+CUBC_DEFINE_PIXEL_OPS(16, uint16_t)
+CUBC_DEFINE_PIXEL_OPS(32, uint32_t)
+CUBC_DEFINE_PIXEL_OPS(64, uint64_t)
+
+static size_t _Cubc_FormatSize(Cubc_PixelFormat format) {
+    switch (format) {
+    case CUBC_FORMAT_RGB565:
+        return 2;
+    case CUBC_FORMAT_A8:
+        return 1;
+    case CUBC_FORMAT_RGBA16F:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+size_t Cubc_PixelFormatSize(Cubc_PixelFormat format) {
+    return _Cubc_FormatSize(format);
+}
+
+static inline void* _Cubc_PixelAddress(const Cubc_Canvas* canvas, int64_t x,
+                                       int64_t y) {
+    return (uint8_t*) canvas->data +
+           (x + y * (int64_t) CUBC_CANVAS_STRIDE(*canvas)) *
+               (int64_t) _Cubc_FormatSize(canvas->format);
+}
+
+// Fills `n` pixels of `format` from `dst` on with `value`, a color encoded in
+// that format.
+static void _Cubc_Fill(Cubc_PixelFormat format, void* dst, size_t n,
+                       uint64_t value, bool stream) {
+    switch (_Cubc_FormatSize(format)) {
+    case 1:
+        _Cubc_Fill8((uint8_t*) dst, n, (uint8_t) value, stream);
+        break;
+    case 2:
+        _Cubc_Fill16((uint16_t*) dst, n, (uint16_t) value, stream);
+        break;
+    case 8:
+        _Cubc_Fill64((uint64_t*) dst, n, value, stream);
+        break;
+    default:
+        _Cubc_Fill32((uint32_t*) dst, n, (uint32_t) value, stream);
+        break;
+    }
+}
+
+static void _Cubc_Gather(Cubc_PixelFormat format, void* dst, const void* src,
+                         const uint32_t* xs, size_t n) {
+    switch (_Cubc_FormatSize(format)) {
+    case 1:
+        _Cubc_Gather8((uint8_t*) dst, (const uint8_t*) src, xs, n);
+        break;
+    case 2:
+        _Cubc_Gather16((uint16_t*) dst, (const uint16_t*) src, xs, n);
+        break;
+    case 8:
+        _Cubc_Gather64((uint64_t*) dst, (const uint64_t*) src, xs, n);
+        break;
+    default:
+        _Cubc_Gather32((uint32_t*) dst, (const uint32_t*) src, xs, n);
+        break;
+    }
+}
+
+// Fills of at least this many bytes use streaming stores.
+#ifndef CUBC_STREAM_MIN_BYTES
+#define CUBC_STREAM_MIN_BYTES (8 << 20)
+#endif
+
+Cubc_Canvas Cubc_CanvasFromImageFormat(const char* file_name,
+                                       Cubc_PixelFormat format) {
     int x, y, comp;
     uint8_t* img_data  = stbi_load(file_name, &x, &y, &comp, 4);
-    Cubc_Canvas canvas = {
-        .pixels = (uint32_t*) malloc(sizeof(uint32_t) * x * y),
-        .w      = x,
-        .h      = y,
-    };
-    int m = 0;
-    for (int i = 0; i < x * y * 4; i += 4) {
-        uint8_t r        = img_data[i + 3];
-        uint8_t g        = img_data[i + 2];
-        uint8_t b        = img_data[i + 1];
-        uint8_t a        = img_data[i];
-        canvas.pixels[m] = r | (g << 8) | (b << 16) | (a << 24);
-        m++;
+    Cubc_Canvas canvas = CUBC_ZERO;
+    canvas.format      = format;
+    if (img_data == NULL) {
+        return canvas;
     }
+    size_t n      = (size_t) x * y;
+    canvas.data   = malloc(n * _Cubc_FormatSize(format));
+    canvas.w      = x;
+    canvas.h      = y;
+    canvas.stride = x;
+    // R, G, B, A bytes are the byte swapped RGBA8888 words, and swapping back
+    // is the same conversion as writing them out.
+    _Cubc_PackRGBA(img_data, (const uint32_t*) img_data, n);
+    _Cubc_EncodeRow(format, canvas.data, (const uint32_t*) img_data, n);
+    stbi_image_free(img_data);
     return canvas;
 }
 
-void Cubc_CanvasBlitCanvas(Cubc_Canvas* dest, const Cubc_Canvas* src,
-                           uint32_t x, uint32_t y, float scale_x,
-                           float scale_y) {
-    for (uint32_t dest_y = 0; dest_y < (uint32_t) (src->h * scale_y);
-         dest_y++) {
-        for (uint32_t dest_x = 0; dest_x < (uint32_t) (src->w * scale_x);
-             dest_x++) {
-            uint32_t src_x = (uint32_t) (dest_x / scale_x);
-            uint32_t src_y = (uint32_t) (dest_y / scale_y);
-
-            if (src_x >= src->w || src_y >= src->h) {
-                continue;
-            }
+Cubc_Canvas Cubc_CanvasFromImage(const char* file_name) {
+    return Cubc_CanvasFromImageFormat(file_name, CUBC_FORMAT_RGBA8888);
+}
+
+Cubc_Canvas Cubc_CanvasView(const Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                            uint32_t w, uint32_t h) {
+    size_t view_x = x < canvas->w ? x : canvas->w;
+    size_t view_y = y < canvas->h ? y : canvas->h;
+    size_t view_w = w < canvas->w - view_x ? w : canvas->w - view_x;
+    size_t view_h = h < canvas->h - view_y ? h : canvas->h - view_y;
+    size_t stride = CUBC_CANVAS_STRIDE(*canvas);
+    return (Cubc_Canvas){
+        .data          = _Cubc_PixelAddress(canvas, view_x, view_y),
+        .w             = view_w,
+        .h             = view_h,
+        .stride        = stride,
+        .commands      = NULL,
+        .premultiplied = canvas->premultiplied,
+        .format        = canvas->format,
+    };
+}
 
-            uint32_t dest_pos_x = x + dest_x;
-            uint32_t dest_pos_y = y + dest_y;
+Cubc_Canvas Cubc_CanvasViewR(const Cubc_Canvas* canvas, Cubc_Rect rect) {
+    return Cubc_CanvasView(canvas, rect.x, rect.y, rect.w, rect.h);
+}
 
-            if (dest_pos_x >= dest->w || dest_pos_y >= dest->h) {
-                continue;
-            }
+// Pixels are packed as 0xRRGGBBAA, so alpha is the low byte of each pixel.
+#define CUBC_ALPHA(pixel) ((pixel) & 0xff)
 
-            Cubc_CanvasPixel(dest, dest_pos_x, dest_pos_y,
-                             (Cubc_Color) CUBC_CANVAS_AT(*src, src_x, src_y));
-        }
+// x / 255 rounded to nearest, exact for x <= 255 * 255.
+static inline uint32_t _Cubc_Div255(uint32_t x) {
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+// _Cubc_Div255 of the two 16-bit lanes of `x` at once.
+static inline uint32_t _Cubc_Div255Pairs(uint32_t x) {
+    x += 0x00800080;
+    return ((x + ((x >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+}
+
+// Source-over of one pixel. Straight alpha blends the color channels by the
+// source alpha and composites the alpha channel, premultiplied alpha adds the
+// source to the destination scaled by the inverse source alpha. Works on red
+// and blue, then green and alpha, as pairs of 16-bit lanes.
+static uint32_t _Cubc_PixelOver(uint32_t d, uint32_t s, Cubc_AlphaMode alpha) {
+    uint32_t sa   = CUBC_ALPHA(s);
+    uint32_t inv  = 255 - sa;
+    uint32_t d_rb = (d >> 8) & 0x00ff00ff;
+    uint32_t d_ga = d & 0x00ff00ff;
+    uint32_t rb, ga;
+    if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        rb = ((s >> 8) & 0x00ff00ff) + _Cubc_Div255Pairs(d_rb * inv);
+        ga = (s & 0x00ff00ff) + _Cubc_Div255Pairs(d_ga * inv);
+        // Saturate lanes that reached 256.
+        uint32_t carry_rb = rb & 0x01000100;
+        uint32_t carry_ga = ga & 0x01000100;
+        rb                = (rb | (carry_rb - (carry_rb >> 8))) & 0x00ff00ff;
+        ga                = (ga | (carry_ga - (carry_ga >> 8))) & 0x00ff00ff;
+    } else {
+        rb = _Cubc_Div255Pairs(((s >> 8) & 0x00ff00ff) * sa + d_rb * inv);
+        ga = _Cubc_Div255Pairs(((s & 0x00ff0000) | 0xff) * sa + d_ga * inv);
     }
+    return (rb << 8) | ga;
 }
 
-void Cubc_CanvasBlitCanvasV(Cubc_Canvas* dest, const Cubc_Canvas* src,
-                            Cubc_V2u pos, Cubc_V2f scale) {
-    Cubc_CanvasBlitCanvas(dest, src, pos.x, pos.y, scale.x, scale.y);
+// Scales all four channels of `p` by `coverage` / 255.
+static inline uint32_t _Cubc_PixelScale(uint32_t p, uint32_t coverage) {
+    return (_Cubc_Div255Pairs(((p >> 8) & 0x00ff00ff) * coverage) << 8) |
+           _Cubc_Div255Pairs((p & 0x00ff00ff) * coverage);
 }
 
-void Cubc_CanvasBlitCanvasR(Cubc_Canvas* dest, const Cubc_Canvas* src,
-                            Cubc_Rect rect) {
-    Cubc_CanvasBlitCanvas(dest, src, rect.x, rect.y, rect.w, rect.h);
+// `color`, premultiplied when `alpha` is, with its alpha scaled by
+// `coverage` / 255.
+static inline uint32_t _Cubc_Coverage(uint32_t color, uint32_t coverage,
+                                      Cubc_AlphaMode alpha) {
+    if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        return _Cubc_PixelScale(color, coverage);
+    }
+    return (color & 0xffffff00) | _Cubc_Div255(CUBC_ALPHA(color) * coverage);
 }
 
-void Cubc_CanvasClear(Cubc_Canvas* canvas, Cubc_Color color) {
-    for (int i = 0; i < canvas->w * canvas->h; i++) {
-        canvas->pixels[i] = color.color;
+// Reference implementation of _Cubc_OverRow. A premultiplied source with
+// zero alpha still adds its color channels, so only all-zero pixels leave the
+// destination unchanged there.
+static void _Cubc_OverRowScalar(uint32_t* dst, const uint32_t* src, size_t n,
+                                Cubc_AlphaMode alpha) {
+    uint32_t clear_mask = alpha == CUBC_ALPHA_PREMULTIPLIED ? 0xffffffff : 0xff;
+    for (size_t i = 0; i < n; i++) {
+        if (CUBC_ALPHA(src[i]) == 255) {
+            dst[i] = src[i];
+        } else if ((src[i] & clear_mask) != 0) {
+            dst[i] = _Cubc_PixelOver(dst[i], src[i], alpha);
+        }
     }
 }
-void Cubc_CanvasPixel(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
-                      Cubc_Color color) {
-    if (x + y * canvas->w < canvas->w * canvas->h) {
-        CUBC_CANVAS_AT(*canvas, x, y) = color.color;
+
+// Reference implementation of _Cubc_CoverRow.
+static void _Cubc_CoverRowScalar(uint32_t* dst, const uint8_t* coverage,
+                                 size_t n, uint32_t color,
+                                 Cubc_AlphaMode alpha) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = _Cubc_PixelOver(
+            dst[i], _Cubc_Coverage(color, coverage[i], alpha), alpha);
     }
 }
 
-void Cubc_CanvasPixelV(Cubc_Canvas* canvas, Cubc_V2u pos, Cubc_Color color) {
-    CUBC_CANVAS_AT(*canvas, pos.x, pos.y) = color.color;
+// A pixel's worth of signed area in the buffers of _Cubc_AccumulateRow.
+#define CUBC_AREA_ONE 65536
+
+// The coverage of a pixel whose summed signed area is `sum`. Nonzero winding
+// clamps its magnitude, even-odd folds it over every two whole pixels. The
+// sums wrap around, which only changes their multiple of those.
+static inline uint8_t _Cubc_AreaCoverage(uint32_t sum, bool even_odd) {
+    uint32_t v;
+    if (even_odd) {
+        v = sum & (2 * CUBC_AREA_ONE - 1);
+        v = v > CUBC_AREA_ONE ? 2 * CUBC_AREA_ONE - v : v;
+    } else {
+        v = (int32_t) sum < 0 ? 0 - sum : sum;
+        v = v > CUBC_AREA_ONE ? CUBC_AREA_ONE : v;
+    }
+    return (uint8_t) ((v * 255 + CUBC_AREA_ONE / 2) >> 16);
 }
 
-void Cubc_CanvasLine(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0, uint32_t x1,
-                     uint32_t y1, Cubc_Color color) {
-    bool steep = false;
-    if (x0 - x1 < y0 - y1) {
-        SWAP(x0, y0);
-        SWAP(x1, y1);
-        steep = true;
-    }
-    if (x0 > x1) {
-        SWAP(x0, x1);
-        SWAP(y0, y1);
-    }
-    int dx      = x1 - x0;
-    int dy      = y1 - y0;
-    int derror2 = dy * 2;
-    int error2  = 0;
-    int y       = y0;
-    for (int x = x0; x <= x1; x++) {
-        if (steep) {
-            Cubc_CanvasPixel(canvas, y, x, color);
-        } else {
-            Cubc_CanvasPixel(canvas, x, y, color);
+static void _Cubc_AccumulateTail(uint8_t* coverage, int32_t* area, size_t n,
+                                 bool even_odd, uint32_t sum) {
+    for (size_t i = 0; i < n; i++) {
+        sum         += (uint32_t) area[i];
+        area[i]      = 0;
+        coverage[i]  = _Cubc_AreaCoverage(sum, even_odd);
+    }
+}
+
+// Reference implementation of _Cubc_AccumulateRow.
+static void _Cubc_AccumulateRowScalar(uint8_t* coverage, int32_t* area,
+                                      size_t n, bool even_odd) {
+    _Cubc_AccumulateTail(coverage, area, n, even_odd, 0);
+}
+
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+static inline __m128i _Cubc_Div255x8(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Source-over of 2 pixels widened to 16-bit channels.
+static inline __m128i _Cubc_Over16Sse2(__m128i d, __m128i s,
+                                       bool premultiplied) {
+    __m128i a   = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0), 0);
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    __m128i dd  = _mm_mullo_epi16(d, inv);
+    if (premultiplied) {
+        return _mm_add_epi16(s, _Cubc_Div255x8(dd));
+    }
+    // Setting the source alpha channel to 255 makes the alpha lane come out
+    // as sa + da * (255 - sa) / 255 from the same expression.
+    __m128i s1 = _mm_or_si128(s, _mm_setr_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+    return _Cubc_Div255x8(_mm_add_epi16(_mm_mullo_epi16(s1, a), dd));
+}
+
+static void _Cubc_OverRowSse2(uint32_t* dst, const uint32_t* src, size_t n,
+                              Cubc_AlphaMode alpha) {
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32(0xff);
+    bool premultiplied   = alpha == CUBC_ALPHA_PREMULTIPLIED;
+    const __m128i clear  = _mm_set1_epi32(premultiplied ? 0xffffffff : 0xff);
+    size_t i             = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s  = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i sa = _mm_and_si128(s, opaque);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, opaque)) == 0xffff) {
+            _mm_storeu_si128((__m128i*) (dst + i), s);
+            continue;
         }
-        error2 += derror2;
-        if (error2 > dx) {
-            y      += (y1 > y0 ? 1 : -1);
-            error2 -= dx * 2;
+        __m128i sc = _mm_and_si128(s, clear);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sc, zero)) == 0xffff) {
+            continue;
         }
+        __m128i d  = _mm_loadu_si128((const __m128i*) (dst + i));
+        __m128i lo = _Cubc_Over16Sse2(_mm_unpacklo_epi8(d, zero),
+                                      _mm_unpacklo_epi8(s, zero),
+                                      premultiplied);
+        __m128i hi = _Cubc_Over16Sse2(_mm_unpackhi_epi8(d, zero),
+                                      _mm_unpackhi_epi8(s, zero),
+                                      premultiplied);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(lo, hi));
     }
+    _Cubc_OverRowScalar(dst + i, src + i, n - i, alpha);
 }
 
-void Cubc_CanvasLineV(Cubc_Canvas* canvas, Cubc_V2u begin, Cubc_V2u end,
-                      Cubc_Color color) {
-    Cubc_CanvasLine(canvas, begin.x, begin.y, end.x, end.y, color);
+static void _Cubc_CoverRowSse2(uint32_t* dst, const uint8_t* coverage,
+                               size_t n, uint32_t color,
+                               Cubc_AlphaMode alpha) {
+    const __m128i zero = _mm_setzero_si128();
+    bool premultiplied = alpha == CUBC_ALPHA_PREMULTIPLIED;
+    const __m128i c    = _mm_unpacklo_epi8(_mm_set1_epi32((int32_t) color),
+                                           zero);
+    // Straight alpha only scales the alpha channel: the max with `lowest`
+    // turns the coverage of the color channels into 255.
+    const __m128i lowest =
+        premultiplied ? zero : _mm_set1_epi64x(0x00ff00ff00ff0000);
+    size_t i             = 0;
+    for (; i + 4 <= n; i += 4) {
+        int32_t quad;
+        memcpy(&quad, coverage + i, sizeof(quad));
+        // One coverage per pixel, repeated over its four channels.
+        __m128i k  = _mm_unpacklo_epi8(_mm_cvtsi32_si128(quad), zero);
+        k          = _mm_unpacklo_epi16(k, k);
+        __m128i d  = _mm_loadu_si128((const __m128i*) (dst + i));
+        __m128i s0 = _mm_max_epi16(_mm_unpacklo_epi32(k, k), lowest);
+        __m128i s1 = _mm_max_epi16(_mm_unpackhi_epi32(k, k), lowest);
+        __m128i lo = _Cubc_Over16Sse2(_mm_unpacklo_epi8(d, zero),
+                                      _Cubc_Div255x8(_mm_mullo_epi16(c, s0)),
+                                      premultiplied);
+        __m128i hi = _Cubc_Over16Sse2(_mm_unpackhi_epi8(d, zero),
+                                      _Cubc_Div255x8(_mm_mullo_epi16(c, s1)),
+                                      premultiplied);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+    _Cubc_CoverRowScalar(dst + i, coverage + i, n - i, color, alpha);
 }
 
-void Cubc_CanvasWireframeTriangle(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0,
-                                  uint32_t x1, uint32_t y1, uint32_t x2,
-                                  uint32_t y2, Cubc_Color color) {
-    Cubc_CanvasLine(canvas, x0, y0, x1, y1, color);
-    Cubc_CanvasLine(canvas, x1, y1, x2, y2, color);
-    Cubc_CanvasLine(canvas, x2, y2, x0, y0, color);
+// _Cubc_AreaCoverage of 4 sums.
+static inline __m128i _Cubc_AreaCoverageSse2(__m128i v, bool even_odd) {
+    const __m128i one = _mm_set1_epi32(CUBC_AREA_ONE);
+    __m128i clamp;
+    if (even_odd) {
+        v           = _mm_and_si128(v, _mm_set1_epi32(2 * CUBC_AREA_ONE - 1));
+        __m128i far = _mm_cmpgt_epi32(v, one);
+        clamp = _mm_and_si128(far, _mm_sub_epi32(_mm_add_epi32(one, one), v));
+        v     = _mm_or_si128(clamp, _mm_andnot_si128(far, v));
+    } else {
+        __m128i sign = _mm_srai_epi32(v, 31);
+        v            = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+        // The magnitude of INT32_MIN stays negative, and clamps too.
+        __m128i far  = _mm_or_si128(_mm_cmpgt_epi32(v, one),
+                                    _mm_cmplt_epi32(v, _mm_setzero_si128()));
+        v = _mm_or_si128(_mm_and_si128(far, one), _mm_andnot_si128(far, v));
+    }
+    v = _mm_sub_epi32(_mm_slli_epi32(v, 8), v);
+    v = _mm_add_epi32(v, _mm_set1_epi32(CUBC_AREA_ONE / 2));
+    return _mm_srli_epi32(v, 16);
 }
 
-void Cubc_CanvasWireframeTriangleV(Cubc_Canvas* canvas, Cubc_V2u pos0,
-                                   Cubc_V2u pos1, Cubc_V2u pos2,
-                                   Cubc_Color color) {
-    Cubc_CanvasLineV(canvas, pos0, pos1, color);
-    Cubc_CanvasLineV(canvas, pos1, pos2, color);
-    Cubc_CanvasLineV(canvas, pos2, pos0, color);
+static void _Cubc_AccumulateRowSse2(uint8_t* coverage, int32_t* area,
+                                    size_t n, bool even_odd) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum        = zero;
+    size_t i           = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i* p = (__m128i*) (area + i + 4 * k);
+            __m128i a  = _mm_loadu_si128(p);
+            _mm_storeu_si128(p, zero);
+            // Prefix sum within the vector, then carry in the sum so far.
+            a    = _mm_add_epi32(a, _mm_slli_si128(a, 4));
+            a    = _mm_add_epi32(a, _mm_slli_si128(a, 8));
+            a    = _mm_add_epi32(a, sum);
+            sum  = _mm_shuffle_epi32(a, 0xff);
+            v[k] = _Cubc_AreaCoverageSse2(a, even_odd);
+        }
+        __m128i words = _mm_packs_epi32(v[0], v[1]);
+        _mm_storel_epi64((__m128i*) (coverage + i),
+                         _mm_packus_epi16(words, words));
+    }
+    _Cubc_AccumulateTail(coverage + i, area + i, n - i, even_odd,
+                         (uint32_t) _mm_cvtsi128_si32(sum));
 }
+CUBC_TARGET_END
+#endif
 
-int _Cubc_InterpolateX(uint32_t y0, uint32_t x0, uint32_t y1, uint32_t x1,
-                       uint32_t y) {
-    if (y1 == y0)
-        return x0;
-    int64_t dx = (int64_t) (x1 - x0);
-    int64_t dy = (int64_t) (y1 - y0);
-    return x0 + (y - y0) * dx / dy;
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+static inline __m256i _Cubc_Div255x16(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
 }
 
-int _Cubc_InterpolateXV(Cubc_V2u pos0, Cubc_V2u pos1, uint32_t y) {
-    return _Cubc_InterpolateX(pos0.x, pos0.y, pos1.x, pos1.y, y);
+// Source-over of 4 pixels widened to 16-bit channels.
+static inline __m256i _Cubc_Over16Avx2(__m256i d, __m256i s,
+                                       bool premultiplied) {
+    __m256i a   = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0), 0);
+    __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    __m256i dd  = _mm256_mullo_epi16(d, inv);
+    if (premultiplied) {
+        return _mm256_add_epi16(s, _Cubc_Div255x16(dd));
+    }
+    // Setting the source alpha channel to 255 makes the alpha lane come out
+    // as sa + da * (255 - sa) / 255 from the same expression.
+    __m256i s1 = _mm256_or_si256(
+        s, _mm256_setr_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0,
+                             0, 0));
+    return _Cubc_Div255x16(_mm256_add_epi16(_mm256_mullo_epi16(s1, a), dd));
 }
 
-void Cubc_CanvasTriangle(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0,
-                         uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2,
-                         Cubc_Color color) {
-    if (y1 < y0) {
-        SWAP(y0, y1);
-        SWAP(x0, x1);
+static void _Cubc_OverRowAvx2(uint32_t* dst, const uint32_t* src, size_t n,
+                              Cubc_AlphaMode alpha) {
+    const __m256i zero   = _mm256_setzero_si256();
+    const __m256i opaque = _mm256_set1_epi32(0xff);
+    bool premultiplied   = alpha == CUBC_ALPHA_PREMULTIPLIED;
+    const __m256i clear  = _mm256_set1_epi32(premultiplied ? 0xffffffff : 0xff);
+    size_t i             = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s  = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i sa = _mm256_and_si256(s, opaque);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, opaque)) == -1) {
+            _mm256_storeu_si256((__m256i*) (dst + i), s);
+            continue;
+        }
+        __m256i sc = _mm256_and_si256(s, clear);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sc, zero)) == -1) {
+            continue;
+        }
+        __m256i d  = _mm256_loadu_si256((const __m256i*) (dst + i));
+        __m256i lo = _Cubc_Over16Avx2(_mm256_unpacklo_epi8(d, zero),
+                                      _mm256_unpacklo_epi8(s, zero),
+                                      premultiplied);
+        __m256i hi = _Cubc_Over16Avx2(_mm256_unpackhi_epi8(d, zero),
+                                      _mm256_unpackhi_epi8(s, zero),
+                                      premultiplied);
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_packus_epi16(lo, hi));
     }
-    if (y2 < y0) {
-        SWAP(y2, y0);
-        SWAP(x2, x0);
+    _mm256_zeroupper();
+    _Cubc_OverRowScalar(dst + i, src + i, n - i, alpha);
+}
+
+// Composites `c`, unpacked to 16 bits per channel, over the 8 pixels `d`
+// with its alpha scaled by their coverage `k8`.
+static inline __m256i _Cubc_Cover8Avx2(__m256i d, __m128i k8, __m256i c,
+                                       __m256i lowest, bool premultiplied) {
+    const __m256i zero = _mm256_setzero_si256();
+    // One coverage per pixel, repeated over its four channels, with pixels
+    // 0-3 in the low lane and 4-7 in the high one like the unpacks of `d`
+    // below.
+    k8         = _mm_unpacklo_epi8(k8, _mm_setzero_si128());
+    __m256i k  = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_unpacklo_epi16(k8, k8)),
+        _mm_unpackhi_epi16(k8, k8), 1);
+    __m256i s0 = _mm256_max_epi16(_mm256_unpacklo_epi32(k, k), lowest);
+    __m256i s1 = _mm256_max_epi16(_mm256_unpackhi_epi32(k, k), lowest);
+    __m256i lo = _Cubc_Over16Avx2(
+        _mm256_unpacklo_epi8(d, zero),
+        _Cubc_Div255x16(_mm256_mullo_epi16(c, s0)), premultiplied);
+    __m256i hi = _Cubc_Over16Avx2(
+        _mm256_unpackhi_epi8(d, zero),
+        _Cubc_Div255x16(_mm256_mullo_epi16(c, s1)), premultiplied);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+// The last pixels take masked loads and stores, which leave the pixels past
+// them alone.
+static void _Cubc_CoverRowAvx2(uint32_t* dst, const uint8_t* coverage,
+                               size_t n, uint32_t color,
+                               Cubc_AlphaMode alpha) {
+    const __m256i zero = _mm256_setzero_si256();
+    bool premultiplied = alpha == CUBC_ALPHA_PREMULTIPLIED;
+    const __m256i c    = _mm256_unpacklo_epi8(
+        _mm256_set1_epi32((int32_t) color), zero);
+    // Straight alpha only scales the alpha channel: the max with `lowest`
+    // turns the coverage of the color channels into 255.
+    const __m256i lowest =
+        premultiplied ? zero : _mm256_set1_epi64x(0x00ff00ff00ff0000);
+    size_t i             = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = _mm256_loadu_si256((const __m256i*) (dst + i));
+        __m256i k = _Cubc_Cover8Avx2(
+            d, _mm_loadl_epi64((const __m128i*) (coverage + i)), c, lowest,
+            premultiplied);
+        _mm256_storeu_si256((__m256i*) (dst + i), k);
     }
-    if (y2 < y1) {
-        SWAP(y2, y1);
-        SWAP(x2, x1);
+    if (i < n) {
+        // The coverage is put together in a register: loading it back from
+        // memory right after storing it byte by byte would stall.
+        uint64_t last = 0;
+        for (size_t j = n; j-- > i;) {
+            last = last << 8 | coverage[j];
+        }
+        __m256i in = _mm256_cmpgt_epi32(
+            _mm256_set1_epi32((int32_t) (n - i)),
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i d  = _mm256_maskload_epi32((const int*) (dst + i), in);
+        __m256i k  = _Cubc_Cover8Avx2(d, _mm_set_epi64x(0, (int64_t) last), c,
+                                      lowest, premultiplied);
+        _mm256_maskstore_epi32((int*) (dst + i), in, k);
     }
+    _mm256_zeroupper();
+}
 
-    for (int y = y0; y <= y1; y++) {
-        uint32_t x_begin = _Cubc_InterpolateX(y0, x0, y2, x2, y);
-        uint32_t x_end   = _Cubc_InterpolateX(y0, x0, y1, x1, y);
-        Cubc_CanvasLine(canvas, x_begin, y, x_end, y, color);
+// _Cubc_AreaCoverage of 8 sums.
+static inline __m256i _Cubc_AreaCoverageAvx2(__m256i v, bool even_odd) {
+    const __m256i one = _mm256_set1_epi32(CUBC_AREA_ONE);
+    if (even_odd) {
+        v = _mm256_and_si256(v, _mm256_set1_epi32(2 * CUBC_AREA_ONE - 1));
+        v = _mm256_min_epi32(v, _mm256_sub_epi32(_mm256_add_epi32(one, one),
+                                                 v));
+    } else {
+        // The magnitude of INT32_MIN stays 2^31, which clamps as unsigned.
+        v = _mm256_min_epu32(_mm256_abs_epi32(v), one);
     }
+    v = _mm256_sub_epi32(_mm256_slli_epi32(v, 8), v);
+    v = _mm256_add_epi32(v, _mm256_set1_epi32(CUBC_AREA_ONE / 2));
+    return _mm256_srli_epi32(v, 16);
+}
 
-    for (int y = y1; y <= y2; y++) {
-        uint32_t x_begin = _Cubc_InterpolateX(y0, x0, y2, x2, y);
-        uint32_t x_end   = _Cubc_InterpolateX(y1, x1, y2, x2, y);
-        Cubc_CanvasLine(canvas, x_begin, y, x_end, y, color);
+static void _Cubc_AccumulateRowAvx2(uint8_t* coverage, int32_t* area,
+                                    size_t n, bool even_odd) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i last = _mm256_set1_epi32(7);
+    __m256i sum        = zero;
+    size_t i           = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v[2];
+        for (int k = 0; k < 2; k++) {
+            __m256i* p = (__m256i*) (area + i + 8 * k);
+            __m256i a  = _mm256_loadu_si256(p);
+            _mm256_storeu_si256(p, zero);
+            // Prefix sums within both lanes, then the low lane's total
+            // carried into the high one and the sum so far into both.
+            a         = _mm256_add_epi32(a, _mm256_slli_si256(a, 4));
+            a         = _mm256_add_epi32(a, _mm256_slli_si256(a, 8));
+            __m256i t = _mm256_permute2x128_si256(a, a, 0x08);
+            a         = _mm256_add_epi32(a, _mm256_shuffle_epi32(t, 0xff));
+            a         = _mm256_add_epi32(a, sum);
+            sum       = _mm256_permutevar8x32_epi32(a, last);
+            v[k]      = _Cubc_AreaCoverageAvx2(a, even_odd);
+        }
+        // The packs work within lanes, the permute puts 0-7 before 8-15.
+        __m256i words = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(v[0], v[1]), 0xd8);
+        _mm_storeu_si128((__m128i*) (coverage + i),
+                         _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                          _mm256_extracti128_si256(words, 1)));
     }
+    uint32_t carry = (uint32_t) _mm256_cvtsi256_si32(sum);
+    _mm256_zeroupper();
+    _Cubc_AccumulateTail(coverage + i, area + i, n - i, even_odd, carry);
 }
+CUBC_TARGET_END
+#endif
 
-void Cubc_CanvasTriangleV(Cubc_Canvas* canvas, Cubc_V2u pos0, Cubc_V2u pos1,
-                          Cubc_V2u pos2, Cubc_Color color) {
-    Cubc_CanvasTriangle(canvas, pos0.x, pos0.y, pos1.x, pos1.y, pos2.x, pos2.y,
-                        color);
+#if defined(CUBC_HAVE_AVX512)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX512)
+static inline __m512i _Cubc_Div255x32(__m512i x) {
+    x = _mm512_add_epi16(x, _mm512_set1_epi16(128));
+    return _mm512_srli_epi16(_mm512_add_epi16(x, _mm512_srli_epi16(x, 8)), 8);
 }
 
-void Cubc_CanvasRect(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t w,
-                     uint32_t h, Cubc_Color color) {
-    for (int dy = y; dy <= y + h; dy++) {
-        Cubc_CanvasLine(canvas, x, dy, x + w, dy, color);
+// Source-over of 8 pixels widened to 16-bit channels.
+static inline __m512i _Cubc_Over16Avx512(__m512i d, __m512i s,
+                                         bool premultiplied) {
+    __m512i a   = _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(s, 0), 0);
+    __m512i inv = _mm512_sub_epi16(_mm512_set1_epi16(255), a);
+    __m512i dd  = _mm512_mullo_epi16(d, inv);
+    if (premultiplied) {
+        return _mm512_add_epi16(s, _Cubc_Div255x32(dd));
     }
+    // 255 in the alpha channel of every pixel, the low 16 bits of each 64.
+    __m512i s1 = _mm512_or_si512(s, _mm512_set1_epi64(255));
+    return _Cubc_Div255x32(_mm512_add_epi16(_mm512_mullo_epi16(s1, a), dd));
 }
-void Cubc_CanvasRectV(Cubc_Canvas* canvas, Cubc_V2f pos, Cubc_V2f size,
-                      Cubc_Color color) {
 
-    Cubc_CanvasRect(canvas, pos.x, pos.y, size.x, size.y, color);
+static void _Cubc_OverRowAvx512(uint32_t* dst, const uint32_t* src, size_t n,
+                                Cubc_AlphaMode alpha) {
+    const __m512i zero   = _mm512_setzero_si512();
+    const __m512i opaque = _mm512_set1_epi32(0xff);
+    bool premultiplied   = alpha == CUBC_ALPHA_PREMULTIPLIED;
+    const __m512i clear  = _mm512_set1_epi32(premultiplied ? -1 : 0xff);
+    size_t i             = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i s = _mm512_loadu_si512(src + i);
+        if (_mm512_cmpeq_epi32_mask(_mm512_and_si512(s, opaque), opaque) ==
+            0xffff) {
+            _mm512_storeu_si512(dst + i, s);
+            continue;
+        }
+        if (_mm512_test_epi32_mask(s, clear) == 0) {
+            continue;
+        }
+        __m512i d  = _mm512_loadu_si512(dst + i);
+        __m512i lo = _Cubc_Over16Avx512(_mm512_unpacklo_epi8(d, zero),
+                                        _mm512_unpacklo_epi8(s, zero),
+                                        premultiplied);
+        __m512i hi = _Cubc_Over16Avx512(_mm512_unpackhi_epi8(d, zero),
+                                        _mm512_unpackhi_epi8(s, zero),
+                                        premultiplied);
+        _mm512_storeu_si512(dst + i, _mm512_packus_epi16(lo, hi));
+    }
+    _mm256_zeroupper();
+    _Cubc_OverRowScalar(dst + i, src + i, n - i, alpha);
 }
-void Cubc_CanvasRectR(Cubc_Canvas* canvas, Cubc_Rect rect, Cubc_Color color) {
-    Cubc_CanvasRect(canvas, rect.x, rect.y, rect.w, rect.h, color);
+
+// Composites `c`, unpacked to 16 bits per channel, over the 16 pixels `d`
+// with its alpha scaled by their coverage `k16`.
+static inline __m512i _Cubc_Cover16Avx512(__m512i d, __m128i k16, __m512i c,
+                                          __m512i lowest,
+                                          bool premultiplied) {
+    const __m512i zero = _mm512_setzero_si512();
+    // One coverage per pixel in both words of its dword, spread over its
+    // four channels by the unpacks like those of `d` below.
+    __m512i k  = _mm512_mullo_epi32(_mm512_cvtepu8_epi32(k16),
+                                    _mm512_set1_epi32(0x00010001));
+    __m512i s0 = _mm512_max_epi16(_mm512_unpacklo_epi32(k, k), lowest);
+    __m512i s1 = _mm512_max_epi16(_mm512_unpackhi_epi32(k, k), lowest);
+    __m512i lo = _Cubc_Over16Avx512(
+        _mm512_unpacklo_epi8(d, zero),
+        _Cubc_Div255x32(_mm512_mullo_epi16(c, s0)), premultiplied);
+    __m512i hi = _Cubc_Over16Avx512(
+        _mm512_unpackhi_epi8(d, zero),
+        _Cubc_Div255x32(_mm512_mullo_epi16(c, s1)), premultiplied);
+    return _mm512_packus_epi16(lo, hi);
 }
 
-Cubc_Color Cubc_ColorBlend(Cubc_Color src, Cubc_Color dest) {
-    return CLITERAL(Cubc_Color){
-        src.r * src.a + dest.r * (1 - dest.a),
-        src.g * src.a + dest.g * (1 - dest.a),
-        src.b * src.a + dest.b * (1 - dest.a),
-        src.a,
-    };
+// The last pixels take masked loads and stores, which leave the pixels past
+// them alone.
+static void _Cubc_CoverRowAvx512(uint32_t* dst, const uint8_t* coverage,
+                                 size_t n, uint32_t color,
+                                 Cubc_AlphaMode alpha) {
+    const __m512i zero = _mm512_setzero_si512();
+    bool premultiplied = alpha == CUBC_ALPHA_PREMULTIPLIED;
+    const __m512i c    = _mm512_unpacklo_epi8(
+        _mm512_set1_epi32((int32_t) color), zero);
+    // Straight alpha only scales the alpha channel: the max with `lowest`
+    // turns the coverage of the color channels into 255.
+    const __m512i lowest =
+        premultiplied ? zero : _mm512_set1_epi64(0x00ff00ff00ff0000);
+    size_t i             = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i d = _mm512_loadu_si512(dst + i);
+        __m512i k = _Cubc_Cover16Avx512(
+            d, _mm_loadu_si128((const __m128i*) (coverage + i)), c, lowest,
+            premultiplied);
+        _mm512_storeu_si512(dst + i, k);
+    }
+    if (i < n) {
+        __mmask16 in = (__mmask16) ((1u << (n - i)) - 1);
+        __m512i d    = _mm512_maskz_loadu_epi32(in, dst + i);
+        __m128i k16  = _mm512_castsi512_si128(
+            _mm512_maskz_loadu_epi8((__mmask64) in, coverage + i));
+        _mm512_mask_storeu_epi32(
+            dst + i, in, _Cubc_Cover16Avx512(d, k16, c, lowest, premultiplied));
+    }
+    _mm256_zeroupper();
 }
+CUBC_TARGET_END
+#endif
 
-Cubc_Color Cubc_ColorMultiplyBlend(Cubc_Color a, Cubc_Color b) {
-    return CLITERAL(Cubc_Color){
-        .r = a.r * b.r,
-        .g = a.g * b.g,
-        .b = a.b * b.b,
-        .a = a.a * b.a,
-    };
+static inline void _Cubc_OverRow(uint32_t* dst, const uint32_t* src, size_t n,
+                                 Cubc_AlphaMode alpha) {
+    _Cubc_ActiveKernels()->over_row(dst, src, n, alpha);
 }
-Cubc_Color Cubc_ColorScreenBlend(Cubc_Color a, Cubc_Color b) {
-    return CLITERAL(Cubc_Color){
-        .r = 1 - (1 - a.r) * (1 - b.r),
-        .g = 1 - (1 - a.g) * (1 - b.g),
-        .b = 1 - (1 - a.b) * (1 - b.b),
-        .a = 1 - (1 - a.a) * (1 - b.a),
-    };
+
+// Composites `color`, premultiplied when `alpha` is, over `n` pixels with its
+// alpha scaled by `coverage[i]` / 255.
+static inline void _Cubc_CoverRow(uint32_t* dst, const uint8_t* coverage,
+                                  size_t n, uint32_t color,
+                                  Cubc_AlphaMode alpha) {
+    _Cubc_ActiveKernels()->cover_row(dst, coverage, n, color, alpha);
 }
-Cubc_Color Cubc_ColorOverlayBlend(Cubc_Color a, Cubc_Color b) {
-    if (a.color / (float) 0xffffffff < 0.5) {
-        return CLITERAL(Cubc_Color){
-            .r = 2 * a.r * b.r,
-            .g = 2 * a.g * b.g,
-            .b = 2 * a.b * b.b,
-            .a = 2 * a.a * b.a,
-        };
+
+// Sums the `n` signed areas of a row from the left into the coverage of each
+// pixel, by nonzero winding or `even_odd`, and clears them.
+static inline void _Cubc_AccumulateRow(uint8_t* coverage, int32_t* area,
+                                       size_t n, bool even_odd) {
+    _Cubc_ActiveKernels()->accumulate_row(coverage, area, n, even_odd);
+}
+
+static uint32_t _Cubc_PixelPremultiply(uint32_t p) {
+    uint32_t a   = CUBC_ALPHA(p);
+    uint32_t out = a;
+    for (int shift = 8; shift < 32; shift += 8) {
+        out |= _Cubc_Div255(((p >> shift) & 0xff) * a) << shift;
     }
-    return CLITERAL(Cubc_Color){
-        .r = 1 - 2 * (1 - a.r) * (1 - b.r),
-        .g = 1 - 2 * (1 - a.g) * (1 - b.g),
-        .b = 1 - 2 * (1 - a.b) * (1 - b.b),
-        .a = 1 - 2 * (1 - a.a) * (1 - b.a),
-    };
+    return out;
 }
-Cubc_Color Cubc_ColorHardLightBlend(Cubc_Color a, Cubc_Color b) {
-    if (b.color / (float) 0xffffffff < 0.5) {
-        return CLITERAL(Cubc_Color){
-            .r = 2 * a.r * b.r,
-            .g = 2 * a.g * b.g,
-            .b = 2 * a.b * b.b,
-            .a = 2 * a.a * b.a,
-        };
+
+// Rounds to nearest. Channels above alpha, which premultiplied pixels can't
+// have, saturate.
+static uint32_t _Cubc_PixelUnpremultiply(uint32_t p) {
+    uint32_t a   = CUBC_ALPHA(p);
+    uint32_t out = a;
+    if (a == 0) {
+        return out;
     }
-    return CLITERAL(Cubc_Color){
-        .r = 1 - 2 * (1 - a.r) * (1 - b.r),
-        .g = 1 - 2 * (1 - a.g) * (1 - b.g),
-        .b = 1 - 2 * (1 - a.b) * (1 - b.b),
-        .a = 1 - 2 * (1 - a.a) * (1 - b.a),
-    };
+    for (int shift = 8; shift < 32; shift += 8) {
+        uint32_t c = (((p >> shift) & 0xff) * 255 + a / 2) / a;
+        out |= (c > 255 ? 255 : c) << shift;
+    }
+    return out;
 }
-Cubc_Color Cubc_ColorSoftLightBlend(Cubc_Color a, Cubc_Color b) {
-    return CLITERAL(Cubc_Color){
-        .r = a.r * a.r * (1 - b.r) + 2 * b.r * a.r,
-        .g = a.g * a.g * (1 - b.g) + 2 * b.g * a.g,
-        .b = a.b * a.b * (1 - b.b) + 2 * b.b * a.b,
-        .a = a.a * a.a * (1 - b.a) + 2 * b.a * a.a,
-    };
+
+// Reference implementations of _Cubc_PremultiplyRow and
+// _Cubc_UnpremultiplyRow.
+static void _Cubc_PremultiplyRowScalar(uint32_t* dst, const uint32_t* src,
+                                       size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = _Cubc_PixelPremultiply(src[i]);
+    }
+}
+
+static void _Cubc_UnpremultiplyRowScalar(uint32_t* dst, const uint32_t* src,
+                                         size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = _Cubc_PixelUnpremultiply(src[i]);
+    }
+}
+
+// The SIMD kernels divide in single precision, which is exact here: a
+// quotient c * 255 / a that isn't a whole or half number is at least 1 / 510
+// away from one.
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+static void _Cubc_PremultiplyRowSse2(uint32_t* dst, const uint32_t* src,
+                                     size_t n) {
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(0xff);
+    size_t i            = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p  = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i lo = _mm_unpacklo_epi8(p, zero);
+        __m128i hi = _mm_unpackhi_epi8(p, zero);
+        lo         = _Cubc_Div255x8(_mm_mullo_epi16(
+            lo, _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0), 0)));
+        hi         = _Cubc_Div255x8(_mm_mullo_epi16(
+            hi, _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0), 0)));
+        __m128i r  = _mm_packus_epi16(lo, hi);
+        r = _mm_or_si128(_mm_andnot_si128(alpha, r), _mm_and_si128(alpha, p));
+        _mm_storeu_si128((__m128i*) (dst + i), r);
+    }
+    _Cubc_PremultiplyRowScalar(dst + i, src + i, n - i);
+}
+
+// Unpremultiplies the pixel widened to 32-bit channels in `c`.
+static inline __m128i _Cubc_Unpremultiply1Sse2(__m128i c) {
+    __m128 f = _mm_cvtepi32_ps(c);
+    __m128 a = _mm_shuffle_ps(f, f, 0);
+    __m128 q = _mm_div_ps(_mm_mul_ps(f, _mm_set1_ps(255.0f)), a);
+    // Pixels with zero alpha divide by zero and come out as zero.
+    q = _mm_and_ps(q, _mm_cmpneq_ps(a, _mm_setzero_ps()));
+    return _mm_cvttps_epi32(_mm_add_ps(q, _mm_set1_ps(0.5f)));
+}
+
+static void _Cubc_UnpremultiplyRowSse2(uint32_t* dst, const uint32_t* src,
+                                       size_t n) {
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(0xff);
+    size_t i            = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p  = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i lo = _mm_unpacklo_epi8(p, zero);
+        __m128i hi = _mm_unpackhi_epi8(p, zero);
+        __m128i r  = _mm_packus_epi16(
+            _mm_packs_epi32(
+                _Cubc_Unpremultiply1Sse2(_mm_unpacklo_epi16(lo, zero)),
+                _Cubc_Unpremultiply1Sse2(_mm_unpackhi_epi16(lo, zero))),
+            _mm_packs_epi32(
+                _Cubc_Unpremultiply1Sse2(_mm_unpacklo_epi16(hi, zero)),
+                _Cubc_Unpremultiply1Sse2(_mm_unpackhi_epi16(hi, zero))));
+        r = _mm_or_si128(_mm_andnot_si128(alpha, r), _mm_and_si128(alpha, p));
+        _mm_storeu_si128((__m128i*) (dst + i), r);
+    }
+    _Cubc_UnpremultiplyRowScalar(dst + i, src + i, n - i);
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+static void _Cubc_PremultiplyRowAvx2(uint32_t* dst, const uint32_t* src,
+                                     size_t n) {
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32(0xff);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p  = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i lo = _mm256_unpacklo_epi8(p, zero);
+        __m256i hi = _mm256_unpackhi_epi8(p, zero);
+        lo         = _Cubc_Div255x16(_mm256_mullo_epi16(
+            lo, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0), 0)));
+        hi         = _Cubc_Div255x16(_mm256_mullo_epi16(
+            hi, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0), 0)));
+        __m256i r  = _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), p, alpha);
+        _mm256_storeu_si256((__m256i*) (dst + i), r);
+    }
+    _mm256_zeroupper();
+    _Cubc_PremultiplyRowScalar(dst + i, src + i, n - i);
+}
+
+// Unpremultiplies the two pixels widened to 32-bit channels in `c`.
+static inline __m256i _Cubc_Unpremultiply2Avx2(__m256i c) {
+    __m256 f = _mm256_cvtepi32_ps(c);
+    __m256 a = _mm256_shuffle_ps(f, f, 0);
+    __m256 q = _mm256_div_ps(_mm256_mul_ps(f, _mm256_set1_ps(255.0f)), a);
+    // Pixels with zero alpha divide by zero and come out as zero.
+    q = _mm256_and_ps(q, _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+    return _mm256_cvttps_epi32(_mm256_add_ps(q, _mm256_set1_ps(0.5f)));
+}
+
+static void _Cubc_UnpremultiplyRowAvx2(uint32_t* dst, const uint32_t* src,
+                                       size_t n) {
+    const __m256i alpha = _mm256_set1_epi32(0xff);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p  = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i c0 = _Cubc_Unpremultiply2Avx2(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*) (src + i))));
+        __m256i c1 = _Cubc_Unpremultiply2Avx2(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*) (src + i + 2))));
+        __m256i c2 = _Cubc_Unpremultiply2Avx2(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*) (src + i + 4))));
+        __m256i c3 = _Cubc_Unpremultiply2Avx2(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*) (src + i + 6))));
+        // The packs interleave the 128-bit lanes, pixels come out in the
+        // order 0 2 4 6 1 3 5 7.
+        __m256i r  = _mm256_packus_epi16(_mm256_packs_epi32(c0, c1),
+                                         _mm256_packs_epi32(c2, c3));
+        r          = _mm256_permutevar8x32_epi32(r, order);
+        r          = _mm256_blendv_epi8(r, p, alpha);
+        _mm256_storeu_si256((__m256i*) (dst + i), r);
+    }
+    _mm256_zeroupper();
+    _Cubc_UnpremultiplyRowScalar(dst + i, src + i, n - i);
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX512)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX512)
+static void _Cubc_PremultiplyRowAvx512(uint32_t* dst, const uint32_t* src,
+                                       size_t n) {
+    const __m512i zero = _mm512_setzero_si512();
+    size_t i           = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i p  = _mm512_loadu_si512(src + i);
+        __m512i lo = _mm512_unpacklo_epi8(p, zero);
+        __m512i hi = _mm512_unpackhi_epi8(p, zero);
+        lo         = _Cubc_Div255x32(_mm512_mullo_epi16(
+            lo, _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(lo, 0), 0)));
+        hi         = _Cubc_Div255x32(_mm512_mullo_epi16(
+            hi, _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(hi, 0), 0)));
+        // Alpha stays, it is the lowest byte of every pixel.
+        __m512i r  = _mm512_mask_blend_epi8(0x1111111111111111,
+                                            _mm512_packus_epi16(lo, hi), p);
+        _mm512_storeu_si512(dst + i, r);
+    }
+    _mm256_zeroupper();
+    _Cubc_PremultiplyRowScalar(dst + i, src + i, n - i);
+}
+CUBC_TARGET_END
+#endif
+
+static inline void _Cubc_PremultiplyRow(uint32_t* dst, const uint32_t* src,
+                                        size_t n) {
+    _Cubc_ActiveKernels()->premultiply_row(dst, src, n);
+}
+
+static inline void _Cubc_UnpremultiplyRow(uint32_t* dst, const uint32_t* src,
+                                          size_t n) {
+    _Cubc_ActiveKernels()->unpremultiply_row(dst, src, n);
+}
+
+static Cubc_AlphaMode _Cubc_AlphaModeOf(const Cubc_Canvas* canvas) {
+    return canvas->premultiplied ? CUBC_ALPHA_PREMULTIPLIED
+                                 : CUBC_ALPHA_STRAIGHT;
+}
+
+// Copies `n` pixels from the alpha convention `from` to `to`. `dst` may be
+// `src`.
+static void _Cubc_ConvertRow(uint32_t* dst, const uint32_t* src, size_t n,
+                             Cubc_AlphaMode from, Cubc_AlphaMode to) {
+    if (from == to) {
+        if (dst != src) {
+            memcpy(dst, src, n * sizeof(uint32_t));
+        }
+    } else if (to == CUBC_ALPHA_PREMULTIPLIED) {
+        _Cubc_PremultiplyRow(dst, src, n);
+    } else {
+        _Cubc_UnpremultiplyRow(dst, src, n);
+    }
+}
+
+// Blits up to this wide keep their source column table on the stack.
+#ifndef CUBC_BLIT_STACK_TABLE
+#define CUBC_BLIT_STACK_TABLE 1024
+#endif
+
+// Scaled rows are gathered into chunks of this many pixels before blending.
+#define CUBC_BLIT_CHUNK 256
+
+// Half float nearest to `value`, rounding ties to even like F16C.
+static uint16_t _Cubc_FloatToHalf(float value) {
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign  = f & 0x80000000u;
+    f             ^= sign;
+    uint32_t half;
+    if (f >= 0x47800000u) {
+        // Too large for a half, infinity or NaN.
+        half = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+    } else if (f < 0x38800000u) {
+        // Subnormal half: adding 0.5 lines the mantissa up and rounds it.
+        float v;
+        memcpy(&v, &f, sizeof(v));
+        v += 0.5f;
+        memcpy(&f, &v, sizeof(f));
+        half = f - 0x3f000000u;
+    } else {
+        uint32_t odd  = (f >> 13) & 1;
+        f            += ((uint32_t) (15 - 127) << 23) + 0xfff + odd;
+        half          = f >> 13;
+    }
+    return (uint16_t) (half | (sign >> 16));
+}
+
+static float _Cubc_HalfToFloat(uint16_t half) {
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    float value;
+    if (exponent == 0) {
+        value = (float) mantissa * (1.0f / 16777216.0f);
+    } else {
+        uint32_t f = exponent == 0x1f ? 0x7f800000u | (mantissa << 13)
+                                      : ((exponent + 112) << 23) |
+                                            (mantissa << 13);
+        memcpy(&value, &f, sizeof(value));
+    }
+    return half & 0x8000 ? -value : value;
+}
+
+static uint16_t _Cubc_ChannelToHalf(uint32_t c) {
+    return _Cubc_FloatToHalf((float) c * (1.0f / 255.0f));
+}
+
+// Clamps to [0, 1], NaN included, and rounds to 8 bits.
+static uint32_t _Cubc_HalfToChannel(uint16_t half) {
+    float v = _Cubc_HalfToFloat(half) * 255.0f;
+    v       = v > 0.0f ? v : 0.0f;
+    v       = v < 255.0f ? v : 255.0f;
+    return (uint32_t) (v + 0.5f);
+}
+
+// The RGBA8888 color `p` in `format`. Channels are rounded to nearest, which
+// for RGB565 is (c * 31 + 127) / 255 and (c * 63 + 127) / 255 done with a
+// multiply and a shift.
+static uint64_t _Cubc_EncodePixel(Cubc_PixelFormat format, uint32_t p) {
+    uint32_t r = p >> 24;
+    uint32_t g = (p >> 16) & 0xff;
+    uint32_t b = (p >> 8) & 0xff;
+    uint32_t a = p & 0xff;
+    switch (format) {
+    case CUBC_FORMAT_BGRA8888:
+        return (uint32_t) ((p >> 8) | (p << 24));
+    case CUBC_FORMAT_RGB565:
+        return (((r * 249 + 1014) >> 11) << 11) |
+               (((g * 253 + 505) >> 10) << 5) | ((b * 249 + 1014) >> 11);
+    case CUBC_FORMAT_A8:
+        return a;
+    case CUBC_FORMAT_RGBA16F:
+        return (uint64_t) _Cubc_ChannelToHalf(r) |
+               (uint64_t) _Cubc_ChannelToHalf(g) << 16 |
+               (uint64_t) _Cubc_ChannelToHalf(b) << 32 |
+               (uint64_t) _Cubc_ChannelToHalf(a) << 48;
+    default:
+        return p;
+    }
+}
+
+static uint32_t _Cubc_DecodePixel(Cubc_PixelFormat format, uint64_t v) {
+    switch (format) {
+    case CUBC_FORMAT_BGRA8888: {
+        uint32_t p = (uint32_t) v;
+        return (p << 8) | (p >> 24);
+    }
+    case CUBC_FORMAT_RGB565: {
+        uint32_t r = (v >> 11) & 0x1f;
+        uint32_t g = (v >> 5) & 0x3f;
+        uint32_t b = v & 0x1f;
+        r          = (r << 3) | (r >> 2);
+        g          = (g << 2) | (g >> 4);
+        b          = (b << 3) | (b >> 2);
+        return (r << 24) | (g << 16) | (b << 8) | 0xff;
+    }
+    case CUBC_FORMAT_A8:
+        return 0xffffff00u | (uint32_t) (v & 0xff);
+    case CUBC_FORMAT_RGBA16F:
+        return (_Cubc_HalfToChannel((uint16_t) v) << 24) |
+               (_Cubc_HalfToChannel((uint16_t) (v >> 16)) << 16) |
+               (_Cubc_HalfToChannel((uint16_t) (v >> 32)) << 8) |
+               _Cubc_HalfToChannel((uint16_t) (v >> 48));
+    default:
+        return (uint32_t) v;
+    }
+}
+
+// Converts `n` RGBA8888 pixels to `format`.
+static void _Cubc_EncodeRowScalar(Cubc_PixelFormat format, void* dst,
+                                  const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v = _Cubc_EncodePixel(format, src[i]);
+        switch (_Cubc_FormatSize(format)) {
+        case 1:
+            ((uint8_t*) dst)[i] = (uint8_t) v;
+            break;
+        case 2:
+            ((uint16_t*) dst)[i] = (uint16_t) v;
+            break;
+        case 8:
+            ((uint64_t*) dst)[i] = v;
+            break;
+        default:
+            ((uint32_t*) dst)[i] = (uint32_t) v;
+            break;
+        }
+    }
+}
+
+// Converts `n` pixels of `format` to RGBA8888.
+static void _Cubc_DecodeRowScalar(Cubc_PixelFormat format, uint32_t* dst,
+                                  const void* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v;
+        switch (_Cubc_FormatSize(format)) {
+        case 1:
+            v = ((const uint8_t*) src)[i];
+            break;
+        case 2:
+            v = ((const uint16_t*) src)[i];
+            break;
+        case 8:
+            v = ((const uint64_t*) src)[i];
+            break;
+        default:
+            v = ((const uint32_t*) src)[i];
+            break;
+        }
+        dst[i] = _Cubc_DecodePixel(format, v);
+    }
+}
+
+#if defined(CUBC_HAVE_SSE2)
+// Rotates every pixel right by `bits`, which swaps RGBA8888 and BGRA8888.
+static void _Cubc_RotateRowScalar(uint32_t* dst, const uint32_t* src,
+                                  size_t n, int bits) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (src[i] >> bits) | (src[i] << (32 - bits));
+    }
+}
+#endif
+
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+static void _Cubc_RotateRowSse2(uint32_t* dst, const uint32_t* src, size_t n,
+                                int bits) {
+    const __m128i right = _mm_cvtsi32_si128(bits);
+    const __m128i left  = _mm_cvtsi32_si128(32 - bits);
+    size_t i            = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*) (src + i));
+        p = _mm_or_si128(_mm_srl_epi32(p, right), _mm_sll_epi32(p, left));
+        _mm_storeu_si128((__m128i*) (dst + i), p);
+    }
+    _Cubc_RotateRowScalar(dst + i, src + i, n - i, bits);
+}
+
+// (c * mul + add) >> shift of 8 channels in 16-bit lanes, which rounds them
+// to 5 or 6 bits, see _Cubc_EncodePixel.
+static inline __m128i _Cubc_Narrow16Sse2(__m128i c, int16_t mul, int16_t add,
+                                         int shift) {
+    __m128i v = _mm_mullo_epi16(c, _mm_set1_epi16(mul));
+    return _mm_srli_epi16(_mm_add_epi16(v, _mm_set1_epi16(add)), shift);
+}
+
+static void _Cubc_Encode565Sse2(uint16_t* dst, const uint32_t* src, size_t n) {
+    const __m128i byte = _mm_set1_epi32(0xff);
+    size_t i           = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i*) (src + i + 4));
+        __m128i r  = _mm_packs_epi32(_mm_srli_epi32(p0, 24),
+                                     _mm_srli_epi32(p1, 24));
+        __m128i g  = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(p0, 16), byte),
+            _mm_and_si128(_mm_srli_epi32(p1, 16), byte));
+        __m128i b  = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(p0, 8), byte),
+            _mm_and_si128(_mm_srli_epi32(p1, 8), byte));
+        r          = _mm_slli_epi16(_Cubc_Narrow16Sse2(r, 249, 1014, 11), 11);
+        g          = _mm_slli_epi16(_Cubc_Narrow16Sse2(g, 253, 505, 10), 5);
+        b          = _Cubc_Narrow16Sse2(b, 249, 1014, 11);
+        __m128i v  = _mm_or_si128(_mm_or_si128(r, g), b);
+        _mm_storeu_si128((__m128i*) (dst + i), v);
+    }
+    _Cubc_EncodeRowScalar(CUBC_FORMAT_RGB565, dst + i, src + i, n - i);
+}
+
+static void _Cubc_Decode565Sse2(uint32_t* dst, const uint16_t* src, size_t n) {
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v  = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i r  = _mm_srli_epi16(v, 11);
+        __m128i g  = _mm_and_si128(_mm_srli_epi16(v, 5), mask6);
+        __m128i b  = _mm_and_si128(v, mask5);
+        r          = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g          = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b          = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        __m128i hi = _mm_or_si128(_mm_slli_epi16(r, 8), g);
+        __m128i lo = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_set1_epi16(0xff));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi16(lo, hi));
+        _mm_storeu_si128((__m128i*) (dst + i + 4), _mm_unpackhi_epi16(lo, hi));
+    }
+    _Cubc_DecodeRowScalar(CUBC_FORMAT_RGB565, dst + i, src + i, n - i);
+}
+
+static void _Cubc_EncodeA8Sse2(uint8_t* dst, const uint32_t* src, size_t n) {
+    const __m128i byte = _mm_set1_epi32(0xff);
+    size_t i           = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + i + 4));
+        __m128i c = _mm_loadu_si128((const __m128i*) (src + i + 8));
+        __m128i d = _mm_loadu_si128((const __m128i*) (src + i + 12));
+        __m128i v = _mm_packus_epi16(
+            _mm_packs_epi32(_mm_and_si128(a, byte), _mm_and_si128(b, byte)),
+            _mm_packs_epi32(_mm_and_si128(c, byte), _mm_and_si128(d, byte)));
+        _mm_storeu_si128((__m128i*) (dst + i), v);
+    }
+    _Cubc_EncodeRowScalar(CUBC_FORMAT_A8, dst + i, src + i, n - i);
+}
+
+static void _Cubc_DecodeA8Sse2(uint32_t* dst, const uint8_t* src, size_t n) {
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i white = _mm_set1_epi32((int) 0xffffff00u);
+    size_t i            = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v  = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128((__m128i*) (dst + i),
+                         _mm_or_si128(_mm_unpacklo_epi16(lo, zero), white));
+        _mm_storeu_si128((__m128i*) (dst + i + 4),
+                         _mm_or_si128(_mm_unpackhi_epi16(lo, zero), white));
+        _mm_storeu_si128((__m128i*) (dst + i + 8),
+                         _mm_or_si128(_mm_unpacklo_epi16(hi, zero), white));
+        _mm_storeu_si128((__m128i*) (dst + i + 12),
+                         _mm_or_si128(_mm_unpackhi_epi16(hi, zero), white));
+    }
+    _Cubc_DecodeRowScalar(CUBC_FORMAT_A8, dst + i, src + i, n - i);
+}
+
+static void _Cubc_EncodeRowSse2(Cubc_PixelFormat format, void* dst,
+                                const uint32_t* src, size_t n) {
+    switch (format) {
+    case CUBC_FORMAT_BGRA8888:
+        _Cubc_RotateRowSse2((uint32_t*) dst, src, n, 8);
+        break;
+    case CUBC_FORMAT_RGB565:
+        _Cubc_Encode565Sse2((uint16_t*) dst, src, n);
+        break;
+    case CUBC_FORMAT_A8:
+        _Cubc_EncodeA8Sse2((uint8_t*) dst, src, n);
+        break;
+    default:
+        _Cubc_EncodeRowScalar(format, dst, src, n);
+        break;
+    }
+}
+
+static void _Cubc_DecodeRowSse2(Cubc_PixelFormat format, uint32_t* dst,
+                                const void* src, size_t n) {
+    switch (format) {
+    case CUBC_FORMAT_BGRA8888:
+        _Cubc_RotateRowSse2(dst, (const uint32_t*) src, n, 24);
+        break;
+    case CUBC_FORMAT_RGB565:
+        _Cubc_Decode565Sse2(dst, (const uint16_t*) src, n);
+        break;
+    case CUBC_FORMAT_A8:
+        _Cubc_DecodeA8Sse2(dst, (const uint8_t*) src, n);
+        break;
+    default:
+        _Cubc_DecodeRowScalar(format, dst, src, n);
+        break;
+    }
+}
+CUBC_TARGET_END
+#endif
+
+// RGBA16F only has SIMD conversions from AVX2 on, with F16C.
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+static void _Cubc_RotateRowAvx2(uint32_t* dst, const uint32_t* src, size_t n,
+                                int bits) {
+    const __m128i right = _mm_cvtsi32_si128(bits);
+    const __m128i left  = _mm_cvtsi32_si128(32 - bits);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*) (src + i));
+        p         = _mm256_or_si256(_mm256_srl_epi32(p, right),
+                                    _mm256_sll_epi32(p, left));
+        _mm256_storeu_si256((__m256i*) (dst + i), p);
+    }
+    _mm256_zeroupper();
+    _Cubc_RotateRowScalar(dst + i, src + i, n - i, bits);
+}
+
+// (c * mul + add) >> shift of 16 channels in 16-bit lanes, which rounds them
+// to 5 or 6 bits, see _Cubc_EncodePixel.
+static inline __m256i _Cubc_Narrow16Avx2(__m256i c, int16_t mul, int16_t add,
+                                         int shift) {
+    __m256i v = _mm256_mullo_epi16(c, _mm256_set1_epi16(mul));
+    return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_set1_epi16(add)),
+                             shift);
+}
+
+static void _Cubc_Encode565Avx2(uint16_t* dst, const uint32_t* src, size_t n) {
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    size_t i           = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i p0 = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i p1 = _mm256_loadu_si256((const __m256i*) (src + i + 8));
+        __m256i r  = _mm256_packs_epi32(_mm256_srli_epi32(p0, 24),
+                                        _mm256_srli_epi32(p1, 24));
+        __m256i g  = _mm256_packs_epi32(
+            _mm256_and_si256(_mm256_srli_epi32(p0, 16), byte),
+            _mm256_and_si256(_mm256_srli_epi32(p1, 16), byte));
+        __m256i b  = _mm256_packs_epi32(
+            _mm256_and_si256(_mm256_srli_epi32(p0, 8), byte),
+            _mm256_and_si256(_mm256_srli_epi32(p1, 8), byte));
+        r          = _mm256_slli_epi16(
+            _Cubc_Narrow16Avx2(r, 249, 1014, 11), 11);
+        g          = _mm256_slli_epi16(_Cubc_Narrow16Avx2(g, 253, 505, 10),
+                                       5);
+        b          = _Cubc_Narrow16Avx2(b, 249, 1014, 11);
+        __m256i v  = _mm256_or_si256(_mm256_or_si256(r, g), b);
+        // The packs interleave the 128-bit lanes of p0 and p1.
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*) (dst + i), v);
+    }
+    _mm256_zeroupper();
+    _Cubc_EncodeRowScalar(CUBC_FORMAT_RGB565, dst + i, src + i, n - i);
+}
+
+static void _Cubc_Decode565Avx2(uint32_t* dst, const uint16_t* src, size_t n) {
+    const __m256i mask6 = _mm256_set1_epi16(0x3f);
+    const __m256i mask5 = _mm256_set1_epi16(0x1f);
+    size_t i            = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i r  = _mm256_srli_epi16(v, 11);
+        __m256i g  = _mm256_and_si256(_mm256_srli_epi16(v, 5), mask6);
+        __m256i b  = _mm256_and_si256(v, mask5);
+        r          = _mm256_or_si256(_mm256_slli_epi16(r, 3),
+                                     _mm256_srli_epi16(r, 2));
+        g          = _mm256_or_si256(_mm256_slli_epi16(g, 2),
+                                     _mm256_srli_epi16(g, 4));
+        b          = _mm256_or_si256(_mm256_slli_epi16(b, 3),
+                                     _mm256_srli_epi16(b, 2));
+        __m256i hi = _mm256_or_si256(_mm256_slli_epi16(r, 8), g);
+        __m256i lo = _mm256_or_si256(_mm256_slli_epi16(b, 8),
+                                     _mm256_set1_epi16(0xff));
+        __m256i p0 = _mm256_unpacklo_epi16(lo, hi);
+        __m256i p1 = _mm256_unpackhi_epi16(lo, hi);
+        _mm256_storeu_si256((__m256i*) (dst + i),
+                            _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256((__m256i*) (dst + i + 8),
+                            _mm256_permute2x128_si256(p0, p1, 0x31));
+    }
+    _mm256_zeroupper();
+    _Cubc_DecodeRowScalar(CUBC_FORMAT_RGB565, dst + i, src + i, n - i);
+}
+
+static void _Cubc_EncodeA8Avx2(uint8_t* dst, const uint32_t* src, size_t n) {
+    const __m256i byte  = _mm256_set1_epi32(0xff);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i            = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (src + i + 8));
+        __m256i c = _mm256_loadu_si256((const __m256i*) (src + i + 16));
+        __m256i d = _mm256_loadu_si256((const __m256i*) (src + i + 24));
+        __m256i v = _mm256_packus_epi16(
+            _mm256_packs_epi32(_mm256_and_si256(a, byte),
+                               _mm256_and_si256(b, byte)),
+            _mm256_packs_epi32(_mm256_and_si256(c, byte),
+                               _mm256_and_si256(d, byte)));
+        v         = _mm256_permutevar8x32_epi32(v, order);
+        _mm256_storeu_si256((__m256i*) (dst + i), v);
+    }
+    _mm256_zeroupper();
+    _Cubc_EncodeRowScalar(CUBC_FORMAT_A8, dst + i, src + i, n - i);
+}
+
+static void _Cubc_DecodeA8Avx2(uint32_t* dst, const uint8_t* src, size_t n) {
+    const __m256i white = _mm256_set1_epi32((int) 0xffffff00u);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*) (src + i)));
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_or_si256(a, white));
+    }
+    _mm256_zeroupper();
+    _Cubc_DecodeRowScalar(CUBC_FORMAT_A8, dst + i, src + i, n - i);
+}
+
+#if defined(CUBC_HAVE_F16C)
+static void _Cubc_Encode16FAvx2(uint16_t* dst, const uint32_t* src, size_t n) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+    size_t i           = 0;
+    for (; i + 2 <= n; i += 2) {
+        // A, B, G, R bytes to R, G, B, A floats.
+        __m256i c = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*) (src + i)));
+        c         = _mm256_shuffle_epi32(c, _MM_SHUFFLE(0, 1, 2, 3));
+        __m256 v  = _mm256_mul_ps(_mm256_cvtepi32_ps(c), scale);
+        _mm_storeu_si128((__m128i*) (dst + 4 * i),
+                         _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+    _mm256_zeroupper();
+    _Cubc_EncodeRowScalar(CUBC_FORMAT_RGBA16F, dst + 4 * i, src + i, n - i);
+}
+
+static void _Cubc_Decode16FAvx2(uint32_t* dst, const uint16_t* src, size_t n) {
+    const __m256 scale  = _mm256_set1_ps(255.0f);
+    const __m256 max    = _mm256_set1_ps(255.0f);
+    const __m256 half   = _mm256_set1_ps(0.5f);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+    size_t i            = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i c[2];
+        for (int k = 0; k < 2; k++) {
+            __m256 v = _mm256_cvtph_ps(
+                _mm_loadu_si128((const __m128i*) (src + 4 * i + 8 * k)));
+            // max returns its second operand for NaN.
+            v    = _mm256_max_ps(_mm256_mul_ps(v, scale), _mm256_setzero_ps());
+            v    = _mm256_add_ps(_mm256_min_ps(v, max), half);
+            c[k] = _mm256_shuffle_epi32(_mm256_cvttps_epi32(v),
+                                        _MM_SHUFFLE(0, 1, 2, 3));
+        }
+        // Pixels 0 and 2 end up in the low lane, 1 and 3 in the high one.
+        __m256i p = _mm256_packus_epi32(c[0], c[1]);
+        p         = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(p, p),
+                                                order);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm256_castsi256_si128(p));
+    }
+    _mm256_zeroupper();
+    _Cubc_DecodeRowScalar(CUBC_FORMAT_RGBA16F, dst + i, src + 4 * i, n - i);
+}
+#endif
+
+static void _Cubc_EncodeRowAvx2(Cubc_PixelFormat format, void* dst,
+                                const uint32_t* src, size_t n) {
+    switch (format) {
+    case CUBC_FORMAT_BGRA8888:
+        _Cubc_RotateRowAvx2((uint32_t*) dst, src, n, 8);
+        break;
+    case CUBC_FORMAT_RGB565:
+        _Cubc_Encode565Avx2((uint16_t*) dst, src, n);
+        break;
+    case CUBC_FORMAT_A8:
+        _Cubc_EncodeA8Avx2((uint8_t*) dst, src, n);
+        break;
+#if defined(CUBC_HAVE_F16C)
+    case CUBC_FORMAT_RGBA16F:
+        _Cubc_Encode16FAvx2((uint16_t*) dst, src, n);
+        break;
+#endif
+    default:
+        _mm256_zeroupper();
+        _Cubc_EncodeRowScalar(format, dst, src, n);
+        break;
+    }
+}
+
+static void _Cubc_DecodeRowAvx2(Cubc_PixelFormat format, uint32_t* dst,
+                                const void* src, size_t n) {
+    switch (format) {
+    case CUBC_FORMAT_BGRA8888:
+        _Cubc_RotateRowAvx2(dst, (const uint32_t*) src, n, 24);
+        break;
+    case CUBC_FORMAT_RGB565:
+        _Cubc_Decode565Avx2(dst, (const uint16_t*) src, n);
+        break;
+    case CUBC_FORMAT_A8:
+        _Cubc_DecodeA8Avx2(dst, (const uint8_t*) src, n);
+        break;
+#if defined(CUBC_HAVE_F16C)
+    case CUBC_FORMAT_RGBA16F:
+        _Cubc_Decode16FAvx2(dst, (const uint16_t*) src, n);
+        break;
+#endif
+    default:
+        _mm256_zeroupper();
+        _Cubc_DecodeRowScalar(format, dst, src, n);
+        break;
+    }
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX512)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX512)
+static void _Cubc_RotateRowAvx512(uint32_t* dst, const uint32_t* src,
+                                  size_t n, int bits) {
+    const __m512i count = _mm512_set1_epi32(bits);
+    size_t i            = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i p = _mm512_loadu_si512(src + i);
+        _mm512_storeu_si512(dst + i, _mm512_rorv_epi32(p, count));
+    }
+    _mm256_zeroupper();
+    _Cubc_RotateRowScalar(dst + i, src + i, n - i, bits);
+}
+
+// The other formats use the AVX2 kernels.
+static void _Cubc_EncodeRowAvx512(Cubc_PixelFormat format, void* dst,
+                                  const uint32_t* src, size_t n) {
+    if (format == CUBC_FORMAT_BGRA8888) {
+        _Cubc_RotateRowAvx512((uint32_t*) dst, src, n, 8);
+    } else {
+        _Cubc_EncodeRowAvx2(format, dst, src, n);
+    }
+}
+
+static void _Cubc_DecodeRowAvx512(Cubc_PixelFormat format, uint32_t* dst,
+                                  const void* src, size_t n) {
+    if (format == CUBC_FORMAT_BGRA8888) {
+        _Cubc_RotateRowAvx512(dst, (const uint32_t*) src, n, 24);
+    } else {
+        _Cubc_DecodeRowAvx2(format, dst, src, n);
+    }
+}
+CUBC_TARGET_END
+#endif
+
+static inline void _Cubc_EncodeRow(Cubc_PixelFormat format, void* dst,
+                                   const uint32_t* src, size_t n) {
+    _Cubc_ActiveKernels()->encode_row(format, dst, src, n);
+}
+
+static inline void _Cubc_DecodeRow(Cubc_PixelFormat format, uint32_t* dst,
+                                   const void* src, size_t n) {
+    _Cubc_ActiveKernels()->decode_row(format, dst, src, n);
+}
+
+void Cubc_PixelsConvert(void* dest, Cubc_PixelFormat dest_format,
+                        const void* src, Cubc_PixelFormat src_format,
+                        size_t n) {
+    if (dest_format == src_format) {
+        memmove(dest, src, n * _Cubc_FormatSize(src_format));
+    } else if (src_format == CUBC_FORMAT_RGBA8888) {
+        _Cubc_EncodeRow(dest_format, dest, (const uint32_t*) src, n);
+    } else if (dest_format == CUBC_FORMAT_RGBA8888) {
+        _Cubc_DecodeRow(src_format, (uint32_t*) dest, src, n);
+    } else {
+        size_t src_size  = _Cubc_FormatSize(src_format);
+        size_t dest_size = _Cubc_FormatSize(dest_format);
+        uint32_t chunk[CUBC_BLIT_CHUNK];
+        for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+            size_t m = n - i < CUBC_BLIT_CHUNK ? n - i : CUBC_BLIT_CHUNK;
+            _Cubc_DecodeRow(src_format, chunk,
+                            (const uint8_t*) src + i * src_size, m);
+            _Cubc_EncodeRow(dest_format, (uint8_t*) dest + i * dest_size,
+                            chunk, m);
+        }
+    }
+}
+
+// Separable blend mode `mode` of one 8-bit channel, with `d` the backdrop and
+// `s` the blended color.
+static uint32_t _Cubc_MixChannel(uint32_t d, uint32_t s, Cubc_BlendMode mode) {
+    switch (mode) {
+    case CUBC_BLEND_MULTIPLY:
+        return _Cubc_Div255(d * s);
+    case CUBC_BLEND_SCREEN:
+        return d + s - _Cubc_Div255(d * s);
+    case CUBC_BLEND_OVERLAY:
+    case CUBC_BLEND_HARD_LIGHT: {
+        // Multiply below half, screen above, decided by the backdrop for
+        // overlay and by the blended color for hard light.
+        uint32_t key = mode == CUBC_BLEND_OVERLAY ? d : s;
+        if (key <= 127) {
+            return _Cubc_Div255(2 * d * s);
+        }
+        return 255 - _Cubc_Div255(2 * (255 - d) * (255 - s));
+    }
+    case CUBC_BLEND_SOFT_LIGHT: {
+        // Pegtop's soft light, d^2 + 2 s d (1 - d).
+        uint32_t c = _Cubc_Div255(d * d) +
+                     _Cubc_Div255(2 * s * _Cubc_Div255(d * (255 - d)));
+        return c > 255 ? 255 : c;
+    }
+    default:
+        return s;
+    }
+}
+
+// The color channels of `s` replaced by their blend with `d`.
+static uint32_t _Cubc_PixelMix(uint32_t d, uint32_t s, Cubc_BlendMode mode) {
+    uint32_t out = CUBC_ALPHA(s);
+    for (int shift = 8; shift < 32; shift += 8) {
+        out |= _Cubc_MixChannel((d >> shift) & 0xff, (s >> shift) & 0xff, mode)
+            << shift;
+    }
+    return out;
+}
+
+// Reference implementation of _Cubc_MixRow.
+static void _Cubc_MixRowScalar(uint32_t* out, const uint32_t* dst,
+                               const uint32_t* src, size_t n,
+                               Cubc_BlendMode mode) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = _Cubc_PixelMix(dst[i], src[i], mode);
+    }
+}
+
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+// _Cubc_MixChannel of 16-bit channels. Overlay and hard light compute both
+// halves and select per lane, the products of the discarded half may wrap.
+static inline __m128i _Cubc_Mix16Sse2(__m128i d, __m128i s,
+                                      Cubc_BlendMode mode) {
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i mid = _mm_set1_epi16(127);
+    switch (mode) {
+    case CUBC_BLEND_MULTIPLY:
+        return _Cubc_Div255x8(_mm_mullo_epi16(d, s));
+    case CUBC_BLEND_SCREEN:
+        return _mm_sub_epi16(_mm_add_epi16(d, s),
+                             _Cubc_Div255x8(_mm_mullo_epi16(d, s)));
+    case CUBC_BLEND_OVERLAY:
+    case CUBC_BLEND_HARD_LIGHT: {
+        __m128i key   = mode == CUBC_BLEND_OVERLAY ? d : s;
+        __m128i high  = _mm_cmpgt_epi16(key, mid);
+        __m128i lo    = _Cubc_Div255x8(
+            _mm_mullo_epi16(_mm_add_epi16(d, d), s));
+        __m128i inv_d = _mm_sub_epi16(max, d);
+        __m128i inv_s = _mm_sub_epi16(max, s);
+        __m128i hi    = _mm_sub_epi16(
+            max, _Cubc_Div255x8(
+                     _mm_mullo_epi16(_mm_add_epi16(inv_d, inv_d), inv_s)));
+        return _mm_or_si128(_mm_and_si128(high, hi),
+                            _mm_andnot_si128(high, lo));
+    }
+    case CUBC_BLEND_SOFT_LIGHT: {
+        __m128i dd = _Cubc_Div255x8(_mm_mullo_epi16(d, d));
+        __m128i t  = _Cubc_Div255x8(_mm_mullo_epi16(d, _mm_sub_epi16(max, d)));
+        __m128i st = _Cubc_Div255x8(_mm_mullo_epi16(_mm_add_epi16(s, s), t));
+        return _mm_min_epi16(_mm_add_epi16(dd, st), max);
+    }
+    default:
+        return s;
+    }
+}
+
+static void _Cubc_MixRowSse2(uint32_t* out, const uint32_t* dst,
+                             const uint32_t* src, size_t n,
+                             Cubc_BlendMode mode) {
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(0xff);
+    size_t i            = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s  = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i d  = _mm_loadu_si128((const __m128i*) (dst + i));
+        __m128i lo = _Cubc_Mix16Sse2(_mm_unpacklo_epi8(d, zero),
+                                     _mm_unpacklo_epi8(s, zero), mode);
+        __m128i hi = _Cubc_Mix16Sse2(_mm_unpackhi_epi8(d, zero),
+                                     _mm_unpackhi_epi8(s, zero), mode);
+        __m128i m  = _mm_packus_epi16(lo, hi);
+        m          = _mm_or_si128(_mm_andnot_si128(alpha, m),
+                                  _mm_and_si128(alpha, s));
+        _mm_storeu_si128((__m128i*) (out + i), m);
+    }
+    _Cubc_MixRowScalar(out + i, dst + i, src + i, n - i, mode);
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+// _Cubc_MixChannel of 16-bit channels. Overlay and hard light compute both
+// halves and select per lane, the products of the discarded half may wrap.
+static inline __m256i _Cubc_Mix16Avx2(__m256i d, __m256i s,
+                                      Cubc_BlendMode mode) {
+    const __m256i max = _mm256_set1_epi16(255);
+    const __m256i mid = _mm256_set1_epi16(127);
+    switch (mode) {
+    case CUBC_BLEND_MULTIPLY:
+        return _Cubc_Div255x16(_mm256_mullo_epi16(d, s));
+    case CUBC_BLEND_SCREEN:
+        return _mm256_sub_epi16(_mm256_add_epi16(d, s),
+                                _Cubc_Div255x16(_mm256_mullo_epi16(d, s)));
+    case CUBC_BLEND_OVERLAY:
+    case CUBC_BLEND_HARD_LIGHT: {
+        __m256i key    = mode == CUBC_BLEND_OVERLAY ? d : s;
+        __m256i high   = _mm256_cmpgt_epi16(key, mid);
+        __m256i lo     = _Cubc_Div255x16(
+            _mm256_mullo_epi16(_mm256_add_epi16(d, d), s));
+        __m256i inv_d  = _mm256_sub_epi16(max, d);
+        __m256i inv_s  = _mm256_sub_epi16(max, s);
+        __m256i hi     = _mm256_sub_epi16(
+            max, _Cubc_Div255x16(_mm256_mullo_epi16(
+                     _mm256_add_epi16(inv_d, inv_d), inv_s)));
+        return _mm256_blendv_epi8(lo, hi, high);
+    }
+    case CUBC_BLEND_SOFT_LIGHT: {
+        __m256i dd = _Cubc_Div255x16(_mm256_mullo_epi16(d, d));
+        __m256i t  = _Cubc_Div255x16(
+            _mm256_mullo_epi16(d, _mm256_sub_epi16(max, d)));
+        __m256i st = _Cubc_Div255x16(
+            _mm256_mullo_epi16(_mm256_add_epi16(s, s), t));
+        return _mm256_min_epi16(_mm256_add_epi16(dd, st), max);
+    }
+    default:
+        return s;
+    }
+}
+
+static void _Cubc_MixRowAvx2(uint32_t* out, const uint32_t* dst,
+                             const uint32_t* src, size_t n,
+                             Cubc_BlendMode mode) {
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32(0xff);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s  = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i d  = _mm256_loadu_si256((const __m256i*) (dst + i));
+        __m256i lo = _Cubc_Mix16Avx2(_mm256_unpacklo_epi8(d, zero),
+                                     _mm256_unpacklo_epi8(s, zero), mode);
+        __m256i hi = _Cubc_Mix16Avx2(_mm256_unpackhi_epi8(d, zero),
+                                     _mm256_unpackhi_epi8(s, zero), mode);
+        __m256i m  = _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), s, alpha);
+        _mm256_storeu_si256((__m256i*) (out + i), m);
+    }
+    _mm256_zeroupper();
+    _Cubc_MixRowScalar(out + i, dst + i, src + i, n - i, mode);
+}
+CUBC_TARGET_END
+#endif
+
+static inline void _Cubc_MixRow(uint32_t* out, const uint32_t* dst,
+                                const uint32_t* src, size_t n,
+                                Cubc_BlendMode mode) {
+    _Cubc_ActiveKernels()->mix_row(out, dst, src, n, mode);
+}
+
+// Composites `n` pixels of `src` over `dst`. Blend modes other than normal
+// first replace the source colors by their blend with the straight colors of
+// the destination. A straight source over a premultiplied destination is
+// premultiplied on the way, a premultiplied source over a straight
+// destination composites as if the destination were opaque.
+static void _Cubc_BlendSpan(uint32_t* dst, const uint32_t* src, size_t n,
+                            Cubc_AlphaMode src_alpha, Cubc_AlphaMode dst_alpha,
+                            Cubc_BlendMode mode) {
+    if (mode == CUBC_BLEND_NORMAL &&
+        (src_alpha == CUBC_ALPHA_PREMULTIPLIED || src_alpha == dst_alpha)) {
+        _Cubc_OverRow(dst, src, n, src_alpha);
+        return;
+    }
+    uint32_t chunk[CUBC_BLIT_CHUNK];
+    uint32_t backdrop[CUBC_BLIT_CHUNK];
+    for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+        size_t m = n - i < CUBC_BLIT_CHUNK ? n - i : CUBC_BLIT_CHUNK;
+
+        const uint32_t* s    = src + i;
+        Cubc_AlphaMode alpha = src_alpha;
+        if (mode != CUBC_BLEND_NORMAL) {
+            const uint32_t* d = dst + i;
+            if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+                _Cubc_UnpremultiplyRow(chunk, s, m);
+                s = chunk;
+            }
+            if (dst_alpha == CUBC_ALPHA_PREMULTIPLIED) {
+                _Cubc_UnpremultiplyRow(backdrop, d, m);
+                d = backdrop;
+            }
+            _Cubc_MixRow(chunk, d, s, m, mode);
+            s     = chunk;
+            alpha = CUBC_ALPHA_STRAIGHT;
+        }
+        if (alpha != dst_alpha) {
+            _Cubc_PremultiplyRow(chunk, s, m);
+            s     = chunk;
+            alpha = CUBC_ALPHA_PREMULTIPLIED;
+        }
+        _Cubc_OverRow(dst + i, s, m, alpha);
+    }
+}
+
+void Cubc_ColorBlendRow(uint32_t* dest, const uint32_t* src, size_t n,
+                        Cubc_BlendMode mode) {
+    _Cubc_BlendSpan(dest, src, n, CUBC_ALPHA_STRAIGHT, CUBC_ALPHA_STRAIGHT,
+                    mode);
+}
+
+// What a Porter-Duff operator scales the source and the destination by, in
+// terms of the alpha of the other one.
+typedef enum {
+    CUBC_FACTOR_ZERO,
+    CUBC_FACTOR_ONE,
+    CUBC_FACTOR_ALPHA,
+    CUBC_FACTOR_INV_ALPHA,
+} _Cubc_Factor;
+
+// Source and destination factors of each Cubc_CompositeOp.
+static const _Cubc_Factor _Cubc_CompositeFactors[][2] = {
+    [CUBC_COMPOSITE_CLEAR]    = {CUBC_FACTOR_ZERO, CUBC_FACTOR_ZERO},
+    [CUBC_COMPOSITE_SRC]      = {CUBC_FACTOR_ONE, CUBC_FACTOR_ZERO},
+    [CUBC_COMPOSITE_SRC_OVER] = {CUBC_FACTOR_ONE, CUBC_FACTOR_INV_ALPHA},
+    [CUBC_COMPOSITE_DST_OVER] = {CUBC_FACTOR_INV_ALPHA, CUBC_FACTOR_ONE},
+    [CUBC_COMPOSITE_SRC_IN]   = {CUBC_FACTOR_ALPHA, CUBC_FACTOR_ZERO},
+    [CUBC_COMPOSITE_DST_IN]   = {CUBC_FACTOR_ZERO, CUBC_FACTOR_ALPHA},
+    [CUBC_COMPOSITE_SRC_OUT]  = {CUBC_FACTOR_INV_ALPHA, CUBC_FACTOR_ZERO},
+    [CUBC_COMPOSITE_DST_OUT]  = {CUBC_FACTOR_ZERO, CUBC_FACTOR_INV_ALPHA},
+    [CUBC_COMPOSITE_SRC_ATOP] = {CUBC_FACTOR_ALPHA, CUBC_FACTOR_INV_ALPHA},
+    [CUBC_COMPOSITE_DST_ATOP] = {CUBC_FACTOR_INV_ALPHA, CUBC_FACTOR_ALPHA},
+    [CUBC_COMPOSITE_XOR]      = {CUBC_FACTOR_INV_ALPHA, CUBC_FACTOR_INV_ALPHA},
+    [CUBC_COMPOSITE_PLUS]     = {CUBC_FACTOR_ONE, CUBC_FACTOR_ONE},
+};
+
+static uint32_t _Cubc_FactorValue(_Cubc_Factor factor, uint32_t alpha) {
+    switch (factor) {
+    case CUBC_FACTOR_ZERO:
+        return 0;
+    case CUBC_FACTOR_ONE:
+        return 255;
+    case CUBC_FACTOR_ALPHA:
+        return alpha;
+    default:
+        return 255 - alpha;
+    }
+}
+
+// Porter-Duff operator `op` on one premultiplied pixel. Both terms are
+// rounded on their own, so a factor of one passes its pixel through exactly.
+static uint32_t _Cubc_PixelComposite(uint32_t d, uint32_t s,
+                                     Cubc_CompositeOp op) {
+    uint32_t fs  = _Cubc_FactorValue(_Cubc_CompositeFactors[op][0],
+                                     CUBC_ALPHA(d));
+    uint32_t fd  = _Cubc_FactorValue(_Cubc_CompositeFactors[op][1],
+                                     CUBC_ALPHA(s));
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t c = _Cubc_Div255(((s >> shift) & 0xff) * fs) +
+                     _Cubc_Div255(((d >> shift) & 0xff) * fd);
+        out |= (c > 255 ? 255 : c) << shift;
+    }
+    return out;
+}
+
+// Reference implementation of _Cubc_CompositeRow.
+static void _Cubc_CompositeRowScalar(uint32_t* dst, const uint32_t* src,
+                                     size_t n, Cubc_CompositeOp op) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = _Cubc_PixelComposite(dst[i], src[i], op);
+    }
+}
+
+// The SIMD kernels build a factor from the broadcast alpha `a` as
+// ((a & keep) | one) ^ invert, with 16-bit masks set up once per row.
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+typedef struct {
+    __m128i keep, one, invert;
+} _Cubc_FactorMasksSse2;
+
+static _Cubc_FactorMasksSse2 _Cubc_FactorMasksOfSse2(_Cubc_Factor factor) {
+    bool alpha = factor == CUBC_FACTOR_ALPHA || factor == CUBC_FACTOR_INV_ALPHA;
+    return (_Cubc_FactorMasksSse2){
+        .keep   = _mm_set1_epi16(alpha ? 0xff : 0),
+        .one    = _mm_set1_epi16(factor == CUBC_FACTOR_ONE ? 0xff : 0),
+        .invert = _mm_set1_epi16(factor == CUBC_FACTOR_INV_ALPHA ? 0xff : 0),
+    };
+}
+
+// Scales the 16-bit channels of `x` by the factor `f` of the alpha of `y`.
+static inline __m128i _Cubc_Scale16Sse2(__m128i x, __m128i y,
+                                        const _Cubc_FactorMasksSse2* f) {
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(y, 0), 0);
+    a = _mm_xor_si128(_mm_or_si128(_mm_and_si128(a, f->keep), f->one),
+                      f->invert);
+    return _Cubc_Div255x8(_mm_mullo_epi16(x, a));
+}
+
+static void _Cubc_CompositeRowSse2(uint32_t* dst, const uint32_t* src, size_t n,
+                                   Cubc_CompositeOp op) {
+    const __m128i zero       = _mm_setzero_si128();
+    _Cubc_FactorMasksSse2 fs = _Cubc_FactorMasksOfSse2(
+        _Cubc_CompositeFactors[op][0]);
+    _Cubc_FactorMasksSse2 fd = _Cubc_FactorMasksOfSse2(
+        _Cubc_CompositeFactors[op][1]);
+    size_t i                 = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s   = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i d   = _mm_loadu_si128((const __m128i*) (dst + i));
+        __m128i slo = _mm_unpacklo_epi8(s, zero);
+        __m128i shi = _mm_unpackhi_epi8(s, zero);
+        __m128i dlo = _mm_unpacklo_epi8(d, zero);
+        __m128i dhi = _mm_unpackhi_epi8(d, zero);
+        __m128i lo  = _mm_add_epi16(_Cubc_Scale16Sse2(slo, dlo, &fs),
+                                    _Cubc_Scale16Sse2(dlo, slo, &fd));
+        __m128i hi  = _mm_add_epi16(_Cubc_Scale16Sse2(shi, dhi, &fs),
+                                    _Cubc_Scale16Sse2(dhi, shi, &fd));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+    _Cubc_CompositeRowScalar(dst + i, src + i, n - i, op);
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+typedef struct {
+    __m256i keep, one, invert;
+} _Cubc_FactorMasksAvx2;
+
+static _Cubc_FactorMasksAvx2 _Cubc_FactorMasksOfAvx2(_Cubc_Factor factor) {
+    bool alpha = factor == CUBC_FACTOR_ALPHA || factor == CUBC_FACTOR_INV_ALPHA;
+    return (_Cubc_FactorMasksAvx2){
+        .keep   = _mm256_set1_epi16(alpha ? 0xff : 0),
+        .one    = _mm256_set1_epi16(factor == CUBC_FACTOR_ONE ? 0xff : 0),
+        .invert = _mm256_set1_epi16(factor == CUBC_FACTOR_INV_ALPHA ? 0xff : 0),
+    };
+}
+
+// Scales the 16-bit channels of `x` by the factor `f` of the alpha of `y`.
+static inline __m256i _Cubc_Scale16Avx2(__m256i x, __m256i y,
+                                        const _Cubc_FactorMasksAvx2* f) {
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(y, 0), 0);
+    a         = _mm256_xor_si256(
+        _mm256_or_si256(_mm256_and_si256(a, f->keep), f->one), f->invert);
+    return _Cubc_Div255x16(_mm256_mullo_epi16(x, a));
+}
+
+static void _Cubc_CompositeRowAvx2(uint32_t* dst, const uint32_t* src, size_t n,
+                                   Cubc_CompositeOp op) {
+    const __m256i zero       = _mm256_setzero_si256();
+    _Cubc_FactorMasksAvx2 fs = _Cubc_FactorMasksOfAvx2(
+        _Cubc_CompositeFactors[op][0]);
+    _Cubc_FactorMasksAvx2 fd = _Cubc_FactorMasksOfAvx2(
+        _Cubc_CompositeFactors[op][1]);
+    size_t i                 = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s   = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i d   = _mm256_loadu_si256((const __m256i*) (dst + i));
+        __m256i slo = _mm256_unpacklo_epi8(s, zero);
+        __m256i shi = _mm256_unpackhi_epi8(s, zero);
+        __m256i dlo = _mm256_unpacklo_epi8(d, zero);
+        __m256i dhi = _mm256_unpackhi_epi8(d, zero);
+        __m256i lo  = _mm256_add_epi16(_Cubc_Scale16Avx2(slo, dlo, &fs),
+                                       _Cubc_Scale16Avx2(dlo, slo, &fd));
+        __m256i hi  = _mm256_add_epi16(_Cubc_Scale16Avx2(shi, dhi, &fs),
+                                       _Cubc_Scale16Avx2(dhi, shi, &fd));
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    _mm256_zeroupper();
+    _Cubc_CompositeRowScalar(dst + i, src + i, n - i, op);
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX512)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX512)
+typedef struct {
+    __m512i keep, one, invert;
+} _Cubc_FactorMasksAvx512;
+
+static _Cubc_FactorMasksAvx512 _Cubc_FactorMasksOfAvx512(_Cubc_Factor factor) {
+    bool alpha = factor == CUBC_FACTOR_ALPHA || factor == CUBC_FACTOR_INV_ALPHA;
+    return (_Cubc_FactorMasksAvx512){
+        .keep   = _mm512_set1_epi16(alpha ? 0xff : 0),
+        .one    = _mm512_set1_epi16(factor == CUBC_FACTOR_ONE ? 0xff : 0),
+        .invert = _mm512_set1_epi16(factor == CUBC_FACTOR_INV_ALPHA ? 0xff : 0),
+    };
+}
+
+static inline __m512i _Cubc_Scale16Avx512(__m512i x, __m512i y,
+                                          const _Cubc_FactorMasksAvx512* f) {
+    __m512i a = _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(y, 0), 0);
+    a         = _mm512_xor_si512(
+        _mm512_or_si512(_mm512_and_si512(a, f->keep), f->one), f->invert);
+    return _Cubc_Div255x32(_mm512_mullo_epi16(x, a));
+}
+
+static void _Cubc_CompositeRowAvx512(uint32_t* dst, const uint32_t* src,
+                                     size_t n, Cubc_CompositeOp op) {
+    const __m512i zero         = _mm512_setzero_si512();
+    _Cubc_FactorMasksAvx512 fs = _Cubc_FactorMasksOfAvx512(
+        _Cubc_CompositeFactors[op][0]);
+    _Cubc_FactorMasksAvx512 fd = _Cubc_FactorMasksOfAvx512(
+        _Cubc_CompositeFactors[op][1]);
+    size_t i                   = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i s   = _mm512_loadu_si512(src + i);
+        __m512i d   = _mm512_loadu_si512(dst + i);
+        __m512i slo = _mm512_unpacklo_epi8(s, zero);
+        __m512i shi = _mm512_unpackhi_epi8(s, zero);
+        __m512i dlo = _mm512_unpacklo_epi8(d, zero);
+        __m512i dhi = _mm512_unpackhi_epi8(d, zero);
+        __m512i lo  = _mm512_add_epi16(_Cubc_Scale16Avx512(slo, dlo, &fs),
+                                       _Cubc_Scale16Avx512(dlo, slo, &fd));
+        __m512i hi  = _mm512_add_epi16(_Cubc_Scale16Avx512(shi, dhi, &fs),
+                                       _Cubc_Scale16Avx512(dhi, shi, &fd));
+        _mm512_storeu_si512(dst + i, _mm512_packus_epi16(lo, hi));
+    }
+    _mm256_zeroupper();
+    _Cubc_CompositeRowScalar(dst + i, src + i, n - i, op);
+}
+CUBC_TARGET_END
+#endif
+
+static inline void _Cubc_CompositeRow(uint32_t* dst, const uint32_t* src,
+                                      size_t n, Cubc_CompositeOp op) {
+    _Cubc_ActiveKernels()->composite_row(dst, src, n, op);
+}
+
+// _Cubc_CompositeRow, with the operators that reduce to a fill, a copy or
+// source-over handed to the faster kernels for those.
+static void _Cubc_CompositeSpan(uint32_t* dst, const uint32_t* src, size_t n,
+                                Cubc_CompositeOp op) {
+    switch (op) {
+    case CUBC_COMPOSITE_CLEAR:
+        memset(dst, 0, n * sizeof(uint32_t));
+        break;
+    case CUBC_COMPOSITE_SRC:
+        memcpy(dst, src, n * sizeof(uint32_t));
+        break;
+    case CUBC_COMPOSITE_SRC_OVER:
+        _Cubc_OverRow(dst, src, n, CUBC_ALPHA_PREMULTIPLIED);
+        break;
+    default:
+        _Cubc_CompositeRow(dst, src, n, op);
+        break;
+    }
+}
+
+// _Cubc_CompositeSpan with straight sources or destinations premultiplied a
+// chunk at a time, and straight destinations converted back.
+static void _Cubc_CompositeSpanMode(uint32_t* dst, const uint32_t* src,
+                                    size_t n, Cubc_AlphaMode src_alpha,
+                                    Cubc_AlphaMode dst_alpha,
+                                    Cubc_CompositeOp op) {
+    if (src_alpha == CUBC_ALPHA_PREMULTIPLIED &&
+        dst_alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        _Cubc_CompositeSpan(dst, src, n, op);
+        return;
+    }
+    uint32_t src_chunk[CUBC_BLIT_CHUNK];
+    uint32_t dst_chunk[CUBC_BLIT_CHUNK];
+    for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+        size_t m          = n - i < CUBC_BLIT_CHUNK ? n - i : CUBC_BLIT_CHUNK;
+        const uint32_t* s = src + i;
+        if (src_alpha == CUBC_ALPHA_STRAIGHT) {
+            _Cubc_PremultiplyRow(src_chunk, s, m);
+            s = src_chunk;
+        }
+        if (dst_alpha == CUBC_ALPHA_PREMULTIPLIED) {
+            _Cubc_CompositeSpan(dst + i, s, m, op);
+            continue;
+        }
+        _Cubc_PremultiplyRow(dst_chunk, dst + i, m);
+        _Cubc_CompositeSpan(dst_chunk, s, m, op);
+        _Cubc_UnpremultiplyRow(dst + i, dst_chunk, m);
+    }
+}
+
+// Filtered blits resample with weights of this many fractional bits.
+#define CUBC_FILTER_BITS 14
+
+// For the i-th destination column (or row) of a filtered blit, source pixels
+// first[i] up to first[i] + taps - 1 are weighted by weights[i * stride] up to
+// weights[i * stride + taps - 1], which sum to 1 << CUBC_FILTER_BITS. The
+// stride is even and padded with zero weights, so weights can be read in
+// pairs. `halves` marks tables that average disjoint pixel pairs, as exact
+// 0.5x bilinear and box filters do: first[i] is first[0] + 2 * i and both
+// weights are one half.
+struct _Cubc_FilterTable {
+    uint32_t* first;
+    int16_t* weights;
+    size_t taps, stride;
+    bool halves;
+};
+
+static double _Cubc_FilterKernel(Cubc_Filter filter, double t) {
+    t = t < 0 ? -t : t;
+    if (filter == CUBC_FILTER_BILINEAR) {
+        return t < 1 ? 1 - t : 0;
+    }
+    // Catmull-Rom.
+    if (t < 1) {
+        return (1.5 * t - 2.5) * t * t + 1;
+    }
+    if (t < 2) {
+        return ((-0.5 * t + 2.5) * t - 4) * t + 2;
+    }
+    return 0;
+}
+
+static inline int64_t _Cubc_Floor(double x) {
+    int64_t i = (int64_t) x;
+    return i > x ? i - 1 : i;
+}
+
+// Builds the weights of destination columns `begin` up to `end` - 1 of a
+// blit that scales `n` source pixels by `scale`. Taps outside the source are
+// folded into the edge pixels. Every entry only depends on its own column,
+// so clipped blits produce the same pixels as whole ones.
+static void _Cubc_FilterTableInit(_Cubc_FilterTable* table, Cubc_Filter filter,
+                                  float scale, size_t n, int64_t begin,
+                                  int64_t end) {
+    const int32_t one = 1 << CUBC_FILTER_BITS;
+
+    size_t raw_taps = filter == CUBC_FILTER_BICUBIC ? 4 : 2;
+    if (filter == CUBC_FILTER_BOX && scale < 1.0f) {
+        // A window of a whole number of pixels, as in 0.5x or 0.25x, starts
+        // on a pixel boundary and covers exactly that many.
+        double width = 1.0 / scale;
+        raw_taps     = (size_t) width + (width == (size_t) width ? 0 : 2);
+    }
+    size_t taps  = raw_taps < n ? raw_taps : n;
+    size_t count = end - begin;
+
+    table->taps    = taps;
+    table->stride  = (taps + 1) & ~(size_t) 1;
+    table->first   = (uint32_t*) malloc(sizeof(uint32_t) * count);
+    table->weights = (int16_t*) calloc(count * table->stride, sizeof(int16_t));
+    double* f      = (double*) malloc(sizeof(double) * taps);
+
+    for (size_t i = 0; i < count; i++) {
+        int64_t d = begin + (int64_t) i;
+        int64_t lo, hi;
+        double a, b, c;
+        if (filter == CUBC_FILTER_BOX) {
+            // Area of [j, j + 1) covered by [a, b).
+            a  = d / (double) scale;
+            b  = (d + 1) / (double) scale;
+            lo = _Cubc_Floor(a);
+            hi = -_Cubc_Floor(-b) - 1;
+        } else {
+            int64_t radius = filter == CUBC_FILTER_BICUBIC ? 2 : 1;
+            c              = (d + 0.5) / scale - 0.5;
+            lo             = _Cubc_Floor(c) - radius + 1;
+            hi             = _Cubc_Floor(c) + radius;
+        }
+        if (hi - lo + 1 > (int64_t) raw_taps) {
+            hi = lo + raw_taps - 1;
+        }
+
+        int64_t first = lo > 0 ? lo : 0;
+        if (first > (int64_t) (n - taps)) {
+            first = n - taps;
+        }
+        for (size_t t = 0; t < taps; t++) {
+            f[t] = 0;
+        }
+        double sum = 0;
+        for (int64_t j = lo; j <= hi; j++) {
+            double w;
+            if (filter == CUBC_FILTER_BOX) {
+                w = (j + 1 < b ? j + 1 : b) - (j > a ? j : a);
+            } else {
+                w = _Cubc_FilterKernel(filter, j - c);
+            }
+            int64_t k     = j < 0 ? 0 : j >= (int64_t) n ? (int64_t) n - 1 : j;
+            f[k - first] += w;
+            sum          += w;
+        }
+
+        // Round to fixed point and give the rounding error to the largest
+        // weight, so that flat areas stay exact.
+        int16_t* weights = table->weights + i * table->stride;
+        int32_t total    = 0;
+        size_t largest   = 0;
+        for (size_t t = 0; t < taps; t++) {
+            double v    = f[t] / sum * one;
+            weights[t]  = (int16_t) (v < 0 ? -(int32_t) (0.5 - v)
+                                           : (int32_t) (v + 0.5));
+            total      += weights[t];
+            if (weights[t] > weights[largest]) {
+                largest = t;
+            }
+        }
+        weights[largest] += one - total;
+        table->first[i]   = (uint32_t) first;
+    }
+    free(f);
+
+    table->halves = taps == 2;
+    for (size_t i = 0; table->halves && i < count; i++) {
+        const int16_t* weights = table->weights + i * table->stride;
+        table->halves = table->first[i] == table->first[0] + 2 * i &&
+                        weights[0] == one / 2 && weights[1] == one / 2;
+    }
+}
+
+static void _Cubc_FilterTableFree(_Cubc_FilterTable* table) {
+    free(table->first);
+    free(table->weights);
+}
+
+static inline void _Cubc_FilterAdd(int32_t acc[4], uint32_t pixel, int32_t w) {
+    acc[0] += w * (int32_t) (pixel & 0xff);
+    acc[1] += w * (int32_t) ((pixel >> 8) & 0xff);
+    acc[2] += w * (int32_t) ((pixel >> 16) & 0xff);
+    acc[3] += w * (int32_t) (pixel >> 24);
+}
+
+static inline uint32_t _Cubc_FilterPack(const int32_t acc[4]) {
+    uint32_t pixel = 0;
+    for (int c = 0; c < 4; c++) {
+        int32_t v  = acc[c] >> CUBC_FILTER_BITS;
+        v          = v < 0 ? 0 : v > 255 ? 255 : v;
+        pixel     |= (uint32_t) v << (8 * c);
+    }
+    return pixel;
+}
+
+// Reference implementations of _Cubc_FilterRow and _Cubc_FilterColumns. They
+// start at pixel `i`, so that the SIMD versions can hand over their tails.
+static void _Cubc_FilterRowScalar(uint32_t* dst, const uint32_t* src,
+                                  const _Cubc_FilterTable* table, size_t i,
+                                  size_t n) {
+    for (; i < n; i++) {
+        const uint32_t* s = src + table->first[i];
+        const int16_t* w  = table->weights + i * table->stride;
+        int32_t round     = 1 << (CUBC_FILTER_BITS - 1);
+        int32_t acc[4]    = {round, round, round, round};
+        for (size_t t = 0; t < table->taps; t++) {
+            _Cubc_FilterAdd(acc, s[t], w[t]);
+        }
+        dst[i] = _Cubc_FilterPack(acc);
+    }
+}
+
+static void _Cubc_FilterColumnsScalar(uint32_t* dst,
+                                      const uint32_t* const* rows,
+                                      const int16_t* w, size_t taps, size_t i,
+                                      size_t n) {
+    for (; i < n; i++) {
+        int32_t round  = 1 << (CUBC_FILTER_BITS - 1);
+        int32_t acc[4] = {round, round, round, round};
+        for (size_t t = 0; t < taps; t++) {
+            _Cubc_FilterAdd(acc, rows[t][i], w[t]);
+        }
+        dst[i] = _Cubc_FilterPack(acc);
+    }
+}
+
+#if defined(CUBC_HAVE_SSE2)
+// Weights w[0] and w[1] in the halves of every 32-bit lane, for multiply-adds
+// of interleaved pixels.
+static inline int32_t _Cubc_FilterPair(const int16_t* w) {
+    int32_t pair;
+    memcpy(&pair, w, sizeof(pair));
+    return pair;
+}
+#endif
+
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+// One destination pixel from one source row, with a 32-bit lane per channel.
+static inline __m128i _Cubc_FilterPixelSse2(const uint32_t* s, const int16_t* w,
+                                            size_t taps) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc        = _mm_set1_epi32(1 << (CUBC_FILTER_BITS - 1));
+    size_t t           = 0;
+    for (; t + 2 <= taps; t += 2) {
+        // Interleave the channels of both pixels, so that one multiply-add
+        // applies both weights.
+        __m128i p = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i*) (s + t)), zero);
+        p         = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+        acc       = _mm_add_epi32(
+            acc, _mm_madd_epi16(p, _mm_set1_epi32(_Cubc_FilterPair(w + t))));
+    }
+    if (t < taps) {
+        __m128i p = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int32_t) s[t]), zero);
+        p         = _mm_unpacklo_epi16(p, zero);
+        acc       = _mm_add_epi32(
+            acc, _mm_madd_epi16(p, _mm_set1_epi32(_Cubc_FilterPair(w + t))));
+    }
+    return _mm_srai_epi32(acc, CUBC_FILTER_BITS);
+}
+
+// Filters destination pixels `i` to `n` from one source row, two at a time.
+// Halving tables average the even and odd pixels of four windows at once,
+// which rounds like the weights do.
+static void _Cubc_FilterRowSse2(uint32_t* dst, const uint32_t* src,
+                                const _Cubc_FilterTable* table, size_t i,
+                                size_t n) {
+    for (; table->halves && i + 4 <= n; i += 4) {
+        __m128 a     = _mm_loadu_ps((const float*) (src + table->first[i]));
+        __m128 b     = _mm_loadu_ps((const float*) (src + table->first[i] + 4));
+        __m128i even = _mm_castps_si128(
+            _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd  = _mm_castps_si128(
+            _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_avg_epu8(even, odd));
+    }
+    const int16_t* w = table->weights + i * table->stride;
+    for (; i + 2 <= n; i += 2) {
+        __m128i a  = _Cubc_FilterPixelSse2(src + table->first[i], w,
+                                           table->taps);
+        w         += table->stride;
+        __m128i b  = _Cubc_FilterPixelSse2(src + table->first[i + 1], w,
+                                           table->taps);
+        w         += table->stride;
+        __m128i ab = _mm_packs_epi32(a, b);
+        _mm_storel_epi64((__m128i*) (dst + i), _mm_packus_epi16(ab, ab));
+    }
+    _Cubc_FilterRowScalar(dst, src, table, i, n);
+}
+
+// Combines `taps` filtered rows into destination pixels `i` to `n`, four at a
+// time.
+static void _Cubc_FilterColumnsSse2(uint32_t* dst, const uint32_t* const* rows,
+                                    const int16_t* w, size_t taps, size_t i,
+                                    size_t n) {
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (CUBC_FILTER_BITS - 1));
+    // Two equal weights round like an average.
+    for (; taps == 2 && w[0] == w[1] && i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (rows[0] + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (rows[1] + i));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_avg_epu8(a, b));
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for (size_t t = 0; t < taps; t += 2) {
+            __m128i a    = _mm_loadu_si128((const __m128i*) (rows[t] + i));
+            __m128i b    = zero;
+            __m128i pair = _mm_set1_epi32(_Cubc_FilterPair(w + t));
+            if (t + 1 < taps) {
+                b = _mm_loadu_si128((const __m128i*) (rows[t + 1] + i));
+            }
+            // Interleave the bytes of both rows before widening them, so
+            // that every pixel is one unpack away from its multiply-add.
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+
+            acc0 = _mm_add_epi32(
+                acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), pair));
+            acc1 = _mm_add_epi32(
+                acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), pair));
+            acc2 = _mm_add_epi32(
+                acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), pair));
+            acc3 = _mm_add_epi32(
+                acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), pair));
+        }
+        acc0 = _mm_srai_epi32(acc0, CUBC_FILTER_BITS);
+        acc1 = _mm_srai_epi32(acc1, CUBC_FILTER_BITS);
+        acc2 = _mm_srai_epi32(acc2, CUBC_FILTER_BITS);
+        acc3 = _mm_srai_epi32(acc3, CUBC_FILTER_BITS);
+
+        __m128i lo = _mm_packs_epi32(acc0, acc1);
+        __m128i hi = _mm_packs_epi32(acc2, acc3);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+    _Cubc_FilterColumnsScalar(dst, rows, w, taps, i, n);
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+// Byte order that interleaves the channels of two adjacent pixels, so that
+// one multiply-add applies both of their weights: r0 g0 b0 a0 r1 g1 b1 a1
+// becomes r0 r1 g0 g1 b0 b1 a0 a1.
+#define CUBC_FILTER_PAIRS                                                      \
+    0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15
+
+// Byte order that moves the first pixels of two two-pixel windows to the low
+// half and the second pixels to the high half.
+#define CUBC_FILTER_SPLIT                                                      \
+    0, 1, 2, 3, 8, 9, 10, 11, 4, 5, 6, 7, 12, 13, 14, 15
+
+// Byte order that spreads the second weights of two weight pairs over the
+// channels of their pixels.
+#define CUBC_FILTER_SECOND                                                     \
+    2, 3, 2, 3, 2, 3, 2, 3, 6, 7, 6, 7, 6, 7, 6, 7
+
+// Two destination pixels from one source row, one per 128-bit lane with a
+// 32-bit lane per channel. Taps are read four at a time.
+static inline __m256i _Cubc_FilterPixelsAvx2(const uint32_t* a,
+                                             const uint32_t* b,
+                                             const int16_t* wa,
+                                             const int16_t* wb, size_t taps) {
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i pairs = _mm256_setr_epi8(CUBC_FILTER_PAIRS,
+                                           CUBC_FILTER_PAIRS);
+    __m256i acc         = _mm256_set1_epi32(1 << (CUBC_FILTER_BITS - 1));
+    size_t t            = 0;
+    for (; t + 4 <= taps; t += 4) {
+        __m256i p = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (a + t))),
+            _mm_loadu_si128((const __m128i*) (b + t)), 1);
+        __m256i w = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*) (wa + t))),
+            _mm_loadl_epi64((const __m128i*) (wb + t)), 1);
+        p         = _mm256_shuffle_epi8(p, pairs);
+        acc       = _mm256_add_epi32(
+            acc, _mm256_madd_epi16(_mm256_unpacklo_epi8(p, zero),
+                                   _mm256_shuffle_epi32(w, 0x00)));
+        acc       = _mm256_add_epi32(
+            acc, _mm256_madd_epi16(_mm256_unpackhi_epi8(p, zero),
+                                   _mm256_shuffle_epi32(w, 0x55)));
+    }
+    // The remaining two or three taps, with the zero weight that pads an odd
+    // count applied to a zero pixel.
+    if (t < taps) {
+        __m128i pa, pb;
+        if (t + 1 < taps) {
+            pa = _mm_loadl_epi64((const __m128i*) (a + t));
+            pb = _mm_loadl_epi64((const __m128i*) (b + t));
+        } else {
+            pa = _mm_cvtsi32_si128((int32_t) a[t]);
+            pb = _mm_cvtsi32_si128((int32_t) b[t]);
+        }
+        __m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(pa), pb, 1);
+        __m256i w = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_set1_epi32(_Cubc_FilterPair(wa + t))),
+            _mm_set1_epi32(_Cubc_FilterPair(wb + t)), 1);
+        p         = _mm256_shuffle_epi8(p, pairs);
+        acc       = _mm256_add_epi32(
+            acc, _mm256_madd_epi16(_mm256_unpacklo_epi8(p, zero), w));
+        if (t + 3 == taps) {
+            p   = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_cvtsi32_si128((int32_t) a[t + 2])),
+                _mm_cvtsi32_si128((int32_t) b[t + 2]), 1);
+            w   = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                    _mm_set1_epi32(_Cubc_FilterPair(wa + t + 2))),
+                _mm_set1_epi32(_Cubc_FilterPair(wb + t + 2)), 1);
+            p   = _mm256_shuffle_epi8(p, pairs);
+            acc = _mm256_add_epi32(
+                acc, _mm256_madd_epi16(_mm256_unpacklo_epi8(p, zero), w));
+        }
+    }
+    return _mm256_srai_epi32(acc, CUBC_FILTER_BITS);
+}
+
+// Filters destination pixels `i` to `n` from one source row, four at a time.
+// Two-tap tables, which bilinear filters and halving box filters use, keep
+// the weights of consecutive pixels adjacent, so four pixels share one
+// vector of windows and one of weights.
+static void _Cubc_FilterRowAvx2(uint32_t* dst, const uint32_t* src,
+                                const _Cubc_FilterTable* table, size_t i,
+                                size_t n) {
+    const __m256i order   = _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0);
+    size_t stride         = table->stride;
+    const uint32_t* first = table->first;
+    for (; table->halves && i + 8 <= n; i += 8) {
+        // The shuffles work per 128-bit lane and leave the averages of
+        // windows 0 1 4 5 in the low lane and 2 3 6 7 in the high one.
+        __m256 a     = _mm256_loadu_ps((const float*) (src + first[i]));
+        __m256 b     = _mm256_loadu_ps((const float*) (src + first[i] + 8));
+        __m256i even = _mm256_castps_si256(
+            _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd  = _mm256_castps_si256(
+            _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i p    = _mm256_permute4x64_epi64(_mm256_avg_epu8(even, odd),
+                                                _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*) (dst + i), p);
+    }
+    const int16_t* w = table->weights + i * stride;
+    if (table->taps == 2) {
+        // As in _Cubc_FilterColumnsAvx2, each channel is a plus a rounding
+        // high multiply of 2 * (b - a) by the second weight.
+        const __m256i zero   = _mm256_setzero_si256();
+        const __m256i split  = _mm256_setr_epi8(CUBC_FILTER_SPLIT,
+                                                CUBC_FILTER_SPLIT);
+        const __m256i pixels = _mm256_setr_epi32(0, 1, 0, 0, 2, 3, 0, 0);
+        const __m256i second = _mm256_setr_epi8(CUBC_FILTER_SECOND,
+                                                CUBC_FILTER_SECOND);
+        for (; i + 4 <= n; i += 4) {
+            // The windows of pixels i, i + 1 in the low lane and i + 2,
+            // i + 3 in the high one.
+            __m128d ab = _mm_loadh_pd(
+                _mm_castsi128_pd(
+                    _mm_loadl_epi64((const __m128i*) (src + first[i]))),
+                (const double*) (src + first[i + 1]));
+            __m128d cd = _mm_loadh_pd(
+                _mm_castsi128_pd(
+                    _mm_loadl_epi64((const __m128i*) (src + first[i + 2]))),
+                (const double*) (src + first[i + 3]));
+            __m256i p  = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_castpd_si128(ab)),
+                _mm_castpd_si128(cd), 1);
+            __m256i q  = _mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i*) w));
+            w         += 4 * stride;
+
+            p         = _mm256_shuffle_epi8(p, split);
+            q         = _mm256_permutevar8x32_epi32(q, pixels);
+            q         = _mm256_shuffle_epi8(q, second);
+            __m256i a = _mm256_unpacklo_epi8(p, zero);
+            __m256i d = _mm256_sub_epi16(_mm256_unpackhi_epi8(p, zero), a);
+            d         = _mm256_mulhrs_epi16(_mm256_slli_epi16(d, 1), q);
+            p         = _mm256_add_epi16(a, d);
+            p         = _mm256_packus_epi16(p, p);
+            p         = _mm256_permute4x64_epi64(p, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*) (dst + i), _mm256_castsi256_si128(p));
+        }
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m256i ab  = _Cubc_FilterPixelsAvx2(src + first[i],
+                                             src + first[i + 1], w,
+                                             w + stride, table->taps);
+        __m256i cd  = _Cubc_FilterPixelsAvx2(src + first[i + 2],
+                                             src + first[i + 3],
+                                             w + 2 * stride, w + 3 * stride,
+                                             table->taps);
+        w          += 4 * stride;
+
+        // The packs work per 128-bit lane and leave a c in the low lane and
+        // b d in the high one.
+        __m256i p = _mm256_packs_epi32(ab, cd);
+        p         = _mm256_packus_epi16(p, p);
+        p         = _mm256_permutevar8x32_epi32(p, order);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm256_castsi256_si128(p));
+    }
+    _mm256_zeroupper();
+    _Cubc_FilterRowScalar(dst, src, table, i, n);
+}
+
+// Combines `taps` filtered rows into destination pixels `i` to `n`, eight at
+// a time.
+static void _Cubc_FilterColumnsAvx2(uint32_t* dst, const uint32_t* const* rows,
+                                    const int16_t* w, size_t taps, size_t i,
+                                    size_t n) {
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(1 << (CUBC_FILTER_BITS - 1));
+    if (taps == 2) {
+        // Two weights sum to one, so every channel is a plus
+        // (w[1] * (b - a) + round) >> CUBC_FILTER_BITS, which a rounding high
+        // multiply of 2 * (b - a) by w[1] gives exactly, in 16-bit lanes.
+        const __m256i w1 = _mm256_set1_epi16(w[1]);
+        // Two equal weights round like an average.
+        for (; w[0] == w[1] && i + 8 <= n; i += 8) {
+            __m256i a = _mm256_loadu_si256((const __m256i*) (rows[0] + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*) (rows[1] + i));
+            _mm256_storeu_si256((__m256i*) (dst + i), _mm256_avg_epu8(a, b));
+        }
+        for (; i + 8 <= n; i += 8) {
+            __m256i a    = _mm256_loadu_si256((const __m256i*) (rows[0] + i));
+            __m256i b    = _mm256_loadu_si256((const __m256i*) (rows[1] + i));
+            __m256i a_lo = _mm256_unpacklo_epi8(a, zero);
+            __m256i a_hi = _mm256_unpackhi_epi8(a, zero);
+            __m256i d_lo = _mm256_unpacklo_epi8(b, zero);
+            __m256i d_hi = _mm256_unpackhi_epi8(b, zero);
+            d_lo         = _mm256_slli_epi16(_mm256_sub_epi16(d_lo, a_lo), 1);
+            d_hi         = _mm256_slli_epi16(_mm256_sub_epi16(d_hi, a_hi), 1);
+            d_lo         = _mm256_mulhrs_epi16(d_lo, w1);
+            d_hi         = _mm256_mulhrs_epi16(d_hi, w1);
+            _mm256_storeu_si256(
+                (__m256i*) (dst + i),
+                _mm256_packus_epi16(_mm256_add_epi16(a_lo, d_lo),
+                                    _mm256_add_epi16(a_hi, d_hi)));
+        }
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for (size_t t = 0; t < taps; t += 2) {
+            __m256i a    = _mm256_loadu_si256((const __m256i*) (rows[t] + i));
+            __m256i b    = zero;
+            __m256i pair = _mm256_set1_epi32(_Cubc_FilterPair(w + t));
+            if (t + 1 < taps) {
+                b = _mm256_loadu_si256((const __m256i*) (rows[t + 1] + i));
+            }
+            __m256i lo   = _mm256_unpacklo_epi8(a, b);
+            __m256i hi   = _mm256_unpackhi_epi8(a, b);
+
+            acc0 = _mm256_add_epi32(
+                acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), pair));
+            acc1 = _mm256_add_epi32(
+                acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), pair));
+            acc2 = _mm256_add_epi32(
+                acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), pair));
+            acc3 = _mm256_add_epi32(
+                acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), pair));
+        }
+        acc0 = _mm256_srai_epi32(acc0, CUBC_FILTER_BITS);
+        acc1 = _mm256_srai_epi32(acc1, CUBC_FILTER_BITS);
+        acc2 = _mm256_srai_epi32(acc2, CUBC_FILTER_BITS);
+        acc3 = _mm256_srai_epi32(acc3, CUBC_FILTER_BITS);
+        // The unpacks and packs stay within 128-bit lanes, so the pixels come
+        // out in order.
+        __m256i lo = _mm256_packs_epi32(acc0, acc1);
+        __m256i hi = _mm256_packs_epi32(acc2, acc3);
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    _mm256_zeroupper();
+    _Cubc_FilterColumnsScalar(dst, rows, w, taps, i, n);
+}
+CUBC_TARGET_END
+#endif
+
+static inline void _Cubc_FilterRow(uint32_t* dst, const uint32_t* src,
+                                   const _Cubc_FilterTable* table, size_t n) {
+    _Cubc_ActiveKernels()->filter_row(dst, src, table, 0, n);
+}
+
+static inline void _Cubc_FilterColumns(uint32_t* dst,
+                                       const uint32_t* const* rows,
+                                       const int16_t* w, size_t taps,
+                                       size_t n) {
+    _Cubc_ActiveKernels()->filter_columns(dst, rows, w, taps, 0, n);
+}
+
+#define CUBC_TRIANGLE_BLOCK 8
+
+// Writes `color` to the pixels of a CUBC_TRIANGLE_BLOCK square block where
+// all three edge values are non-negative. w holds the edge values at the
+// top-left pixel of the block, a and b their x and y steps.
+static void _Cubc_TriangleBlockScalar(uint32_t* dst, size_t stride,
+                                      const int32_t* w, const int32_t* a,
+                                      const int32_t* b, uint32_t color) {
+    int32_t row0 = w[0], row1 = w[1], row2 = w[2];
+    for (int y = 0; y < CUBC_TRIANGLE_BLOCK; y++) {
+        int32_t w0 = row0, w1 = row1, w2 = row2;
+        for (int x = 0; x < CUBC_TRIANGLE_BLOCK; x++) {
+            if ((w0 | w1 | w2) >= 0) {
+                dst[x] = color;
+            }
+            w0 += a[0];
+            w1 += a[1];
+            w2 += a[2];
+        }
+        row0 += b[0];
+        row1 += b[1];
+        row2 += b[2];
+        dst  += stride;
+    }
+}
+
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+static void _Cubc_TriangleBlockSse2(uint32_t* dst, size_t stride,
+                                    const int32_t* w, const int32_t* a,
+                                    const int32_t* b, uint32_t color) {
+    const __m128i c = _mm_set1_epi32(color);
+
+    __m128i w0_lo = _mm_setr_epi32(w[0], w[0] + a[0], w[0] + 2 * a[0],
+                                   w[0] + 3 * a[0]);
+    __m128i w1_lo = _mm_setr_epi32(w[1], w[1] + a[1], w[1] + 2 * a[1],
+                                   w[1] + 3 * a[1]);
+    __m128i w2_lo = _mm_setr_epi32(w[2], w[2] + a[2], w[2] + 2 * a[2],
+                                   w[2] + 3 * a[2]);
+    __m128i w0_hi = _mm_add_epi32(w0_lo, _mm_set1_epi32(4 * a[0]));
+    __m128i w1_hi = _mm_add_epi32(w1_lo, _mm_set1_epi32(4 * a[1]));
+    __m128i w2_hi = _mm_add_epi32(w2_lo, _mm_set1_epi32(4 * a[2]));
+
+    const __m128i b0 = _mm_set1_epi32(b[0]);
+    const __m128i b1 = _mm_set1_epi32(b[1]);
+    const __m128i b2 = _mm_set1_epi32(b[2]);
+    for (int y = 0; y < CUBC_TRIANGLE_BLOCK; y++) {
+        __m128i m_lo = _mm_or_si128(_mm_or_si128(w0_lo, w1_lo), w2_lo);
+        __m128i m_hi = _mm_or_si128(_mm_or_si128(w0_hi, w1_hi), w2_hi);
+        // The sign bit is set exactly for the lanes that are outside.
+        __m128i out_lo = _mm_srai_epi32(m_lo, 31);
+        __m128i out_hi = _mm_srai_epi32(m_hi, 31);
+        __m128i* p_lo  = (__m128i*) dst;
+        __m128i* p_hi  = (__m128i*) (dst + 4);
+        __m128i old_lo = _mm_and_si128(out_lo, _mm_loadu_si128(p_lo));
+        __m128i old_hi = _mm_and_si128(out_hi, _mm_loadu_si128(p_hi));
+        __m128i new_lo = _mm_andnot_si128(out_lo, c);
+        __m128i new_hi = _mm_andnot_si128(out_hi, c);
+        _mm_storeu_si128(p_lo, _mm_or_si128(old_lo, new_lo));
+        _mm_storeu_si128(p_hi, _mm_or_si128(old_hi, new_hi));
+        w0_lo = _mm_add_epi32(w0_lo, b0);
+        w1_lo = _mm_add_epi32(w1_lo, b1);
+        w2_lo = _mm_add_epi32(w2_lo, b2);
+        w0_hi = _mm_add_epi32(w0_hi, b0);
+        w1_hi = _mm_add_epi32(w1_hi, b1);
+        w2_hi = _mm_add_epi32(w2_hi, b2);
+        dst  += stride;
+    }
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+static void _Cubc_TriangleBlockAvx2(uint32_t* dst, size_t stride,
+                                    const int32_t* w, const int32_t* a,
+                                    const int32_t* b, uint32_t color) {
+    const __m256i c = _mm256_set1_epi32(color);
+
+    __m256i w0 = _mm256_setr_epi32(w[0], w[0] + a[0], w[0] + 2 * a[0],
+                                   w[0] + 3 * a[0], w[0] + 4 * a[0],
+                                   w[0] + 5 * a[0], w[0] + 6 * a[0],
+                                   w[0] + 7 * a[0]);
+    __m256i w1 = _mm256_setr_epi32(w[1], w[1] + a[1], w[1] + 2 * a[1],
+                                   w[1] + 3 * a[1], w[1] + 4 * a[1],
+                                   w[1] + 5 * a[1], w[1] + 6 * a[1],
+                                   w[1] + 7 * a[1]);
+    __m256i w2 = _mm256_setr_epi32(w[2], w[2] + a[2], w[2] + 2 * a[2],
+                                   w[2] + 3 * a[2], w[2] + 4 * a[2],
+                                   w[2] + 5 * a[2], w[2] + 6 * a[2],
+                                   w[2] + 7 * a[2]);
+
+    const __m256i b0 = _mm256_set1_epi32(b[0]);
+    const __m256i b1 = _mm256_set1_epi32(b[1]);
+    const __m256i b2 = _mm256_set1_epi32(b[2]);
+    for (int y = 0; y < CUBC_TRIANGLE_BLOCK; y++) {
+        __m256i m  = _mm256_or_si256(_mm256_or_si256(w0, w1), w2);
+        __m256i in = _mm256_cmpgt_epi32(m, _mm256_set1_epi32(-1));
+        _mm256_maskstore_epi32((int*) dst, in, c);
+        w0   = _mm256_add_epi32(w0, b0);
+        w1   = _mm256_add_epi32(w1, b1);
+        w2   = _mm256_add_epi32(w2, b2);
+        dst += stride;
+    }
+}
+CUBC_TARGET_END
+#endif
+
+static inline void _Cubc_TriangleBlock(uint32_t* dst, size_t stride,
+                                       const int32_t* w, const int32_t* a,
+                                       const int32_t* b, uint32_t color) {
+    _Cubc_ActiveKernels()->triangle_block(dst, stride, w, a, b, color);
+}
+
+// Converts `n` pixels to R, G, B bytes.
+static void _Cubc_PackRGBScalar(uint8_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[3 * i]     = src[i] >> 24;
+        dst[3 * i + 1] = src[i] >> 16;
+        dst[3 * i + 2] = src[i] >> 8;
+    }
+}
+
+// Converts `n` pixels to R, G, B, A bytes.
+static void _Cubc_PackRGBAScalar(uint8_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[4 * i]     = src[i] >> 24;
+        dst[4 * i + 1] = src[i] >> 16;
+        dst[4 * i + 2] = src[i] >> 8;
+        dst[4 * i + 3] = src[i];
+    }
+}
+
+// Converts `n` pixels to BT.601 studio-range Y, Cb and Cr planes.
+static void _Cubc_PackYCbCrScalar(uint8_t* y, uint8_t* cb, uint8_t* cr,
+                                  const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int32_t r = src[i] >> 24;
+        int32_t g = (src[i] >> 16) & 0xff;
+        int32_t b = (src[i] >> 8) & 0xff;
+        y[i]      = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        cb[i]     = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        cr[i]     = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+}
+
+#if defined(CUBC_HAVE_SSE2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_SSE2)
+static void _Cubc_PackRGBASse2(uint8_t* dst, const uint32_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // Swap the bytes of every 16-bit half, then the halves.
+        __m128i p = _mm_loadu_si128((const __m128i*) (src + i));
+        p         = _mm_or_si128(_mm_slli_epi16(p, 8), _mm_srli_epi16(p, 8));
+        p         = _mm_shufflelo_epi16(p, _MM_SHUFFLE(2, 3, 0, 1));
+        p         = _mm_shufflehi_epi16(p, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i*) (dst + 4 * i), p);
+    }
+    _Cubc_PackRGBAScalar(dst + 4 * i, src + i, n - i);
+}
+
+// One component of four pixels. `lo` and `hi` hold the 16-bit channels of two
+// pixels each, `weights` the matching A, B, G, R coefficients.
+static inline __m128i _Cubc_YCbCr4(__m128i lo, __m128i hi, __m128i weights,
+                                   int32_t offset) {
+    // Every pixel leaves two partial sums, add them up.
+    __m128 a    = _mm_castsi128_ps(_mm_madd_epi16(lo, weights));
+    __m128 b    = _mm_castsi128_ps(_mm_madd_epi16(hi, weights));
+    __m128i sum = _mm_add_epi32(
+        _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+        _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+    sum         = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+    return _mm_add_epi32(sum, _mm_set1_epi32(offset));
+}
+
+static void _Cubc_PackYCbCrSse2(uint8_t* y, uint8_t* cb, uint8_t* cr,
+                                const uint32_t* src, size_t n) {
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i to_y  = _mm_setr_epi16(0, 25, 129, 66, 0, 25, 129, 66);
+    const __m128i to_cb = _mm_setr_epi16(0, 112, -74, -38, 0, 112, -74, -38);
+    const __m128i to_cr = _mm_setr_epi16(0, -18, -94, 112, 0, -18, -94, 112);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i*) (src + i + 4));
+        __m128i a  = _mm_unpacklo_epi8(p0, zero);
+        __m128i b  = _mm_unpackhi_epi8(p0, zero);
+        __m128i c  = _mm_unpacklo_epi8(p1, zero);
+        __m128i d  = _mm_unpackhi_epi8(p1, zero);
+
+        __m128i ys  = _mm_packs_epi32(_Cubc_YCbCr4(a, b, to_y, 16),
+                                      _Cubc_YCbCr4(c, d, to_y, 16));
+        __m128i cbs = _mm_packs_epi32(_Cubc_YCbCr4(a, b, to_cb, 128),
+                                      _Cubc_YCbCr4(c, d, to_cb, 128));
+        __m128i crs = _mm_packs_epi32(_Cubc_YCbCr4(a, b, to_cr, 128),
+                                      _Cubc_YCbCr4(c, d, to_cr, 128));
+        _mm_storel_epi64((__m128i*) (y + i), _mm_packus_epi16(ys, ys));
+        _mm_storel_epi64((__m128i*) (cb + i), _mm_packus_epi16(cbs, cbs));
+        _mm_storel_epi64((__m128i*) (cr + i), _mm_packus_epi16(crs, crs));
+    }
+    _Cubc_PackYCbCrScalar(y + i, cb + i, cr + i, src + i, n - i);
+}
+CUBC_TARGET_END
+#endif
+
+#if defined(CUBC_HAVE_AVX2)
+CUBC_TARGET_BEGIN(CUBC_TARGET_AVX2)
+static void _Cubc_PackRGBAvx2(uint8_t* dst, const uint32_t* src, size_t n) {
+    // Pixels are A, B, G, R in memory. Reverse the colors of each pixel
+    // within its 128-bit lane, then close the gap between the lanes.
+    const __m256i colors = _mm256_setr_epi8(
+        3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1, 3, 2, 1, 7, 6,
+        5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i            = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*) (src + i));
+        p         = _mm256_permutevar8x32_epi32(
+            _mm256_shuffle_epi8(p, colors), lanes);
+        _mm_storeu_si128((__m128i*) (dst + 3 * i), _mm256_castsi256_si128(p));
+        _mm_storel_epi64((__m128i*) (dst + 3 * i + 16),
+                         _mm256_extracti128_si256(p, 1));
+    }
+    _mm256_zeroupper();
+    _Cubc_PackRGBScalar(dst + 3 * i, src + i, n - i);
+}
+
+static void _Cubc_PackRGBAAvx2(uint8_t* dst, const uint32_t* src, size_t n) {
+    const __m256i reverse = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6,
+        5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*) (src + i));
+        _mm256_storeu_si256((__m256i*) (dst + 4 * i),
+                            _mm256_shuffle_epi8(p, reverse));
+    }
+    _mm256_zeroupper();
+    _Cubc_PackRGBAScalar(dst + 4 * i, src + i, n - i);
+}
+CUBC_TARGET_END
+#endif
+
+static inline void _Cubc_PackRGB(uint8_t* dst, const uint32_t* src, size_t n) {
+    _Cubc_ActiveKernels()->pack_rgb(dst, src, n);
+}
+
+static inline void _Cubc_PackRGBA(uint8_t* dst, const uint32_t* src,
+                                  size_t n) {
+    _Cubc_ActiveKernels()->pack_rgba(dst, src, n);
+}
+
+static inline void _Cubc_PackYCbCr(uint8_t* y, uint8_t* cb, uint8_t* cr,
+                                   const uint32_t* src, size_t n) {
+    _Cubc_ActiveKernels()->pack_ycbcr(y, cb, cr, src, n);
+}
+
+static const _Cubc_Kernels _Cubc_KernelsScalar = {
+    .fill8             = _Cubc_Fill8Scalar,
+    .fill16            = _Cubc_Fill16Scalar,
+    .fill32            = _Cubc_Fill32Scalar,
+    .fill64            = _Cubc_Fill64Scalar,
+    .over_row          = _Cubc_OverRowScalar,
+    .cover_row         = _Cubc_CoverRowScalar,
+    .accumulate_row    = _Cubc_AccumulateRowScalar,
+    .premultiply_row   = _Cubc_PremultiplyRowScalar,
+    .unpremultiply_row = _Cubc_UnpremultiplyRowScalar,
+    .encode_row        = _Cubc_EncodeRowScalar,
+    .decode_row        = _Cubc_DecodeRowScalar,
+    .mix_row           = _Cubc_MixRowScalar,
+    .composite_row     = _Cubc_CompositeRowScalar,
+    .filter_row        = _Cubc_FilterRowScalar,
+    .filter_columns    = _Cubc_FilterColumnsScalar,
+    .triangle_block    = _Cubc_TriangleBlockScalar,
+    .pack_rgb          = _Cubc_PackRGBScalar,
+    .pack_rgba         = _Cubc_PackRGBAScalar,
+    .pack_ycbcr        = _Cubc_PackYCbCrScalar,
+};
+
+// Kernels without a 128-bit version reuse the scalar ones.
+#if defined(CUBC_HAVE_SSE2)
+static const _Cubc_Kernels _Cubc_KernelsSse2 = {
+    .fill8             = _Cubc_Fill8Sse2,
+    .fill16            = _Cubc_Fill16Sse2,
+    .fill32            = _Cubc_Fill32Sse2,
+    .fill64            = _Cubc_Fill64Sse2,
+    .over_row          = _Cubc_OverRowSse2,
+    .cover_row         = _Cubc_CoverRowSse2,
+    .accumulate_row    = _Cubc_AccumulateRowSse2,
+    .premultiply_row   = _Cubc_PremultiplyRowSse2,
+    .unpremultiply_row = _Cubc_UnpremultiplyRowSse2,
+    .encode_row        = _Cubc_EncodeRowSse2,
+    .decode_row        = _Cubc_DecodeRowSse2,
+    .mix_row           = _Cubc_MixRowSse2,
+    .composite_row     = _Cubc_CompositeRowSse2,
+    .filter_row        = _Cubc_FilterRowSse2,
+    .filter_columns    = _Cubc_FilterColumnsSse2,
+    .triangle_block    = _Cubc_TriangleBlockSse2,
+    .pack_rgb          = _Cubc_PackRGBScalar,
+    .pack_rgba         = _Cubc_PackRGBASse2,
+    .pack_ycbcr        = _Cubc_PackYCbCrSse2,
+};
+#endif
+
+// Kernels without a 256-bit version reuse the SSE2 ones.
+#if defined(CUBC_HAVE_AVX2)
+static const _Cubc_Kernels _Cubc_KernelsAvx2 = {
+    .fill8             = _Cubc_Fill8Avx2,
+    .fill16            = _Cubc_Fill16Avx2,
+    .fill32            = _Cubc_Fill32Avx2,
+    .fill64            = _Cubc_Fill64Avx2,
+    .over_row          = _Cubc_OverRowAvx2,
+    .cover_row         = _Cubc_CoverRowAvx2,
+    .accumulate_row    = _Cubc_AccumulateRowAvx2,
+    .premultiply_row   = _Cubc_PremultiplyRowAvx2,
+    .unpremultiply_row = _Cubc_UnpremultiplyRowAvx2,
+    .encode_row        = _Cubc_EncodeRowAvx2,
+    .decode_row        = _Cubc_DecodeRowAvx2,
+    .mix_row           = _Cubc_MixRowAvx2,
+    .composite_row     = _Cubc_CompositeRowAvx2,
+    .filter_row        = _Cubc_FilterRowAvx2,
+    .filter_columns    = _Cubc_FilterColumnsAvx2,
+    .triangle_block    = _Cubc_TriangleBlockAvx2,
+    .pack_rgb          = _Cubc_PackRGBAvx2,
+    .pack_rgba         = _Cubc_PackRGBAAvx2,
+    .pack_ycbcr        = _Cubc_PackYCbCrSse2,
+};
+#endif
+
+// Kernels without a 512-bit version reuse the AVX2 ones.
+#if defined(CUBC_HAVE_AVX512)
+static const _Cubc_Kernels _Cubc_KernelsAvx512 = {
+    .fill8             = _Cubc_Fill8Avx512,
+    .fill16            = _Cubc_Fill16Avx512,
+    .fill32            = _Cubc_Fill32Avx512,
+    .fill64            = _Cubc_Fill64Avx512,
+    .over_row          = _Cubc_OverRowAvx512,
+    .cover_row         = _Cubc_CoverRowAvx512,
+    .accumulate_row    = _Cubc_AccumulateRowAvx2,
+    .premultiply_row   = _Cubc_PremultiplyRowAvx512,
+    .unpremultiply_row = _Cubc_UnpremultiplyRowAvx2,
+    .encode_row        = _Cubc_EncodeRowAvx512,
+    .decode_row        = _Cubc_DecodeRowAvx512,
+    .mix_row           = _Cubc_MixRowAvx2,
+    .composite_row     = _Cubc_CompositeRowAvx512,
+    .filter_row        = _Cubc_FilterRowAvx2,
+    .filter_columns    = _Cubc_FilterColumnsAvx2,
+    .triangle_block    = _Cubc_TriangleBlockAvx2,
+    .pack_rgb          = _Cubc_PackRGBAvx2,
+    .pack_rgba         = _Cubc_PackRGBAAvx2,
+    .pack_ycbcr        = _Cubc_PackYCbCrSse2,
+};
+#endif
+
+// The highest level the CPU supports among the levels built.
+static Cubc_CpuLevel _Cubc_DetectLevel(void) {
+#if defined(CUBC_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw")) {
+        return CUBC_CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+        return CUBC_CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return CUBC_CPU_SSE2;
+    }
+    return CUBC_CPU_SCALAR;
+#elif defined(CUBC_HAVE_AVX512)
+    return CUBC_CPU_AVX512;
+#elif defined(CUBC_HAVE_AVX2)
+    return CUBC_CPU_AVX2;
+#elif defined(CUBC_HAVE_SSE2)
+    return CUBC_CPU_SSE2;
+#else
+    return CUBC_CPU_SCALAR;
+#endif
+}
+
+// Every level up to the detected one is built.
+static const _Cubc_Kernels* _Cubc_KernelsOf(Cubc_CpuLevel level) {
+    switch (level) {
+#if defined(CUBC_HAVE_AVX512)
+    case CUBC_CPU_AVX512:
+        return &_Cubc_KernelsAvx512;
+#endif
+#if defined(CUBC_HAVE_AVX2)
+    case CUBC_CPU_AVX2:
+        return &_Cubc_KernelsAvx2;
+#endif
+#if defined(CUBC_HAVE_SSE2)
+    case CUBC_CPU_SSE2:
+        return &_Cubc_KernelsSse2;
+#endif
+    default:
+        return &_Cubc_KernelsScalar;
+    }
+}
+
+// Set on first use, threads racing there store the same values.
+static int _Cubc_DetectedLevel = -1;
+static int _Cubc_Level;
+static const _Cubc_Kernels* _Cubc_Active;
+
+Cubc_CpuLevel Cubc_CpuDetect(void) {
+    int level = __atomic_load_n(&_Cubc_DetectedLevel, __ATOMIC_RELAXED);
+    if (level < 0) {
+        level = (int) _Cubc_DetectLevel();
+        __atomic_store_n(&_Cubc_DetectedLevel, level, __ATOMIC_RELAXED);
+    }
+    return (Cubc_CpuLevel) level;
+}
+
+Cubc_CpuLevel Cubc_SetCpuLevel(Cubc_CpuLevel level) {
+    Cubc_CpuLevel max = Cubc_CpuDetect();
+    level             = level < max ? level : max;
+    __atomic_store_n(&_Cubc_Level, (int) level, __ATOMIC_RELAXED);
+    __atomic_store_n(&_Cubc_Active, _Cubc_KernelsOf(level), __ATOMIC_RELEASE);
+    return level;
+}
+
+static const _Cubc_Kernels* _Cubc_ActiveKernels(void) {
+    const _Cubc_Kernels* kernels =
+        __atomic_load_n(&_Cubc_Active, __ATOMIC_ACQUIRE);
+    if (kernels == NULL) {
+        Cubc_SetCpuLevel(Cubc_CpuDetect());
+        kernels = __atomic_load_n(&_Cubc_Active, __ATOMIC_ACQUIRE);
+    }
+    return kernels;
+}
+
+Cubc_CpuLevel Cubc_GetCpuLevel(void) {
+    _Cubc_ActiveKernels();
+    return (Cubc_CpuLevel) __atomic_load_n(&_Cubc_Level, __ATOMIC_RELAXED);
+}
+
+// Resamples the clipped destination rectangle `begin_x`..`end_x` by
+// `begin_y`..`end_y` (relative to x, y) in two separable passes.
+static void _Cubc_BlitFiltered(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                               uint32_t x, uint32_t y, int64_t begin_x,
+                               int64_t begin_y, int64_t end_x, int64_t end_y,
+                               float scale_x, float scale_y,
+                               Cubc_Filter filter) {
+    _Cubc_FilterTable columns, rows;
+    _Cubc_FilterTableInit(&columns, filter, scale_x, src->w, begin_x, end_x);
+    _Cubc_FilterTableInit(&rows, filter, scale_y, src->h, begin_y, end_y);
+
+    size_t n    = end_x - begin_x;
+    size_t taps = rows.taps;
+
+    // Source columns read by the horizontal pass.
+    size_t lo = columns.first[0];
+    size_t m  = columns.first[n - 1] + columns.taps - lo;
+
+    // Estimated cost per output pixel of either order, counting a horizontal
+    // tap as four vertical ones since it gathers every window separately.
+    // Filtering rows first filters 1 / scale_y new source rows per output
+    // row, filtering columns first runs the vertical pass over 1 / scale_x
+    // source columns per output pixel. Only the scales decide, so that
+    // clipped blits pick the same order and round the same way.
+    double new_rows      = 1.0 / scale_y < taps ? 1.0 / scale_y : taps;
+    double rows_first    = new_rows * columns.taps * 4 + taps;
+    double columns_first = taps / scale_x + columns.taps * 4.0;
+    bool filter_x        = scale_x != 1.0f;
+    bool filter_y        = scale_y != 1.0f;
+    bool vertical_first  = filter_x && filter_y && columns_first < rows_first;
+
+    size_t ring_size        = vertical_first ? m : n * taps;
+    uint32_t* ring          = (uint32_t*) malloc(sizeof(uint32_t) * ring_size);
+    int64_t* ring_rows      = (int64_t*) malloc(sizeof(int64_t) * taps);
+    const uint32_t** inputs = (const uint32_t**) malloc(sizeof(uint32_t*) *
+                                                        taps);
+    for (size_t t = 0; t < taps; t++) {
+        ring_rows[t] = -1;
+    }
+    if (vertical_first) {
+        // The horizontal pass reads the vertically filtered row instead.
+        for (size_t i = 0; i < n; i++) {
+            columns.first[i] -= lo;
+        }
+    }
+
+    for (int64_t dest_y = begin_y; dest_y < end_y; dest_y++) {
+        size_t j      = dest_y - begin_y;
+        uint32_t* row = &CUBC_CANVAS_AT(*dest, x + begin_x, y + dest_y);
+        if (!filter_y) {
+            _Cubc_FilterRow(row, &CUBC_CANVAS_AT(*src, 0, dest_y), &columns,
+                            n);
+            continue;
+        }
+        if (vertical_first) {
+            for (size_t t = 0; t < taps; t++) {
+                inputs[t] = &CUBC_CANVAS_AT(*src, lo, rows.first[j] + t);
+            }
+            _Cubc_FilterColumns(ring, inputs, rows.weights + j * rows.stride,
+                                taps, m);
+            _Cubc_FilterRow(row, ring, &columns, n);
+            continue;
+        }
+        // Horizontally filtered source rows are kept in a ring, so every
+        // source row is filtered once per blit.
+        for (size_t t = 0; t < taps; t++) {
+            int64_t src_y = (int64_t) rows.first[j] + t;
+            size_t slot   = src_y % taps;
+            if (!filter_x) {
+                inputs[t] = &CUBC_CANVAS_AT(*src, begin_x, src_y);
+                continue;
+            }
+            if (ring_rows[slot] != src_y) {
+                _Cubc_FilterRow(ring + slot * n,
+                                &CUBC_CANVAS_AT(*src, 0, src_y), &columns, n);
+                ring_rows[slot] = src_y;
+            }
+            inputs[t] = ring + slot * n;
+        }
+        _Cubc_FilterColumns(row, inputs, rows.weights + j * rows.stride, taps,
+                            n);
+    }
+
+    free(inputs);
+    free(ring_rows);
+    free(ring);
+    _Cubc_FilterTableFree(&columns);
+    _Cubc_FilterTableFree(&rows);
+}
+
+// Nearest neighbour blit of the destination columns [begin_x, end_x) and
+// rows [begin_y, end_y) where either canvas isn't RGBA8888. Copies between
+// canvases of the same format move the pixels as they are, everything else
+// goes through RGBA8888 a chunk at a time.
+static void _Cubc_BlitFormats(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                              uint32_t x, uint32_t y, int64_t begin_x,
+                              int64_t begin_y, int64_t end_x, int64_t end_y,
+                              float scale_x, float scale_y, bool blend,
+                              Cubc_AlphaMode alpha, Cubc_AlphaMode dest_alpha,
+                              Cubc_BlendMode mode) {
+    size_t n         = end_x - begin_x;
+    size_t src_size  = _Cubc_FormatSize(src->format);
+    size_t dest_size = _Cubc_FormatSize(dest->format);
+    bool copy = !blend && src->format == dest->format && alpha == dest_alpha;
+
+    uint32_t stack_table[CUBC_BLIT_STACK_TABLE];
+    uint32_t* src_xs = stack_table;
+    if (scale_x != 1.0f && n > CUBC_BLIT_STACK_TABLE) {
+        src_xs = (uint32_t*) malloc(sizeof(uint32_t) * n);
+    }
+    for (size_t i = 0; scale_x != 1.0f && i < n; i++) {
+        src_xs[i] = (uint32_t) ((begin_x + (int64_t) i) / scale_x);
+    }
+
+    // Gathered source pixels, up to 8 bytes each.
+    uint64_t gathered[CUBC_BLIT_CHUNK];
+    uint32_t chunk[CUBC_BLIT_CHUNK];
+    uint32_t backdrop[CUBC_BLIT_CHUNK];
+    for (int64_t dest_y = begin_y; dest_y < end_y; dest_y++) {
+        const uint8_t* src_row = (const uint8_t*) _Cubc_PixelAddress(
+            src, 0, (uint32_t) (dest_y / scale_y));
+        uint8_t* row = (uint8_t*) _Cubc_PixelAddress(dest, x + begin_x,
+                                                     y + dest_y);
+        for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+            size_t m           = n - i < CUBC_BLIT_CHUNK ? n - i
+                                                         : CUBC_BLIT_CHUNK;
+            const void* pixels = src_row + (begin_x + i) * src_size;
+            uint8_t* out       = row + i * dest_size;
+            if (scale_x != 1.0f) {
+                _Cubc_Gather(src->format, gathered, src_row, src_xs + i, m);
+                pixels = gathered;
+            }
+            if (copy) {
+                memcpy(out, pixels, m * dest_size);
+                continue;
+            }
+            _Cubc_DecodeRow(src->format, chunk, pixels, m);
+            if (blend) {
+                _Cubc_DecodeRow(dest->format, backdrop, out, m);
+                _Cubc_BlendSpan(backdrop, chunk, m, alpha, dest_alpha, mode);
+                _Cubc_EncodeRow(dest->format, out, backdrop, m);
+            } else {
+                _Cubc_ConvertRow(chunk, chunk, m, alpha, dest_alpha);
+                _Cubc_EncodeRow(dest->format, out, chunk, m);
+            }
+        }
+    }
+
+    if (src_xs != stack_table) {
+        free(src_xs);
+    }
+}
+
+static void _Cubc_BlitCanvas(Cubc_Canvas* dest, const _Cubc_Clip* clip,
+                             const Cubc_Canvas* src, uint32_t x, uint32_t y,
+                             float scale_x, float scale_y, bool blend,
+                             Cubc_AlphaMode alpha, Cubc_AlphaMode dest_alpha,
+                             Cubc_Filter filter, Cubc_BlendMode mode) {
+    int64_t w = (uint32_t) (src->w * scale_x);
+    int64_t h = (uint32_t) (src->h * scale_y);
+
+    int64_t begin_x = clip->x0 > x ? clip->x0 - x : 0;
+    int64_t begin_y = clip->y0 > y ? clip->y0 - y : 0;
+    int64_t end_x   = clip->x1 - x + 1 < w ? clip->x1 - x + 1 : w;
+    int64_t end_y   = clip->y1 - y + 1 < h ? clip->y1 - y + 1 : h;
+
+    // Rounding can map the last column or row just past the source.
+    while (end_x > begin_x && (uint32_t) ((end_x - 1) / scale_x) >= src->w) {
+        end_x--;
+    }
+    while (end_y > begin_y && (uint32_t) ((end_y - 1) / scale_y) >= src->h) {
+        end_y--;
+    }
+
+    if (begin_x >= end_x || begin_y >= end_y) {
+        return;
+    }
+    if (dest->format != CUBC_FORMAT_RGBA8888 ||
+        src->format != CUBC_FORMAT_RGBA8888) {
+        _Cubc_BlitFormats(dest, src, x, y, begin_x, begin_y, end_x, end_y,
+                          scale_x, scale_y, blend, alpha, dest_alpha, mode);
+        return;
+    }
+    size_t n = end_x - begin_x;
+
+    if (scale_x == 1.0f && scale_y == 1.0f) {
+        for (int64_t dest_y = begin_y; dest_y < end_y; dest_y++) {
+            uint32_t* row           = &CUBC_CANVAS_AT(*dest, x + begin_x,
+                                                      y + dest_y);
+            const uint32_t* src_row = &CUBC_CANVAS_AT(*src, begin_x, dest_y);
+            if (blend) {
+                _Cubc_BlendSpan(row, src_row, n, alpha, dest_alpha, mode);
+            } else {
+                _Cubc_ConvertRow(row, src_row, n, alpha, dest_alpha);
+            }
+        }
+        return;
+    }
+
+    if (filter != CUBC_FILTER_NEAREST) {
+        _Cubc_BlitFiltered(dest, src, x, y, begin_x, begin_y, end_x, end_y,
+                           scale_x, scale_y, filter);
+        for (int64_t dest_y = begin_y; alpha != dest_alpha && dest_y < end_y;
+             dest_y++) {
+            uint32_t* row = &CUBC_CANVAS_AT(*dest, x + begin_x, y + dest_y);
+            _Cubc_ConvertRow(row, row, n, alpha, dest_alpha);
+        }
+        return;
+    }
+
+    // The source column of every destination column is the same for all
+    // rows, so look it up once per blit.
+    uint32_t stack_table[CUBC_BLIT_STACK_TABLE];
+    uint32_t* src_xs = stack_table;
+    if (n > CUBC_BLIT_STACK_TABLE) {
+        src_xs = (uint32_t*) malloc(sizeof(uint32_t) * n);
+    }
+    for (size_t i = 0; i < n; i++) {
+        src_xs[i] = (uint32_t) ((begin_x + (int64_t) i) / scale_x);
+    }
+
+    uint32_t prev_src_y = UINT32_MAX;
+    for (int64_t dest_y = begin_y; dest_y < end_y; dest_y++) {
+        uint32_t src_y = (uint32_t) (dest_y / scale_y);
+        uint32_t* row  = &CUBC_CANVAS_AT(*dest, x + begin_x, y + dest_y);
+        const uint32_t* src_row = &CUBC_CANVAS_AT(*src, 0, src_y);
+        if (blend) {
+            uint32_t chunk[CUBC_BLIT_CHUNK];
+            for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+                size_t m = n - i < CUBC_BLIT_CHUNK ? n - i : CUBC_BLIT_CHUNK;
+                for (size_t j = 0; j < m; j++) {
+                    chunk[j] = src_row[src_xs[i + j]];
+                }
+                _Cubc_BlendSpan(row + i, chunk, m, alpha, dest_alpha, mode);
+            }
+            continue;
+        }
+        if (src_y == prev_src_y) {
+            // Upscaled rows repeat the row above.
+            memcpy(row, row - CUBC_CANVAS_STRIDE(*dest), n * sizeof(uint32_t));
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            row[i] = src_row[src_xs[i]];
+        }
+        _Cubc_ConvertRow(row, row, n, alpha, dest_alpha);
+        prev_src_y = src_y;
+    }
+
+    if (src_xs != stack_table) {
+        free(src_xs);
+    }
+}
+
+static void _Cubc_BlitCanvasMode(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                 uint32_t x, uint32_t y, float scale_x,
+                                 float scale_y, bool blend,
+                                 Cubc_AlphaMode alpha, Cubc_Filter filter,
+                                 Cubc_BlendMode mode) {
+    if (dest->commands) {
+        Cubc_Command command = {
+            .kind  = CUBC_COMMAND_BLIT,
+            .color = {0},
+            .blit  = {*src, x, y, scale_x, scale_y, blend, alpha,
+                      _Cubc_AlphaModeOf(dest), filter, mode},
+            .min_x = x,
+            .min_y = y,
+            .max_x = (int64_t) x + (uint32_t) (src->w * scale_x) - 1,
+            .max_y = (int64_t) y + (uint32_t) (src->h * scale_y) - 1,
+        };
+        _Cubc_Record(dest, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(dest);
+    _Cubc_BlitCanvas(dest, &clip, src, x, y, scale_x, scale_y, blend, alpha,
+                     _Cubc_AlphaModeOf(dest), filter, mode);
+}
+
+void Cubc_CanvasBlitCanvas(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                           uint32_t x, uint32_t y, float scale_x,
+                           float scale_y) {
+    _Cubc_BlitCanvasMode(dest, src, x, y, scale_x, scale_y, false,
+                         _Cubc_AlphaModeOf(src), CUBC_FILTER_NEAREST,
+                         CUBC_BLEND_NORMAL);
+}
+
+void Cubc_CanvasBlitCanvasAlpha(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                uint32_t x, uint32_t y, float scale_x,
+                                float scale_y, Cubc_AlphaMode alpha) {
+    _Cubc_BlitCanvasMode(dest, src, x, y, scale_x, scale_y, true, alpha,
+                         CUBC_FILTER_NEAREST, CUBC_BLEND_NORMAL);
+}
+
+void Cubc_CanvasBlitCanvasFiltered(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                   uint32_t x, uint32_t y, float scale_x,
+                                   float scale_y, Cubc_Filter filter) {
+    _Cubc_BlitCanvasMode(dest, src, x, y, scale_x, scale_y, false,
+                         _Cubc_AlphaModeOf(src), filter, CUBC_BLEND_NORMAL);
+}
+
+void Cubc_CanvasBlendCanvas(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                            uint32_t x, uint32_t y, Cubc_BlendMode mode) {
+    _Cubc_BlitCanvasMode(dest, src, x, y, 1.0f, 1.0f, true,
+                         _Cubc_AlphaModeOf(src), CUBC_FILTER_NEAREST, mode);
+}
+
+void Cubc_CanvasBlitCanvasV(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                            Cubc_V2u pos, Cubc_V2f scale) {
+    Cubc_CanvasBlitCanvas(dest, src, pos.x, pos.y, scale.x, scale.y);
+}
+
+void Cubc_CanvasBlitCanvasR(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                            Cubc_Rect rect) {
+    Cubc_CanvasBlitCanvas(dest, src, rect.x, rect.y, rect.w, rect.h);
+}
+
+// One axis of a nine-slice: where each of the three slices starts and how
+// long it is in the source and in the destination.
+typedef struct {
+    int64_t src[3], src_size[3], dest[3], dest_size[3];
+} _Cubc_Slices;
+
+static _Cubc_Slices _Cubc_SlicesOf(int64_t size, int64_t lo, int64_t hi,
+                                   int64_t dest_size) {
+    lo              = lo < size ? lo : size;
+    hi              = hi < size - lo ? hi : size - lo;
+    int64_t mid     = size - lo - hi;
+    int64_t dest_lo = lo, dest_hi = hi;
+    if (lo + hi > dest_size || (mid == 0 && lo + hi > 0)) {
+        dest_lo = (int64_t) ((_Cubc_Wide) dest_size * lo / (lo + hi));
+        dest_hi = dest_size - dest_lo;
+    }
+    _Cubc_Slices slices = {
+        .src       = {0, lo, lo + mid},
+        .src_size  = {lo, mid, hi},
+        .dest      = {0, dest_lo, dest_size - dest_hi},
+        .dest_size = {dest_lo, dest_size - dest_lo - dest_hi, dest_hi},
+    };
+    return slices;
+}
+
+// Fills `out` with the source pixel under the center of each destination
+// pixel from `begin` to `end`. In a slice S long drawn D long that is
+// (2 d + 1) S / 2 D pixels into it for pixel d, whose quotient and
+// remainder are stepped from pixel to pixel rather than divided out.
+static void _Cubc_SliceSources(const _Cubc_Slices* slices, int64_t begin,
+                               int64_t end, uint32_t* out) {
+    for (int k = 0; k < 3; k++) {
+        int64_t from = slices->dest[k] > begin ? slices->dest[k] : begin;
+        int64_t to   = slices->dest[k] + slices->dest_size[k];
+        to           = to < end ? to : end;
+        if (from >= to) {
+            continue;
+        }
+        int64_t den    = 2 * slices->dest_size[k];
+        _Cubc_Wide num = (2 * (from - slices->dest[k]) + 1) *
+                         (_Cubc_Wide) slices->src_size[k];
+        int64_t q      = (int64_t) (num / den);
+        int64_t r      = (int64_t) (num % den);
+        int64_t step_q = 2 * slices->src_size[k] / den;
+        int64_t step_r = 2 * slices->src_size[k] % den;
+        for (int64_t i = from; i < to; i++) {
+            out[i - begin]  = (uint32_t) (slices->src[k] + q);
+            q              += step_q;
+            r              += step_r;
+            if (r >= den) {
+                r -= den;
+                q++;
+            }
+        }
+    }
+}
+
+// Nine-slice blits in any formats. The source column of every destination
+// column is looked up once, so that each row is a single gather, and stored
+// rows from the same source row as the row above copy it instead.
+static void _Cubc_BlitSliced(Cubc_Canvas* dest, const _Cubc_Clip* clip,
+                             const Cubc_Canvas* src, uint32_t x, uint32_t y,
+                             uint32_t w, uint32_t h, Cubc_Insets insets,
+                             bool blend, Cubc_AlphaMode alpha,
+                             Cubc_AlphaMode dest_alpha) {
+    if (src->w == 0 || src->h == 0) {
+        return;
+    }
+    _Cubc_Slices columns = _Cubc_SlicesOf(src->w, insets.left, insets.right,
+                                          w);
+    _Cubc_Slices rows    = _Cubc_SlicesOf(src->h, insets.top, insets.bottom,
+                                          h);
+
+    int64_t begin_x = clip->x0 > x ? clip->x0 - x : 0;
+    int64_t begin_y = clip->y0 > y ? clip->y0 - y : 0;
+    int64_t end_x   = clip->x1 - x + 1 < w ? clip->x1 - x + 1 : w;
+    int64_t end_y   = clip->y1 - y + 1 < h ? clip->y1 - y + 1 : h;
+    if (begin_x >= end_x || begin_y >= end_y) {
+        return;
+    }
+    size_t n         = end_x - begin_x;
+    size_t dest_size = _Cubc_FormatSize(dest->format);
+    bool copy = !blend && src->format == dest->format && alpha == dest_alpha;
+
+    // The source columns, then the source rows.
+    size_t rows_n = end_y - begin_y;
+    uint32_t stack_table[CUBC_BLIT_STACK_TABLE];
+    uint32_t* src_xs = stack_table;
+    if (n + rows_n > CUBC_BLIT_STACK_TABLE) {
+        src_xs = (uint32_t*) malloc(sizeof(uint32_t) * (n + rows_n));
+    }
+    uint32_t* src_ys = src_xs + n;
+    _Cubc_SliceSources(&columns, begin_x, end_x, src_xs);
+    _Cubc_SliceSources(&rows, begin_y, end_y, src_ys);
+
+    // Gathered source pixels, up to 8 bytes each.
+    uint64_t gathered[CUBC_BLIT_CHUNK];
+    uint32_t chunk[CUBC_BLIT_CHUNK];
+    uint32_t backdrop[CUBC_BLIT_CHUNK];
+    uint32_t prev_src_y = UINT32_MAX;
+    for (int64_t dest_y = begin_y; dest_y < end_y; dest_y++) {
+        uint32_t src_y = src_ys[dest_y - begin_y];
+        uint8_t* row   = (uint8_t*) _Cubc_PixelAddress(dest, x + begin_x,
+                                                       y + dest_y);
+        if (!blend && src_y == prev_src_y) {
+            memcpy(row, _Cubc_PixelAddress(dest, x + begin_x, y + dest_y - 1),
+                   n * dest_size);
+            continue;
+        }
+        prev_src_y = src_y;
+
+        const void* src_row = _Cubc_PixelAddress(src, 0, src_y);
+        if (copy) {
+            _Cubc_Gather(src->format, row, src_row, src_xs, n);
+            continue;
+        }
+        for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+            size_t m     = n - i < CUBC_BLIT_CHUNK ? n - i : CUBC_BLIT_CHUNK;
+            uint8_t* out = row + i * dest_size;
+            _Cubc_Gather(src->format, gathered, src_row, src_xs + i, m);
+            const uint32_t* colors = (const uint32_t*) gathered;
+            if (src->format != CUBC_FORMAT_RGBA8888) {
+                _Cubc_DecodeRow(src->format, chunk, gathered, m);
+                colors = chunk;
+            }
+            // RGBA8888 destinations are blended in place.
+            uint32_t* target = dest->format == CUBC_FORMAT_RGBA8888
+                                   ? (uint32_t*) out
+                                   : backdrop;
+            if (blend) {
+                if (target == backdrop) {
+                    _Cubc_DecodeRow(dest->format, backdrop, out, m);
+                }
+                _Cubc_BlendSpan(target, colors, m, alpha, dest_alpha,
+                                CUBC_BLEND_NORMAL);
+            } else {
+                _Cubc_ConvertRow(target, colors, m, alpha, dest_alpha);
+            }
+            if (target == backdrop) {
+                _Cubc_EncodeRow(dest->format, out, backdrop, m);
+            }
+        }
+    }
+
+    if (src_xs != stack_table) {
+        free(src_xs);
+    }
+}
+
+static void _Cubc_CanvasBlitSliced(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                   uint32_t x, uint32_t y, uint32_t w,
+                                   uint32_t h, Cubc_Insets insets, bool blend,
+                                   Cubc_AlphaMode alpha) {
+    if (dest->commands) {
+        Cubc_Command command = {
+            .kind   = CUBC_COMMAND_BLIT_SLICED,
+            .color  = {0},
+            .sliced = {*src, x, y, w, h, insets, blend, alpha,
+                       _Cubc_AlphaModeOf(dest)},
+            .min_x  = x,
+            .min_y  = y,
+            .max_x  = (int64_t) x + w - 1,
+            .max_y  = (int64_t) y + h - 1,
+        };
+        _Cubc_Record(dest, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(dest);
+    _Cubc_BlitSliced(dest, &clip, src, x, y, w, h, insets, blend, alpha,
+                     _Cubc_AlphaModeOf(dest));
+}
+
+void Cubc_CanvasBlitCanvasSliced(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                 uint32_t x, uint32_t y, uint32_t w,
+                                 uint32_t h, Cubc_Insets insets) {
+    _Cubc_CanvasBlitSliced(dest, src, x, y, w, h, insets, false,
+                           _Cubc_AlphaModeOf(src));
+}
+
+void Cubc_CanvasBlitCanvasSlicedR(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                  Cubc_Rect rect, Cubc_Insets insets) {
+    Cubc_CanvasBlitCanvasSliced(dest, src, rect.x, rect.y, rect.w, rect.h,
+                                insets);
+}
+
+void Cubc_CanvasBlitCanvasSlicedAlpha(Cubc_Canvas* dest,
+                                      const Cubc_Canvas* src, uint32_t x,
+                                      uint32_t y, uint32_t w, uint32_t h,
+                                      Cubc_Insets insets,
+                                      Cubc_AlphaMode alpha) {
+    _Cubc_CanvasBlitSliced(dest, src, x, y, w, h, insets, true, alpha);
+}
+
+// Composites [x0, x1] x [y0, y1] of `dest` with `src` placed at `x`, `y`, or
+// with the RGBA8888 pixels of `fill` when `src` is NULL, where either canvas
+// isn't RGBA8888. Runs through RGBA8888 a chunk at a time.
+static void _Cubc_CompositeFormats(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                   const uint32_t* fill, uint32_t x,
+                                   uint32_t y, int64_t x0, int64_t y0,
+                                   int64_t x1, int64_t y1, Cubc_CompositeOp op,
+                                   Cubc_AlphaMode dest_alpha) {
+    size_t n                 = x1 - x0 + 1;
+    size_t dest_size         = _Cubc_FormatSize(dest->format);
+    Cubc_AlphaMode src_alpha = src ? _Cubc_AlphaModeOf(src)
+                                   : CUBC_ALPHA_PREMULTIPLIED;
+    uint32_t chunk[CUBC_BLIT_CHUNK];
+    uint32_t backdrop[CUBC_BLIT_CHUNK];
+    for (int64_t row_y = y0; row_y <= y1; row_y++) {
+        uint8_t* row = (uint8_t*) _Cubc_PixelAddress(dest, x0, row_y);
+        for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+            size_t m          = n - i < CUBC_BLIT_CHUNK ? n - i
+                                                        : CUBC_BLIT_CHUNK;
+            const uint32_t* pixels = fill;
+            if (src) {
+                _Cubc_DecodeRow(src->format, chunk,
+                                _Cubc_PixelAddress(src, x0 - x + i, row_y - y),
+                                m);
+                pixels = chunk;
+            }
+            _Cubc_DecodeRow(dest->format, backdrop, row + i * dest_size, m);
+            _Cubc_CompositeSpanMode(backdrop, pixels, m, src_alpha, dest_alpha,
+                                    op);
+            _Cubc_EncodeRow(dest->format, row + i * dest_size, backdrop, m);
+        }
+    }
+}
+
+// Composites the `w` by `h` area of `dest` at `x`, `y` with `src`, or with a
+// solid premultiplied `color` when `src` is NULL.
+static void _Cubc_Composite(Cubc_Canvas* dest, const _Cubc_Clip* clip,
+                            const Cubc_Canvas* src, Cubc_Color color,
+                            uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                            Cubc_CompositeOp op, Cubc_AlphaMode dest_alpha) {
+    int64_t x0 = x > clip->x0 ? x : clip->x0;
+    int64_t y0 = y > clip->y0 ? y : clip->y0;
+    int64_t x1 = (int64_t) x + w - 1 < clip->x1 ? (int64_t) x + w - 1
+                                                 : clip->x1;
+    int64_t y1 = (int64_t) y + h - 1 < clip->y1 ? (int64_t) y + h - 1
+                                                 : clip->y1;
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    size_t n                 = x1 - x0 + 1;
+    Cubc_AlphaMode src_alpha = src ? _Cubc_AlphaModeOf(src)
+                                   : CUBC_ALPHA_PREMULTIPLIED;
+
+    uint32_t fill[CUBC_BLIT_CHUNK];
+    if (!src) {
+        _Cubc_Fill32(fill, n < CUBC_BLIT_CHUNK ? n : CUBC_BLIT_CHUNK,
+                     color.color, false);
+    }
+    if (dest->format != CUBC_FORMAT_RGBA8888 ||
+        (src && src->format != CUBC_FORMAT_RGBA8888)) {
+        _Cubc_CompositeFormats(dest, src, fill, x, y, x0, y0, x1, y1, op,
+                               dest_alpha);
+        return;
+    }
+    for (int64_t row_y = y0; row_y <= y1; row_y++) {
+        uint32_t* row = &CUBC_CANVAS_AT(*dest, x0, row_y);
+        if (src) {
+            _Cubc_CompositeSpanMode(row,
+                                    &CUBC_CANVAS_AT(*src, x0 - x, row_y - y),
+                                    n, src_alpha, dest_alpha, op);
+            continue;
+        }
+        for (size_t i = 0; i < n; i += CUBC_BLIT_CHUNK) {
+            size_t m = n - i < CUBC_BLIT_CHUNK ? n - i : CUBC_BLIT_CHUNK;
+            _Cubc_CompositeSpanMode(row + i, fill, m, src_alpha, dest_alpha,
+                                    op);
+        }
+    }
+}
+
+static void _Cubc_CompositeMode(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                                Cubc_Color color, uint32_t x, uint32_t y,
+                                uint32_t w, uint32_t h, Cubc_CompositeOp op) {
+    if (w == 0 || h == 0) {
+        return;
+    }
+    if (dest->commands) {
+        Cubc_Canvas none     = CUBC_ZERO;
+        Cubc_Command command = {
+            .kind      = CUBC_COMMAND_COMPOSITE,
+            .color     = color,
+            .composite = {src ? *src : none, x, y, w, h, op,
+                          _Cubc_AlphaModeOf(dest)},
+            .min_x     = x,
+            .min_y     = y,
+            .max_x     = (int64_t) x + w - 1,
+            .max_y     = (int64_t) y + h - 1,
+        };
+        _Cubc_Record(dest, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(dest);
+    _Cubc_Composite(dest, &clip, src, color, x, y, w, h, op,
+                    _Cubc_AlphaModeOf(dest));
+}
+
+void Cubc_CanvasComposite(Cubc_Canvas* dest, const Cubc_Canvas* src,
+                          uint32_t x, uint32_t y, Cubc_CompositeOp op) {
+    Cubc_Color unused = {0};
+    _Cubc_CompositeMode(dest, src, unused, x, y, src->w, src->h, op);
+}
+
+void Cubc_CanvasCompositeRect(Cubc_Canvas* dest, uint32_t x, uint32_t y,
+                              uint32_t w, uint32_t h, Cubc_Color color,
+                              Cubc_CompositeOp op) {
+    _Cubc_CompositeMode(dest, NULL, color, x, y, w, h, op);
+}
+
+static void _Cubc_ConvertCanvas(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                                bool premultiply) {
+    size_t n = clip->x1 - clip->x0 + 1;
+    for (int64_t y = clip->y0; y <= clip->y1; y++) {
+        uint32_t* row = &CUBC_CANVAS_AT(*canvas, clip->x0, y);
+        // BGRA8888 converts in place through RGBA8888.
+        if (canvas->format == CUBC_FORMAT_BGRA8888) {
+            _Cubc_DecodeRow(canvas->format, row, row, n);
+        }
+        if (premultiply) {
+            _Cubc_PremultiplyRow(row, row, n);
+        } else {
+            _Cubc_UnpremultiplyRow(row, row, n);
+        }
+        if (canvas->format == CUBC_FORMAT_BGRA8888) {
+            _Cubc_EncodeRow(canvas->format, row, row, n);
+        }
+    }
+}
+
+static void _Cubc_SetPremultiplied(Cubc_Canvas* canvas, bool premultiplied) {
+    if (canvas->premultiplied == premultiplied ||
+        (canvas->format != CUBC_FORMAT_RGBA8888 &&
+         canvas->format != CUBC_FORMAT_BGRA8888)) {
+        return;
+    }
+    // Commands read the mark when they're recorded, so it changes right
+    // away even when the pixels don't.
+    canvas->premultiplied = premultiplied;
+    if (canvas->w == 0 || canvas->h == 0) {
+        return;
+    }
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind  = premultiplied ? CUBC_COMMAND_PREMULTIPLY
+                                   : CUBC_COMMAND_UNPREMULTIPLY,
+            .color = {0},
+            .rect  = CUBC_ZERO,
+            .min_x = 0,
+            .min_y = 0,
+            .max_x = (int64_t) canvas->w - 1,
+            .max_y = (int64_t) canvas->h - 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_ConvertCanvas(canvas, &clip, premultiplied);
+}
+
+void Cubc_CanvasPremultiply(Cubc_Canvas* canvas) {
+    _Cubc_SetPremultiplied(canvas, true);
+}
+
+void Cubc_CanvasUnpremultiply(Cubc_Canvas* canvas) {
+    _Cubc_SetPremultiplied(canvas, false);
+}
+
+static void _Cubc_FillRect(Cubc_Canvas* canvas, int64_t x0, int64_t y0,
+                           int64_t x1, int64_t y1, Cubc_Color color) {
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    uint64_t value = _Cubc_EncodePixel(canvas->format, color.color);
+    size_t w       = x1 - x0 + 1;
+    if (x0 == 0 && w == CUBC_CANVAS_STRIDE(*canvas)) {
+        // Whole rows are contiguous, fill them as a single span.
+        size_t n = w * (y1 - y0 + 1);
+        _Cubc_Fill(canvas->format, _Cubc_PixelAddress(canvas, 0, y0), n, value,
+                   n * _Cubc_FormatSize(canvas->format) >=
+                       CUBC_STREAM_MIN_BYTES);
+        return;
+    }
+    for (int64_t y = y0; y <= y1; y++) {
+        _Cubc_Fill(canvas->format, _Cubc_PixelAddress(canvas, x0, y), w,
+                   value, false);
+    }
+}
+
+static void _Cubc_Clear(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                        Cubc_Color color) {
+    _Cubc_FillRect(canvas, clip->x0, clip->y0, clip->x1, clip->y1, color);
+}
+
+void Cubc_CanvasClear(Cubc_Canvas* canvas, Cubc_Color color) {
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind  = CUBC_COMMAND_CLEAR,
+            .color = color,
+            .rect  = CUBC_ZERO,
+            .min_x = 0,
+            .min_y = 0,
+            .max_x = (int64_t) canvas->w - 1,
+            .max_y = (int64_t) canvas->h - 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Clear(canvas, &clip, color);
+}
+
+static void _Cubc_Pixel(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                        int64_t x, int64_t y, Cubc_Color color) {
+    if (x >= clip->x0 && x <= clip->x1 && y >= clip->y0 && y <= clip->y1) {
+        _Cubc_Fill(canvas->format, _Cubc_PixelAddress(canvas, x, y), 1,
+                   _Cubc_EncodePixel(canvas->format, color.color), false);
+    }
+}
+
+void Cubc_CanvasPixel(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                      Cubc_Color color) {
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind   = CUBC_COMMAND_PIXEL,
+            .color  = color,
+            .points = {x, y, 0, 0, 0, 0},
+            .min_x  = x,
+            .min_y  = y,
+            .max_x  = x,
+            .max_y  = y,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Pixel(canvas, &clip, x, y, color);
+}
+
+void Cubc_CanvasPixelV(Cubc_Canvas* canvas, Cubc_V2u pos, Cubc_Color color) {
+    Cubc_CanvasPixel(canvas, pos.x, pos.y, color);
+}
+
+// Smallest step of a Bresenham line with major length `da` and minor length
+// `db` at which the minor coordinate has advanced `n` times.
+static int64_t _Cubc_LineStep(int64_t da, int64_t db, int64_t n) {
+    if (n <= 0) {
+        return 0;
+    }
+    if (db == 0) {
+        return INT64_MAX;
+    }
+    return (int64_t) (((_Cubc_Wide) 2 * da * (n - 1) + da) / (2 * db)) + 1;
+}
+
+static void _Cubc_Line(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                       int64_t x0, int64_t y0, int64_t x1, int64_t y1,
+                       Cubc_Color color) {
+    int64_t dx = x1 - x0;
+    int64_t dy = y1 - y0;
+    bool steep = (dy < 0 ? -dy : dy) > (dx < 0 ? -dx : dx);
+
+    // Walk along the major axis a and step the minor axis b.
+    int64_t a0   = steep ? y0 : x0;
+    int64_t b0   = steep ? x0 : y0;
+    int64_t a1   = steep ? y1 : x1;
+    int64_t b1   = steep ? x1 : y1;
+    int64_t a_lo = steep ? clip->y0 : clip->x0;
+    int64_t a_hi = steep ? clip->y1 : clip->x1;
+    int64_t b_lo = steep ? clip->x0 : clip->y0;
+    int64_t b_hi = steep ? clip->x1 : clip->y1;
+    if (a0 > a1) {
+        SWAP(a0, a1);
+        SWAP(b0, b1);
+    }
+    int64_t da = a1 - a0;
+    int64_t db = b1 < b0 ? b0 - b1 : b1 - b0;
+    int64_t sb = b1 < b0 ? -1 : 1;
+
+    // Clip the range of steps against both axes once, so that the loop below
+    // never leaves the clip rectangle.
+    int64_t n_lo = sb > 0 ? b_lo - b0 : b0 - b_hi;
+    int64_t n_hi = sb > 0 ? b_hi - b0 : b0 - b_lo;
+    if (n_hi < 0) {
+        return;
+    }
+    int64_t k0    = a_lo - a0 > 0 ? a_lo - a0 : 0;
+    int64_t k1    = a_hi - a0 < da ? a_hi - a0 : da;
+    int64_t k_in  = _Cubc_LineStep(da, db, n_lo);
+    int64_t k_out = _Cubc_LineStep(da, db, n_hi + 1) - 1;
+    k0            = k0 > k_in ? k0 : k_in;
+    k1            = k1 < k_out ? k1 : k_out;
+    if (k0 > k1) {
+        return;
+    }
+
+    int64_t n = 0;
+    if (da > 0) {
+        n = (int64_t) (((_Cubc_Wide) 2 * k0 * db + da - 1) / (2 * da));
+    }
+    int64_t error2 = (int64_t) ((_Cubc_Wide) 2 * k0 * db -
+                                (_Cubc_Wide) 2 * n * da);
+
+    ptrdiff_t stride = CUBC_CANVAS_STRIDE(*canvas);
+    ptrdiff_t step_a = steep ? stride : 1;
+    ptrdiff_t step_b = steep ? sb : sb * stride;
+    int64_t a        = a0 + k0;
+    int64_t b        = b0 + sb * n;
+    ptrdiff_t i      = steep ? b + a * stride : a + b * stride;
+    int64_t count    = k1 - k0 + 1;
+    uint64_t value   = _Cubc_EncodePixel(canvas->format, color.color);
+    switch (_Cubc_FormatSize(canvas->format)) {
+    case 1:
+        _Cubc_LineLoop8((uint8_t*) canvas->data, i, count, step_a, step_b,
+                        error2, da, db, (uint8_t) value);
+        break;
+    case 2:
+        _Cubc_LineLoop16((uint16_t*) canvas->data, i, count, step_a, step_b,
+                         error2, da, db, (uint16_t) value);
+        break;
+    case 8:
+        _Cubc_LineLoop64((uint64_t*) canvas->data, i, count, step_a, step_b,
+                         error2, da, db, value);
+        break;
+    default:
+        _Cubc_LineLoop32(canvas->pixels, i, count, step_a, step_b, error2, da,
+                         db, (uint32_t) value);
+        break;
+    }
+}
+
+void Cubc_CanvasLine(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0, uint32_t x1,
+                     uint32_t y1, Cubc_Color color) {
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind   = CUBC_COMMAND_LINE,
+            .color  = color,
+            .points = {x0, y0, x1, y1, 0, 0},
+            .min_x  = x0 < x1 ? x0 : x1,
+            .min_y  = y0 < y1 ? y0 : y1,
+            .max_x  = x0 > x1 ? x0 : x1,
+            .max_y  = y0 > y1 ? y0 : y1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Line(canvas, &clip, x0, y0, x1, y1, color);
+}
+
+void Cubc_CanvasLineV(Cubc_Canvas* canvas, Cubc_V2u begin, Cubc_V2u end,
+                      Cubc_Color color) {
+    Cubc_CanvasLine(canvas, begin.x, begin.y, end.x, end.y, color);
+}
+
+
+static inline bool _Cubc_Finite(double x) {
+    return x - x == 0;
+}
+
+// Floor of n / d for any signs.
+static inline int64_t _Cubc_FloorDiv(int64_t n, int64_t d) {
+    int64_t q = n / d;
+    return (n % d != 0 && (n < 0) != (d < 0)) ? q - 1 : q;
+}
+
+// Clips the segment to [x_lo, x_hi] x [y_lo, y_hi] (Liang-Barsky). Returns
+// false when nothing is left.
+static bool _Cubc_ClipSegment(double* x0, double* y0, double* x1, double* y1,
+                              double x_lo, double y_lo, double x_hi,
+                              double y_hi) {
+    double dx   = *x1 - *x0;
+    double dy   = *y1 - *y0;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {*x0 - x_lo, x_hi - *x0, *y0 - y_lo, y_hi - *y0};
+    double t0 = 0, t1 = 1;
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) {
+                return false;
+            }
+            continue;
+        }
+        double t = q[i] / p[i];
+        if (p[i] < 0) {
+            t0 = t > t0 ? t : t0;
+        } else {
+            t1 = t < t1 ? t : t1;
+        }
+    }
+    if (t0 > t1) {
+        return false;
+    }
+    double start_x = *x0, start_y = *y0;
+    *x0            = start_x + t0 * dx;
+    *y0            = start_y + t0 * dy;
+    *x1            = start_x + t1 * dx;
+    *y1            = start_y + t1 * dy;
+    return true;
+}
+
+// Pixels of an anti-aliased primitive gathered with their coverage, so that
+// _Cubc_CoverRow blends them together.
+#define CUBC_COVER_BATCH 128
+
+typedef struct {
+    uint8_t* at[CUBC_COVER_BATCH];
+    uint32_t pixels[CUBC_COVER_BATCH];
+    uint8_t coverage[CUBC_COVER_BATCH];
+} _Cubc_CoverBatch;
+
+// Composites the first `n` gathered pixels onto the canvas. No pixel may be
+// gathered twice. RGBA8888 batches are padded with pixels without coverage to
+// a whole number of vectors, which spares the kernels their scalar tails.
+static void _Cubc_CoverFlush(Cubc_Canvas* canvas, _Cubc_CoverBatch* batch,
+                             size_t n, uint32_t color, Cubc_AlphaMode alpha) {
+    size_t padded = (n + 7) & ~(size_t) 7;
+    for (size_t i = n; i < padded; i++) {
+        batch->pixels[i]   = 0;
+        batch->coverage[i] = 0;
+    }
+    if (canvas->format == CUBC_FORMAT_RGBA8888) {
+        for (size_t i = 0; i < n; i++) {
+            batch->pixels[i] = *(uint32_t*) batch->at[i];
+        }
+        _Cubc_CoverRow(batch->pixels, batch->coverage, padded, color, alpha);
+        for (size_t i = 0; i < n; i++) {
+            *(uint32_t*) batch->at[i] = batch->pixels[i];
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            _Cubc_DecodeRow(canvas->format, batch->pixels + i, batch->at[i],
+                            1);
+        }
+        _Cubc_CoverRow(batch->pixels, batch->coverage, n, color, alpha);
+        for (size_t i = 0; i < n; i++) {
+            _Cubc_EncodeRow(canvas->format, batch->at[i], batch->pixels + i,
+                            1);
+        }
+    }
+}
+
+// Composites `color`, premultiplied when `alpha` is, over pixels `x0` to
+// `x1` of row `y`. Opaque colors are stored, which gives the same pixels.
+static void _Cubc_OverSpan(Cubc_Canvas* canvas, int64_t x0, int64_t x1,
+                           int64_t y, uint32_t color, Cubc_AlphaMode alpha) {
+    if (CUBC_ALPHA(color) == 255) {
+        _Cubc_Fill(canvas->format, _Cubc_PixelAddress(canvas, x0, y),
+                   x1 - x0 + 1, _Cubc_EncodePixel(canvas->format, color),
+                   false);
+        return;
+    }
+    uint8_t coverage[CUBC_COVER_BATCH];
+    uint32_t pixels[CUBC_COVER_BATCH];
+    memset(coverage, 255,
+           x1 - x0 + 1 < CUBC_COVER_BATCH ? (size_t) (x1 - x0 + 1)
+                                          : CUBC_COVER_BATCH);
+    bool native = canvas->format == CUBC_FORMAT_RGBA8888;
+    for (int64_t x = x0; x <= x1; x += CUBC_COVER_BATCH) {
+        size_t n = (size_t) (x1 - x + 1 < CUBC_COVER_BATCH ? x1 - x + 1
+                                                           : CUBC_COVER_BATCH);
+        void* p  = _Cubc_PixelAddress(canvas, x, y);
+        if (native) {
+            _Cubc_CoverRow((uint32_t*) p, coverage, n, color, alpha);
+            continue;
+        }
+        _Cubc_DecodeRow(canvas->format, pixels, p, n);
+        _Cubc_CoverRow(pixels, coverage, n, color, alpha);
+        _Cubc_EncodeRow(canvas->format, p, pixels, n);
+    }
+}
+
+// Endpoints further out than this are first clipped to the canvas, which
+// keeps the fixed-point positions of _Cubc_LineAA in range.
+#define CUBC_LINE_AA_LIMIT 16777216.0
+
+// Splits the coverage of a column of _Cubc_LineAA at 16.16 minor position `b`
+// between its two pixels, scaled by the part `gap` / 255 of the column the
+// line spans. Returns the row or column of the first pixel.
+static inline int64_t _Cubc_LineAAColumn(int64_t b, uint32_t gap, uint32_t* lo,
+                                         uint32_t* hi) {
+    // b >= (b_lo - 1) * 65536 >= -65536, so the shifts stay positive.
+    uint32_t frac = (uint32_t) ((b + 65536) >> 8) & 0xff;
+    *lo           = 255 - frac;
+    *hi           = frac;
+    if (gap != 255) {
+        *lo = _Cubc_Div255(*lo * gap);
+        *hi = _Cubc_Div255(*hi * gap);
+    }
+    return ((b + 65536) >> 16) - 1;
+}
+
+// Composites `color`, premultiplied when `alpha` is, over the `n` pixels
+// `step` bytes apart from `p` on, with its alpha scaled by their `coverage`.
+// At most CUBC_COVER_BATCH pixels, whose coverage is read on up to a whole
+// number of vectors, which spares the kernels their scalar tails. Opaque
+// colors at full coverage are stored, which gives the same pixels.
+static void _Cubc_CoverStrip(Cubc_Canvas* canvas, uint8_t* p, int64_t step,
+                             size_t n, const uint8_t* coverage, uint32_t color,
+                             Cubc_AlphaMode alpha) {
+    bool native     = canvas->format == CUBC_FORMAT_RGBA8888;
+    bool contiguous = step == (int64_t) _Cubc_FormatSize(canvas->format);
+    if (native && CUBC_ALPHA(color) == 255) {
+        for (size_t i = 0; i < n; i++, p += step) {
+            if (coverage[i] == 255) {
+                *(uint32_t*) p = color;
+            } else if (coverage[i] != 0) {
+                *(uint32_t*) p = _Cubc_PixelOver(
+                    *(uint32_t*) p, _Cubc_Coverage(color, coverage[i], alpha),
+                    alpha);
+            }
+        }
+        return;
+    }
+    if (native && contiguous) {
+        _Cubc_CoverRow((uint32_t*) p, coverage, n, color, alpha);
+        return;
+    }
+    uint32_t pixels[CUBC_COVER_BATCH + 8];
+    size_t padded = (n + 7) & ~(size_t) 7;
+    memset(pixels + n, 0, 8 * sizeof(uint32_t));
+    if (contiguous) {
+        _Cubc_DecodeRow(canvas->format, pixels, p, n);
+    } else if (native) {
+        for (size_t i = 0; i < n; i++) {
+            pixels[i] = *(const uint32_t*) (p + (int64_t) i * step);
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            _Cubc_DecodeRow(canvas->format, pixels + i, p + (int64_t) i * step,
+                            1);
+        }
+    }
+    _Cubc_CoverRow(pixels, coverage, padded, color, alpha);
+    if (contiguous) {
+        _Cubc_EncodeRow(canvas->format, p, pixels, n);
+    } else if (native) {
+        for (size_t i = 0; i < n; i++) {
+            *(uint32_t*) (p + (int64_t) i * step) = pixels[i];
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            _Cubc_EncodeRow(canvas->format, p + (int64_t) i * step, pixels + i,
+                            1);
+        }
+    }
+}
+
+// Narrows the first `*count` steps of a strip, whose minor position starts at
+// `m` and moves by `s` of -1, 0 or 1 per step, to the ones where it lies in
+// [lo, hi]. Returns the first of them and leaves their number in `*count`.
+static int64_t _Cubc_StripClip(int64_t m, int64_t s, int64_t lo, int64_t hi,
+                               int64_t* count) {
+    int64_t j0 = 0, j1 = *count - 1;
+    if (s == 0) {
+        j1 = m < lo || m > hi ? -1 : j1;
+    } else {
+        // m + j * s in [lo, hi], for j moving either way.
+        int64_t a = (lo - m) * s, b = (hi - m) * s;
+        j0        = j0 > (a < b ? a : b) ? j0 : (a < b ? a : b);
+        j1        = j1 < (a > b ? a : b) ? j1 : (a > b ? a : b);
+    }
+    *count = j1 >= j0 ? j1 - j0 + 1 : 0;
+    return j0;
+}
+
+// Xiaolin Wu's line. Every column along the major axis covers the two pixels
+// around the line, split by the 16.16 fixed-point minor position, and the
+// end columns are scaled by the part of them the line spans. Positions only
+// depend on the column, so every clip draws the same pixels.
+static void _Cubc_LineAA(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                         double x0, double y0, double x1, double y1,
+                         Cubc_Color color, Cubc_AlphaMode alpha) {
+    if (!_Cubc_Finite(x0) || !_Cubc_Finite(y0) || !_Cubc_Finite(x1) ||
+        !_Cubc_Finite(y1)) {
+        return;
+    }
+    double limit = CUBC_LINE_AA_LIMIT;
+    if (x0 < -limit || x0 > limit || y0 < -limit || y0 > limit ||
+        x1 < -limit || x1 > limit || y1 < -limit || y1 > limit) {
+        // Two pixels of margin keep the clipped ends from showing.
+        if (!_Cubc_ClipSegment(&x0, &y0, &x1, &y1, -2, -2,
+                               (double) canvas->w + 1,
+                               (double) canvas->h + 1)) {
+            return;
+        }
+    }
+
+    double dx  = x1 - x0;
+    double dy  = y1 - y0;
+    bool steep = (dy < 0 ? -dy : dy) > (dx < 0 ? -dx : dx);
+
+    // Walk along the major axis a and step the minor axis b.
+    double a0    = steep ? y0 : x0;
+    double b0    = steep ? x0 : y0;
+    double a1    = steep ? y1 : x1;
+    double b1    = steep ? x1 : y1;
+    int64_t a_lo = steep ? clip->y0 : clip->x0;
+    int64_t a_hi = steep ? clip->y1 : clip->x1;
+    int64_t b_lo = steep ? clip->x0 : clip->y0;
+    int64_t b_hi = steep ? clip->x1 : clip->y1;
+    if (a0 > a1) {
+        SWAP(a0, a1);
+        SWAP(b0, b1);
+    }
+    double slope = a1 > a0 ? (b1 - b0) / (a1 - a0) : 0;
+
+    // The columns holding the endpoints, and how much of them the line spans
+    // in 1/255ths.
+    int64_t first = _Cubc_Floor(a0 + 0.5);
+    int64_t last  = _Cubc_Floor(a1 + 0.5);
+    uint32_t gap_first, gap_last;
+    if (first == last) {
+        gap_first = gap_last = (uint32_t) ((a1 - a0) * 255 + 0.5);
+    } else {
+        gap_first = (uint32_t) (((double) first + 0.5 - a0) * 255 + 0.5);
+        gap_last  = (uint32_t) ((a1 - ((double) last - 0.5)) * 255 + 0.5);
+    }
+    // Minor position at the first column and its step per column.
+    int64_t base = _Cubc_Floor((b0 + slope * ((double) first - a0)) * 65536 +
+                               0.5);
+    int64_t step = _Cubc_Floor(slope * 65536 + 0.5);
+
+    // Clip the columns against both axes once: the pixel pair of a column
+    // starts at floor(b), which has to lie in [b_lo - 1, b_hi]. It moves one
+    // way only, so the divisions can be skipped when both ends lie there.
+    int64_t k0    = a_lo > first ? a_lo - first : 0;
+    int64_t k1    = (a_hi < last ? a_hi : last) - first;
+    int64_t lo_fx = (b_lo - 1) * 65536 - base;
+    int64_t hi_fx = (b_hi + 1) * 65536 - 1 - base;
+    int64_t e0    = k0 * step;
+    int64_t e1    = k1 * step;
+    if (e0 < lo_fx || e0 > hi_fx || e1 < lo_fx || e1 > hi_fx) {
+        if (step > 0) {
+            int64_t k_in  = -_Cubc_FloorDiv(-lo_fx, step);
+            int64_t k_out = _Cubc_FloorDiv(hi_fx, step);
+            k0            = k0 > k_in ? k0 : k_in;
+            k1            = k1 < k_out ? k1 : k_out;
+        } else if (step < 0) {
+            int64_t k_in  = -_Cubc_FloorDiv(-hi_fx, step);
+            int64_t k_out = _Cubc_FloorDiv(lo_fx, step);
+            k0            = k0 > k_in ? k0 : k_in;
+            k1            = k1 < k_out ? k1 : k_out;
+        } else {
+            return;
+        }
+    }
+    if (k0 > k1) {
+        return;
+    }
+
+    uint32_t c = color.color;
+    if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        c = _Cubc_PixelPremultiply(c);
+    }
+    // Byte offsets of a step along either axis.
+    int64_t size   = (int64_t) _Cubc_FormatSize(canvas->format);
+    int64_t stride = (int64_t) CUBC_CANVAS_STRIDE(*canvas) * size;
+    int64_t step_a = steep ? stride : size;
+    int64_t step_b = steep ? size : stride;
+    uint8_t* data  = (uint8_t*) canvas->data;
+    int64_t end    = last - first;
+
+    // Axis-aligned and diagonal lines split all columns but the ends alike,
+    // so the upper and the lower pixels of their columns each form a strip
+    // of evenly spaced pixels.
+    if (step == 0 || step == 65536 || step == -65536) {
+        // Coverage of the upper and lower pixels of the inner columns and
+        // of the ends.
+        uint32_t cover[2], head[2], tail[2];
+        int64_t s      = step / 65536;
+        int64_t ahead  = step_a + s * step_b;
+        int64_t minor  = _Cubc_LineAAColumn(base + k0 * step, 255, &cover[0],
+                                            &cover[1]);
+        uint8_t* start = data + (first + k0) * step_a + minor * step_b;
+        _Cubc_LineAAColumn(base, gap_first, &head[0], &head[1]);
+        _Cubc_LineAAColumn(base + end * step, gap_last, &tail[0], &tail[1]);
+        uint8_t covered[CUBC_COVER_BATCH];
+        for (int64_t t = 0; t < 2; t++) {
+            if (cover[t] == 0) {
+                continue;
+            }
+            int64_t count = k1 - k0 + 1;
+            int64_t j = _Cubc_StripClip(minor + t, s, b_lo, b_hi, &count);
+            memset(covered, (int) cover[t], sizeof(covered));
+            for (int64_t i = 0; i < count; i += CUBC_COVER_BATCH) {
+                int64_t k = k0 + j + i;
+                size_t n  = (size_t) (count - i < CUBC_COVER_BATCH
+                                          ? count - i
+                                          : CUBC_COVER_BATCH);
+                if (k == 0) {
+                    covered[0] = (uint8_t) head[t];
+                }
+                if (k + (int64_t) n - 1 == end) {
+                    covered[n - 1] = (uint8_t) tail[t];
+                }
+                _Cubc_CoverStrip(canvas, start + t * step_b + (j + i) * ahead,
+                                 ahead, n, covered, c, alpha);
+                covered[0] = covered[n - 1] = (uint8_t) cover[t];
+            }
+        }
+        return;
+    }
+
+    // Pixels off the clip are gathered like the others but not counted, so
+    // the next one takes their place.
+    _Cubc_CoverBatch batch;
+    size_t n        = 0;
+    int64_t b       = base + k0 * step;
+    uint8_t* column = data + (first + k0) * step_a;
+    for (int64_t k = k0; k <= k1; k++, b += step, column += step_a) {
+        if (n + 2 > CUBC_COVER_BATCH) {
+            _Cubc_CoverFlush(canvas, &batch, n, c, alpha);
+            n = 0;
+        }
+        uint32_t lo, hi;
+        int64_t minor = _Cubc_LineAAColumn(
+            b, k == 0 ? gap_first : k == end ? gap_last : 255, &lo, &hi);
+        uint8_t* p        = column + minor * step_b;
+        batch.at[n]       = p;
+        batch.coverage[n] = (uint8_t) lo;
+        n                += minor >= b_lo;
+        batch.at[n]       = p + step_b;
+        batch.coverage[n] = (uint8_t) hi;
+        n                += minor + 1 <= b_hi;
+    }
+    _Cubc_CoverFlush(canvas, &batch, n, c, alpha);
+}
+
+// Floor of `v` clamped to a range every canvas fits in.
+static int64_t _Cubc_CoordFloor(double v) {
+    double limit = 1099511627776.0;
+    return _Cubc_Floor(v < -limit ? -limit : v > limit ? limit : v);
+}
+
+void Cubc_CanvasLineAA(Cubc_Canvas* canvas, float x0, float y0, float x1,
+                       float y1, Cubc_Color color) {
+    if (canvas->commands) {
+        if (!_Cubc_Finite(x0) || !_Cubc_Finite(y0) || !_Cubc_Finite(x1) ||
+            !_Cubc_Finite(y1)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind    = CUBC_COMMAND_LINE_AA,
+            .color   = color,
+            .segment = {x0, y0, x1, y1, _Cubc_AlphaModeOf(canvas)},
+            .min_x   = _Cubc_CoordFloor(x0 < x1 ? x0 : x1) - 1,
+            .min_y   = _Cubc_CoordFloor(y0 < y1 ? y0 : y1) - 1,
+            .max_x   = _Cubc_CoordFloor(x0 > x1 ? x0 : x1) + 2,
+            .max_y   = _Cubc_CoordFloor(y0 > y1 ? y0 : y1) + 2,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_LineAA(canvas, &clip, x0, y0, x1, y1, color,
+                 _Cubc_AlphaModeOf(canvas));
+}
+
+void Cubc_CanvasLineAAV(Cubc_Canvas* canvas, Cubc_V2f begin, Cubc_V2f end,
+                        Cubc_Color color) {
+    Cubc_CanvasLineAA(canvas, begin.x, begin.y, end.x, end.y, color);
+}
+
+// Pixel rows a stroke covers, collected from all its pieces and merged
+// before they are drawn.
+typedef struct {
+    int64_t y, x0, x1;
+} _Cubc_Span;
+
+typedef struct {
+    _Cubc_Span* items;
+    size_t count, capacity;
+} _Cubc_SpanList;
+
+// Adds the pixel centers from `x0` to `x1` on row `y`, clipped.
+static void _Cubc_SpanPush(_Cubc_SpanList* list, const _Cubc_Clip* clip,
+                           int64_t y, double x0, double x1) {
+    x0 = x0 > (double) clip->x0 ? x0 : (double) clip->x0;
+    x1 = x1 < (double) clip->x1 ? x1 : (double) clip->x1;
+    if (!(x0 <= x1)) {
+        return;
+    }
+    int64_t first = (int64_t) ceil(x0);
+    int64_t last  = (int64_t) floor(x1);
+    if (first > last) {
+        return;
+    }
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->items    = (_Cubc_Span*) realloc(
+            list->items, sizeof(_Cubc_Span) * list->capacity);
+    }
+    list->items[list->count++] = (_Cubc_Span){y, first, last};
+}
+
+// The clipped rows from `top` to `bottom`. Returns false when there are none.
+static bool _Cubc_SpanRows(const _Cubc_Clip* clip, double top, double bottom,
+                           int64_t* first, int64_t* last) {
+    top    = top > (double) clip->y0 ? top : (double) clip->y0;
+    bottom = bottom < (double) clip->y1 ? bottom : (double) clip->y1;
+    if (!(top <= bottom)) {
+        return false;
+    }
+    *first = (int64_t) ceil(top);
+    *last  = (int64_t) floor(bottom);
+    return *first <= *last;
+}
+
+// Adds the rows of the convex polygon with the `n` corners `x`, `y`.
+static void _Cubc_ConvexSpans(_Cubc_SpanList* list, const _Cubc_Clip* clip,
+                              const double* x, const double* y, size_t n) {
+    double top = y[0], bottom = y[0];
+    for (size_t i = 1; i < n; i++) {
+        top    = y[i] < top ? y[i] : top;
+        bottom = y[i] > bottom ? y[i] : bottom;
+    }
+    int64_t first, last;
+    if (!_Cubc_SpanRows(clip, top, bottom, &first, &last)) {
+        return;
+    }
+    for (int64_t row = first; row <= last; row++) {
+        double r     = (double) row;
+        double left  = HUGE_VAL;
+        double right = -HUGE_VAL;
+        for (size_t i = 0; i < n; i++) {
+            size_t j = i + 1 < n ? i + 1 : 0;
+            if ((r < y[i] && r < y[j]) || (r > y[i] && r > y[j])) {
+                continue;
+            }
+            double x0 = x[i], x1 = x[j];
+            if (y[i] != y[j]) {
+                x0 = x1 = x[i] + (r - y[i]) * (x[j] - x[i]) / (y[j] - y[i]);
+            }
+            left  = x0 < left ? x0 : left;
+            left  = x1 < left ? x1 : left;
+            right = x0 > right ? x0 : right;
+            right = x1 > right ? x1 : right;
+        }
+        _Cubc_SpanPush(list, clip, row, left, right);
+    }
+}
+
+// Adds the rows of the disc of radius `r` around `cx`, `cy`.
+static void _Cubc_DiscSpans(_Cubc_SpanList* list, const _Cubc_Clip* clip,
+                            double cx, double cy, double r) {
+    int64_t first, last;
+    if (!_Cubc_SpanRows(clip, cy - r, cy + r, &first, &last)) {
+        return;
+    }
+    for (int64_t row = first; row <= last; row++) {
+        double dy   = (double) row - cy;
+        double half = sqrt(r * r - dy * dy);
+        _Cubc_SpanPush(list, clip, row, cx - half, cx + half);
+    }
+}
+
+// Stable counting sort of `count` spans from `from` into `to`, by row or by
+// start, whose values run from `min` to `min` + `range` - 1.
+static void _Cubc_SpanSort(_Cubc_Span* to, const _Cubc_Span* from,
+                           size_t count, size_t* counts, int64_t min,
+                           size_t range, bool by_row) {
+    memset(counts, 0, sizeof(size_t) * range);
+    for (size_t i = 0; i < count; i++) {
+        counts[(by_row ? from[i].y : from[i].x0) - min]++;
+    }
+    size_t sum = 0;
+    for (size_t i = 0; i < range; i++) {
+        size_t n   = counts[i];
+        counts[i]  = sum;
+        sum       += n;
+    }
+    for (size_t i = 0; i < count; i++) {
+        to[counts[(by_row ? from[i].y : from[i].x0) - min]++] = from[i];
+    }
+}
+
+// Draws the union of the spans in `list`, every pixel once, and frees it.
+static void _Cubc_SpanFlush(Cubc_Canvas* canvas, _Cubc_SpanList* list,
+                            Cubc_Color color, Cubc_AlphaMode alpha) {
+    uint32_t c = color.color;
+    if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        c = _Cubc_PixelPremultiply(c);
+    }
+    if (list->count == 0) {
+        return;
+    }
+    // Spans are clipped, so sorting by start and then by row takes time in
+    // proportion to their number and the clip size. Strokes often have
+    // hundreds of spans per row, where comparison sorts are far slower.
+    int64_t min_x = list->items[0].x0, max_x = min_x;
+    int64_t min_y = list->items[0].y, max_y = min_y;
+    for (size_t i = 1; i < list->count; i++) {
+        _Cubc_Span span = list->items[i];
+        min_x           = span.x0 < min_x ? span.x0 : min_x;
+        max_x           = span.x0 > max_x ? span.x0 : max_x;
+        min_y           = span.y < min_y ? span.y : min_y;
+        max_y           = span.y > max_y ? span.y : max_y;
+    }
+    size_t range_x = (size_t) (max_x - min_x + 1);
+    size_t range_y = (size_t) (max_y - min_y + 1);
+    size_t* counts = (size_t*) malloc(
+        sizeof(size_t) * (range_x > range_y ? range_x : range_y));
+    _Cubc_Span* sorted = (_Cubc_Span*) malloc(sizeof(_Cubc_Span) * list->count);
+    _Cubc_SpanSort(sorted, list->items, list->count, counts, min_x, range_x,
+                   false);
+    _Cubc_SpanSort(list->items, sorted, list->count, counts, min_y, range_y,
+                   true);
+    free(sorted);
+    free(counts);
+    for (size_t i = 0; i < list->count;) {
+        _Cubc_Span span = list->items[i++];
+        while (i < list->count && list->items[i].y == span.y &&
+               list->items[i].x0 <= span.x1 + 1) {
+            span.x1 = list->items[i].x1 > span.x1 ? list->items[i].x1 : span.x1;
+            i++;
+        }
+        _Cubc_OverSpan(canvas, span.x0, span.x1, span.y, c, alpha);
+    }
+    free(list->items);
+}
+
+// Adds the join of the segments meeting at `x`, `y`, which arrive along the
+// unit direction `ax`, `ay` and leave along `bx`, `by`.
+static void _Cubc_JoinSpans(_Cubc_SpanList* list, const _Cubc_Clip* clip,
+                            double x, double y, double ax, double ay,
+                            double bx, double by, double half,
+                            Cubc_LineJoin join) {
+    if (join == CUBC_JOIN_ROUND) {
+        _Cubc_DiscSpans(list, clip, x, y, half);
+        return;
+    }
+    double cross = ax * by - ay * bx;
+    if (cross == 0) {
+        // Straight on needs no join, and a reversal has no outer corner.
+        return;
+    }
+    // The offsets of both segment edges on the outside of the turn.
+    double side = cross > 0 ? -half : half;
+    double px[4], py[4];
+    px[0] = x;
+    py[0] = y;
+    px[1] = x - ay * side;
+    py[1] = y + ax * side;
+    px[2] = x - by * side;
+    py[2] = y + bx * side;
+    // The miter tip lies 1 / cos(angle / 2) half widths out on the bisector.
+    double mx = -(ay + by), my = ax + bx;
+    double cos_half = sqrt((1 + ax * bx + ay * by) / 2);
+    if (join == CUBC_JOIN_MITER && cos_half * CUBC_MITER_LIMIT >= 1) {
+        double scale = side / (cos_half * sqrt(mx * mx + my * my));
+        px[3]        = px[2];
+        py[3]        = py[2];
+        px[2]        = x + mx * scale;
+        py[2]        = y + my * scale;
+        _Cubc_ConvexSpans(list, clip, px, py, 4);
+        return;
+    }
+    _Cubc_ConvexSpans(list, clip, px, py, 3);
+}
+
+// Adds the spans of the stroke of `points`, `half` a width to either side,
+// to `list`.
+static void _Cubc_PolylineSpans(_Cubc_SpanList* list, const _Cubc_Clip* clip,
+                                const Cubc_V2f* points, size_t count,
+                                bool closed, double half, Cubc_LineJoin join,
+                                Cubc_LineCap cap) {
+    if (count == 0) {
+        return;
+    }
+    // The finite points without repeats.
+    double* x = (double*) malloc(sizeof(double) * 2 * count);
+    double* y = x + count;
+    size_t n  = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!_Cubc_Finite(points[i].x) || !_Cubc_Finite(points[i].y) ||
+            (n > 0 && points[i].x == x[n - 1] && points[i].y == y[n - 1])) {
+            continue;
+        }
+        x[n]   = points[i].x;
+        y[n++] = points[i].y;
+    }
+    if (closed && n > 1 && x[n - 1] == x[0] && y[n - 1] == y[0]) {
+        n--;
+    }
+    closed = closed && n > 2;
+    if (n == 0) {
+        free(x);
+        return;
+    }
+
+    if (n == 1) {
+        // A lone point only shows its caps.
+        if (cap == CUBC_CAP_ROUND) {
+            _Cubc_DiscSpans(list, clip, x[0], y[0], half);
+        } else if (cap == CUBC_CAP_SQUARE) {
+            double px[4] = {x[0] - half, x[0] + half, x[0] + half, x[0] - half};
+            double py[4] = {y[0] - half, y[0] - half, y[0] + half, y[0] + half};
+            _Cubc_ConvexSpans(list, clip, px, py, 4);
+        }
+    }
+    size_t segments = closed ? n : n - 1;
+    double prev_dx = 0, prev_dy = 0;
+    for (size_t i = 0; i < segments; i++) {
+        size_t j   = i + 1 < n ? i + 1 : 0;
+        double dx  = x[j] - x[i];
+        double dy  = y[j] - y[i];
+        double len = sqrt(dx * dx + dy * dy);
+        dx        /= len;
+        dy        /= len;
+        // Square caps stretch the end segments by half the width.
+        double ext0 = !closed && cap == CUBC_CAP_SQUARE && i == 0 ? half : 0;
+        double ext1 =
+            !closed && cap == CUBC_CAP_SQUARE && i == segments - 1 ? half : 0;
+        double x0 = x[i] - dx * ext0, y0 = y[i] - dy * ext0;
+        double x1 = x[j] + dx * ext1, y1 = y[j] + dy * ext1;
+        double nx = -dy * half, ny = dx * half;
+        double px[4] = {x0 + nx, x1 + nx, x1 - nx, x0 - nx};
+        double py[4] = {y0 + ny, y1 + ny, y1 - ny, y0 - ny};
+        _Cubc_ConvexSpans(list, clip, px, py, 4);
+        if (i > 0) {
+            _Cubc_JoinSpans(list, clip, x[i], y[i], prev_dx, prev_dy, dx, dy,
+                            half, join);
+        }
+        prev_dx = dx;
+        prev_dy = dy;
+    }
+    if (closed) {
+        double dx  = x[1] - x[0];
+        double dy  = y[1] - y[0];
+        double len = sqrt(dx * dx + dy * dy);
+        _Cubc_JoinSpans(list, clip, x[0], y[0], prev_dx, prev_dy, dx / len,
+                        dy / len, half, join);
+    } else if (n > 1 && cap == CUBC_CAP_ROUND) {
+        _Cubc_DiscSpans(list, clip, x[0], y[0], half);
+        _Cubc_DiscSpans(list, clip, x[n - 1], y[n - 1], half);
+    }
+    free(x);
+}
+
+static void _Cubc_Polyline(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                           const Cubc_V2f* points, size_t count, bool closed,
+                           float width, Cubc_LineJoin join, Cubc_LineCap cap,
+                           Cubc_Color color, Cubc_AlphaMode alpha) {
+    double half = (double) width / 2;
+    if (!(half > 0) || !_Cubc_Finite(half)) {
+        return;
+    }
+    _Cubc_SpanList list = CUBC_ZERO;
+    _Cubc_PolylineSpans(&list, clip, points, count, closed, half, join, cap);
+    _Cubc_SpanFlush(canvas, &list, color, alpha);
+}
+
+void Cubc_CanvasPolyline(Cubc_Canvas* canvas, const Cubc_V2f* points,
+                         size_t count, bool closed, float width,
+                         Cubc_LineJoin join, Cubc_LineCap cap,
+                         Cubc_Color color) {
+    if (canvas->commands) {
+        // Bounds of the finite points, padded by the longest miter.
+        double min_x = HUGE_VAL, min_y = HUGE_VAL;
+        double max_x = -HUGE_VAL, max_y = -HUGE_VAL;
+        for (size_t i = 0; i < count; i++) {
+            if (!_Cubc_Finite(points[i].x) || !_Cubc_Finite(points[i].y)) {
+                continue;
+            }
+            min_x = points[i].x < min_x ? points[i].x : min_x;
+            min_y = points[i].y < min_y ? points[i].y : min_y;
+            max_x = points[i].x > max_x ? points[i].x : max_x;
+            max_y = points[i].y > max_y ? points[i].y : max_y;
+        }
+        double pad = (double) width / 2 * CUBC_MITER_LIMIT + 1;
+        if (!(min_x <= max_x) || !(pad > 0) || !_Cubc_Finite(pad)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind     = CUBC_COMMAND_POLYLINE,
+            .color    = color,
+            .polyline = {points, count, {{0, 0}, {0, 0}}, closed, width, join,
+                         cap, _Cubc_AlphaModeOf(canvas)},
+            .min_x    = _Cubc_CoordFloor(min_x - pad),
+            .min_y    = _Cubc_CoordFloor(min_y - pad),
+            .max_x    = _Cubc_CoordFloor(max_x + pad) + 1,
+            .max_y    = _Cubc_CoordFloor(max_y + pad) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Polyline(canvas, &clip, points, count, closed, width, join, cap,
+                   color, _Cubc_AlphaModeOf(canvas));
+}
+
+void Cubc_CanvasThickLine(Cubc_Canvas* canvas, float x0, float y0, float x1,
+                          float y1, float width, Cubc_LineCap cap,
+                          Cubc_Color color) {
+    if (!_Cubc_Finite(x0) || !_Cubc_Finite(y0) || !_Cubc_Finite(x1) ||
+        !_Cubc_Finite(y1)) {
+        return;
+    }
+    Cubc_V2f ends[2] = {{x0, y0}, {x1, y1}};
+    if (canvas->commands) {
+        // The corners of square caps lie up to sqrt(2) half widths out.
+        double pad = (double) width + 1;
+        if (!(pad > 1) || !_Cubc_Finite(pad)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind     = CUBC_COMMAND_POLYLINE,
+            .color    = color,
+            .polyline = {NULL, 2, {ends[0], ends[1]}, false, width,
+                         CUBC_JOIN_BEVEL, cap, _Cubc_AlphaModeOf(canvas)},
+            .min_x    = _Cubc_CoordFloor((x0 < x1 ? x0 : x1) - pad),
+            .min_y    = _Cubc_CoordFloor((y0 < y1 ? y0 : y1) - pad),
+            .max_x    = _Cubc_CoordFloor((x0 > x1 ? x0 : x1) + pad) + 1,
+            .max_y    = _Cubc_CoordFloor((y0 > y1 ? y0 : y1) + pad) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Polyline(canvas, &clip, ends, 2, false, width, CUBC_JOIN_BEVEL, cap,
+                   color, _Cubc_AlphaModeOf(canvas));
+}
+
+void Cubc_CanvasThickLineV(Cubc_Canvas* canvas, Cubc_V2f begin, Cubc_V2f end,
+                           float width, Cubc_LineCap cap, Cubc_Color color) {
+    Cubc_CanvasThickLine(canvas, begin.x, begin.y, end.x, end.y, width, cap,
+                         color);
+}
+
+// A polygon edge crossing the pixel centers of rows `first` to `last`, at
+// `x0` + (row - `y0`) * `slope`. `winding` is 1 when it runs down, -1 up.
+typedef struct {
+    int64_t first, last;
+    double x0, y0, slope, x;
+    int winding;
+} _Cubc_PolygonEdge;
+
+// Adds the edge from `a` to `b` when it crosses a clipped row.
+static void _Cubc_PolygonEdgeAdd(_Cubc_PolygonEdge* edges, size_t* count,
+                                 const _Cubc_Clip* clip, Cubc_V2f a,
+                                 Cubc_V2f b) {
+    int winding = 1;
+    if (a.y > b.y) {
+        SWAP(a, b);
+        winding = -1;
+    }
+    // Rows from the top end up to, but not including, the bottom end, so
+    // edges that meet at a corner cross its row once.
+    double top    = a.y > (double) clip->y0 ? a.y : (double) clip->y0;
+    double bottom = b.y < (double) clip->y1 + 1 ? b.y : (double) clip->y1 + 1;
+    if (!(top < bottom)) {
+        return;
+    }
+    int64_t first = (int64_t) ceil(top);
+    int64_t last  = (int64_t) ceil(bottom) - 1;
+    if (first > last) {
+        return;
+    }
+    edges[(*count)++] = (_Cubc_PolygonEdge){
+        .first   = first,
+        .last    = last,
+        .x0      = a.x,
+        .y0      = a.y,
+        .slope   = ((double) b.x - a.x) / ((double) b.y - a.y),
+        .x       = 0,
+        .winding = winding,
+    };
+}
+
+static void _Cubc_Polygon(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                          const Cubc_V2f* points, const size_t* counts,
+                          size_t contour_count, Cubc_FillRule rule,
+                          Cubc_Color color) {
+    size_t total = 0;
+    for (size_t i = 0; i < contour_count; i++) {
+        total += counts[i];
+    }
+    if (total < 3) {
+        return;
+    }
+    _Cubc_PolygonEdge* edges =
+        (_Cubc_PolygonEdge*) malloc(sizeof(_Cubc_PolygonEdge) * total);
+    size_t edge_count = 0;
+    const Cubc_V2f* contour = points;
+    for (size_t i = 0; i < contour_count; contour += counts[i++]) {
+        // Every contour is closed over its finite points.
+        const Cubc_V2f* first = NULL;
+        const Cubc_V2f* prev  = NULL;
+        for (size_t j = 0; j < counts[i]; j++) {
+            const Cubc_V2f* p = &contour[j];
+            if (!_Cubc_Finite(p->x) || !_Cubc_Finite(p->y)) {
+                continue;
+            }
+            if (prev) {
+                _Cubc_PolygonEdgeAdd(edges, &edge_count, clip, *prev, *p);
+            } else {
+                first = p;
+            }
+            prev = p;
+        }
+        if (prev && prev != first) {
+            _Cubc_PolygonEdgeAdd(edges, &edge_count, clip, *prev, *first);
+        }
+    }
+    if (edge_count == 0) {
+        free(edges);
+        return;
+    }
+
+    // The edge table: the edges bucketed by their first row, so every row
+    // only looks at the edges that start on it.
+    int64_t top = edges[0].first, bottom = edges[0].last;
+    for (size_t i = 1; i < edge_count; i++) {
+        top    = edges[i].first < top ? edges[i].first : top;
+        bottom = edges[i].last > bottom ? edges[i].last : bottom;
+    }
+    size_t rows    = (size_t) (bottom - top + 1);
+    size_t* starts = (size_t*) calloc(rows + 1, sizeof(size_t));
+    size_t* table  = (size_t*) malloc(sizeof(size_t) * edge_count);
+    _Cubc_PolygonEdge* active =
+        (_Cubc_PolygonEdge*) malloc(sizeof(_Cubc_PolygonEdge) * edge_count);
+    for (size_t i = 0; i < edge_count; i++) {
+        starts[edges[i].first - top + 1]++;
+    }
+    for (size_t i = 0; i < rows; i++) {
+        starts[i + 1] += starts[i];
+    }
+    for (size_t i = 0; i < edge_count; i++) {
+        table[starts[edges[i].first - top]++] = i;
+    }
+    // The scatter moved every start to the next bucket.
+    memmove(starts + 1, starts, sizeof(size_t) * rows);
+    starts[0] = 0;
+
+    uint64_t value      = _Cubc_EncodePixel(canvas->format, color.color);
+    double left         = (double) clip->x0;
+    double right        = (double) clip->x1 + 1;
+    size_t active_count = 0;
+    for (int64_t row = top; row <= bottom; row++) {
+        size_t kept = 0;
+        for (size_t i = 0; i < active_count; i++) {
+            if (active[i].last >= row) {
+                active[kept++] = active[i];
+            }
+        }
+        active_count = kept;
+        for (size_t i = starts[row - top]; i < starts[row - top + 1]; i++) {
+            active[active_count++] = edges[table[i]];
+        }
+        // The crossings keep their order from row to row unless edges
+        // cross, so an insertion sort is close to linear.
+        for (size_t i = 0; i < active_count; i++) {
+            _Cubc_PolygonEdge e = active[i];
+            e.x                 = e.x0 + ((double) row - e.y0) * e.slope;
+            size_t j            = i;
+            for (; j > 0 && active[j - 1].x > e.x; j--) {
+                active[j] = active[j - 1];
+            }
+            active[j] = e;
+        }
+
+        // Fill the pixel centers from the crossing that enters the inside
+        // up to, but not including, the one that leaves it.
+        int winding = 0;
+        double from = 0;
+        for (size_t i = 0; i < active_count; i++) {
+            bool was_inside = rule == CUBC_FILL_EVEN_ODD ? (winding & 1) != 0
+                                                          : winding != 0;
+            winding += active[i].winding;
+            bool inside = rule == CUBC_FILL_EVEN_ODD ? (winding & 1) != 0
+                                                      : winding != 0;
+            if (inside == was_inside) {
+                continue;
+            }
+            if (inside) {
+                from = active[i].x;
+                continue;
+            }
+            double x0 = from > left ? from : left;
+            double x1 = active[i].x < right ? active[i].x : right;
+            if (!(x0 < x1)) {
+                continue;
+            }
+            int64_t begin = (int64_t) ceil(x0);
+            int64_t end   = (int64_t) ceil(x1);
+            if (begin < end) {
+                _Cubc_Fill(canvas->format,
+                           _Cubc_PixelAddress(canvas, begin, row),
+                           end - begin, value, false);
+            }
+        }
+    }
+    free(active);
+    free(table);
+    free(starts);
+    free(edges);
+}
+
+void Cubc_CanvasPolygon(Cubc_Canvas* canvas, const Cubc_V2f* points,
+                        const size_t* counts, size_t contour_count,
+                        Cubc_FillRule rule, Cubc_Color color) {
+    if (canvas->commands) {
+        double min_x = HUGE_VAL, min_y = HUGE_VAL;
+        double max_x = -HUGE_VAL, max_y = -HUGE_VAL;
+        size_t total = 0;
+        for (size_t i = 0; i < contour_count; i++) {
+            total += counts[i];
+        }
+        for (size_t i = 0; i < total; i++) {
+            if (!_Cubc_Finite(points[i].x) || !_Cubc_Finite(points[i].y)) {
+                continue;
+            }
+            min_x = points[i].x < min_x ? points[i].x : min_x;
+            min_y = points[i].y < min_y ? points[i].y : min_y;
+            max_x = points[i].x > max_x ? points[i].x : max_x;
+            max_y = points[i].y > max_y ? points[i].y : max_y;
+        }
+        if (!(min_x <= max_x)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind    = CUBC_COMMAND_POLYGON,
+            .color   = color,
+            .polygon = {points, counts, contour_count, rule},
+            .min_x   = _Cubc_CoordFloor(min_x),
+            .min_y   = _Cubc_CoordFloor(min_y),
+            .max_x   = _Cubc_CoordFloor(max_x) + 1,
+            .max_y   = _Cubc_CoordFloor(max_y) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Polygon(canvas, &clip, points, counts, contour_count, rule, color);
+}
+
+static void _Cubc_PathPush(Cubc_Path* path, Cubc_PathVerb verb,
+                           const Cubc_V2f* points, size_t count) {
+    if (path->verb_count == path->verb_capacity) {
+        path->verb_capacity = path->verb_capacity ? path->verb_capacity * 2
+                                                  : 16;
+        path->verbs         = (Cubc_PathVerb*) realloc(
+            path->verbs, sizeof(Cubc_PathVerb) * path->verb_capacity);
+    }
+    while (path->point_count + count > path->point_capacity) {
+        path->point_capacity = path->point_capacity
+                                   ? path->point_capacity * 2
+                                   : 16;
+        path->points         = (Cubc_V2f*) realloc(
+            path->points, sizeof(Cubc_V2f) * path->point_capacity);
+    }
+    path->verbs[path->verb_count++] = verb;
+    for (size_t i = 0; i < count; i++) {
+        path->points[path->point_count++] = points[i];
+    }
+}
+
+void Cubc_PathMoveTo(Cubc_Path* path, float x, float y) {
+    Cubc_V2f points[1] = {{x, y}};
+    _Cubc_PathPush(path, CUBC_PATH_MOVE, points, 1);
+}
+
+void Cubc_PathLineTo(Cubc_Path* path, float x, float y) {
+    Cubc_V2f points[1] = {{x, y}};
+    _Cubc_PathPush(path, CUBC_PATH_LINE, points, 1);
+}
+
+void Cubc_PathQuadTo(Cubc_Path* path, float cx, float cy, float x, float y) {
+    Cubc_V2f points[2] = {{cx, cy}, {x, y}};
+    _Cubc_PathPush(path, CUBC_PATH_QUAD, points, 2);
+}
+
+void Cubc_PathCubicTo(Cubc_Path* path, float c0x, float c0y, float c1x,
+                      float c1y, float x, float y) {
+    Cubc_V2f points[3] = {{c0x, c0y}, {c1x, c1y}, {x, y}};
+    _Cubc_PathPush(path, CUBC_PATH_CUBIC, points, 3);
+}
+
+void Cubc_PathClose(Cubc_Path* path) {
+    _Cubc_PathPush(path, CUBC_PATH_CLOSE, NULL, 0);
+}
+
+void Cubc_PathFree(Cubc_Path* path) {
+    free(path->verbs);
+    free(path->points);
+    path->verbs          = NULL;
+    path->verb_count     = 0;
+    path->verb_capacity  = 0;
+    path->points         = NULL;
+    path->point_count    = 0;
+    path->point_capacity = 0;
+}
+
+// Flattened curves are within this many pixels of the true ones.
+#ifndef CUBC_PATH_TOLERANCE
+#define CUBC_PATH_TOLERANCE 0.25
+#endif
+
+// Curves are split into at most this many lines.
+#define CUBC_PATH_MAX_STEPS 1024
+
+// The points of a flattened path, contour i being the next counts[i] and
+// closed[i] telling whether its subpath was closed.
+typedef struct {
+    Cubc_V2f* points;
+    size_t count, capacity;
+    size_t* counts;
+    bool* closed;
+    size_t contour_count, contour_capacity;
+} _Cubc_Outline;
+
+static void _Cubc_OutlineContour(_Cubc_Outline* outline) {
+    if (outline->contour_count == outline->contour_capacity) {
+        outline->contour_capacity = outline->contour_capacity
+                                        ? outline->contour_capacity * 2
+                                        : 16;
+        outline->counts           = (size_t*) realloc(
+            outline->counts, sizeof(size_t) * outline->contour_capacity);
+        outline->closed           = (bool*) realloc(
+            outline->closed, sizeof(bool) * outline->contour_capacity);
+    }
+    outline->closed[outline->contour_count]   = false;
+    outline->counts[outline->contour_count++] = 0;
+}
+
+// Adds a point to the last contour, unless it isn't finite.
+static void _Cubc_OutlinePoint(_Cubc_Outline* outline, double x, double y) {
+    if (!_Cubc_Finite(x) || !_Cubc_Finite(y)) {
+        return;
+    }
+    if (outline->count == outline->capacity) {
+        outline->capacity = outline->capacity ? outline->capacity * 2 : 64;
+        outline->points   = (Cubc_V2f*) realloc(
+            outline->points, sizeof(Cubc_V2f) * outline->capacity);
+    }
+    outline->points[outline->count++] = (Cubc_V2f){(float) x, (float) y};
+    outline->counts[outline->contour_count - 1]++;
+}
+
+static void _Cubc_OutlineFree(_Cubc_Outline* outline) {
+    free(outline->points);
+    free(outline->counts);
+    free(outline->closed);
+}
+
+// Cubic curves are approximated by quadratic ones within this part of the
+// tolerance, and the rest is left to the lines.
+#define CUBC_PATH_QUAD_SHARE 0.1
+
+// A quadratic curve seen as a segment of the parabola y = x * x. Lines
+// evenly spaced in the integral of the square root of its curvature, from
+// a0 to a1, stray about equally far from it, and `weight` is how many it
+// needs times twice the square root of the tolerance. A curve whose points
+// are on one line has none of these.
+typedef struct {
+    double x0, y0, cx, cy, x1, y1;
+    double a0, a1, u0, u_scale, weight;
+    bool line;
+} _Cubc_Quad;
+
+// Approximations of the integral of 1 / sqrt(sqrt(1 + 4 * x * x)) and of its
+// inverse.
+static double _Cubc_ParabolaIntegral(double x) {
+    double d = 0.67;
+    return x / (1 - d + sqrt(sqrt(d * d * d * d + 0.25 * x * x)));
+}
+
+static double _Cubc_ParabolaInverse(double x) {
+    double b = 0.39;
+    return x * (1 - b + sqrt(b * b + 0.25 * x * x));
+}
+
+static _Cubc_Quad _Cubc_QuadOf(double x0, double y0, double cx, double cy,
+                               double x1, double y1, double sqrt_tolerance) {
+    _Cubc_Quad q = {x0, y0, cx, cy, x1, y1, 0, 0, 0, 0, 0, true};
+    double ddx   = 2 * cx - x0 - x1;
+    double ddy   = 2 * cy - y0 - y1;
+    double cross = (x1 - x0) * ddy - (y1 - y0) * ddx;
+    double p0    = ((cx - x0) * ddx + (cy - y0) * ddy) / cross;
+    double p1    = ((x1 - cx) * ddx + (y1 - cy) * ddy) / cross;
+    double scale =
+        fabs(cross) / (sqrt(ddx * ddx + ddy * ddy) * fabs(p1 - p0));
+    q.a0        = _Cubc_ParabolaIntegral(p0);
+    q.a1        = _Cubc_ParabolaIntegral(p1);
+    double da   = fabs(q.a1 - q.a0);
+    double root = sqrt(scale);
+    if ((p0 < 0) == (p1 < 0)) {
+        q.weight = da * root;
+    } else {
+        // The vertex is on the curve, where the integral is too coarse.
+        q.weight = sqrt_tolerance * da /
+                   _Cubc_ParabolaIntegral(sqrt_tolerance / root);
+    }
+    q.u0      = _Cubc_ParabolaInverse(q.a0);
+    q.u_scale = 1 / (_Cubc_ParabolaInverse(q.a1) - q.u0);
+    q.line    = !(q.weight > 0) || !_Cubc_Finite(q.weight) ||
+                !_Cubc_Finite(q.u_scale);
+    if (q.line) {
+        q.weight = 0;
+    }
+    return q;
+}
+
+// Adds the point of `q` at `f` of its weight.
+static void _Cubc_QuadPoint(_Cubc_Outline* outline, const _Cubc_Quad* q,
+                            double f) {
+    double a = q->a0 + (q->a1 - q->a0) * f;
+    double t = (_Cubc_ParabolaInverse(a) - q->u0) * q->u_scale, s = 1 - t;
+    _Cubc_OutlinePoint(outline,
+                       s * s * q->x0 + 2 * s * t * q->cx + t * t * q->x1,
+                       s * s * q->y0 + 2 * s * t * q->cy + t * t * q->y1);
+}
+
+// Adds the point where a quadratic curve on one line turns back, if it does.
+static void _Cubc_QuadTurn(_Cubc_Outline* outline, const _Cubc_Quad* q) {
+    double ddx = 2 * q->cx - q->x0 - q->x1;
+    double ddy = 2 * q->cy - q->y0 - q->y1;
+    double t   = ((q->cx - q->x0) * ddx + (q->cy - q->y0) * ddy) /
+               (ddx * ddx + ddy * ddy);
+    if (t > 0 && t < 1) {
+        double s = 1 - t;
+        _Cubc_OutlinePoint(outline,
+                           s * s * q->x0 + 2 * s * t * q->cx + t * t * q->x1,
+                           s * s * q->y0 + 2 * s * t * q->cy + t * t * q->y1);
+    }
+}
+
+// Quadratic curve i of the `n` that split the curve with control points `c`
+// of `degree`. A cubic curve is cut at equal steps in t and every piece
+// replaced by the quadratic curve through its ends that best matches it.
+static _Cubc_Quad _Cubc_CurveQuad(const double* c, int degree, size_t i,
+                                  size_t n, double sqrt_tolerance) {
+    if (degree == 2) {
+        return _Cubc_QuadOf(c[0], c[1], c[2], c[3], c[4], c[5],
+                            sqrt_tolerance);
+    }
+    double ends[2][2], tangents[2][2];
+    for (int e = 0; e < 2; e++) {
+        double t = (double) (i + e) / (double) n, s = 1 - t;
+        for (int k = 0; k < 2; k++) {
+            ends[e][k] = s * s * s * c[k] + 3 * s * s * t * c[2 + k] +
+                         3 * s * t * t * c[4 + k] + t * t * t * c[6 + k];
+            tangents[e][k] = 3 * (s * s * (c[2 + k] - c[k]) +
+                                  2 * s * t * (c[4 + k] - c[2 + k]) +
+                                  t * t * (c[6 + k] - c[4 + k]));
+        }
+    }
+    double dt = 1 / (3.0 * (double) n);
+    double cx = (2 * ends[0][0] + 2 * ends[1][0] +
+                 3 * dt * (tangents[0][0] - tangents[1][0])) /
+                4;
+    double cy = (2 * ends[0][1] + 2 * ends[1][1] +
+                 3 * dt * (tangents[0][1] - tangents[1][1])) /
+                4;
+    return _Cubc_QuadOf(ends[0][0], ends[0][1], cx, cy, ends[1][0],
+                        ends[1][1], sqrt_tolerance);
+}
+
+// Adds the lines of the quadratic or cubic curve with the 2 * (`degree` + 1)
+// coordinates `c`, whose start is already in `outline`, as their ends. The
+// line count is the closed form over the quadratic pieces rather than a
+// subdivision, so flat curves take few lines and tight ones enough to stay
+// within CUBC_PATH_TOLERANCE.
+static void _Cubc_FlattenCurve(_Cubc_Outline* outline, const double* c,
+                               int degree) {
+    size_t quads = 1;
+    if (degree == 3) {
+        // A quadratic curve strays from a cubic one by sqrt(3) / 36 of the
+        // third difference of its control points, which falls with the cube
+        // of the pieces.
+        double ex    = c[6] - 3 * c[4] + 3 * c[2] - c[0];
+        double ey    = c[7] - 3 * c[5] + 3 * c[3] - c[1];
+        double limit = 36 / sqrt(3) * CUBC_PATH_QUAD_SHARE *
+                       CUBC_PATH_TOLERANCE;
+        double n     = ceil(cbrt(sqrt(ex * ex + ey * ey) / limit));
+        quads        = !(n > 1)                 ? 1
+                       : n < CUBC_PATH_MAX_STEPS ? (size_t) n
+                                                 : CUBC_PATH_MAX_STEPS;
+    }
+    // The integrals are a few percent off, which the share left over also
+    // covers for quadratic curves.
+    double root = sqrt(CUBC_PATH_TOLERANCE * (1 - CUBC_PATH_QUAD_SHARE));
+    for (size_t i = 0; i < quads; i++) {
+        _Cubc_Quad q = _Cubc_CurveQuad(c, degree, i, quads, root);
+        if (q.line) {
+            _Cubc_QuadTurn(outline, &q);
+        } else {
+            double steps = ceil(0.5 * q.weight / root);
+            size_t n     = steps < CUBC_PATH_MAX_STEPS ? (size_t) steps
+                                                       : CUBC_PATH_MAX_STEPS;
+            for (size_t k = 1; k < n; k++) {
+                _Cubc_QuadPoint(outline, &q, (double) k / (double) n);
+            }
+        }
+        if (i + 1 < quads) {
+            _Cubc_OutlinePoint(outline, q.x1, q.y1);
+        }
+    }
+    _Cubc_OutlinePoint(outline, c[2 * degree], c[2 * degree + 1]);
+}
+
+// Flattens the subpaths of `path` into the contours of `outline`.
+static void _Cubc_PathFlatten(const Cubc_Path* path, _Cubc_Outline* outline) {
+    const Cubc_V2f* p = path->points;
+    Cubc_V2f start = {0, 0}, at = {0, 0};
+    bool open = false;
+    for (size_t i = 0; i < path->verb_count; i++) {
+        Cubc_PathVerb verb = path->verbs[i];
+        if (verb == CUBC_PATH_MOVE) {
+            start = at = *p++;
+            open       = false;
+            continue;
+        }
+        if (verb == CUBC_PATH_CLOSE) {
+            if (open) {
+                outline->closed[outline->contour_count - 1] = true;
+            }
+            at   = start;
+            open = false;
+            continue;
+        }
+        if (!open) {
+            _Cubc_OutlineContour(outline);
+            _Cubc_OutlinePoint(outline, at.x, at.y);
+            open = true;
+        }
+        switch (verb) {
+        case CUBC_PATH_LINE:
+            at = *p++;
+            _Cubc_OutlinePoint(outline, at.x, at.y);
+            break;
+        case CUBC_PATH_QUAD: {
+            double c[6] = {at.x, at.y, p[0].x, p[0].y, p[1].x, p[1].y};
+            _Cubc_FlattenCurve(outline, c, 2);
+            at  = p[1];
+            p  += 2;
+            break;
+        }
+        case CUBC_PATH_CUBIC: {
+            double c[8] = {at.x,   at.y,   p[0].x, p[0].y,
+                           p[1].x, p[1].y, p[2].x, p[2].y};
+            _Cubc_FlattenCurve(outline, c, 3);
+            at  = p[2];
+            p  += 3;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+// The pixel nearest to `v`, in the range _Cubc_Line works in.
+static int64_t _Cubc_CurvePixel(double v) {
+    int64_t p = _Cubc_CoordFloor(v + 0.5);
+    return p < INT32_MIN ? INT32_MIN : p > INT32_MAX ? INT32_MAX : p;
+}
+
+// Draws the lines of the curve with the `degree` + 1 control points
+// `points`. Lines between the same pixels are skipped, unless the whole
+// curve is in one.
+static void _Cubc_Curve(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                        const Cubc_V2f* points, int degree,
+                        Cubc_Color color) {
+    double c[8];
+    for (int i = 0; i <= degree; i++) {
+        c[2 * i]     = points[i].x;
+        c[2 * i + 1] = points[i].y;
+    }
+    _Cubc_Outline outline = CUBC_ZERO;
+    _Cubc_OutlineContour(&outline);
+    _Cubc_OutlinePoint(&outline, c[0], c[1]);
+    _Cubc_FlattenCurve(&outline, c, degree);
+    int64_t x0 = _Cubc_CurvePixel(outline.points[0].x);
+    int64_t y0 = _Cubc_CurvePixel(outline.points[0].y);
+    bool drawn = false;
+    for (size_t i = 1; i < outline.count; i++) {
+        int64_t x1 = _Cubc_CurvePixel(outline.points[i].x);
+        int64_t y1 = _Cubc_CurvePixel(outline.points[i].y);
+        if (x1 == x0 && y1 == y0) {
+            continue;
+        }
+        _Cubc_Line(canvas, clip, x0, y0, x1, y1, color);
+        x0    = x1;
+        y0    = y1;
+        drawn = true;
+    }
+    if (!drawn) {
+        _Cubc_Line(canvas, clip, x0, y0, x0, y0, color);
+    }
+    _Cubc_OutlineFree(&outline);
+}
+
+static void _Cubc_CanvasCurve(Cubc_Canvas* canvas, const Cubc_V2f* points,
+                              int degree, Cubc_Color color) {
+    double min_x = HUGE_VAL, min_y = HUGE_VAL;
+    double max_x = -HUGE_VAL, max_y = -HUGE_VAL;
+    for (int i = 0; i <= degree; i++) {
+        if (!_Cubc_Finite(points[i].x) || !_Cubc_Finite(points[i].y)) {
+            return;
+        }
+        min_x = points[i].x < min_x ? points[i].x : min_x;
+        min_y = points[i].y < min_y ? points[i].y : min_y;
+        max_x = points[i].x > max_x ? points[i].x : max_x;
+        max_y = points[i].y > max_y ? points[i].y : max_y;
+    }
+    if (canvas->commands) {
+        // The lines stay within the tolerance of the control points' hull.
+        Cubc_Command command = {
+            .kind  = CUBC_COMMAND_CURVE,
+            .color = color,
+            .curve = {{points[0], points[1], points[2],
+                       degree == 3 ? points[3] : points[2]},
+                      degree == 3},
+            .min_x = _Cubc_CurvePixel(min_x) - 1,
+            .min_y = _Cubc_CurvePixel(min_y) - 1,
+            .max_x = _Cubc_CurvePixel(max_x) + 1,
+            .max_y = _Cubc_CurvePixel(max_y) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Curve(canvas, &clip, points, degree, color);
+}
+
+void Cubc_CanvasQuadBezier(Cubc_Canvas* canvas, float x0, float y0, float cx,
+                           float cy, float x1, float y1, Cubc_Color color) {
+    Cubc_V2f points[3] = {{x0, y0}, {cx, cy}, {x1, y1}};
+    _Cubc_CanvasCurve(canvas, points, 2, color);
+}
+
+void Cubc_CanvasQuadBezierV(Cubc_Canvas* canvas, Cubc_V2f begin,
+                            Cubc_V2f control, Cubc_V2f end, Cubc_Color color) {
+    Cubc_V2f points[3] = {begin, control, end};
+    _Cubc_CanvasCurve(canvas, points, 2, color);
+}
+
+void Cubc_CanvasCubicBezier(Cubc_Canvas* canvas, float x0, float y0,
+                            float c0x, float c0y, float c1x, float c1y,
+                            float x1, float y1, Cubc_Color color) {
+    Cubc_V2f points[4] = {{x0, y0}, {c0x, c0y}, {c1x, c1y}, {x1, y1}};
+    _Cubc_CanvasCurve(canvas, points, 3, color);
+}
+
+void Cubc_CanvasCubicBezierV(Cubc_Canvas* canvas, Cubc_V2f begin,
+                             Cubc_V2f control0, Cubc_V2f control1,
+                             Cubc_V2f end, Cubc_Color color) {
+    Cubc_V2f points[4] = {begin, control0, control1, end};
+    _Cubc_CanvasCurve(canvas, points, 3, color);
+}
+
+// Rows of a path are rasterized this many at a time, which bounds the
+// memory of the signed areas.
+#ifndef CUBC_PATH_BAND
+#define CUBC_PATH_BAND 32
+#endif
+
+// An edge of a flattened path in 1/256 pixels, shifted by half a pixel so
+// that pixel i spans [i, i + 1). It runs down from y0 to y1, `winding` tells
+// whether the path did.
+typedef struct {
+    int64_t x0, y0, x1, y1;
+    int64_t first, last;
+    double slope;
+    int32_t winding;
+} _Cubc_PathEdge;
+
+typedef struct {
+    _Cubc_PathEdge* items;
+    size_t count, capacity;
+} _Cubc_PathEdgeList;
+
+static int64_t _Cubc_PathFixed(double v) {
+    return (int64_t) floor((v + 0.5) * 256 + 0.5);
+}
+
+static void _Cubc_PathEdgePush(_Cubc_PathEdgeList* list, double x0,
+                               double y0, double x1, double y1) {
+    _Cubc_PathEdge e = {
+        .x0      = _Cubc_PathFixed(x0),
+        .y0      = _Cubc_PathFixed(y0),
+        .x1      = _Cubc_PathFixed(x1),
+        .y1      = _Cubc_PathFixed(y1),
+        .first   = 0,
+        .last    = 0,
+        .slope   = 0,
+        .winding = 1,
+    };
+    if (e.y0 == e.y1) {
+        return;
+    }
+    if (e.y0 > e.y1) {
+        SWAP(e.x0, e.x1);
+        SWAP(e.y0, e.y1);
+        e.winding = -1;
+    }
+    e.first = _Cubc_FloorDiv(e.y0, 256);
+    e.last  = _Cubc_FloorDiv(e.y1 - 1, 256);
+    e.slope = (double) (e.x1 - e.x0) / (double) (e.y1 - e.y0);
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->items    = (_Cubc_PathEdge*) realloc(
+            list->items, sizeof(_Cubc_PathEdge) * list->capacity);
+    }
+    list->items[list->count++] = e;
+}
+
+// Adds the line from `x0`, `y0` to `x1`, `y1` as edges, clipped to the
+// canvas and a margin. Parts above or below can't change a visible row and
+// are dropped, parts to the left or right become vertical edges along the
+// margin, which keeps the winding of the rows they cross. The clip only
+// depends on the canvas, so every tile quantizes the same edges.
+static void _Cubc_PathEdgeAdd(_Cubc_PathEdgeList* list,
+                              const Cubc_Canvas* canvas, double x0,
+                              double y0, double x1, double y1) {
+    double x_lo = -2, x_hi = (double) canvas->w + 1;
+    double y_lo = -2, y_hi = (double) canvas->h + 1;
+    if (x0 >= x_lo && x0 <= x_hi && x1 >= x_lo && x1 <= x_hi &&
+        y0 >= y_lo && y0 <= y_hi && y1 >= y_lo && y1 <= y_hi) {
+        _Cubc_PathEdgePush(list, x0, y0, x1, y1);
+        return;
+    }
+    if (!_Cubc_ClipSegment(&x0, &y0, &x1, &y1, -HUGE_VAL, y_lo, HUGE_VAL,
+                           y_hi)) {
+        return;
+    }
+    // Split where the line crosses the margins, then move every piece
+    // inside them.
+    double t[4] = {0, 0, 0, 1};
+    size_t n    = 1;
+    if (x0 != x1) {
+        double a = (x_lo - x0) / (x1 - x0), b = (x_hi - x0) / (x1 - x0);
+        if (a > b) {
+            SWAP(a, b);
+        }
+        if (a > 0 && a < 1) {
+            t[n++] = a;
+        }
+        if (b > 0 && b < 1) {
+            t[n++] = b;
+        }
+    }
+    t[n] = 1;
+    for (size_t i = 0; i < n; i++) {
+        double ax = x0 + (x1 - x0) * t[i], ay = y0 + (y1 - y0) * t[i];
+        double bx = x0 + (x1 - x0) * t[i + 1], by = y0 + (y1 - y0) * t[i + 1];
+        ax = ax < x_lo ? x_lo : ax > x_hi ? x_hi : ax;
+        bx = bx < x_lo ? x_lo : bx > x_hi ? x_hi : bx;
+        _Cubc_PathEdgePush(list, ax, ay, bx, by);
+    }
+}
+
+// The integral of clamp(v, 0, 1).
+static inline double _Cubc_RampArea(double v) {
+    return v <= 0 ? 0 : v < 1 ? v * v / 2 : v - 0.5;
+}
+
+// Adds the signed area edge `e` covers to its right on rows `top` to
+// `bottom` into `area`, which holds columns `start` to `end` of every row,
+// `stride` apart. The area of a column is the difference of rounded running
+// totals, so every row adds up to the edge's exact height and rows whose
+// edges cancel stay zero. Columns left of `start` go into the first one,
+// those right of `end` are dropped, which keeps the sums from `start` to
+// `end` the same for every clip. Widens `first`, `last` of every row to the
+// columns written.
+static void _Cubc_PathDeposit(int32_t* area, size_t stride, int64_t start,
+                              int64_t end, const _Cubc_PathEdge* e,
+                              int64_t top, int64_t bottom, int64_t* first,
+                              int64_t* last) {
+    int64_t from_row = e->first > top ? e->first : top;
+    int64_t to_row   = e->last < bottom ? e->last : bottom;
+    uint32_t winding = (uint32_t) e->winding;
+    // Positions only depend on the row, never on where the loop starts.
+    int64_t ya = e->y0 > from_row * 256 ? e->y0 : from_row * 256;
+    double xa  = (double) e->x0 + (double) (ya - e->y0) * e->slope;
+    for (int64_t row = from_row; row <= to_row; row++) {
+        int64_t yb     = e->y1 < row * 256 + 256 ? e->y1 : row * 256 + 256;
+        double xb      = (double) e->x0 + (double) (yb - e->y0) * e->slope;
+        int64_t height = (yb - ya) * 256;
+        double left    = (xa < xb ? xa : xb) / 256;
+        double right   = (xa < xb ? xb : xa) / 256;
+        size_t r       = (size_t) (row - top);
+        int32_t* line  = area + r * stride - start;
+        ya             = yb;
+        xa             = xb;
+
+        // Edges are inside the canvas margin, where truncation is in range.
+        int64_t c0   = (int64_t) left - (left < (double) (int64_t) left);
+        int64_t c1   = (int64_t) right - (right < (double) (int64_t) right) + 1;
+        int64_t from = c0 > start ? c0 : start;
+        int64_t to   = c1 < end ? c1 : end;
+        if (from > to && c1 >= start) {
+            // Right of the clip, where the row stays covered up to the end.
+            first[r] = end < first[r] ? end : first[r];
+            last[r]  = end;
+            continue;
+        }
+        if (from > to) {
+            from = to = start;
+        }
+        first[r] = from < first[r] ? from : first[r];
+        last[r]  = to > last[r] ? to : last[r];
+        // Within one column the part left of the edge is that left of its
+        // middle, which is most of the rows of most edges.
+        if (c1 == c0 + 1 && from == c0 && to == c1) {
+            double a      = ((double) c1 - (left + right) / 2) * height;
+            int64_t total = (int64_t) (a + 0.5);
+            line[c0]      = (int32_t) ((uint32_t) line[c0] +
+                                  winding * (uint32_t) total);
+            line[c1]      = (int32_t) ((uint32_t) line[c1] +
+                                  winding * (uint32_t) (height - total));
+            continue;
+        }
+        // Nearly vertical edges are treated the same, which also keeps the
+        // division well conditioned.
+        double width    = right - left;
+        bool steep      = c1 == c0 + 1 || width < 1e-6;
+        double scale    = steep ? (double) height : (double) height / width;
+        double middle   = (left + right) / 2;
+        int64_t covered = 0;
+        for (int64_t c = from; c <= to; c++) {
+            // The part of the columns up to c the edge has to its left,
+            // averaged over the row.
+            int64_t total = height;
+            if (c < c1) {
+                double u = (double) (c + 1);
+                double a = steep ? u - middle
+                                 : _Cubc_RampArea(u - left) -
+                                       _Cubc_RampArea(u - right);
+                a        = a * scale;
+                a        = a < 0 ? 0 : a > (double) height ? height : a;
+                total    = (int64_t) (a + 0.5);
+            }
+            line[c] = (int32_t) ((uint32_t) line[c] +
+                                 winding * (uint32_t) (total - covered));
+            covered = total;
+        }
+    }
+}
+
+// Composites `color` over pixels `x` to `x` + `n` - 1 of row `y`, with its
+// alpha scaled by `coverage`. Runs of full coverage of an opaque color are
+// stored.
+static void _Cubc_CoverSpan(Cubc_Canvas* canvas, int64_t x, int64_t y,
+                            const uint8_t* coverage, size_t n, uint32_t color,
+                            Cubc_AlphaMode alpha) {
+    bool opaque     = CUBC_ALPHA(color) == 255;
+    bool native     = canvas->format == CUBC_FORMAT_RGBA8888;
+    uint64_t value  = _Cubc_EncodePixel(canvas->format, color);
+    uint32_t pixels[CUBC_COVER_BATCH];
+    size_t i = 0;
+    while (i < n) {
+        uint64_t eight;
+        if (i + 8 <= n && (memcpy(&eight, coverage + i, 8), eight == 0)) {
+            i += 8;
+            continue;
+        }
+        if (coverage[i] == 0) {
+            i++;
+            continue;
+        }
+        size_t j = i;
+        if (opaque && coverage[i] == 255) {
+            while (j < n && coverage[j] == 255) {
+                j++;
+            }
+            _Cubc_Fill(canvas->format, _Cubc_PixelAddress(canvas, x + i, y),
+                       j - i, value, false);
+            i = j;
+            continue;
+        }
+        while (j < n && coverage[j] != 0 && !(opaque && coverage[j] == 255) &&
+               (native || j - i < CUBC_COVER_BATCH)) {
+            j++;
+        }
+        void* p = _Cubc_PixelAddress(canvas, x + i, y);
+        if (native) {
+            _Cubc_CoverRow((uint32_t*) p, coverage + i, j - i, color, alpha);
+        } else {
+            _Cubc_DecodeRow(canvas->format, pixels, p, j - i);
+            _Cubc_CoverRow(pixels, coverage + i, j - i, color, alpha);
+            _Cubc_EncodeRow(canvas->format, p, pixels, j - i);
+        }
+        i = j;
+    }
+}
+
+// Signed-area coverage accumulation: every edge adds the area it covers to
+// its right, split over the columns it crosses, into one buffer per band of
+// rows, and a prefix sum over every row turns the areas into coverage. The
+// edges live in a table bucketed by band and an active list, like the ones
+// of _Cubc_Polygon.
+static void _Cubc_FillPath(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                           const Cubc_Path* path, Cubc_FillRule rule,
+                           Cubc_Color color, Cubc_AlphaMode alpha) {
+    _Cubc_Outline outline = CUBC_ZERO;
+    _Cubc_PathFlatten(path, &outline);
+    _Cubc_PathEdgeList list = CUBC_ZERO;
+    const Cubc_V2f* contour = outline.points;
+    for (size_t i = 0; i < outline.contour_count;
+         contour += outline.counts[i++]) {
+        size_t n = outline.counts[i];
+        for (size_t j = 0; n > 1 && j < n; j++) {
+            Cubc_V2f a = contour[j], b = contour[j + 1 < n ? j + 1 : 0];
+            _Cubc_PathEdgeAdd(&list, canvas, a.x, a.y, b.x, b.y);
+        }
+    }
+    _Cubc_OutlineFree(&outline);
+    if (list.count == 0) {
+        return;
+    }
+
+    _Cubc_PathEdge* edges = list.items;
+    int64_t top = clip->y1 + 1, bottom = clip->y0 - 1, start = clip->x1 + 1;
+    for (size_t i = 0; i < list.count; i++) {
+        int64_t column = _Cubc_FloorDiv(
+            edges[i].x0 < edges[i].x1 ? edges[i].x0 : edges[i].x1, 256);
+        top    = edges[i].first < top ? edges[i].first : top;
+        bottom = edges[i].last > bottom ? edges[i].last : bottom;
+        start  = column < start ? column : start;
+    }
+    top          = top > clip->y0 ? top : clip->y0;
+    bottom       = bottom < clip->y1 ? bottom : clip->y1;
+    start        = start > clip->x0 ? start : clip->x0;
+    int64_t end  = clip->x1;
+    if (top > bottom || start > end) {
+        free(edges);
+        return;
+    }
+
+    // Edges by the band they start in; those above the clip start in the
+    // first one.
+    size_t width    = (size_t) (end - start + 1);
+    size_t bands    = (size_t) ((bottom - top) / CUBC_PATH_BAND + 1);
+    size_t* starts  = (size_t*) calloc(bands + 1, sizeof(size_t));
+    size_t* table   = (size_t*) malloc(sizeof(size_t) * list.count);
+    size_t kept     = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        if (edges[i].last < top || edges[i].first > bottom) {
+            continue;
+        }
+        int64_t first = edges[i].first > top ? edges[i].first : top;
+        starts[(first - top) / CUBC_PATH_BAND + 1]++;
+        edges[kept++] = edges[i];
+    }
+    for (size_t i = 0; i < bands; i++) {
+        starts[i + 1] += starts[i];
+    }
+    for (size_t i = 0; i < kept; i++) {
+        int64_t first = edges[i].first > top ? edges[i].first : top;
+        table[starts[(first - top) / CUBC_PATH_BAND]++] = i;
+    }
+    memmove(starts + 1, starts, sizeof(size_t) * bands);
+    starts[0] = 0;
+
+    int32_t* area =
+        (int32_t*) calloc((size_t) CUBC_PATH_BAND * width, sizeof(int32_t));
+    uint8_t* coverage = (uint8_t*) malloc(width);
+    size_t* active    = (size_t*) malloc(sizeof(size_t) * (kept + 1));
+    size_t active_count = 0;
+    uint32_t c          = color.color;
+    if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        c = _Cubc_PixelPremultiply(c);
+    }
+    bool even_odd = rule == CUBC_FILL_EVEN_ODD;
+    for (size_t band = 0; band < bands; band++) {
+        int64_t band_top    = top + (int64_t) band * CUBC_PATH_BAND;
+        int64_t band_bottom = band_top + CUBC_PATH_BAND - 1;
+        band_bottom         = band_bottom < bottom ? band_bottom : bottom;
+        size_t alive        = 0;
+        for (size_t i = 0; i < active_count; i++) {
+            if (edges[active[i]].last >= band_top) {
+                active[alive++] = active[i];
+            }
+        }
+        active_count = alive;
+        for (size_t i = starts[band]; i < starts[band + 1]; i++) {
+            active[active_count++] = table[i];
+        }
+
+        int64_t first[CUBC_PATH_BAND], last[CUBC_PATH_BAND];
+        for (int64_t row = band_top; row <= band_bottom; row++) {
+            first[row - band_top] = end + 1;
+            last[row - band_top]  = start - 1;
+        }
+        for (size_t i = 0; i < active_count; i++) {
+            _Cubc_PathDeposit(area, width, start, end, &edges[active[i]],
+                              band_top, band_bottom, first, last);
+        }
+        // The areas of a row sum to zero right of its last edge, unless the
+        // path goes on past the clip, where `last` is its end.
+        for (int64_t row = band_top; row <= band_bottom; row++) {
+            size_t r = (size_t) (row - band_top);
+            if (first[r] > last[r]) {
+                continue;
+            }
+            size_t offset = (size_t) (first[r] - start);
+            size_t n      = (size_t) (last[r] - first[r] + 1);
+            _Cubc_AccumulateRow(coverage, area + r * width + offset, n,
+                                even_odd);
+            _Cubc_CoverSpan(canvas, first[r], row, coverage, n, c, alpha);
+        }
+    }
+    free(active);
+    free(coverage);
+    free(area);
+    free(table);
+    free(starts);
+    free(edges);
+}
+
+// Bounds of the finite control points of `path`, which hold its curves, or
+// false when there are none.
+static bool _Cubc_PathBounds(const Cubc_Path* path, double* min_x,
+                             double* min_y, double* max_x, double* max_y) {
+    *min_x = *min_y = HUGE_VAL;
+    *max_x = *max_y = -HUGE_VAL;
+    for (size_t i = 0; i < path->point_count; i++) {
+        Cubc_V2f p = path->points[i];
+        if (!_Cubc_Finite(p.x) || !_Cubc_Finite(p.y)) {
+            continue;
+        }
+        *min_x = p.x < *min_x ? p.x : *min_x;
+        *min_y = p.y < *min_y ? p.y : *min_y;
+        *max_x = p.x > *max_x ? p.x : *max_x;
+        *max_y = p.y > *max_y ? p.y : *max_y;
+    }
+    // So does the origin, where the path starts without a move.
+    if (path->verb_count > 0 && path->verbs[0] != CUBC_PATH_MOVE) {
+        *min_x = *min_x < 0 ? *min_x : 0;
+        *min_y = *min_y < 0 ? *min_y : 0;
+        *max_x = *max_x > 0 ? *max_x : 0;
+        *max_y = *max_y > 0 ? *max_y : 0;
+    }
+    return *min_x <= *max_x;
+}
+
+void Cubc_CanvasFillPath(Cubc_Canvas* canvas, const Cubc_Path* path,
+                         Cubc_FillRule rule, Cubc_Color color) {
+    if (canvas->commands) {
+        double min_x, min_y, max_x, max_y;
+        if (!_Cubc_PathBounds(path, &min_x, &min_y, &max_x, &max_y)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind  = CUBC_COMMAND_FILL_PATH,
+            .color = color,
+            .path  = {path, rule, _Cubc_AlphaModeOf(canvas), 0,
+                      CUBC_JOIN_MITER, CUBC_CAP_BUTT},
+            .min_x = _Cubc_CoordFloor(min_x) - 1,
+            .min_y = _Cubc_CoordFloor(min_y) - 1,
+            .max_x = _Cubc_CoordFloor(max_x) + 1,
+            .max_y = _Cubc_CoordFloor(max_y) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_FillPath(canvas, &clip, path, rule, color,
+                   _Cubc_AlphaModeOf(canvas));
+}
+
+// The flattened subpaths go to the polyline stroker as one list of spans.
+static void _Cubc_StrokePath(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                             const Cubc_Path* path, float width,
+                             Cubc_LineJoin join, Cubc_LineCap cap,
+                             Cubc_Color color, Cubc_AlphaMode alpha) {
+    double half = (double) width / 2;
+    if (!(half > 0) || !_Cubc_Finite(half)) {
+        return;
+    }
+    _Cubc_Outline outline = CUBC_ZERO;
+    _Cubc_PathFlatten(path, &outline);
+    _Cubc_SpanList list     = CUBC_ZERO;
+    const Cubc_V2f* contour = outline.points;
+    for (size_t i = 0; i < outline.contour_count;
+         contour += outline.counts[i++]) {
+        _Cubc_PolylineSpans(&list, clip, contour, outline.counts[i],
+                            outline.closed[i], half, join, cap);
+    }
+    _Cubc_OutlineFree(&outline);
+    _Cubc_SpanFlush(canvas, &list, color, alpha);
+}
+
+void Cubc_CanvasStrokePath(Cubc_Canvas* canvas, const Cubc_Path* path,
+                           float width, Cubc_LineJoin join, Cubc_LineCap cap,
+                           Cubc_Color color) {
+    if (canvas->commands) {
+        // Padded by the longest miter, like Cubc_CanvasPolyline.
+        double min_x, min_y, max_x, max_y;
+        double pad = (double) width / 2 * CUBC_MITER_LIMIT + 1;
+        if (!_Cubc_PathBounds(path, &min_x, &min_y, &max_x, &max_y) ||
+            !(pad > 0) || !_Cubc_Finite(pad)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind  = CUBC_COMMAND_STROKE_PATH,
+            .color = color,
+            .path  = {path, CUBC_FILL_NONZERO, _Cubc_AlphaModeOf(canvas),
+                      width, join, cap},
+            .min_x = _Cubc_CoordFloor(min_x - pad),
+            .min_y = _Cubc_CoordFloor(min_y - pad),
+            .max_x = _Cubc_CoordFloor(max_x + pad) + 1,
+            .max_y = _Cubc_CoordFloor(max_y + pad) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_StrokePath(canvas, &clip, path, width, join, cap, color,
+                     _Cubc_AlphaModeOf(canvas));
+}
+
+void Cubc_CanvasWireframeTriangle(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0,
+                                  uint32_t x1, uint32_t y1, uint32_t x2,
+                                  uint32_t y2, Cubc_Color color) {
+    Cubc_CanvasLine(canvas, x0, y0, x1, y1, color);
+    Cubc_CanvasLine(canvas, x1, y1, x2, y2, color);
+    Cubc_CanvasLine(canvas, x2, y2, x0, y0, color);
+}
+
+void Cubc_CanvasWireframeTriangleV(Cubc_Canvas* canvas, Cubc_V2u pos0,
+                                   Cubc_V2u pos1, Cubc_V2u pos2,
+                                   Cubc_Color color) {
+    Cubc_CanvasLineV(canvas, pos0, pos1, color);
+    Cubc_CanvasLineV(canvas, pos1, pos2, color);
+    Cubc_CanvasLineV(canvas, pos2, pos0, color);
+}
+
+// Edge function E(x, y) = a * (x - x0) + b * (y - y0) + c of the directed
+// edge p0 -> p1, taken from the origin (x0, y0) of the pixels it is evaluated
+// on. Pixels with E >= 0 lie on the inner side of a counter-clockwise
+// triangle; `bias` is 0 for top and left edges and -1 otherwise, so that
+// pixels exactly on a shared edge are only owned by one of the two triangles.
+typedef struct {
+    int64_t a, b, c;
+    int64_t bias;
+    int64_t x0, y0;
+} _Cubc_Edge;
+
+// The edge p0 -> p1 over the pixels [x0, x0 + w] x [y0, y0 + h]. Vertices far
+// off them would take E past 64 bits, so `c` is clamped to just beyond what
+// the pixels add to it, which keeps the side every pixel lies on.
+static _Cubc_Edge _Cubc_EdgeMake(int64_t px0, int64_t py0, int64_t px1,
+                                 int64_t py1, int64_t x0, int64_t y0,
+                                 int64_t w, int64_t h) {
+    _Cubc_Edge e = {
+        .a    = py1 - py0,
+        .b    = px0 - px1,
+        .c    = 0,
+        .bias = 0,
+        .x0   = x0,
+        .y0   = y0,
+    };
+    _Cubc_Wide c    = (_Cubc_Wide) e.a * (x0 - px0) +
+                      (_Cubc_Wide) e.b * (y0 - py0);
+    _Cubc_Wide span = (_Cubc_Wide) (e.a < 0 ? -e.a : e.a) * w +
+                      (_Cubc_Wide) (e.b < 0 ? -e.b : e.b) * h + 1;
+    e.c             = (int64_t) (c > span ? span : c < -span ? -span : c);
+    bool top_left   = e.a > 0 || (e.a == 0 && e.b > 0);
+    e.bias          = top_left ? 0 : -1;
+    return e;
+}
+
+static int64_t _Cubc_EdgeEval(const _Cubc_Edge* e, int64_t x, int64_t y) {
+    return e->a * (x - e->x0) + e->b * (y - e->y0) + e->c + e->bias;
+}
+
+// Fills the pixels of [x0, x1] x [y0, y1] that are inside all three edges.
+static void _Cubc_TriangleSpans(Cubc_Canvas* canvas, const _Cubc_Edge* e,
+                                int64_t x0, int64_t y0, int64_t x1,
+                                int64_t y1, uint64_t value) {
+    int64_t row0 = _Cubc_EdgeEval(&e[0], x0, y0);
+    int64_t row1 = _Cubc_EdgeEval(&e[1], x0, y0);
+    int64_t row2 = _Cubc_EdgeEval(&e[2], x0, y0);
+
+    for (int64_t y = y0; y <= y1; y++) {
+        int64_t w0 = row0, w1 = row1, w2 = row2;
+        int64_t x  = x0;
+        // Skip the empty run on the left, then fill until the first pixel
+        // that falls outside again; a triangle covers one span per row.
+        while (x <= x1 && (w0 | w1 | w2) < 0) {
+            w0 += e[0].a;
+            w1 += e[1].a;
+            w2 += e[2].a;
+            x++;
+        }
+        int64_t begin = x;
+        while (x <= x1 && (w0 | w1 | w2) >= 0) {
+            w0 += e[0].a;
+            w1 += e[1].a;
+            w2 += e[2].a;
+            x++;
+        }
+        if (x > begin) {
+            _Cubc_Fill(canvas->format, _Cubc_PixelAddress(canvas, begin, y),
+                       x - begin, value, false);
+        }
+        row0 += e[0].b;
+        row1 += e[1].b;
+        row2 += e[2].b;
+    }
+}
+
+// Rasterizes the triangle in CUBC_TRIANGLE_BLOCK square blocks. Each block
+// is first tested against the edges at its corners: blocks outside any edge
+// are skipped, blocks inside all edges are filled row by row, and only the
+// blocks crossed by an edge evaluate per-pixel coverage. Edges that fully
+// contain a partial block are dropped from its test, which keeps the
+// per-pixel values small enough for 32-bit lanes.
+static void _Cubc_TriangleBlocks(Cubc_Canvas* canvas, const _Cubc_Edge* e,
+                                 int64_t x0, int64_t y0, int64_t x1,
+                                 int64_t y1, uint32_t color) {
+    const int64_t n  = CUBC_TRIANGLE_BLOCK;
+    size_t stride    = CUBC_CANVAS_STRIDE(*canvas);
+    int64_t blocks_x = (x1 - x0 + 1) / n;
+    int64_t blocks_y = (y1 - y0 + 1) / n;
+    int64_t lo[3], hi[3];
+    for (int i = 0; i < 3; i++) {
+        lo[i] = ((e[i].a < 0 ? e[i].a : 0) + (e[i].b < 0 ? e[i].b : 0)) *
+                (n - 1);
+        hi[i] = ((e[i].a > 0 ? e[i].a : 0) + (e[i].b > 0 ? e[i].b : 0)) *
+                (n - 1);
+    }
+
+    for (int64_t by = 0; by < blocks_y; by++) {
+        int64_t y = y0 + by * n;
+        for (int64_t bx = 0; bx < blocks_x; bx++) {
+            int64_t x = x0 + bx * n;
+            int32_t w[3], a[3], b[3];
+            bool partial = false;
+            bool reject  = false;
+            for (int i = 0; i < 3; i++) {
+                int64_t v = _Cubc_EdgeEval(&e[i], x, y);
+                if (v + hi[i] < 0) {
+                    reject = true;
+                    break;
+                }
+                if (v + lo[i] >= 0) {
+                    w[i] = a[i] = b[i] = 0;
+                } else {
+                    w[i]    = (int32_t) v;
+                    a[i]    = (int32_t) e[i].a;
+                    b[i]    = (int32_t) e[i].b;
+                    partial = true;
+                }
+            }
+            if (reject) {
+                continue;
+            }
+            uint32_t* dst = &CUBC_CANVAS_AT(*canvas, x, y);
+            if (partial) {
+                _Cubc_TriangleBlock(dst, stride, w, a, b, color);
+            } else {
+                for (int64_t row = 0; row < n; row++) {
+                    _Cubc_Fill32(dst + row * stride, n, color, false);
+                }
+            }
+        }
+    }
+
+    // The right and bottom strips that do not make up a whole block.
+    if (x0 + blocks_x * n <= x1) {
+        _Cubc_TriangleSpans(canvas, e, x0 + blocks_x * n, y0, x1,
+                            y0 + blocks_y * n - 1, color);
+    }
+    if (y0 + blocks_y * n <= y1) {
+        _Cubc_TriangleSpans(canvas, e, x0, y0 + blocks_y * n, x1, y1, color);
+    }
+}
+
+// Triangles with a smaller bounding box than this, edge steps that do not
+// fit the 32-bit block lanes, or pixels that aren't 32-bit, are rasterized
+// span by span.
+#define CUBC_TRIANGLE_BLOCK_MIN  32
+#define CUBC_TRIANGLE_BLOCK_STEP (1 << 24)
+
+static void _Cubc_Triangle(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                           uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+                           uint32_t x2, uint32_t y2, Cubc_Color color) {
+    _Cubc_Wide area =
+        (_Cubc_Wide) ((int64_t) x1 - x0) * ((int64_t) y2 - y0) -
+        (_Cubc_Wide) ((int64_t) x2 - x0) * ((int64_t) y1 - y0);
+    if (area == 0) {
+        return;
+    }
+    // The edge functions are positive inside when the signed area is
+    // negative.
+    if (area > 0) {
+        SWAP(x1, x2);
+        SWAP(y1, y2);
+    }
+
+    int64_t min_x = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    int64_t min_y = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    int64_t max_x = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    int64_t max_y = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    min_x         = min_x < clip->x0 ? clip->x0 : min_x;
+    min_y         = min_y < clip->y0 ? clip->y0 : min_y;
+    max_x         = max_x > clip->x1 ? clip->x1 : max_x;
+    max_y         = max_y > clip->y1 ? clip->y1 : max_y;
+    if (min_x > max_x || min_y > max_y) {
+        return;
+    }
+
+    int64_t w       = max_x - min_x;
+    int64_t h       = max_y - min_y;
+    _Cubc_Edge e[3] = {
+        _Cubc_EdgeMake(x1, y1, x2, y2, min_x, min_y, w, h),
+        _Cubc_EdgeMake(x2, y2, x0, y0, min_x, min_y, w, h),
+        _Cubc_EdgeMake(x0, y0, x1, y1, min_x, min_y, w, h),
+    };
+
+    bool small_steps = true;
+    for (int i = 0; i < 3; i++) {
+        if (e[i].a <= -CUBC_TRIANGLE_BLOCK_STEP ||
+            e[i].a >= CUBC_TRIANGLE_BLOCK_STEP ||
+            e[i].b <= -CUBC_TRIANGLE_BLOCK_STEP ||
+            e[i].b >= CUBC_TRIANGLE_BLOCK_STEP) {
+            small_steps = false;
+        }
+    }
+    uint64_t value = _Cubc_EncodePixel(canvas->format, color.color);
+    if (small_steps && _Cubc_FormatSize(canvas->format) == 4 &&
+        max_x - min_x + 1 >= CUBC_TRIANGLE_BLOCK_MIN &&
+        max_y - min_y + 1 >= CUBC_TRIANGLE_BLOCK_MIN) {
+        _Cubc_TriangleBlocks(canvas, e, min_x, min_y, max_x, max_y,
+                             (uint32_t) value);
+    } else {
+        _Cubc_TriangleSpans(canvas, e, min_x, min_y, max_x, max_y, value);
+    }
+}
+
+void Cubc_CanvasTriangle(Cubc_Canvas* canvas, uint32_t x0, uint32_t y0,
+                         uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2,
+                         Cubc_Color color) {
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind   = CUBC_COMMAND_TRIANGLE,
+            .color  = color,
+            .points = {x0, y0, x1, y1, x2, y2},
+            .min_x  = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2),
+            .min_y  = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2),
+            .max_x  = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2),
+            .max_y  = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2),
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Triangle(canvas, &clip, x0, y0, x1, y1, x2, y2, color);
+}
+
+void Cubc_CanvasTriangleV(Cubc_Canvas* canvas, Cubc_V2u pos0, Cubc_V2u pos1,
+                          Cubc_V2u pos2, Cubc_Color color) {
+    Cubc_CanvasTriangle(canvas, pos0.x, pos0.y, pos1.x, pos1.y, pos2.x, pos2.y,
+                        color);
+}
+
+static void _Cubc_Rect(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                       uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                       Cubc_Color color) {
+    int64_t x0 = x < clip->x0 ? clip->x0 : x;
+    int64_t y0 = y < clip->y0 ? clip->y0 : y;
+    int64_t x1 = (int64_t) x + w > clip->x1 ? clip->x1 : (int64_t) x + w;
+    int64_t y1 = (int64_t) y + h > clip->y1 ? clip->y1 : (int64_t) y + h;
+    _Cubc_FillRect(canvas, x0, y0, x1, y1, color);
+}
+
+void Cubc_CanvasRect(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t w,
+                     uint32_t h, Cubc_Color color) {
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind  = CUBC_COMMAND_RECT,
+            .color = color,
+            .rect  = {x, y, w, h},
+            .min_x = x,
+            .min_y = y,
+            .max_x = (int64_t) x + w,
+            .max_y = (int64_t) y + h,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Rect(canvas, &clip, x, y, w, h, color);
+}
+void Cubc_CanvasRectV(Cubc_Canvas* canvas, Cubc_V2f pos, Cubc_V2f size,
+                      Cubc_Color color) {
+
+    Cubc_CanvasRect(canvas, pos.x, pos.y, size.x, size.y, color);
+}
+void Cubc_CanvasRectR(Cubc_Canvas* canvas, Cubc_Rect rect, Cubc_Color color) {
+    Cubc_CanvasRect(canvas, rect.x, rect.y, rect.w, rect.h, color);
+}
+
+// Whole pixel ellipses: the pixel x, y off the center is inside when
+// 4 x^2 B + 4 y^2 A < A B, for A = (2 rx + 1)^2 and B = (2 ry + 1)^2, which
+// never holds with equality. Each row's half width is settled from its
+// estimate in floating point, which is off by rounding only, so every row
+// takes a few steps however wide the shape is.
+typedef struct {
+    _Cubc_Wide a, b, ab;
+    int64_t rx, ry;
+} _Cubc_EllipseRows;
+
+#define CUBC_ELLIPSE_MAX_RADIUS ((int64_t) 1 << 30)
+
+static _Cubc_EllipseRows _Cubc_EllipseRowsOf(int64_t rx, int64_t ry) {
+    rx = rx < CUBC_ELLIPSE_MAX_RADIUS ? rx : CUBC_ELLIPSE_MAX_RADIUS;
+    ry = ry < CUBC_ELLIPSE_MAX_RADIUS ? ry : CUBC_ELLIPSE_MAX_RADIUS;
+    _Cubc_EllipseRows rows = {
+        .a  = (_Cubc_Wide) (2 * rx + 1) * (2 * rx + 1),
+        .b  = (_Cubc_Wide) (2 * ry + 1) * (2 * ry + 1),
+        .ab = 0,
+        .rx = rx,
+        .ry = ry,
+    };
+    rows.ab = rows.a * rows.b;
+    return rows;
+}
+
+// Half width of the row `dy` >= 0 off the center, -1 past the ellipse.
+static int64_t _Cubc_EllipseHalfWidth(const _Cubc_EllipseRows* rows,
+                                      int64_t dy) {
+    if (dy > rows->ry) {
+        return -1;
+    }
+    _Cubc_Wide row = 4 * (_Cubc_Wide) dy * dy * rows->a;
+    double t       = (double) dy / ((double) rows->ry + 0.5);
+    int64_t x      = (int64_t) (((double) rows->rx + 0.5) * sqrt(1 - t * t));
+    x              = x < 0 ? 0 : x > rows->rx ? rows->rx : x;
+    // The center column is always inside.
+    while (x < rows->rx &&
+           4 * (_Cubc_Wide) (x + 1) * (x + 1) * rows->b + row < rows->ab) {
+        x++;
+    }
+    while (x > 0 && 4 * (_Cubc_Wide) x * x * rows->b + row >= rows->ab) {
+        x--;
+    }
+    return x;
+}
+
+// The pixels at angles from `start` up to `end` off a center: left of the
+// start edge, where sx y - sy x >= 0, and right of the end edge, where
+// ey x - ex y > 0, or either of them for sweeps wider than half a turn.
+typedef struct {
+    double sx, sy, ex, ey;
+    // How far from the edges pixels are fully on one side.
+    double start_reach, end_reach;
+    bool wide, full, empty;
+} _Cubc_Wedge;
+
+static _Cubc_Wedge _Cubc_WedgeOf(double start, double end) {
+    double turn       = 6.283185307179586;
+    double sweep      = end - start;
+    _Cubc_Wedge wedge = CUBC_ZERO;
+    if (!_Cubc_Finite(sweep)) {
+        wedge.empty = true;
+        return wedge;
+    }
+    if (sweep >= turn) {
+        wedge.full = true;
+        return wedge;
+    }
+    sweep = fmod(sweep, turn);
+    sweep = sweep < 0 ? sweep + turn : sweep;
+    if (sweep == 0) {
+        wedge.empty = true;
+        return wedge;
+    }
+    wedge.sx   = cos(start);
+    wedge.sy   = sin(start);
+    wedge.ex   = cos(end);
+    wedge.ey   = sin(end);
+    wedge.wide = sweep > turn / 2;
+    wedge.start_reach = (fabs(wedge.sx) + fabs(wedge.sy)) / 2;
+    wedge.end_reach   = (fabs(wedge.ex) + fabs(wedge.ey)) / 2;
+    return wedge;
+}
+
+// Narrows `lo` to `hi` to the whole x where a x + b >= 0, or > 0 when
+// `strict`, judged by that expression alone so every caller agrees.
+static void _Cubc_HalfRow(double a, double b, bool strict, int64_t* lo,
+                          int64_t* hi) {
+#define CUBC_SIDE(x)                                                           \
+    (strict ? a * (double) (x) + b > 0 : a * (double) (x) + b >= 0)
+    if (*lo > *hi) {
+        return;
+    }
+    if (a == 0) {
+        *lo = CUBC_SIDE(0) ? *lo : *hi + 1;
+        return;
+    }
+    double root = -b / a;
+    root = root < (double) (*lo - 1) ? (double) (*lo - 1)
+         : root > (double) (*hi + 1) ? (double) (*hi + 1)
+                                     : root;
+    int64_t x = _Cubc_Floor(root);
+    if (a > 0) {
+        while (x > *lo && CUBC_SIDE(x - 1)) {
+            x--;
+        }
+        while (x <= *hi && !CUBC_SIDE(x)) {
+            x++;
+        }
+        *lo = x > *lo ? x : *lo;
+    } else {
+        while (x < *hi && CUBC_SIDE(x + 1)) {
+            x++;
+        }
+        while (x >= *lo && !CUBC_SIDE(x)) {
+            x--;
+        }
+        *hi = x < *hi ? x : *hi;
+    }
+#undef CUBC_SIDE
+}
+
+// Splits the offsets `lo` to `hi` of the row `dy` off the center of `wedge`
+// into the up to two spans inside it, returning how many.
+static int _Cubc_WedgeRow(const _Cubc_Wedge* wedge, int64_t dy, int64_t lo,
+                          int64_t hi, int64_t spans[4]) {
+    if (wedge->full) {
+        spans[0] = lo;
+        spans[1] = hi;
+        return lo <= hi;
+    }
+    int64_t s0 = lo, s1 = hi, e0 = lo, e1 = hi;
+    _Cubc_HalfRow(-wedge->sy, wedge->sx * (double) dy, false, &s0, &s1);
+    _Cubc_HalfRow(wedge->ey, -wedge->ex * (double) dy, true, &e0, &e1);
+    if (!wedge->wide) {
+        spans[0] = s0 > e0 ? s0 : e0;
+        spans[1] = s1 < e1 ? s1 : e1;
+        // The apex, on both edges, belongs to every wedge. Wide ones have
+        // it left of the start edge.
+        if (dy == 0 && lo <= 0 && hi >= 0) {
+            spans[0] = spans[0] > spans[1] || spans[0] > 0 ? 0 : spans[0];
+            spans[1] = spans[1] < 0 ? 0 : spans[1];
+        }
+        return spans[0] <= spans[1];
+    }
+    int count = 0;
+    if (s0 <= s1) {
+        spans[count++] = s0;
+        spans[count++] = s1;
+    }
+    if (e0 <= e1) {
+        spans[count++] = e0;
+        spans[count++] = e1;
+    }
+    if (count == 4 && spans[2] < spans[0]) {
+        SWAP(spans[0], spans[2]);
+        SWAP(spans[1], spans[3]);
+    }
+    // Overlapping halves are one span.
+    if (count == 4 && spans[2] <= spans[1] + 1) {
+        spans[1] = spans[3] > spans[1] ? spans[3] : spans[1];
+        count    = 2;
+    }
+    return count / 2;
+}
+
+#define CUBC_ELLIPSE_BATCH 64
+
+// The half widths of a batch of rows are found before any of them is
+// filled, as stepping them between the fills stalls on the stores.
+static void _Cubc_Ellipse(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                          int64_t cx, int64_t cy, int64_t rx, int64_t ry,
+                          bool filled, double start, double end,
+                          Cubc_Color color) {
+    _Cubc_Wedge wedge = _Cubc_WedgeOf(start, end);
+    if (wedge.empty) {
+        return;
+    }
+    _Cubc_EllipseRows rows = _Cubc_EllipseRowsOf(rx, ry);
+    int64_t top            = cy - rows.ry > clip->y0 ? cy - rows.ry : clip->y0;
+    int64_t bottom         = cy + rows.ry < clip->y1 ? cy + rows.ry : clip->y1;
+    uint64_t value         = _Cubc_EncodePixel(canvas->format, color.color);
+    for (int64_t first = top; first <= bottom; first += CUBC_ELLIPSE_BATCH) {
+        int64_t half[CUBC_ELLIPSE_BATCH], inner[CUBC_ELLIPSE_BATCH];
+        int64_t count = bottom - first + 1;
+        count = count < CUBC_ELLIPSE_BATCH ? count : CUBC_ELLIPSE_BATCH;
+        for (int64_t i = 0; i < count; i++) {
+            int64_t dy = first + i - cy;
+            dy         = dy < 0 ? -dy : dy;
+            half[i]    = _Cubc_EllipseHalfWidth(&rows, dy);
+            // Outlines have what the row has past the row outside it.
+            inner[i] = 0;
+            if (!filled) {
+                inner[i] = _Cubc_EllipseHalfWidth(&rows, dy + 1) + 1;
+                inner[i] = inner[i] < half[i] ? inner[i] : half[i];
+            }
+        }
+        for (int64_t i = 0; i < count; i++) {
+            int64_t y     = first + i;
+            int64_t parts = 1, part[4] = {-half[i], half[i]};
+            if (inner[i] > 0) {
+                part[1] = -inner[i];
+                part[2] = inner[i];
+                part[3] = half[i];
+                parts   = 2;
+            }
+            for (int64_t j = 0; j < parts; j++) {
+                // Only the part on the clip is split by the wedge.
+                int64_t lo = part[2 * j], hi = part[2 * j + 1], spans[4];
+                lo         = lo > clip->x0 - cx ? lo : clip->x0 - cx;
+                hi         = hi < clip->x1 - cx ? hi : clip->x1 - cx;
+                if (lo > hi) {
+                    continue;
+                }
+                int n = _Cubc_WedgeRow(&wedge, y - cy, lo, hi, spans);
+                for (int k = 0; k < n; k++) {
+                    int64_t x0 = cx + spans[2 * k], x1 = cx + spans[2 * k + 1];
+                    x0         = x0 > clip->x0 ? x0 : clip->x0;
+                    x1         = x1 < clip->x1 ? x1 : clip->x1;
+                    if (x0 <= x1) {
+                        _Cubc_Fill(canvas->format,
+                                   _Cubc_PixelAddress(canvas, x0, y),
+                                   (size_t) (x1 - x0 + 1), value, false);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void _Cubc_CanvasEllipse(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                                uint32_t rx, uint32_t ry, bool filled,
+                                float start, float end, Cubc_Color color) {
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind    = CUBC_COMMAND_ELLIPSE,
+            .color   = color,
+            .ellipse = {(double) x, (double) y, (double) rx, (double) ry,
+                        start, end, 0, filled, _Cubc_AlphaModeOf(canvas)},
+            .min_x   = (int64_t) x - rx,
+            .min_y   = (int64_t) y - ry,
+            .max_x   = (int64_t) x + rx,
+            .max_y   = (int64_t) y + ry,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_Ellipse(canvas, &clip, x, y, rx, ry, filled, start, end, color);
+}
+
+// Start and end angles of the whole shape, a turn and more apart.
+#define CUBC_TURN_START 0.0f
+#define CUBC_TURN_END   7.0f
+
+void Cubc_CanvasEllipse(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                        uint32_t rx, uint32_t ry, Cubc_Color color) {
+    _Cubc_CanvasEllipse(canvas, x, y, rx, ry, true, CUBC_TURN_START,
+                        CUBC_TURN_END, color);
+}
+
+void Cubc_CanvasCircle(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t r,
+                       Cubc_Color color) {
+    _Cubc_CanvasEllipse(canvas, x, y, r, r, true, CUBC_TURN_START,
+                        CUBC_TURN_END, color);
+}
+
+void Cubc_CanvasWireframeEllipse(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                                 uint32_t rx, uint32_t ry, Cubc_Color color) {
+    _Cubc_CanvasEllipse(canvas, x, y, rx, ry, false, CUBC_TURN_START,
+                        CUBC_TURN_END, color);
+}
+
+void Cubc_CanvasWireframeCircle(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                                uint32_t r, Cubc_Color color) {
+    _Cubc_CanvasEllipse(canvas, x, y, r, r, false, CUBC_TURN_START,
+                        CUBC_TURN_END, color);
+}
+
+void Cubc_CanvasArc(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t r,
+                    float start, float end, Cubc_Color color) {
+    _Cubc_CanvasEllipse(canvas, x, y, r, r, false, start, end, color);
+}
+
+void Cubc_CanvasPie(Cubc_Canvas* canvas, uint32_t x, uint32_t y, uint32_t r,
+                    float start, float end, Cubc_Color color) {
+    _Cubc_CanvasEllipse(canvas, x, y, r, r, true, start, end, color);
+}
+
+// The part of the unit square centered on the origin where nx x + ny y <= d,
+// for a unit normal nx, ny: a band of constant width across the middle and
+// a triangle cut off the corner either side.
+static double _Cubc_SquareCoverage(double d, double nx, double ny) {
+    double a    = nx < 0 ? -nx : nx;
+    double b    = ny < 0 ? -ny : ny;
+    if (a < b) {
+        SWAP(a, b);
+    }
+    double half = (a + b) / 2;
+    double ad   = d < 0 ? -d : d;
+    if (ad >= half) {
+        return d > 0 ? 1 : 0;
+    }
+    if (ad <= (a - b) / 2) {
+        return 0.5 + d / a;
+    }
+    double t      = half - ad;
+    double corner = t * t / (2 * a * b);
+    return d > 0 ? 1 - corner : corner;
+}
+
+// Coverage of the pixel `px`, `py` off the center by the ellipse with radii
+// `rx`, `ry`, cut by its tangent at the distance s (1 - s) / |g| from the
+// pixel center, for s = |(px / rx, py / ry)| and g the gradient of s times
+// s, which is exact for circles.
+static double _Cubc_EllipseCoverage(double px, double py, double rx,
+                                    double ry) {
+    if (!(rx > 0) || !(ry > 0)) {
+        return 0;
+    }
+    double u  = px / rx, v = py / ry;
+    double gx = u / rx, gy = v / ry;
+    double g  = sqrt(gx * gx + gy * gy);
+    if (g == 0) {
+        return _Cubc_SquareCoverage(rx < ry ? rx : ry, 1, 0);
+    }
+    double s = sqrt(u * u + v * v);
+    return _Cubc_SquareCoverage(s * (1 - s) / g, gx / g, gy / g);
+}
+
+// The part of the unit square centered on the origin where both
+// nx0 x + ny0 y <= d0 and nx1 x + ny1 y <= d1, clipping it by one line and
+// then the other.
+static double _Cubc_SquareCoverage2(double nx0, double ny0, double d0,
+                                    double nx1, double ny1, double d1) {
+    double x[8] = {-0.5, 0.5, 0.5, -0.5}, y[8] = {-0.5, -0.5, 0.5, 0.5};
+    double nx[2] = {nx0, nx1}, ny[2] = {ny0, ny1}, d[2] = {d0, d1};
+    int n        = 4;
+    for (int k = 0; k < 2; k++) {
+        double kept_x[8], kept_y[8];
+        int m = 0;
+        for (int i = 0; i < n; i++) {
+            int j     = i + 1 < n ? i + 1 : 0;
+            double fi = nx[k] * x[i] + ny[k] * y[i] - d[k];
+            double fj = nx[k] * x[j] + ny[k] * y[j] - d[k];
+            if (fi <= 0) {
+                kept_x[m]   = x[i];
+                kept_y[m++] = y[i];
+            }
+            if ((fi <= 0) != (fj <= 0)) {
+                double t    = fi / (fi - fj);
+                kept_x[m]   = x[i] + t * (x[j] - x[i]);
+                kept_y[m++] = y[i] + t * (y[j] - y[i]);
+            }
+        }
+        memcpy(x, kept_x, sizeof(double) * m);
+        memcpy(y, kept_y, sizeof(double) * m);
+        n = m;
+    }
+    double area = 0;
+    for (int i = 0; i < n; i++) {
+        int j = i + 1 < n ? i + 1 : 0;
+        area += x[i] * y[j] - x[j] * y[i];
+    }
+    return (area < 0 ? -area : area) / 2;
+}
+
+// Coverage of the pixel `px`, `py` off the center of `wedge` by it. Where
+// only one edge crosses the pixel that is its coverage, and near the apex
+// the square is clipped by both.
+static double _Cubc_WedgeCoverage(const _Cubc_Wedge* wedge, double px,
+                                  double py) {
+    double ds = wedge->sx * py - wedge->sy * px;
+    double de = wedge->ex * py - wedge->ey * px;
+    double s  = ds >= wedge->start_reach    ? 1
+              : ds <= -wedge->start_reach ? 0
+                                          : _Cubc_SquareCoverage(
+                                                ds, wedge->sy, -wedge->sx);
+    double e  = de >= wedge->end_reach    ? 0
+              : de <= -wedge->end_reach ? 1
+                                        : 1 - _Cubc_SquareCoverage(
+                                                  de, wedge->ey, -wedge->ex);
+    if (wedge->wide) {
+        if (s == 1 || e == 1 || s == 0 || e == 0) {
+            return s > e ? s : e;
+        }
+        return 1 - _Cubc_SquareCoverage2(-wedge->sy, wedge->sx, -ds,
+                                         wedge->ey, -wedge->ex, de);
+    }
+    if (s == 1 || e == 1 || s == 0 || e == 0) {
+        return s < e ? s : e;
+    }
+    return _Cubc_SquareCoverage2(wedge->sy, -wedge->sx, ds, -wedge->ey,
+                                 wedge->ex, -de);
+}
+
+// The whole x strictly inside the ellipse with radii `rx`, `ry` on the row
+// `py` off its center `cx`, or an empty run.
+static void _Cubc_EllipseRun(double cx, double py, double rx, double ry,
+                             int64_t* from, int64_t* to) {
+    *from = 1;
+    *to   = 0;
+    if (rx > 0 && ry > 0 && py > -ry && py < ry) {
+        double half = rx * sqrt(1 - (py / ry) * (py / ry));
+        *from       = _Cubc_CoordFloor(cx - half) + 1;
+        *to         = _Cubc_CoordFloor(cx + half);
+    }
+}
+
+// Anti-aliased ellipses, or outlines `width` wide, within `start` to `end`.
+// Only pixels within one of an edge have their coverage computed: those
+// further inside are fully covered, and those inside the hole of an outline
+// not at all.
+static void _Cubc_EllipseAA(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                            double cx, double cy, double rx, double ry,
+                            bool filled, double width, double start,
+                            double end, Cubc_Color color,
+                            Cubc_AlphaMode alpha) {
+    _Cubc_Wedge wedge = _Cubc_WedgeOf(start, end);
+    if (wedge.empty || !_Cubc_Finite(cx) || !_Cubc_Finite(cy) ||
+        !_Cubc_Finite(rx) || !_Cubc_Finite(ry) || !(rx >= 0) || !(ry >= 0) ||
+        (!filled && !(width > 0 && _Cubc_Finite(width)))) {
+        return;
+    }
+    double half = filled ? 0 : width / 2;
+    double ox = rx + half, oy = ry + half;
+    double ix = filled ? 0 : rx - half, iy = filled ? 0 : ry - half;
+    if (!(ox > 0) || !(oy > 0)) {
+        return;
+    }
+    int64_t top    = _Cubc_CoordFloor(cy - oy - 1);
+    int64_t bottom = _Cubc_CoordFloor(cy + oy + 1) + 1;
+    int64_t left   = _Cubc_CoordFloor(cx - ox - 1);
+    int64_t right  = _Cubc_CoordFloor(cx + ox + 1) + 1;
+    top            = top > clip->y0 ? top : clip->y0;
+    bottom         = bottom < clip->y1 ? bottom : clip->y1;
+    left           = left > clip->x0 ? left : clip->x0;
+    right          = right < clip->x1 ? right : clip->x1;
+    if (top > bottom || left > right) {
+        return;
+    }
+
+    uint8_t* coverage = (uint8_t*) malloc((size_t) (right - left + 1));
+    uint32_t c        = color.color;
+    if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        c = _Cubc_PixelPremultiply(c);
+    }
+    for (int64_t y = top; y <= bottom; y++) {
+        // Columns within a pixel of the outer edge.
+        int64_t x0, x1;
+        double py = (double) y - cy;
+        _Cubc_EllipseRun(cx, py, ox + 1, oy + 1, &x0, &x1);
+        x0 = x0 - 1 > left ? x0 - 1 : left;
+        x1 = x1 + 1 < right ? x1 + 1 : right;
+        if (x0 > x1) {
+            continue;
+        }
+        int64_t full0, full1, ring0 = 1, ring1 = 0, hole0 = 1, hole1 = 0;
+        _Cubc_EllipseRun(cx, py, ox - 1, oy - 1, &full0, &full1);
+        if (!filled) {
+            _Cubc_EllipseRun(cx, py, ix + 1, iy + 1, &ring0, &ring1);
+            _Cubc_EllipseRun(cx, py, ix - 1, iy - 1, &hole0, &hole1);
+        }
+        for (int64_t x = x0; x <= x1; x++) {
+            bool solid = x >= full0 && x <= full1 && (x < ring0 || x > ring1);
+            if ((solid && wedge.full) || (x >= hole0 && x <= hole1)) {
+                // A run of the same coverage.
+                int64_t to = solid ? full1 : hole1;
+                to         = to < x1 ? to : x1;
+                to         = !solid || to < ring0 || x > ring1 ? to : ring0 - 1;
+                memset(coverage + (x - x0), solid ? 255 : 0,
+                       (size_t) (to - x + 1));
+                x = to;
+                continue;
+            }
+            double px = (double) x - cx;
+            double a  = 1;
+            if (!solid) {
+                a = _Cubc_EllipseCoverage(px, py, ox, oy);
+                if (!filled) {
+                    a -= _Cubc_EllipseCoverage(px, py, ix, iy);
+                }
+            }
+            if (a > 0 && !wedge.full) {
+                a *= _Cubc_WedgeCoverage(&wedge, px, py);
+            }
+            a                = a < 0 ? 0 : a > 1 ? 1 : a;
+            coverage[x - x0] = (uint8_t) (a * 255 + 0.5);
+        }
+        _Cubc_CoverSpan(canvas, x0, y, coverage, (size_t) (x1 - x0 + 1), c,
+                        alpha);
+    }
+    free(coverage);
+}
+
+static void _Cubc_CanvasEllipseAA(Cubc_Canvas* canvas, float x, float y,
+                                  float rx, float ry, bool filled,
+                                  float width, float start, float end,
+                                  Cubc_Color color) {
+    if (canvas->commands) {
+        double half = filled ? 0 : (double) width / 2;
+        double pad  = (rx > ry ? rx : ry) + half + 1;
+        if (!_Cubc_Finite(x) || !_Cubc_Finite(y) || !_Cubc_Finite(pad)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind    = CUBC_COMMAND_ELLIPSE_AA,
+            .color   = color,
+            .ellipse = {x, y, rx, ry, start, end, width, filled,
+                        _Cubc_AlphaModeOf(canvas)},
+            .min_x   = _Cubc_CoordFloor(x - (rx + half + 1)),
+            .min_y   = _Cubc_CoordFloor(y - (ry + half + 1)),
+            .max_x   = _Cubc_CoordFloor(x + (rx + half + 1)) + 1,
+            .max_y   = _Cubc_CoordFloor(y + (ry + half + 1)) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_EllipseAA(canvas, &clip, x, y, rx, ry, filled, width, start, end,
+                    color, _Cubc_AlphaModeOf(canvas));
+}
+
+void Cubc_CanvasEllipseAA(Cubc_Canvas* canvas, float x, float y, float rx,
+                          float ry, Cubc_Color color) {
+    _Cubc_CanvasEllipseAA(canvas, x, y, rx, ry, true, 0, CUBC_TURN_START,
+                          CUBC_TURN_END, color);
+}
+
+void Cubc_CanvasCircleAA(Cubc_Canvas* canvas, float x, float y, float r,
+                         Cubc_Color color) {
+    _Cubc_CanvasEllipseAA(canvas, x, y, r, r, true, 0, CUBC_TURN_START,
+                          CUBC_TURN_END, color);
+}
+
+void Cubc_CanvasArcAA(Cubc_Canvas* canvas, float x, float y, float r,
+                      float width, float start, float end, Cubc_Color color) {
+    _Cubc_CanvasEllipseAA(canvas, x, y, r, r, false, width, start, end, color);
+}
+
+void Cubc_CanvasPieAA(Cubc_Canvas* canvas, float x, float y, float r,
+                      float start, float end, Cubc_Color color) {
+    _Cubc_CanvasEllipseAA(canvas, x, y, r, r, true, 0, start, end, color);
+}
+
+// Radii clockwise from the top left, 0 unless positive, and scaled down
+// together until the two along each side of the `w` by `h` rect add up to at
+// most its length.
+static void _Cubc_CornersFit(double fit[4], Cubc_Corners radii, double w,
+                             double h) {
+    fit[0] = radii.top_left;
+    fit[1] = radii.top_right;
+    fit[2] = radii.bottom_right;
+    fit[3] = radii.bottom_left;
+    for (int k = 0; k < 4; k++) {
+        fit[k] = fit[k] > 0 ? fit[k] : 0;
+        fit[k] = fit[k] < w ? fit[k] : w;
+        fit[k] = fit[k] < h ? fit[k] : h;
+    }
+    double scale = 1;
+    for (int k = 0; k < 4; k++) {
+        // The side from corner k to the next, the top one first.
+        double side = k % 2 ? h : w;
+        double sum  = fit[k] + fit[(k + 1) % 4];
+        if (sum > side && side / sum < scale) {
+            scale = side / sum;
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        fit[k] *= scale;
+    }
+}
+
+// Columns a whole pixel corner cuts off the row `dy` before its center row,
+// none from that row on.
+static int64_t _Cubc_CornerCut(const _Cubc_EllipseRows* corner, int64_t dy) {
+    return dy > 0 ? corner->rx - _Cubc_EllipseHalfWidth(corner, dy) : 0;
+}
+
+// Rows are batched like those of _Cubc_Ellipse. The corners along a side
+// never overlap, so each row is cut by one corner at most at either end.
+static void _Cubc_RoundedRect(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                              int64_t x, int64_t y, int64_t w, int64_t h,
+                              Cubc_Corners radii, Cubc_Color color) {
+    double fit[4];
+    _Cubc_CornersFit(fit, radii, (double) w, (double) h);
+    _Cubc_EllipseRows corners[4];
+    for (int k = 0; k < 4; k++) {
+        corners[k] = _Cubc_EllipseRowsOf((int64_t) fit[k], (int64_t) fit[k]);
+    }
+    int64_t top    = y > clip->y0 ? y : clip->y0;
+    int64_t bottom = y + h < clip->y1 ? y + h : clip->y1;
+    uint64_t value = _Cubc_EncodePixel(canvas->format, color.color);
+    for (int64_t first = top; first <= bottom; first += CUBC_ELLIPSE_BATCH) {
+        int64_t lo[CUBC_ELLIPSE_BATCH], hi[CUBC_ELLIPSE_BATCH];
+        int64_t count = bottom - first + 1;
+        count = count < CUBC_ELLIPSE_BATCH ? count : CUBC_ELLIPSE_BATCH;
+        for (int64_t i = 0; i < count; i++) {
+            int64_t j = first + i - y;
+            lo[i]     = x + _Cubc_CornerCut(&corners[0], corners[0].rx - j) +
+                        _Cubc_CornerCut(&corners[3], j - (h - corners[3].rx));
+            hi[i]     = x + w -
+                        _Cubc_CornerCut(&corners[1], corners[1].rx - j) -
+                        _Cubc_CornerCut(&corners[2], j - (h - corners[2].rx));
+        }
+        for (int64_t i = 0; i < count; i++) {
+            int64_t x0 = lo[i] > clip->x0 ? lo[i] : clip->x0;
+            int64_t x1 = hi[i] < clip->x1 ? hi[i] : clip->x1;
+            if (x0 <= x1) {
+                _Cubc_Fill(canvas->format,
+                           _Cubc_PixelAddress(canvas, x0, first + i),
+                           (size_t) (x1 - x0 + 1), value, false);
+            }
+        }
+    }
+}
+
+void Cubc_CanvasRoundedRect(Cubc_Canvas* canvas, uint32_t x, uint32_t y,
+                            uint32_t w, uint32_t h, Cubc_Corners radii,
+                            Cubc_Color color) {
+    if (canvas->commands) {
+        Cubc_Command command = {
+            .kind         = CUBC_COMMAND_ROUNDED_RECT,
+            .color        = color,
+            .rounded_rect = {(double) x, (double) y, (double) w, (double) h,
+                             radii, _Cubc_AlphaModeOf(canvas)},
+            .min_x        = x,
+            .min_y        = y,
+            .max_x        = (int64_t) x + w,
+            .max_y        = (int64_t) y + h,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_RoundedRect(canvas, &clip, x, y, w, h, radii, color);
+}
+
+void Cubc_CanvasRoundedRectR(Cubc_Canvas* canvas, Cubc_Rect rect,
+                             Cubc_Corners radii, Cubc_Color color) {
+    Cubc_CanvasRoundedRect(canvas, rect.x, rect.y, rect.w, rect.h, radii,
+                           color);
+}
+
+// Anti-aliased rounded rects. Pixels centered in the square of a corner are
+// cut by its circle as well as the sides, and the run of a row clear of the
+// corners and the left and right sides all has the row's coverage.
+static void _Cubc_RoundedRectAA(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                                double x, double y, double w, double h,
+                                Cubc_Corners radii, Cubc_Color color,
+                                Cubc_AlphaMode alpha) {
+    if (!_Cubc_Finite(x) || !_Cubc_Finite(y) || !_Cubc_Finite(w) ||
+        !_Cubc_Finite(h) || !(w > 0) || !(h > 0)) {
+        return;
+    }
+    double r[4];
+    _Cubc_CornersFit(r, radii, w, h);
+    int64_t top    = _Cubc_CoordFloor(y);
+    int64_t bottom = _Cubc_CoordFloor(y + h) + 1;
+    int64_t left   = _Cubc_CoordFloor(x);
+    int64_t right  = _Cubc_CoordFloor(x + w) + 1;
+    top            = top > clip->y0 ? top : clip->y0;
+    bottom         = bottom < clip->y1 ? bottom : clip->y1;
+    left           = left > clip->x0 ? left : clip->x0;
+    right          = right < clip->x1 ? right : clip->x1;
+    if (top > bottom || left > right) {
+        return;
+    }
+
+    uint8_t* coverage = (uint8_t*) malloc((size_t) (right - left + 1));
+    uint32_t c        = color.color;
+    if (alpha == CUBC_ALPHA_PREMULTIPLIED) {
+        c = _Cubc_PixelPremultiply(c);
+    }
+    for (int64_t row = top; row <= bottom; row++) {
+        double py    = (double) row;
+        double from  = py - 0.5 > y ? py - 0.5 : y;
+        double to    = py + 0.5 < y + h ? py + 0.5 : y + h;
+        double cover = to - from;
+        if (!(cover > 0)) {
+            continue;
+        }
+        // The corners whose squares the row's centers are in, if any.
+        bool upper_l = py < y + r[0], lower_l = py > y + h - r[3];
+        bool upper_r = py < y + r[1], lower_r = py > y + h - r[2];
+        double rl    = upper_l ? r[0] : lower_l ? r[3] : 0;
+        double rr    = upper_r ? r[1] : lower_r ? r[2] : 0;
+        double cyl   = upper_l ? y + r[0] : y + h - r[3];
+        double cyr   = upper_r ? y + r[1] : y + h - r[2];
+        int64_t solid0 = _Cubc_CoordFloor(x + (rl > 0.5 ? rl : 0.5)) + 1;
+        int64_t solid1 = _Cubc_CoordFloor(x + w - (rr > 0.5 ? rr : 0.5));
+        for (int64_t col = left; col <= right; col++) {
+            if (col >= solid0 && col <= solid1) {
+                int64_t end = solid1 < right ? solid1 : right;
+                memset(coverage + (col - left),
+                       (uint8_t) (cover * 255 + 0.5),
+                       (size_t) (end - col + 1));
+                col = end;
+                continue;
+            }
+            double px = (double) col;
+            double x0 = px - 0.5 > x ? px - 0.5 : x;
+            double x1 = px + 0.5 < x + w ? px + 0.5 : x + w;
+            double a  = x1 > x0 ? (x1 - x0) * cover : 0;
+            if (a > 0 && rl > 0 && px < x + rl) {
+                double b = _Cubc_EllipseCoverage(px - (x + rl), py - cyl, rl,
+                                                 rl);
+                a        = b < a ? b : a;
+            }
+            if (a > 0 && rr > 0 && px > x + w - rr) {
+                double b = _Cubc_EllipseCoverage(px - (x + w - rr), py - cyr,
+                                                 rr, rr);
+                a        = b < a ? b : a;
+            }
+            coverage[col - left] = (uint8_t) (a * 255 + 0.5);
+        }
+        _Cubc_CoverSpan(canvas, left, row, coverage,
+                        (size_t) (right - left + 1), c, alpha);
+    }
+    free(coverage);
+}
+
+void Cubc_CanvasRoundedRectAA(Cubc_Canvas* canvas, float x, float y, float w,
+                              float h, Cubc_Corners radii, Cubc_Color color) {
+    if (canvas->commands) {
+        if (!_Cubc_Finite(x) || !_Cubc_Finite(y) || !_Cubc_Finite(w) ||
+            !_Cubc_Finite(h)) {
+            return;
+        }
+        Cubc_Command command = {
+            .kind         = CUBC_COMMAND_ROUNDED_RECT_AA,
+            .color        = color,
+            .rounded_rect = {x, y, w, h, radii, _Cubc_AlphaModeOf(canvas)},
+            .min_x        = _Cubc_CoordFloor(x),
+            .min_y        = _Cubc_CoordFloor(y),
+            .max_x        = _Cubc_CoordFloor((double) x + w) + 1,
+            .max_y        = _Cubc_CoordFloor((double) y + h) + 1,
+        };
+        _Cubc_Record(canvas, command);
+        return;
+    }
+    _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+    _Cubc_RoundedRectAA(canvas, &clip, x, y, w, h, radii, color,
+                        _Cubc_AlphaModeOf(canvas));
+}
+
+#ifndef CUBC_TILE_SIZE
+#define CUBC_TILE_SIZE 64
+#endif
+
+static void _Cubc_Record(Cubc_Canvas* canvas, Cubc_Command command) {
+    if (command.min_x < 0) {
+        command.min_x = 0;
+    }
+    if (command.min_y < 0) {
+        command.min_y = 0;
+    }
+    if (command.max_x >= (int64_t) canvas->w) {
+        command.max_x = (int64_t) canvas->w - 1;
+    }
+    if (command.max_y >= (int64_t) canvas->h) {
+        command.max_y = (int64_t) canvas->h - 1;
+    }
+    if (command.min_x > command.max_x || command.min_y > command.max_y) {
+        return;
+    }
+
+    Cubc_CommandList* list = canvas->commands;
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->items    = (Cubc_Command*) realloc(
+            list->items, sizeof(Cubc_Command) * list->capacity);
+    }
+    list->items[list->count++] = command;
+}
+
+static void _Cubc_RunCommand(Cubc_Canvas* canvas, const _Cubc_Clip* clip,
+                             const Cubc_Command* command) {
+    switch (command->kind) {
+    case CUBC_COMMAND_CLEAR:
+        _Cubc_Clear(canvas, clip, command->color);
+        break;
+    case CUBC_COMMAND_PIXEL:
+        _Cubc_Pixel(canvas, clip, command->points.x0, command->points.y0,
+                    command->color);
+        break;
+    case CUBC_COMMAND_LINE:
+        _Cubc_Line(canvas, clip, command->points.x0, command->points.y0,
+                   command->points.x1, command->points.y1, command->color);
+        break;
+    case CUBC_COMMAND_LINE_AA:
+        _Cubc_LineAA(canvas, clip, command->segment.x0, command->segment.y0,
+                     command->segment.x1, command->segment.y1, command->color,
+                     command->segment.dest_alpha);
+        break;
+    case CUBC_COMMAND_CURVE:
+        _Cubc_Curve(canvas, clip, command->curve.points,
+                    command->curve.cubic ? 3 : 2, command->color);
+        break;
+    case CUBC_COMMAND_POLYLINE: {
+        const Cubc_V2f* points = command->polyline.points
+                                     ? command->polyline.points
+                                     : command->polyline.ends;
+        _Cubc_Polyline(canvas, clip, points, command->polyline.count,
+                       command->polyline.closed, command->polyline.width,
+                       command->polyline.join, command->polyline.cap,
+                       command->color, command->polyline.dest_alpha);
+        break;
+    }
+    case CUBC_COMMAND_POLYGON:
+        _Cubc_Polygon(canvas, clip, command->polygon.points,
+                      command->polygon.counts, command->polygon.contour_count,
+                      command->polygon.rule, command->color);
+        break;
+    case CUBC_COMMAND_FILL_PATH:
+        _Cubc_FillPath(canvas, clip, command->path.path, command->path.rule,
+                       command->color, command->path.dest_alpha);
+        break;
+    case CUBC_COMMAND_STROKE_PATH:
+        _Cubc_StrokePath(canvas, clip, command->path.path, command->path.width,
+                         command->path.join, command->path.cap, command->color,
+                         command->path.dest_alpha);
+        break;
+    case CUBC_COMMAND_TRIANGLE:
+        _Cubc_Triangle(canvas, clip, command->points.x0, command->points.y0,
+                       command->points.x1, command->points.y1,
+                       command->points.x2, command->points.y2,
+                       command->color);
+        break;
+    case CUBC_COMMAND_RECT:
+        _Cubc_Rect(canvas, clip, command->rect.x, command->rect.y,
+                   command->rect.w, command->rect.h, command->color);
+        break;
+    case CUBC_COMMAND_ROUNDED_RECT:
+        _Cubc_RoundedRect(canvas, clip, (int64_t) command->rounded_rect.x,
+                          (int64_t) command->rounded_rect.y,
+                          (int64_t) command->rounded_rect.w,
+                          (int64_t) command->rounded_rect.h,
+                          command->rounded_rect.radii, command->color);
+        break;
+    case CUBC_COMMAND_ROUNDED_RECT_AA:
+        _Cubc_RoundedRectAA(canvas, clip, command->rounded_rect.x,
+                            command->rounded_rect.y, command->rounded_rect.w,
+                            command->rounded_rect.h,
+                            command->rounded_rect.radii, command->color,
+                            command->rounded_rect.dest_alpha);
+        break;
+    case CUBC_COMMAND_ELLIPSE:
+        _Cubc_Ellipse(canvas, clip, (int64_t) command->ellipse.x,
+                      (int64_t) command->ellipse.y,
+                      (int64_t) command->ellipse.rx,
+                      (int64_t) command->ellipse.ry, command->ellipse.filled,
+                      command->ellipse.start, command->ellipse.end,
+                      command->color);
+        break;
+    case CUBC_COMMAND_ELLIPSE_AA:
+        _Cubc_EllipseAA(canvas, clip, command->ellipse.x, command->ellipse.y,
+                        command->ellipse.rx, command->ellipse.ry,
+                        command->ellipse.filled, command->ellipse.width,
+                        command->ellipse.start, command->ellipse.end,
+                        command->color, command->ellipse.dest_alpha);
+        break;
+    case CUBC_COMMAND_BLIT:
+        _Cubc_BlitCanvas(canvas, clip, &command->blit.src, command->blit.x,
+                         command->blit.y, command->blit.scale_x,
+                         command->blit.scale_y, command->blit.blend,
+                         command->blit.alpha, command->blit.dest_alpha,
+                         command->blit.filter, command->blit.mode);
+        break;
+    case CUBC_COMMAND_BLIT_SLICED:
+        _Cubc_BlitSliced(canvas, clip, &command->sliced.src, command->sliced.x,
+                         command->sliced.y, command->sliced.w,
+                         command->sliced.h, command->sliced.insets,
+                         command->sliced.blend, command->sliced.alpha,
+                         command->sliced.dest_alpha);
+        break;
+    case CUBC_COMMAND_COMPOSITE:
+        _Cubc_Composite(canvas, clip,
+                        command->composite.src.pixels ? &command->composite.src
+                                                      : NULL,
+                        command->color, command->composite.x,
+                        command->composite.y, command->composite.w,
+                        command->composite.h, command->composite.op,
+                        command->composite.dest_alpha);
+        break;
+    case CUBC_COMMAND_PREMULTIPLY:
+    case CUBC_COMMAND_UNPREMULTIPLY:
+        _Cubc_ConvertCanvas(canvas, clip,
+                            command->kind == CUBC_COMMAND_PREMULTIPLY);
+        break;
+    }
+}
+
+// The commands overlapping tile i are items[bins[offsets[i]]] up to
+// items[bins[offsets[i + 1] - 1]], in recording order.
+typedef struct {
+    Cubc_Canvas* canvas;
+    const Cubc_Command* items;
+    const size_t* offsets;
+    const size_t* bins;
+    size_t tiles_x, tiles_y;
+    size_t next_tile;
+} _Cubc_TileJob;
+
+// The pixels of tile `tile` of a canvas `tiles_x` tiles wide.
+static _Cubc_Clip _Cubc_TileClip(const Cubc_Canvas* canvas, size_t tiles_x,
+                                 size_t tile) {
+    int64_t tile_x  = (int64_t) (tile % tiles_x) * CUBC_TILE_SIZE;
+    int64_t tile_y  = (int64_t) (tile / tiles_x) * CUBC_TILE_SIZE;
+    _Cubc_Clip clip = {
+        .x0 = tile_x,
+        .y0 = tile_y,
+        .x1 = tile_x + CUBC_TILE_SIZE - 1,
+        .y1 = tile_y + CUBC_TILE_SIZE - 1,
+    };
+    if (clip.x1 >= (int64_t) canvas->w) {
+        clip.x1 = (int64_t) canvas->w - 1;
+    }
+    if (clip.y1 >= (int64_t) canvas->h) {
+        clip.y1 = (int64_t) canvas->h - 1;
+    }
+    return clip;
+}
+
+static void* _Cubc_TileWorker(void* arg) {
+    _Cubc_TileJob* job = (_Cubc_TileJob*) arg;
+    size_t tile_count  = job->tiles_x * job->tiles_y;
+    for (;;) {
+        size_t tile = __atomic_fetch_add(&job->next_tile, 1, __ATOMIC_RELAXED);
+        if (tile >= tile_count) {
+            break;
+        }
+        _Cubc_Clip clip = _Cubc_TileClip(job->canvas, job->tiles_x, tile);
+        for (size_t i = job->offsets[tile]; i < job->offsets[tile + 1]; i++) {
+            _Cubc_RunCommand(job->canvas, &clip, &job->items[job->bins[i]]);
+        }
+    }
+    return NULL;
+}
+
+// Runs `worker` on the calling thread and up to `thread_count` - 1 others,
+// no more than there are tiles, and waits for all of them.
+static void _Cubc_RunWorkers(void* (*worker)(void*), void* job,
+                             size_t thread_count, size_t tile_count) {
+#ifndef CUBC_NO_THREADS
+    size_t worker_count = thread_count > 1 ? thread_count - 1 : 0;
+    if (worker_count > tile_count) {
+        worker_count = tile_count;
+    }
+    pthread_t* workers = (pthread_t*) malloc(sizeof(pthread_t) * worker_count);
+    for (size_t i = 0; i < worker_count; i++) {
+        if (pthread_create(&workers[i], NULL, worker, job) != 0) {
+            worker_count = i;
+            break;
+        }
+    }
+    worker(job);
+    for (size_t i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+#else
+    (void) thread_count;
+    (void) tile_count;
+    worker(job);
+#endif
+}
+
+void Cubc_CanvasBeginDeferred(Cubc_Canvas* canvas, Cubc_CommandList* list) {
+    canvas->commands = list;
+}
+
+void Cubc_CanvasEndDeferred(Cubc_Canvas* canvas, size_t thread_count) {
+    Cubc_CommandList* list = canvas->commands;
+    canvas->commands       = NULL;
+    if (list == NULL || list->count == 0) {
+        return;
+    }
+
+    size_t tiles_x    = (canvas->w + CUBC_TILE_SIZE - 1) / CUBC_TILE_SIZE;
+    size_t tiles_y    = (canvas->h + CUBC_TILE_SIZE - 1) / CUBC_TILE_SIZE;
+    size_t tile_count = tiles_x * tiles_y;
+
+    // Bin the commands by the tiles their bounds overlap: count, prefix sum,
+    // then scatter the command indices.
+    size_t* offsets = (size_t*) calloc(tile_count + 1, sizeof(size_t));
+    for (size_t i = 0; i < list->count; i++) {
+        const Cubc_Command* c = &list->items[i];
+        for (int64_t ty = c->min_y / CUBC_TILE_SIZE;
+             ty <= c->max_y / CUBC_TILE_SIZE; ty++) {
+            for (int64_t tx = c->min_x / CUBC_TILE_SIZE;
+                 tx <= c->max_x / CUBC_TILE_SIZE; tx++) {
+                offsets[ty * tiles_x + tx + 1]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < tile_count; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    size_t* bins   = (size_t*) malloc(sizeof(size_t) * offsets[tile_count]);
+    size_t* cursor = (size_t*) malloc(sizeof(size_t) * tile_count);
+    memcpy(cursor, offsets, sizeof(size_t) * tile_count);
+    for (size_t i = 0; i < list->count; i++) {
+        const Cubc_Command* c = &list->items[i];
+        for (int64_t ty = c->min_y / CUBC_TILE_SIZE;
+             ty <= c->max_y / CUBC_TILE_SIZE; ty++) {
+            for (int64_t tx = c->min_x / CUBC_TILE_SIZE;
+                 tx <= c->max_x / CUBC_TILE_SIZE; tx++) {
+                bins[cursor[ty * tiles_x + tx]++] = i;
+            }
+        }
+    }
+    free(cursor);
+
+    // Every tile is rendered by exactly one thread, so the pixel buffer
+    // needs no locking.
+    _Cubc_TileJob job = {
+        .canvas    = canvas,
+        .items     = list->items,
+        .offsets   = offsets,
+        .bins      = bins,
+        .tiles_x   = tiles_x,
+        .tiles_y   = tiles_y,
+        .next_tile = 0,
+    };
+    _Cubc_RunWorkers(_Cubc_TileWorker, &job, thread_count, tile_count);
+
+    free(bins);
+    free(offsets);
+    list->count = 0;
+}
+
+void Cubc_CommandListFree(Cubc_CommandList* list) {
+    free(list->items);
+    list->items    = NULL;
+    list->count    = 0;
+    list->capacity = 0;
+}
+
+typedef struct {
+    uint32_t x0, y0, x1, y1;
+    Cubc_Color color;
+} _Cubc_LineItem;
+
+// Lines binned by tile, like the commands of _Cubc_TileJob. The bins hold
+// copies rather than indices, so every tile reads its lines in order.
+typedef struct {
+    Cubc_Canvas* canvas;
+    const size_t* offsets;
+    const _Cubc_LineItem* bins;
+    size_t tiles_x, tiles_y;
+    size_t next_tile;
+} _Cubc_LineJob;
+
+static void* _Cubc_LineWorker(void* arg) {
+    _Cubc_LineJob* job = (_Cubc_LineJob*) arg;
+    size_t tile_count  = job->tiles_x * job->tiles_y;
+    for (;;) {
+        size_t tile = __atomic_fetch_add(&job->next_tile, 1, __ATOMIC_RELAXED);
+        if (tile >= tile_count) {
+            break;
+        }
+        _Cubc_Clip clip = _Cubc_TileClip(job->canvas, job->tiles_x, tile);
+        for (size_t i = job->offsets[tile]; i < job->offsets[tile + 1]; i++) {
+            const _Cubc_LineItem* line = &job->bins[i];
+            _Cubc_Line(job->canvas, &clip, line->x0, line->y0, line->x1,
+                       line->y1, line->color);
+        }
+    }
+    return NULL;
+}
+
+// The first and last tile columns in tile row `ty` that the line from `x0`,
+// `y0` to `x1`, `y1` may touch. Its pixels stay within half a pixel of the
+// exact line, so where that crosses the rows of the tile and one row either
+// side holds all of them, give or take a column.
+static void _Cubc_LineTileColumns(int64_t x0, int64_t y0, int64_t x1,
+                                  int64_t y1, int64_t ty, int64_t last_column,
+                                  int64_t* first, int64_t* last) {
+    int64_t lo = x0 < x1 ? x0 : x1;
+    int64_t hi = x0 > x1 ? x0 : x1;
+    if (y0 / CUBC_TILE_SIZE != y1 / CUBC_TILE_SIZE) {
+        int64_t top    = ty * CUBC_TILE_SIZE - 1;
+        int64_t bottom = (ty + 1) * CUBC_TILE_SIZE;
+        double slope   = (double) (x1 - x0) / (double) (y1 - y0);
+        double a       = (double) x0 + (double) (top - y0) * slope;
+        double b       = (double) x0 + (double) (bottom - y0) * slope;
+        if (a > b) {
+            SWAP(a, b);
+        }
+        // Both ends are on the segment's own x range or beyond it.
+        if (a > (double) lo + 1) {
+            lo = (int64_t) a - 1;
+        }
+        if (b < (double) hi - 1) {
+            hi = (int64_t) b + 2;
+        }
+    }
+    *first = lo / CUBC_TILE_SIZE;
+    *last  = hi / CUBC_TILE_SIZE < last_column ? hi / CUBC_TILE_SIZE
+                                               : last_column;
+}
+
+// Counts the line from `x0`, `y0` to `x1`, `y1` in every tile it crosses
+// when `bins` is NULL, and otherwise stores `item` at the cursor of each.
+static void _Cubc_LineSpread(uint32_t x0, uint32_t y0, uint32_t x1,
+                             uint32_t y1, size_t tiles_x, int64_t last_row,
+                             size_t* cursor, _Cubc_LineItem* bins,
+                             _Cubc_LineItem item) {
+    int64_t top    = (y0 < y1 ? y0 : y1) / CUBC_TILE_SIZE;
+    int64_t bottom = (y0 > y1 ? y0 : y1) / CUBC_TILE_SIZE;
+    bottom         = bottom < last_row ? bottom : last_row;
+    for (int64_t ty = top; ty <= bottom; ty++) {
+        int64_t first, last;
+        _Cubc_LineTileColumns(x0, y0, x1, y1, ty, (int64_t) tiles_x - 1,
+                              &first, &last);
+        for (int64_t tx = first; tx <= last; tx++) {
+            size_t tile = (size_t) ty * tiles_x + (size_t) tx;
+            if (bins) {
+                bins[cursor[tile]++] = item;
+            } else {
+                cursor[tile]++;
+            }
+        }
+    }
+}
+
+#ifndef CUBC_LINES_PER_TILE
+#define CUBC_LINES_PER_TILE 32
+#endif
+
+void Cubc_CanvasLines(Cubc_Canvas* canvas, const uint32_t* x0,
+                      const uint32_t* y0, const uint32_t* x1,
+                      const uint32_t* y1, const Cubc_Color* colors,
+                      size_t count, size_t thread_count) {
+    if (canvas->commands) {
+        for (size_t i = 0; i < count; i++) {
+            Cubc_CanvasLine(canvas, x0[i], y0[i], x1[i], y1[i], colors[i]);
+        }
+        return;
+    }
+    if (count == 0 || canvas->w == 0 || canvas->h == 0) {
+        return;
+    }
+
+    size_t tiles_x    = (canvas->w + CUBC_TILE_SIZE - 1) / CUBC_TILE_SIZE;
+    size_t tiles_y    = (canvas->h + CUBC_TILE_SIZE - 1) / CUBC_TILE_SIZE;
+    size_t tile_count = tiles_x * tiles_y;
+    int64_t last_row  = (int64_t) tiles_y - 1;
+    size_t w          = canvas->w;
+    size_t h          = canvas->h;
+
+    // Binning a line costs about as much as drawing a short one, which a
+    // single thread only wins back once the tiles hold many lines each.
+    if (thread_count <= 1 && count < tile_count * CUBC_LINES_PER_TILE) {
+        _Cubc_Clip clip = _Cubc_CanvasClip(canvas);
+        for (size_t i = 0; i < count; i++) {
+            _Cubc_Line(canvas, &clip, x0[i], y0[i], x1[i], y1[i], colors[i]);
+        }
+        return;
+    }
+
+    // Bin the lines by the tiles along them in two passes, like
+    // Cubc_CanvasEndDeferred. The count pass notes the tile of every line
+    // inside a single one, which most short lines are, so the second pass
+    // places them directly. Lines that start and end off the canvas on the
+    // same side are dropped.
+    size_t dropped      = tile_count;
+    size_t spread       = tile_count + 1;
+    size_t* offsets     = (size_t*) calloc(tile_count + 1, sizeof(size_t));
+    size_t* tiles       = (size_t*) malloc(sizeof(size_t) * count);
+    _Cubc_LineItem none = CUBC_ZERO;
+    for (size_t i = 0; i < count; i++) {
+        if ((x0[i] >= w && x1[i] >= w) || (y0[i] >= h && y1[i] >= h)) {
+            tiles[i] = dropped;
+            continue;
+        }
+        uint32_t tx0 = x0[i] / CUBC_TILE_SIZE, tx1 = x1[i] / CUBC_TILE_SIZE;
+        uint32_t ty0 = y0[i] / CUBC_TILE_SIZE, ty1 = y1[i] / CUBC_TILE_SIZE;
+        if (tx0 == tx1 && ty0 == ty1) {
+            tiles[i] = (size_t) ty0 * tiles_x + tx0;
+            offsets[tiles[i] + 1]++;
+            continue;
+        }
+        tiles[i] = spread;
+        _Cubc_LineSpread(x0[i], y0[i], x1[i], y1[i], tiles_x, last_row,
+                         offsets + 1, NULL, none);
+    }
+    for (size_t i = 0; i < tile_count; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    _Cubc_LineItem* bins =
+        (_Cubc_LineItem*) malloc(sizeof(_Cubc_LineItem) * offsets[tile_count]);
+    size_t* cursor = (size_t*) malloc(sizeof(size_t) * tile_count);
+    memcpy(cursor, offsets, sizeof(size_t) * tile_count);
+    for (size_t i = 0; i < count; i++) {
+        _Cubc_LineItem item = {x0[i], y0[i], x1[i], y1[i], colors[i]};
+        if (tiles[i] < tile_count) {
+            bins[cursor[tiles[i]]++] = item;
+        } else if (tiles[i] == spread) {
+            _Cubc_LineSpread(x0[i], y0[i], x1[i], y1[i], tiles_x, last_row,
+                             cursor, bins, item);
+        }
+    }
+    free(tiles);
+    free(cursor);
+
+    _Cubc_LineJob job = {
+        .canvas    = canvas,
+        .offsets   = offsets,
+        .bins      = bins,
+        .tiles_x   = tiles_x,
+        .tiles_y   = tiles_y,
+        .next_tile = 0,
+    };
+    _Cubc_RunWorkers(_Cubc_LineWorker, &job, thread_count, tile_count);
+
+    free(bins);
+    free(offsets);
+}
+
+// Writes all of `data` to `fd`, retrying short and interrupted writes.
+static int _Cubc_WriteAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        data += written;
+        size -= written;
+    }
+    return 0;
+}
+
+// Converts the rows of `canvas` with `pack` into one buffer after `header`
+// and writes it out at once.
+static int _Cubc_WriteImage(const Cubc_Canvas* canvas, const char* file_name,
+                            const char* header, size_t channels,
+                            void (*pack)(uint8_t*, const uint32_t*, size_t)) {
+    size_t header_size = strlen(header);
+    size_t row_size    = canvas->w * channels;
+    size_t size        = header_size + row_size * canvas->h;
+    uint8_t* data      = (uint8_t*) malloc(size);
+    if (data == NULL) {
+        return 1;
+    }
+    memcpy(data, header, header_size);
+    // Files store straight RGBA8888.
+    bool decode        = canvas->format != CUBC_FORMAT_RGBA8888;
+    bool unpremultiply = canvas->premultiplied && channels == 4;
+    uint32_t* straight = NULL;
+    if (decode || unpremultiply) {
+        straight = (uint32_t*) malloc(sizeof(uint32_t) * canvas->w);
+        if (straight == NULL) {
+            free(data);
+            return 1;
+        }
+    }
+    for (size_t y = 0; y < canvas->h; y++) {
+        const uint32_t* row = (const uint32_t*) _Cubc_PixelAddress(canvas, 0,
+                                                                   y);
+        if (decode) {
+            _Cubc_DecodeRow(canvas->format, straight, row, canvas->w);
+            row = straight;
+        }
+        if (unpremultiply) {
+            _Cubc_UnpremultiplyRow(straight, row, canvas->w);
+            row = straight;
+        }
+        pack(data + header_size + y * row_size, row, canvas->w);
+    }
+    free(straight);
+
+    FILE* file = fopen(file_name, "wb");
+    if (file == NULL) {
+        free(data);
+        return 1;
+    }
+    int result = fwrite(data, 1, size, file) != size;
+    if (fclose(file) != 0) {
+        result = 1;
+    }
+    free(data);
+    return result;
+}
+
+int Cubc_CanvasWritePPM(const Cubc_Canvas* canvas, const char* file_name) {
+    char header[64];
+    snprintf(header, sizeof(header), "P6\n%zu %zu\n255\n", canvas->w,
+             canvas->h);
+    return _Cubc_WriteImage(canvas, file_name, header, 3, _Cubc_PackRGB);
+}
+
+int Cubc_CanvasWritePAM(const Cubc_Canvas* canvas, const char* file_name) {
+    char header[128];
+    snprintf(header, sizeof(header),
+             "P7\nWIDTH %zu\nHEIGHT %zu\nDEPTH 4\nMAXVAL 255\n"
+             "TUPLTYPE RGB_ALPHA\nENDHDR\n",
+             canvas->w, canvas->h);
+    return _Cubc_WriteImage(canvas, file_name, header, 4, _Cubc_PackRGBA);
+}
+
+int Cubc_FrameWriterOpen(Cubc_FrameWriter* writer, int fd,
+                         Cubc_FrameFormat format, size_t w, size_t h,
+                         uint32_t fps) {
+    // Y4M frames start with their own tag.
+    size_t tag  = format == CUBC_FRAMES_Y4M ? 6 : 0;
+    size_t size = tag + w * h * (format == CUBC_FRAMES_Y4M ? 3 : 4);
+    *writer     = (Cubc_FrameWriter){
+        .fd     = fd,
+        .format = format,
+        .w      = w,
+        .h      = h,
+        .frame  = (uint8_t*) malloc(size),
+        .size   = size,
+    };
+    if (writer->frame == NULL) {
+        return 1;
+    }
+    memcpy(writer->frame, "FRAME\n", tag);
+    if (format != CUBC_FRAMES_Y4M) {
+        return 0;
+    }
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "YUV4MPEG2 W%zu H%zu F%u:1 Ip A1:1 C444\n", w, h,
+                          fps);
+    return _Cubc_WriteAll(fd, (const uint8_t*) header, length);
+}
+
+int Cubc_FrameWriterWrite(Cubc_FrameWriter* writer, const Cubc_Canvas* canvas) {
+    if (canvas->w != writer->w || canvas->h != writer->h) {
+        return 1;
+    }
+    size_t plane = writer->w * writer->h;
+    uint32_t chunk[CUBC_BLIT_CHUNK];
+    // Frames store straight colors, like files. Pixels that need converting
+    // are converted a chunk at a time.
+    bool decode        = canvas->format != CUBC_FORMAT_RGBA8888;
+    bool unpremultiply = canvas->premultiplied;
+    size_t step        = decode || unpremultiply ? CUBC_BLIT_CHUNK : writer->w;
+    for (size_t y = 0; y < writer->h; y++) {
+        for (size_t x = 0; x < writer->w; x += step) {
+            size_t n            = writer->w - x < step ? writer->w - x : step;
+            const uint32_t* row = (const uint32_t*) _Cubc_PixelAddress(
+                canvas, x, y);
+            size_t offset       = y * writer->w + x;
+            if (decode) {
+                _Cubc_DecodeRow(canvas->format, chunk, row, n);
+                row = chunk;
+            }
+            if (unpremultiply) {
+                _Cubc_UnpremultiplyRow(chunk, row, n);
+                row = chunk;
+            }
+            if (writer->format == CUBC_FRAMES_Y4M) {
+                uint8_t* planes = writer->frame + 6;
+                _Cubc_PackYCbCr(planes + offset, planes + plane + offset,
+                                planes + 2 * plane + offset, row, n);
+            } else {
+                _Cubc_PackRGBA(writer->frame + 4 * offset, row, n);
+            }
+        }
+    }
+    return _Cubc_WriteAll(writer->fd, writer->frame, writer->size);
+}
+
+void Cubc_FrameWriterClose(Cubc_FrameWriter* writer) {
+    free(writer->frame);
+    writer->frame = NULL;
+    writer->size  = 0;
+}
+
+Cubc_Color Cubc_ColorBlend(Cubc_Color src, Cubc_Color dest) {
+    Cubc_Color result;
+    result.color = _Cubc_PixelOver(dest.color, src.color, CUBC_ALPHA_STRAIGHT);
+    return result;
+}
+
+Cubc_Color Cubc_ColorBlendMode(Cubc_Color src, Cubc_Color dest,
+                               Cubc_BlendMode mode) {
+    Cubc_Color result;
+    result.color = _Cubc_PixelOver(
+        dest.color, _Cubc_PixelMix(dest.color, src.color, mode),
+        CUBC_ALPHA_STRAIGHT);
+    return result;
+}
+
+Cubc_Color Cubc_ColorMultiplyBlend(Cubc_Color a, Cubc_Color b) {
+    return Cubc_ColorBlendMode(b, a, CUBC_BLEND_MULTIPLY);
+}
+Cubc_Color Cubc_ColorScreenBlend(Cubc_Color a, Cubc_Color b) {
+    return Cubc_ColorBlendMode(b, a, CUBC_BLEND_SCREEN);
+}
+Cubc_Color Cubc_ColorOverlayBlend(Cubc_Color a, Cubc_Color b) {
+    return Cubc_ColorBlendMode(b, a, CUBC_BLEND_OVERLAY);
+}
+Cubc_Color Cubc_ColorHardLightBlend(Cubc_Color a, Cubc_Color b) {
+    return Cubc_ColorBlendMode(b, a, CUBC_BLEND_HARD_LIGHT);
+}
+Cubc_Color Cubc_ColorSoftLightBlend(Cubc_Color a, Cubc_Color b) {
+    return Cubc_ColorBlendMode(b, a, CUBC_BLEND_SOFT_LIGHT);
 }
 
 #endif